@@ -0,0 +1,503 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "dbg.h"
+#include "mem.h"
+#include "bstring.h"
+#include "file.h"
+#include "varint.h"
+#include "action_index.h"
+
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+int sky_action_index_search_sets(sky_action_index *index,
+    sky_action_id_t action_id, uint32_t *position, bool *found);
+
+uint32_t sky_action_index_search_set(sky_action_index_set *set,
+    sky_object_id_t object_id);
+
+int sky_action_index_unpack_set(sky_action_index_set *set, void *ptr,
+    size_t length, size_t *sz);
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a reference to an action index.
+//
+// Returns a reference to the new action index if successful. Otherwise
+// returns null.
+sky_action_index *sky_action_index_create()
+{
+    sky_action_index *index = calloc(sizeof(sky_action_index), 1);
+    check_mem(index);
+    return index;
+
+error:
+    sky_action_index_free(index);
+    return NULL;
+}
+
+// Removes an action index reference from memory.
+//
+// index - The action index to free.
+void sky_action_index_free(sky_action_index *index)
+{
+    if(index) {
+        if(index->path) bdestroy(index->path);
+        index->path = NULL;
+        sky_action_index_unload(index);
+        free(index);
+    }
+}
+
+
+//--------------------------------------
+// Persistence
+//--------------------------------------
+
+// Loads the sets of the action index from file. An index without a file is
+// left empty.
+//
+// index - The action index to load.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_action_index_load(sky_action_index *index)
+{
+    int rc;
+    size_t sz;
+    void *buffer = NULL;
+    FILE *file = NULL;
+    check(index != NULL, "Action index required");
+    check(index->path != NULL, "Action index path required");
+
+    // Unload any sets currently in memory.
+    rc = sky_action_index_unload(index);
+    check(rc == 0, "Unable to unload action index");
+
+    if(!sky_file_exists(index->path)) {
+        return 0;
+    }
+
+    // Read the entire file into memory.
+    off_t length = sky_file_get_size(index->path);
+    check(length >= (off_t)sizeof(uint32_t), "Action index file is truncated: %s", bdata(index->path));
+    buffer = malloc(length); check_mem(buffer);
+    file = fopen(bdata(index->path), "r");
+    check(file != NULL, "Unable to open action index file: %s", bdata(index->path));
+    rc = fread(buffer, length, 1, file);
+    check(rc == 1, "Unable to read action index file: %s", bdata(index->path));
+    fclose(file);
+    file = NULL;
+
+    // Unpack each set.
+    void *ptr = buffer;
+    void *endptr = buffer + length;
+    uint32_t set_count = *((uint32_t*)ptr);
+    ptr += sizeof(uint32_t);
+    if(set_count > 0) {
+        index->sets = calloc(set_count, sizeof(*index->sets));
+        check_mem(index->sets);
+    }
+
+    uint32_t i;
+    for(i=0; i<set_count; i++) {
+        sky_action_index_set *set = &index->sets[i];
+        rc = sky_action_index_unpack_set(set, ptr, endptr - ptr, &sz);
+        index->set_count++;
+        check(rc == 0, "Unable to unpack action index set: %d", i);
+        check(i == 0 || set->action_id > index->sets[i-1].action_id, "Action index sets are out of order");
+        ptr += sz;
+    }
+
+    free(buffer);
+    return 0;
+
+error:
+    if(file) fclose(file);
+    free(buffer);
+    sky_action_index_unload(index);
+    return -1;
+}
+
+// Unpacks a single set of object ids from the index file.
+//
+// set    - The set to unpack into.
+// ptr    - A pointer to the packed set.
+// length - The number of bytes available to read.
+// sz     - A pointer to where the number of bytes read is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_action_index_unpack_set(sky_action_index_set *set, void *ptr,
+                                size_t length, size_t *sz)
+{
+    size_t hdr_length = sizeof(sky_action_id_t) + sizeof(uint32_t) + sizeof(uint32_t);
+    check(length >= hdr_length, "Action index set header is truncated");
+
+    void *start = ptr;
+    set->action_id = *((sky_action_id_t*)ptr);
+    ptr += sizeof(sky_action_id_t);
+    uint32_t count = *((uint32_t*)ptr);
+    ptr += sizeof(uint32_t);
+    uint32_t data_length = *((uint32_t*)ptr);
+    ptr += sizeof(uint32_t);
+    check(data_length <= length - hdr_length, "Action index set is truncated");
+    check(count <= data_length, "Invalid action index set count: %d", count);
+
+    if(count > 0) {
+        set->object_ids = calloc(count, sizeof(*set->object_ids));
+        check_mem(set->object_ids);
+        set->capacity = count;
+    }
+
+    // Each object id is stored as the offset from the previous one.
+    void *endptr = ptr + data_length;
+    sky_object_id_t object_id = 0;
+    uint32_t i;
+    for(i=0; i<count; i++) {
+        check(ptr < endptr, "Action index set is truncated");
+        size_t varint_sz;
+        sky_object_id_t delta = sky_varint_unpack(ptr, &varint_sz);
+        check(delta > 0, "Invalid action index object id offset");
+        object_id += delta;
+        ptr += varint_sz;
+        set->object_ids[set->count++] = object_id;
+    }
+    check(ptr == endptr, "Action index set length mismatch");
+
+    *sz = ptr - start;
+    return 0;
+
+error:
+    *sz = 0;
+    return -1;
+}
+
+// Writes the sets of the action index to file. The index is written to a
+// temporary file first and then renamed over the existing file.
+//
+// index - The action index to save.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_action_index_save(sky_action_index *index)
+{
+    int rc;
+    size_t sz;
+    void *buffer = NULL;
+    FILE *file = NULL;
+    bstring tmp_path = NULL;
+    check(index != NULL, "Action index required");
+    check(index->path != NULL, "Action index path required");
+
+    // Calculate the file size.
+    uint32_t i, j;
+    size_t length = sizeof(uint32_t);
+    for(i=0; i<index->set_count; i++) {
+        sky_action_index_set *set = &index->sets[i];
+        length += sizeof(sky_action_id_t) + sizeof(uint32_t) + sizeof(uint32_t);
+        length += set->count * SKY_VARINT_MAX_LENGTH;
+    }
+
+    // Pack each set as a header followed by its object id offsets.
+    buffer = malloc(length); check_mem(buffer);
+    void *ptr = buffer;
+    *((uint32_t*)ptr) = index->set_count;
+    ptr += sizeof(uint32_t);
+    for(i=0; i<index->set_count; i++) {
+        sky_action_index_set *set = &index->sets[i];
+        *((sky_action_id_t*)ptr) = set->action_id;
+        ptr += sizeof(sky_action_id_t);
+        *((uint32_t*)ptr) = set->count;
+        ptr += sizeof(uint32_t);
+        uint32_t *data_length = (uint32_t*)ptr;
+        ptr += sizeof(uint32_t);
+
+        void *data_ptr = ptr;
+        sky_object_id_t prev_object_id = 0;
+        for(j=0; j<set->count; j++) {
+            sky_varint_pack(ptr, set->object_ids[j] - prev_object_id, &sz);
+            prev_object_id = set->object_ids[j];
+            ptr += sz;
+        }
+        *data_length = (uint32_t)(ptr - data_ptr);
+    }
+    length = ptr - buffer;
+
+    // Write the temporary file and move it into place.
+    tmp_path = bformat("%s.tmp", bdata(index->path)); check_mem(tmp_path);
+    file = fopen(bdata(tmp_path), "w");
+    check(file != NULL, "Unable to open action index file: %s", bdata(tmp_path));
+    rc = fwrite(buffer, length, 1, file);
+    check(rc == 1, "Unable to write action index file: %s", bdata(tmp_path));
+    rc = fclose(file);
+    file = NULL;
+    check(rc == 0, "Unable to close action index file: %s", bdata(tmp_path));
+    rc = rename(bdata(tmp_path), bdata(index->path));
+    check(rc == 0, "Unable to replace action index file: %s", bdata(index->path));
+
+    bdestroy(tmp_path);
+    free(buffer);
+    return 0;
+
+error:
+    if(file) fclose(file);
+    bdestroy(tmp_path);
+    free(buffer);
+    return -1;
+}
+
+// Unloads the sets of the action index from memory.
+//
+// index - The action index.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_action_index_unload(sky_action_index *index)
+{
+    if(index) {
+        uint32_t i;
+        for(i=0; i<index->set_count; i++) {
+            free(index->sets[i].object_ids);
+            index->sets[i].object_ids = NULL;
+        }
+        free(index->sets);
+        index->sets = NULL;
+        index->set_count = 0;
+    }
+
+    return 0;
+}
+
+
+//--------------------------------------
+// Search
+//--------------------------------------
+
+// Performs a binary search on the sets of the index for an action.
+//
+// index     - The action index.
+// action_id - The action id to search for.
+// position  - A pointer to where the position of the set (or the position it
+//             would be inserted at) is returned.
+// found     - A pointer to a flag stating if the set exists.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_action_index_search_sets(sky_action_index *index,
+                                 sky_action_id_t action_id,
+                                 uint32_t *position, bool *found)
+{
+    uint32_t min = 0;
+    uint32_t max = index->set_count;
+
+    *found = false;
+    while(min < max) {
+        uint32_t mid = min + ((max - min) / 2);
+        if(index->sets[mid].action_id == action_id) {
+            *found = true;
+            min = mid;
+            break;
+        }
+        else if(index->sets[mid].action_id < action_id) {
+            min = mid + 1;
+        }
+        else {
+            max = mid;
+        }
+    }
+    *position = min;
+
+    return 0;
+}
+
+// Finds the position of the first object id in a set that is greater than or
+// equal to a given object id.
+//
+// set       - The set.
+// object_id - The object id to search for.
+//
+// Returns the position of the object id or the set's count if every object id
+// is smaller.
+uint32_t sky_action_index_search_set(sky_action_index_set *set,
+                                     sky_object_id_t object_id)
+{
+    // Most objects are added in increasing order so check the end first.
+    if(set->count == 0 || set->object_ids[set->count-1] < object_id) {
+        return set->count;
+    }
+
+    uint32_t min = 0;
+    uint32_t max = set->count;
+    while(min < max) {
+        uint32_t mid = min + ((max - min) / 2);
+        if(set->object_ids[mid] < object_id) {
+            min = mid + 1;
+        }
+        else {
+            max = mid;
+        }
+    }
+    return min;
+}
+
+
+//--------------------------------------
+// Object Management
+//--------------------------------------
+
+// Records that an object has performed an action.
+//
+// index     - The action index.
+// action_id - The action id.
+// object_id - The object id.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_action_index_add(sky_action_index *index, sky_action_id_t action_id,
+                         sky_object_id_t object_id)
+{
+    int rc;
+    uint32_t position;
+    bool found;
+    check(index != NULL, "Action index required");
+    check(object_id != 0, "Object id required");
+
+    // Find or create the set for the action.
+    rc = sky_action_index_search_sets(index, action_id, &position, &found);
+    check(rc == 0, "Unable to search action index");
+    if(!found) {
+        index->sets = realloc(index->sets, sizeof(*index->sets) * (index->set_count+1));
+        check_mem(index->sets);
+        memmove(&index->sets[position+1], &index->sets[position], sizeof(*index->sets) * (index->set_count - position));
+        memset(&index->sets[position], 0, sizeof(*index->sets));
+        index->sets[position].action_id = action_id;
+        index->set_count++;
+    }
+    sky_action_index_set *set = &index->sets[position];
+
+    // Ignore objects that are already in the set.
+    uint32_t object_position = sky_action_index_search_set(set, object_id);
+    if(object_position < set->count && set->object_ids[object_position] == object_id) {
+        return 0;
+    }
+
+    // Grow the set and insert the object id in sorted order.
+    if(set->count == set->capacity) {
+        uint32_t capacity = (set->capacity > 0 ? set->capacity * 2 : 16);
+        set->object_ids = realloc(set->object_ids, sizeof(*set->object_ids) * capacity);
+        check_mem(set->object_ids);
+        set->capacity = capacity;
+    }
+    memmove(&set->object_ids[object_position+1], &set->object_ids[object_position], sizeof(*set->object_ids) * (set->count - object_position));
+    set->object_ids[object_position] = object_id;
+    set->count++;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Retrieves the set of objects that have performed an action.
+//
+// index     - The action index.
+// action_id - The action id.
+// ret       - A pointer to where the set is returned. This is null if no
+//             object has performed the action.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_action_index_get_set(sky_action_index *index,
+                             sky_action_id_t action_id,
+                             sky_action_index_set **ret)
+{
+    int rc;
+    uint32_t position;
+    bool found;
+    check(index != NULL, "Action index required");
+    check(ret != NULL, "Return address required");
+
+    rc = sky_action_index_search_sets(index, action_id, &position, &found);
+    check(rc == 0, "Unable to search action index");
+    *ret = (found ? &index->sets[position] : NULL);
+
+    return 0;
+
+error:
+    if(ret) *ret = NULL;
+    return -1;
+}
+
+// Finds the smallest object id that has performed an action and is greater
+// than or equal to a given object id.
+//
+// index     - The action index.
+// action_id - The action id.
+// object_id - The object id to start from.
+// ret       - A pointer to where the object id is returned. This is zero if
+//             there are no more objects for the action.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_action_index_find_next(sky_action_index *index,
+                               sky_action_id_t action_id,
+                               sky_object_id_t object_id,
+                               sky_object_id_t *ret)
+{
+    int rc;
+    check(ret != NULL, "Return address required");
+
+    sky_action_index_set *set = NULL;
+    rc = sky_action_index_get_set(index, action_id, &set);
+    check(rc == 0, "Unable to retrieve action index set");
+
+    *ret = 0;
+    if(set != NULL) {
+        uint32_t position = sky_action_index_search_set(set, object_id);
+        if(position < set->count) {
+            *ret = set->object_ids[position];
+        }
+    }
+
+    return 0;
+
+error:
+    if(ret) *ret = 0;
+    return -1;
+}
+
+// Checks if an object has performed an action.
+//
+// index     - The action index.
+// action_id - The action id.
+// object_id - The object id.
+// ret       - A pointer to where the flag is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_action_index_contains(sky_action_index *index,
+                              sky_action_id_t action_id,
+                              sky_object_id_t object_id, bool *ret)
+{
+    int rc;
+    check(ret != NULL, "Return address required");
+
+    sky_object_id_t next_object_id;
+    rc = sky_action_index_find_next(index, action_id, object_id, &next_object_id);
+    check(rc == 0, "Unable to search action index");
+    *ret = (next_object_id != 0 && next_object_id == object_id);
+
+    return 0;
+
+error:
+    if(ret) *ret = false;
+    return -1;
+}
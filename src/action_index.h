@@ -0,0 +1,99 @@
+#ifndef _action_index_h
+#define _action_index_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_action_index sky_action_index;
+
+#include "bstring.h"
+#include "file.h"
+#include "types.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The action index is an inverted index from each action id to the set of
+// objects that have performed that action. It is used to restrict a query to
+// the paths of the objects that performed an action without reading the
+// paths of every other object.
+//
+// Each set is kept in memory as a sorted array of object ids. The index file
+// stores the sets one after another with the object ids of each set written
+// as varint offsets from the previous id so that dense ranges of ids take a
+// byte or two each. The file is written to a temporary file and renamed into
+// place when the index is saved.
+//
+// Object ids are only ever added to the index so it can contain objects
+// whose events have since been removed. The index can be used to skip objects
+// but not to prove that an object still has a matching event.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+typedef struct sky_action_index_set {
+    sky_action_id_t action_id;
+    sky_object_id_t *object_ids;
+    uint32_t count;
+    uint32_t capacity;
+} sky_action_index_set;
+
+struct sky_action_index {
+    bstring path;
+    sky_action_index_set *sets;
+    uint32_t set_count;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_action_index *sky_action_index_create();
+
+void sky_action_index_free(sky_action_index *index);
+
+
+//--------------------------------------
+// Persistence
+//--------------------------------------
+
+int sky_action_index_load(sky_action_index *index);
+
+int sky_action_index_save(sky_action_index *index);
+
+int sky_action_index_unload(sky_action_index *index);
+
+
+//--------------------------------------
+// Object Management
+//--------------------------------------
+
+int sky_action_index_add(sky_action_index *index, sky_action_id_t action_id,
+    sky_object_id_t object_id);
+
+int sky_action_index_get_set(sky_action_index *index,
+    sky_action_id_t action_id, sky_action_index_set **ret);
+
+int sky_action_index_find_next(sky_action_index *index,
+    sky_action_id_t action_id, sky_object_id_t object_id,
+    sky_object_id_t *ret);
+
+int sky_action_index_contains(sky_action_index *index,
+    sky_action_id_t action_id, sky_object_id_t object_id, bool *ret);
+
+#endif
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "dbg.h"
+#include "bstring.h"
+#include "archive.h"
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+int sky_archive_map(sky_archive *archive);
+
+int sky_archive_unmap(sky_archive *archive);
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a reference to an archive.
+//
+// Returns a reference to the new archive if successful. Otherwise returns
+// null.
+sky_archive *sky_archive_create()
+{
+    sky_archive *archive = calloc(sizeof(sky_archive), 1); check_mem(archive);
+    return archive;
+
+error:
+    sky_archive_free(archive);
+    return NULL;
+}
+
+// Closes an archive and removes its reference from memory.
+//
+// archive - The archive to free.
+void sky_archive_free(sky_archive *archive)
+{
+    if(archive) {
+        sky_archive_close(archive);
+        bdestroy(archive->path);
+        archive->path = NULL;
+        free(archive);
+    }
+}
+
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+// Opens the archive file and maps its contents. The file is created if it
+// does not exist.
+//
+// archive - The archive to open.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_archive_open(sky_archive *archive)
+{
+    int rc;
+    check(archive != NULL, "Archive required");
+    check(archive->path != NULL, "Archive path required");
+    check(archive->fd == 0, "Archive is already open");
+
+    archive->fd = open(bdata(archive->path), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    check(archive->fd != -1, "Failed to open archive: %s", bdata(archive->path));
+
+    // Map the existing contents.
+    off_t length = lseek(archive->fd, 0, SEEK_END);
+    check(length != -1, "Unable to determine archive length");
+    archive->length = (size_t)length;
+    archive->pending_length = 0;
+    rc = sky_archive_map(archive);
+    check(rc == 0, "Unable to map archive");
+
+    return 0;
+
+error:
+    sky_archive_close(archive);
+    return -1;
+}
+
+// Unmaps and closes the archive file. Data that has been appended but not
+// synced is discarded.
+//
+// archive - The archive to close.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_archive_close(sky_archive *archive)
+{
+    check(archive != NULL, "Archive required");
+
+    sky_archive_unmap(archive);
+    if(archive->fd > 0) {
+        close(archive->fd);
+    }
+    archive->fd = 0;
+    archive->length = 0;
+    archive->pending_length = 0;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Mapping
+//--------------------------------------
+
+// Maps the synced contents of the archive for reading.
+//
+// archive - The archive.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_archive_map(sky_archive *archive)
+{
+    sky_archive_unmap(archive);
+    if(archive->length == 0) {
+        return 0;
+    }
+
+    void *ptr = mmap(0, archive->length, PROT_READ, MAP_SHARED, archive->fd, 0);
+    check(ptr != MAP_FAILED, "Unable to map archive: %s", bdata(archive->path));
+    archive->data = ptr;
+
+    return 0;
+
+error:
+    archive->data = NULL;
+    return -1;
+}
+
+// Unmaps the archive.
+//
+// archive - The archive.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_archive_unmap(sky_archive *archive)
+{
+    if(archive->data != NULL) {
+        munmap(archive->data, archive->length);
+    }
+    archive->data = NULL;
+    return 0;
+}
+
+
+//--------------------------------------
+// Data
+//--------------------------------------
+
+// Appends data to the end of the archive. The data is written immediately but
+// cannot be read until the archive has been synced.
+//
+// archive - The archive.
+// ptr     - The data to append.
+// length  - The number of bytes to append.
+// offset  - A pointer to where the offset of the data in the archive is
+//           returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_archive_append(sky_archive *archive, void *ptr, size_t length,
+                       uint64_t *offset)
+{
+    check(archive != NULL, "Archive required");
+    check(archive->fd > 0, "Archive must be open to append");
+    check(ptr != NULL || length == 0, "Data required");
+    check(offset != NULL, "Offset return address required");
+
+    *offset = archive->length + archive->pending_length;
+    ssize_t bytes = pwrite(archive->fd, ptr, length, (off_t)*offset);
+    check(bytes == (ssize_t)length, "Unable to write to archive: %s", bdata(archive->path));
+    archive->pending_length += length;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Syncs the appended data to disk and remaps the archive so that it can be
+// read. Pointers into the archive are invalidated.
+//
+// archive - The archive.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_archive_sync(sky_archive *archive)
+{
+    int rc;
+    check(archive != NULL, "Archive required");
+    check(archive->fd > 0, "Archive must be open to sync");
+
+    if(archive->pending_length == 0) {
+        return 0;
+    }
+
+    rc = fsync(archive->fd);
+    check(rc == 0, "Unable to sync archive: %s", bdata(archive->path));
+    archive->length += archive->pending_length;
+    archive->pending_length = 0;
+
+    rc = sky_archive_map(archive);
+    check(rc == 0, "Unable to remap archive");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Retrieves a pointer to data in the archive.
+//
+// archive - The archive.
+// offset  - The offset of the data.
+// length  - The number of bytes that will be read.
+// ptr     - A pointer to where the data's starting address will be set.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_archive_get_ptr(sky_archive *archive, uint64_t offset, size_t length,
+                        void **ptr)
+{
+    check(archive != NULL, "Archive required");
+    check(archive->data != NULL, "Archive must be mapped");
+    check(offset + length <= archive->length, "Archive data out of range: %" PRIu64, offset);
+
+    *ptr = archive->data + offset;
+    return 0;
+
+error:
+    *ptr = NULL;
+    return -1;
+}
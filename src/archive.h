@@ -0,0 +1,83 @@
+#ifndef _archive_h
+#define _archive_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_archive sky_archive;
+
+#include "bstring.h"
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The archive is an append-only file that holds the compressed data of the
+// blocks of a data file that are no longer written to. Each archived block is
+// stored as a single compressed run at some offset in the file and the block
+// keeps that offset so that it can be read back.
+//
+// The archive is memory mapped read-only. Archived data is packed end to end
+// without padding so a scan of cold blocks reads far fewer pages than it
+// would from the fixed size slots of the data file. Appended data is synced
+// and the file is remapped before any block refers to it.
+//
+// Data is never removed from the archive. A block that is changed after it
+// has been archived is moved back into the data file and its archived data is
+// left behind.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+struct sky_archive {
+    bstring path;
+    int fd;
+    void *data;
+    size_t length;
+    size_t pending_length;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_archive *sky_archive_create();
+
+void sky_archive_free(sky_archive *archive);
+
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+int sky_archive_open(sky_archive *archive);
+
+int sky_archive_close(sky_archive *archive);
+
+
+//--------------------------------------
+// Data
+//--------------------------------------
+
+int sky_archive_append(sky_archive *archive, void *ptr, size_t length,
+    uint64_t *offset);
+
+int sky_archive_sync(sky_archive *archive);
+
+int sky_archive_get_ptr(sky_archive *archive, uint64_t offset, size_t length,
+    void **ptr);
+
+#endif
@@ -11,6 +11,8 @@
 #include "block.h"
 #include "path.h"
 #include "path_iterator.h"
+#include "compression.h"
+#include "columnar.h"
 
 
 //==============================================================================
@@ -19,8 +21,19 @@
 //
 //==============================================================================
 
+bool sky_block_is_delta_encoded(sky_block *block);
+
+bool sky_block_is_indexed(sky_block *block);
+
+bool sky_block_is_wide(sky_block *block);
+
 int sky_block_get_insertion_info(sky_block *block, sky_event *event,
-    void **path_ptr, void **event_ptr, size_t *block_data_length);
+    void **path_ptr, void **event_ptr, sky_timestamp_t *base,
+    size_t *block_data_length);
+
+int sky_block_get_insertion_length(sky_event *event, bool delta, bool indexed,
+    bool wide, void *path_ptr, void *event_ptr, sky_timestamp_t base,
+    size_t *event_length, size_t *sz);
 
 int sky_block_split_with_event(sky_block *block, sky_event *event,
     sky_block **target_block);
@@ -28,6 +41,37 @@ int sky_block_split_with_event(sky_block *block, sky_event *event,
 int sky_block_span_with_event(sky_block *block, sky_event *new_event,
     void *path_ptr, uint32_t target_size, sky_block **target_block);
 
+int sky_block_merge_paths(sky_block *block, sky_event **events,
+    uint32_t event_count, void *ptr, size_t *sz);
+
+int sky_block_merge_path(void *path_ptr, sky_event **events,
+    uint32_t event_count, bool delta, bool indexed, bool wide, void *ptr,
+    size_t *sz);
+
+int sky_block_pack_event(sky_event *event, bool delta, bool indexed,
+    sky_timestamp_t base, void *ptr, size_t *sz);
+
+uint32_t sky_block_path_ref_lower_bound(sky_block *block,
+    sky_object_id_t object_id);
+
+int sky_block_shift_path_refs(sky_block *block, uint32_t offset,
+    size_t sz, sky_object_id_t object_id, bool path_exists);
+
+
+//==============================================================================
+//
+// Globals
+//
+//==============================================================================
+
+// The decompressed data of the most recently read compressed block. Each
+// thread has its own buffer so readers do not share decompressed data.
+static __thread void *sky_block_read_buffer = NULL;
+
+static __thread size_t sky_block_read_buffer_length = 0;
+
+static __thread sky_block *sky_block_read_buffer_block = NULL;
+
 
 
 //==============================================================================
@@ -62,58 +106,17 @@ error:
 void sky_block_free(sky_block *block)
 {
     if(block) {
+        if(sky_block_read_buffer_block == block) {
+            sky_block_read_buffer_block = NULL;
+        }
+        sky_block_unload_path_refs(block);
+        sky_block_unload_zone_map(block);
         memset(block, 0, sizeof(*block));
         free(block);
     }
 }
 
 
-//--------------------------------------
-// Persistence
-//--------------------------------------
-
-// Syncs the in-memory block back to disk.
-//
-// block - The block to save.
-//
-// Returns 0 if successful, otherwise returns -1.
-int sky_block_save(sky_block *block)
-{
-    int rc;
-    check(block != NULL, "Block required");
-
-    // Retrieve the location of the block in memory.
-    void *ptr = NULL;
-    rc = sky_block_get_ptr(block, &ptr);
-    check(rc == 0, "Unable to retrieve block data pointer");
-    
-    // Determine the page size.
-    long page_size = sysconf(_SC_PAGE_SIZE);
-    
-    // Adjust the pointer to align to page size.
-    size_t offset = ptr - block->data_file->data;
-    if(offset % page_size != 0) {
-        ptr -= offset % page_size;
-    }
-    
-    // Adjust the block size to align to page size.
-    uint32_t block_size = block->data_file->block_size;
-    if(block_size % page_size != 0) {
-        block_size -= (block_size % page_size);
-        block_size += page_size;
-    }
-    
-    // Sync the memory for the block.
-    rc = msync(ptr, block_size, MS_SYNC);
-    check(rc == 0, "Unable to sync block to disk");
-    
-    return 0;
-    
-error:
-    return -1;
-}
-
-
 //--------------------------------------
 // Serialization
 //--------------------------------------
@@ -131,11 +134,20 @@ int sky_block_pack(sky_block *block, void *ptr, size_t *sz)
     check(block != NULL, "Block required");
     check(ptr != NULL, "Pointer required");
     
-    // Write object id range.
-    *((sky_object_id_t*)ptr) = block->min_object_id;
-    ptr += sizeof(sky_object_id_t);
-    *((sky_object_id_t*)ptr) = block->max_object_id;
-    ptr += sizeof(sky_object_id_t);
+    // Write object id range. Wide object ids are stored in 64 bits.
+    bool wide = sky_block_is_wide(block);
+    if(wide) {
+        *((sky_object_id_t*)ptr) = block->min_object_id;
+        ptr += sizeof(sky_object_id_t);
+        *((sky_object_id_t*)ptr) = block->max_object_id;
+        ptr += sizeof(sky_object_id_t);
+    }
+    else {
+        *((uint32_t*)ptr) = (uint32_t)block->min_object_id;
+        ptr += sizeof(uint32_t);
+        *((uint32_t*)ptr) = (uint32_t)block->max_object_id;
+        ptr += sizeof(uint32_t);
+    }
 
     // Write timestamp range.
     *((sky_timestamp_t*)ptr) = block->min_timestamp;
@@ -143,9 +155,17 @@ int sky_block_pack(sky_block *block, void *ptr, size_t *sz)
     *((sky_timestamp_t*)ptr) = block->max_timestamp;
     ptr += sizeof(sky_timestamp_t);
 
+    // Write compressed length if the data file supports compression.
+    size_t _sz = SKY_BLOCK_HEADER_SIZE;
+    if(block->data_file != NULL && block->data_file->version >= SKY_DATA_FILE_COMPRESSED_VERSION) {
+        *((uint32_t*)ptr) = block->compressed_length | (block->archived ? SKY_BLOCK_ARCHIVED_FLAG : 0);
+        ptr += sizeof(uint32_t);
+        _sz = (wide ? SKY_WIDE_BLOCK_HEADER_SIZE : SKY_COMPRESSED_BLOCK_HEADER_SIZE);
+    }
+
     // Store number of bytes written.
     if(sz != NULL) {
-        *sz = SKY_BLOCK_HEADER_SIZE;
+        *sz = _sz;
     }
     
     return 0;
@@ -167,11 +187,20 @@ int sky_block_unpack(sky_block *block, void *ptr, size_t *sz)
     check(block != NULL, "Block required");
     check(ptr != NULL, "Pointer required");
 
-    // Read object id range.
-    block->min_object_id = *((sky_object_id_t*)ptr);
-    ptr += sizeof(sky_object_id_t);
-    block->max_object_id = *((sky_object_id_t*)ptr);
-    ptr += sizeof(sky_object_id_t);
+    // Read object id range. Wide object ids are stored in 64 bits.
+    bool wide = sky_block_is_wide(block);
+    if(wide) {
+        block->min_object_id = *((sky_object_id_t*)ptr);
+        ptr += sizeof(sky_object_id_t);
+        block->max_object_id = *((sky_object_id_t*)ptr);
+        ptr += sizeof(sky_object_id_t);
+    }
+    else {
+        block->min_object_id = *((uint32_t*)ptr);
+        ptr += sizeof(uint32_t);
+        block->max_object_id = *((uint32_t*)ptr);
+        ptr += sizeof(uint32_t);
+    }
 
     // Read timestamp range.
     block->min_timestamp = *((sky_timestamp_t*)ptr);
@@ -179,9 +208,21 @@ int sky_block_unpack(sky_block *block, void *ptr, size_t *sz)
     block->max_timestamp = *((sky_timestamp_t*)ptr);
     ptr += sizeof(sky_timestamp_t);
 
+    // Read compressed length if the data file supports compression.
+    size_t _sz = SKY_BLOCK_HEADER_SIZE;
+    block->compressed_length = 0;
+    block->archived = false;
+    if(block->data_file != NULL && block->data_file->version >= SKY_DATA_FILE_COMPRESSED_VERSION) {
+        uint32_t compressed_length = *((uint32_t*)ptr);
+        block->compressed_length = compressed_length & ~SKY_BLOCK_ARCHIVED_FLAG;
+        block->archived = ((compressed_length & SKY_BLOCK_ARCHIVED_FLAG) != 0);
+        ptr += sizeof(uint32_t);
+        _sz = (wide ? SKY_WIDE_BLOCK_HEADER_SIZE : SKY_COMPRESSED_BLOCK_HEADER_SIZE);
+    }
+
     // Store number of bytes read.
     if(sz != NULL) {
-        *sz = SKY_BLOCK_HEADER_SIZE;
+        *sz = _sz;
     }
     
     return 0;
@@ -196,51 +237,41 @@ error:
 // Header Management
 //--------------------------------------
 
-// Updates the block object id and timestamp ranges and saves the changes to
-// the header file as required.
+// Writes the block's ranges to the memory-mapped header file. The change is
+// persisted to disk the next time the data file is flushed. Data files with
+// shadow blocks write every entry when the header is published instead.
 //
-// block     - The block to update ranges for.
-// object_id - The object id being added to the block.
-// timestamp - The timestamp being added to the block.
+// block - The block to save.
 //
 // Returns 0 if successful, otherwise returns -1.
 int sky_block_save_header(sky_block *block)
 {
     int rc;
     check(block != NULL, "Block required");
+    check(block->data_file->header != NULL, "Header file must be loaded to save block");
+
+    if(block->data_file->shadow_blocks) {
+        return 0;
+    }
 
-    // Open header file.
-    int fd = open(bdata(block->data_file->header_path), O_WRONLY);
-    check(fd != 0, "Unable to open header file for block update");
-    FILE *file = fdopen(fd, "w");
-    check(file != NULL, "Unable to open header file stream for block update");
-    
-    // Write to buffer.
-    size_t sz;
-    uint8_t *buffer[SKY_BLOCK_HEADER_SIZE];
-    rc = sky_block_pack(block, buffer, &sz);
-    check(rc == 0, "Unable to pack block header data");
-    
     // Determine header file position.
     off_t offset;
     rc = sky_block_get_header_offset(block, &offset);
     check(rc == 0, "Unable to determine block offset in header file");
-    rc = fseek(file, offset, SEEK_SET);
-    check(rc == 0, "Unable to position file at block position: %lld", offset);
+    check(offset + block->data_file->block_header_size <= block->data_file->header_length, "Block is outside of header file: %d", block->index);
     
-    // Write to file.
-    rc = fwrite(buffer, SKY_BLOCK_HEADER_SIZE, 1, file);
-    check(rc == 1, "Unable to write block to header file");
-    
-    // Close header file.
-    fclose(file);
-    close(fd);
+    // Write directly to the header file mapping.
+    size_t sz;
+    rc = sky_block_pack(block, block->data_file->header + offset, &sz);
+    check(rc == 0, "Unable to pack block header data");
+
+    // Mark the entry to be synced on the next flush.
+    rc = sky_data_file_set_header_dirty(block->data_file, offset, sz);
+    check(rc == 0, "Unable to mark header as changed");
 
     return 0;
 
 error:
-    if(file) fclose(file);
-    if(fd) close(fd);
     return -1;
 }    
 
@@ -313,6 +344,11 @@ int sky_block_full_update(sky_block *block)
     bool path_initialized  = false;
     bool event_initialized = false;
 
+    // The paths have been moved so the directory and zone map need to be
+    // rebuilt.
+    sky_block_unload_path_refs(block);
+    sky_block_unload_zone_map(block);
+
     // Initialize ranges.
     block->min_object_id = 0;
     block->max_object_id = 0;
@@ -338,19 +374,13 @@ int sky_block_full_update(sky_block *block)
         // Use cursor to loop over each event.
         sky_cursor cursor;
         sky_cursor_init(&cursor);
+        cursor.wide = sky_block_is_wide(block);
         sky_cursor_set_path(&cursor, ptr);
         check(rc == 0, "Unable to set cursor path");
             
         // Loop over cursor until we reach the event insertion point.
         while(!cursor.eof) {
-            sky_timestamp_t timestamp;
-            sky_action_id_t action_id;
-            sky_event_data_length_t data_length;
-
-            // Retrieve current timestamp in cursor.
-            size_t hdrsz;
-            rc = sky_event_unpack_hdr(&timestamp, &action_id, &data_length, cursor.ptr, &hdrsz);
-            check(rc == 0, "Unable to unpack event header");
+            sky_timestamp_t timestamp = cursor.timestamp;
                 
             // Update timestamp ranges.
             if(!event_initialized || timestamp < block->min_timestamp) {
@@ -393,8 +423,9 @@ int sky_block_get_header_offset(sky_block *block, off_t *offset)
 {
     check(block != NULL, "Block required");
     check(offset != NULL, "Offset pointer required");
+    check(block->data_file != NULL, "Data file required");
 
-    *offset = ((uint32_t)SKY_HEADER_FILE_HDR_SIZE) + (block->index * ((uint32_t)SKY_BLOCK_HEADER_SIZE));
+    *offset = ((uint32_t)sky_data_file_header_file_hdr_size(block->data_file->version)) + (block->index * ((uint32_t)block->data_file->block_header_size));
     return 0;
     
 error:
@@ -428,7 +459,8 @@ error:
 }
 
 // Calculates the pointer position for the beginning on the block in the
-// data file based on the data file block size and the block index.
+// data file based on the data file block size and the block index. A
+// snapshot's copy of a block is located in the snapshot's mapping.
 //
 // block - The block to calculate the byte offset of.
 // ptr   - A pointer to where the blocks starting address will be set.
@@ -438,7 +470,8 @@ int sky_block_get_ptr(sky_block *block, void **ptr)
 {
     check(block != NULL, "Block required");
     check(block->data_file != NULL, "Data file required");
-    check(block->data_file->data != NULL, "Data file must be mapped");
+    void *data = (block->mapping != NULL ? block->mapping : block->data_file->data);
+    check(data != NULL, "Data file must be mapped");
 
     // Retrieve the offset.
     size_t offset;
@@ -446,7 +479,7 @@ int sky_block_get_ptr(sky_block *block, void **ptr)
     check(rc == 0, "Unable to determine block offset");
 
     // Calculate pointer based on data pointer.
-    *ptr = block->data_file->data + offset;
+    *ptr = data + offset;
     
     return 0;
 
@@ -455,297 +488,1004 @@ error:
     return -1;
 }
 
-
-//--------------------------------------
-// Spanning
-//--------------------------------------
-
-// Determines the number of blocks that this block's object spans. This
-// function only works on the starting block of a span of blocks.
+// Retrieves a pointer to the uncompressed data of the block. Uncompressed
+// blocks return their location in the data file. Compressed blocks are
+// decompressed into the thread's read buffer which is valid until another
+// compressed block is read on the same thread. The returned data must not be
+// modified.
 //
-// block - The initial block in a block span.
-// count - A pointer to where the number of spanned blocks should be stored.
+// block - The block.
+// ptr   - A pointer to where the data's starting address will be set.
 //
 // Returns 0 if successful, otherwise returns -1.
-int sky_block_get_span_count(sky_block *block, uint32_t *count)
+int sky_block_get_data_ptr(sky_block *block, void **ptr)
 {
+    int rc;
     check(block != NULL, "Block required");
-    check(block->data_file != NULL, "Data file required");
-    check(count != NULL, "Span count address required");
-    
-    sky_data_file *data_file = block->data_file;
-    sky_block **blocks = data_file->blocks;
+    check(ptr != NULL, "Pointer address required");
 
-    // If this block is not spanned then return 1.
-    if(!block->spanned) {
-        *count = 1;
+    // Uncompressed blocks are read in place.
+    if(block->compressed_length == 0) {
+        rc = sky_block_get_ptr(block, ptr);
+        check(rc == 0, "Unable to retrieve block pointer");
+        return 0;
     }
-    // Otherwise calculate the span count.
-    else {
-        // Loop until the ending block of the span is found.
-        uint32_t index = block->index;
-        sky_object_id_t object_id = block->min_object_id;
-        while(true) {
-            index++;
 
-            // If we've reached the end of the blocks or if the object id no longer
-            // matches the starting object id then break out of the loop.
-            if(index > data_file->block_count-1 || object_id != blocks[index]->min_object_id)
-            {
-                break;
-            }
+    // Decompress into the read buffer unless it already holds this block.
+    if(sky_block_read_buffer_block != block) {
+        void *block_ptr;
+        rc = sky_block_get_compressed_ptr(block, &block_ptr);
+        check(rc == 0, "Unable to retrieve compressed data pointer");
+
+        size_t block_size = block->data_file->block_size;
+        if(sky_block_read_buffer_length < block_size) {
+            sky_block_read_buffer = realloc(sky_block_read_buffer, block_size);
+            check_mem(sky_block_read_buffer);
+            sky_block_read_buffer_length = block_size;
         }
 
-        // Assign count back to caller's provided address.
-        *count = (index - block->index);
+        size_t sz;
+        sky_block_read_buffer_block = NULL;
+        rc = sky_decompress(block_ptr, block->compressed_length, sky_block_read_buffer, block_size, &sz);
+        check(rc == 0, "Unable to decompress block: %d", block->index);
+        memset(sky_block_read_buffer + sz, 0, block_size - sz);
+        sky_block_read_buffer_block = block;
     }
-    
+
+    *ptr = sky_block_read_buffer;
     return 0;
 
 error:
-    *count = 0;
+    *ptr = NULL;
     return -1;
 }
 
-// Spans a path across multiple blocks.
-int sky_block_span_with_event(sky_block *block, sky_event *new_event,
-                              void *path_ptr, uint32_t target_size,
-                              sky_block **target_block)
+
+// Retrieves a pointer to the compressed data of a compressed block. The data
+// of an archived block is read from the data file's archive at the offset
+// that is stored in its slot. Other blocks hold their data in their slot.
+//
+// block - The block.
+// ptr   - A pointer to where the data's starting address will be set.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_get_compressed_ptr(sky_block *block, void **ptr)
 {
     int rc;
-    size_t _sz;
     check(block != NULL, "Block required");
-    check(new_event != NULL, "Event required");
-    check(path_ptr != NULL, "Path pointer required");
-    check(target_size > 0, "Target size must be greater than zero");
-    check(target_block > 0, "Target block pointer required");
-    
-    // Initialize events stats.
-    uint32_t event_count = 0;
-    sky_path_event_stat *events;
+    check(ptr != NULL, "Pointer address required");
 
-    // Retrieve block size.
-    sky_data_file *data_file = block->data_file;
-    uint32_t block_size = data_file->block_size;
-    
-    // Retrieve block pointer.
-    void *block_ptr = NULL;
+    void *block_ptr;
     rc = sky_block_get_ptr(block, &block_ptr);
     check(rc == 0, "Unable to retrieve block pointer");
-
-    // Retrieve a list of event sizes in the current block (plus new event).
-    rc = sky_path_get_event_stats(path_ptr, new_event, &events, &event_count);
-    check(rc == 0, "Unable to calculate event stats on path");
-    
-    // Initialize the return value.
-    *target_block = block;
-
-    // Retrieve path info.
-    bool is_first_path_in_block = (path_ptr == block_ptr);
-    sky_object_id_t object_id = *((sky_object_id_t*)path_ptr);
-
-    // Distribute events across blocks.
-    uint32_t i;
-    uint32_t last_index = 0;
-    size_t sz = SKY_PATH_HEADER_LENGTH;
-    for(i=0; i<event_count; i++) {
-        sky_path_event_stat *event = &(events[i]);
-        sky_path_event_stat *next_event = (i < event_count-1 ? &(events[i+1]) : NULL);
-
-        // If we exceed the block size then create a spanned block.
-        if(SKY_PATH_HEADER_LENGTH + event->sz > block_size) {
-            sentinel("Event is too large for block");
-        }
-        
-        // Add the event size to the running total.
-        sz += event->sz;
-
-        // If we exceeded the target size or if there is remaining data
-        // in an already split block then move everything to a new block.
-        bool exceeds_target_size = (sz >= target_size);
-        bool is_last_event = (i == event_count-1 && last_index > 0);
-        bool next_event_exceeds_max = (next_event != NULL && sz + next_event->sz > block_size);
-        if(exceeds_target_size || is_last_event || next_event_exceeds_max) {
-            sky_path_event_stat *last_event = &(events[last_index]);
-
-            // Calculate lengths and positions of event range.
-            size_t start_pos = last_event->start_pos;
-            size_t end_pos   = event->end_pos;
-            size_t len = end_pos - start_pos;
-            void *ptr = path_ptr + start_pos;
-
-            // If this is the first span of the first path of a block then
-            // just leave the data where it is.
-            sky_block *new_block = NULL;
-            void *new_block_ptr = NULL;
-            if(is_first_path_in_block && last_index == 0) {
-                new_block = block;
-                new_block_ptr = path_ptr;
-            }
-            // Otherwise move the data to a new block.
-            else {
-                // Save path pointer.
-                off_t path_off = path_ptr - data_file->data;
-
-                // Create a new block.
-                rc = sky_data_file_create_block(data_file, &new_block);
-                check(rc == 0, "Unable to create new block");
-
-                // Restore path pointer.
-                path_ptr = data_file->data + path_off;
-
-                // Retrieve the new block's pointer.
-                rc = sky_block_get_ptr(new_block, &new_block_ptr);
-                check(rc == 0, "Unable to retrieve new block's data pointer");
-
-                // Move data.
-                if(len > 0) {
-                    memmove(new_block_ptr + SKY_PATH_HEADER_LENGTH, ptr, len);
-                    memset(ptr, 0, len);
-                }
-            }
-
-            // Clear out original header.
-            if(last_index == 0) {
-                memset(path_ptr, 0, SKY_PATH_HEADER_LENGTH);
-            }
-
-            // If we are leaving an empty block then clear the path header.
-            if(len == 0) {
-                memset(new_block_ptr, 0, SKY_PATH_HEADER_LENGTH);
-            }
-            // Otherwise write the header.
-            else {
-                rc = sky_path_pack_hdr(object_id, len, new_block_ptr, &_sz);
-                check(rc == 0, "Unable to write path header");
-            }
-
-            // Update block ranges.
-            rc = sky_block_full_update(new_block);
-            check(rc == 0, "Unable to update block ranges");
-
-            // If new block contains the event timestamp in range then
-            // set it as the target block.
-            if(new_event->timestamp >= last_event->timestamp && event->timestamp <= new_event->timestamp) {
-                *target_block = new_block;
-            }
-            
-            // Flag block as spanned.
-            new_block->spanned = true;
-            
-            // Save where we left off.
-            last_index = i+1;
-            sz = SKY_PATH_HEADER_LENGTH;
-        }
+    if(!block->archived) {
+        *ptr = block_ptr;
+        return 0;
     }
 
-    // Update block range on the original block if a split occurred.
-    if(last_index > 0) {
-        rc = sky_block_full_update(block);
-        check(rc == 0, "Unable to update block ranges");
-    }
-    
-    free(events);
+    check(block->data_file->archive != NULL, "Data file archive required for block: %d", block->index);
+    uint64_t offset = *((uint64_t*)block_ptr);
+    rc = sky_archive_get_ptr(block->data_file->archive, offset, block->compressed_length, ptr);
+    check(rc == 0, "Unable to retrieve archived data for block: %d", block->index);
+
     return 0;
 
 error:
-    *target_block = NULL;
-    free(events);
+    *ptr = NULL;
     return -1;
 }
 
 
 //--------------------------------------
-// Path Stats
+// Compression
 //--------------------------------------
 
-// Generates an index of stats on all the paths in the block. If an event is
-// passed in then it also generates stats on the path the event would be
-// added to or a new path that would be created from that event.
+// Compresses the data of a block in place. Blocks that are empty, already
+// compressed or that do not shrink are left uncompressed. The data file must
+// be version 2 or later.
 //
-// block      - The block to calculate stats on.
-// event      - A soon-to-be-added event to calculate into the paths. If null then
-//              the stats are calculated as they exist in the block.
-// paths      - A pointer to where the stats should be returned.
-// path_count - A pointer to where the number of paths should be returned.
-int sky_block_get_path_stats(sky_block *block, sky_event *event,
-                             sky_block_path_stat **paths,
-                             uint32_t *path_count)
+// block - The block to compress.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_compress(sky_block *block)
 {
     int rc;
+    void *buffer = NULL;
     check(block != NULL, "Block required");
-    check(paths != NULL, "Paths return address required");
-    check(path_count != NULL, "Path count return address required");
+    check(block->data_file != NULL, "Data file required");
+    check(block->data_file->version >= SKY_DATA_FILE_COMPRESSED_VERSION, "Data file version does not support compression");
 
-    // Initialize data file & block pointers.
-    void *block_ptr = NULL;
+    if(block->compressed_length > 0) {
+        return 0;
+    }
+
+    // Determine the length of the data.
+    rc = sky_block_load_path_refs(block);
+    check(rc == 0, "Unable to load path directory");
+    uint32_t data_length = block->data_length;
+    if(data_length == 0) {
+        return 0;
+    }
+
+    // Compress into a buffer that is smaller than the data so that blocks
+    // that do not shrink are skipped.
+    void *block_ptr;
     rc = sky_block_get_ptr(block, &block_ptr);
     check(rc == 0, "Unable to retrieve block pointer");
+    buffer = malloc(data_length); check_mem(buffer);
+    size_t sz;
+    rc = sky_compress(block_ptr, data_length, buffer, data_length-1, &sz);
+    check(rc == 0, "Unable to compress block: %d", block->index);
+
+    // Replace the data and record the compressed length in the header.
+    if(sz > 0) {
+        rc = sky_data_file_touch_block(block->data_file, block);
+        check(rc == 0, "Unable to touch block");
+        rc = sky_block_get_ptr(block, &block_ptr);
+        check(rc == 0, "Unable to retrieve block pointer");
+        memcpy(block_ptr, buffer, sz);
+        memset(block_ptr + sz, 0, data_length - sz);
+        block->compressed_length = (uint32_t)sz;
+        if(sky_block_read_buffer_block == block) {
+            sky_block_read_buffer_block = NULL;
+        }
+
+        rc = sky_block_save_header(block);
+        check(rc == 0, "Unable to save block header");
+    }
+
+    free(buffer);
+    return 0;
+
+error:
+    free(buffer);
+    return -1;
+}
+
+// Decompresses the data of a block in place so that it can be modified. The
+// data of an archived block is decompressed from the archive back into its
+// slot. The path directory is unaffected since path offsets do not change.
+//
+// block - The block to decompress.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_decompress(sky_block *block)
+{
+    int rc;
+    void *buffer = NULL;
+    check(block != NULL, "Block required");
+    check(block->data_file != NULL, "Data file required");
+
+    if(block->compressed_length == 0) {
+        return 0;
+    }
+
+    rc = sky_data_file_touch_block(block->data_file, block);
+    check(rc == 0, "Unable to touch block");
+
+    void *block_ptr, *compressed_ptr;
+    rc = sky_block_get_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+    rc = sky_block_get_compressed_ptr(block, &compressed_ptr);
+    check(rc == 0, "Unable to retrieve compressed data pointer");
+
+    // Decompress into a temporary buffer and copy back over the block.
+    size_t block_size = block->data_file->block_size;
+    buffer = calloc(1, block_size); check_mem(buffer);
+    size_t sz;
+    rc = sky_decompress(compressed_ptr, block->compressed_length, buffer, block_size, &sz);
+    check(rc == 0, "Unable to decompress block: %d", block->index);
+    memcpy(block_ptr, buffer, block_size);
+
+    block->compressed_length = 0;
+    block->archived = false;
+    if(sky_block_read_buffer_block == block) {
+        sky_block_read_buffer_block = NULL;
+    }
+
+    rc = sky_block_save_header(block);
+    check(rc == 0, "Unable to save block header");
+
+    free(buffer);
+    return 0;
+
+error:
+    free(buffer);
+    return -1;
+}
+
+
+// Marks a block as archived once its compressed data has been appended and
+// synced to the data file's archive. The slot of the block is cleared except
+// for the offset of the archived data.
+//
+// block  - The block.
+// offset - The offset of the compressed data in the archive.
+// length - The length of the compressed data.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_archive(sky_block *block, uint64_t offset, uint32_t length)
+{
+    int rc;
+    check(block != NULL, "Block required");
+    check(block->data_file != NULL, "Data file required");
+    check(block->data_file->version >= SKY_DATA_FILE_COMPRESSED_VERSION, "Data file version does not support archiving");
+    check(length > 0 && length < SKY_BLOCK_ARCHIVED_FLAG, "Invalid archived length: %d", length);
+
+    rc = sky_data_file_touch_block(block->data_file, block);
+    check(rc == 0, "Unable to touch block");
+
+    void *block_ptr;
+    rc = sky_block_get_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+    memset(block_ptr, 0, block->data_file->block_size);
+    *((uint64_t*)block_ptr) = offset;
+
+    block->compressed_length = length;
+    block->archived = true;
+    if(sky_block_read_buffer_block == block) {
+        sky_block_read_buffer_block = NULL;
+    }
+
+    rc = sky_block_save_header(block);
+    check(rc == 0, "Unable to save block header");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Columns
+//--------------------------------------
+
+// Rewrites the columnar paths of a block as delta encoded rows in place so
+// that the block can be changed. Compressed blocks are decompressed first.
+// Blocks are filled by the length of their rows so the expanded paths always
+// fit within the block.
+//
+// block - The block to expand.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_expand_columns(sky_block *block)
+{
+    int rc;
+    size_t sz, hdrsz;
+    void *buffer = NULL;
+    check(block != NULL, "Block required");
+    check(block->data_file != NULL, "Data file required");
+
+    if(block->data_file->version < SKY_DATA_FILE_COLUMNAR_VERSION) {
+        return 0;
+    }
+
+    rc = sky_block_decompress(block);
+    check(rc == 0, "Unable to decompress block");
+    rc = sky_block_load_path_refs(block);
+    check(rc == 0, "Unable to load path directory");
+
+    void *block_ptr;
+    rc = sky_block_get_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+
+    // Only rewrite the block if it has a columnar path.
+    uint32_t i;
+    bool wide = sky_block_is_wide(block);
+    bool columnar = false;
+    for(i=0; i<block->path_ref_count && !columnar; i++) {
+        void *path_ptr = block_ptr + block->path_refs[i].offset;
+        size_t hdrlen = sky_path_sizeof_raw_hdr(path_ptr, wide);
+        columnar = sky_columnar_is_columnar(path_ptr + hdrlen, sky_path_sizeof_raw(path_ptr, wide) - hdrlen);
+    }
+    if(!columnar) {
+        return 0;
+    }
+
+    rc = sky_data_file_touch_block(block->data_file, block);
+    check(rc == 0, "Unable to touch block");
+    rc = sky_block_get_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+
+    // Copy each path into a buffer and expand the columnar ones.
+    size_t block_size = block->data_file->block_size;
+    buffer = calloc(1, block_size); check_mem(buffer);
+    size_t length = 0;
+    for(i=0; i<block->path_ref_count; i++) {
+        void *path_ptr = block_ptr + block->path_refs[i].offset;
+        size_t path_length = sky_path_sizeof_raw(path_ptr, wide);
+        size_t hdrlen = sky_path_sizeof_raw_hdr(path_ptr, wide);
+        void *ptr = path_ptr + hdrlen;
+        size_t event_data_length = path_length - hdrlen;
+
+        if(sky_columnar_is_columnar(ptr, event_data_length)) {
+            sky_columnar_path path;
+            rc = sky_columnar_path_init(&path, ptr, event_data_length);
+            check(rc == 0, "Unable to read columnar path");
+            rc = sky_columnar_unpack(&path, true, NULL, &sz);
+            check(rc == 0, "Unable to measure columnar path");
+            check(length + hdrlen + sz <= block_size, "Expanded paths do not fit in block: %d", block->index);
+
+            rc = sky_path_pack_hdr(block->path_refs[i].object_id, sz, wide, buffer + length, &hdrsz);
+            check(rc == 0, "Unable to pack path header");
+            rc = sky_columnar_unpack(&path, true, buffer + length + hdrsz, &sz);
+            check(rc == 0, "Unable to expand columnar path");
+            length += hdrsz + sz;
+        }
+        else {
+            check(length + path_length <= block_size, "Expanded paths do not fit in block: %d", block->index);
+            memcpy(buffer + length, path_ptr, path_length);
+            length += path_length;
+        }
+    }
+
+    // Copy the rows over the block and rebuild the path directory.
+    memcpy(block_ptr, buffer, block_size);
+    sky_block_unload_path_refs(block);
+
+    free(buffer);
+    return 0;
+
+error:
+    free(buffer);
+    return -1;
+}
+
+// Calculates the length of the data in a block once its columnar paths are
+// expanded into rows.
+//
+// block  - The block.
+// length - A pointer to where the length is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_get_row_length(sky_block *block, size_t *length)
+{
+    int rc;
+    size_t sz;
+    check(block != NULL, "Block required");
+    check(length != NULL, "Length return pointer required");
+
+    rc = sky_block_load_path_refs(block);
+    check(rc == 0, "Unable to load path directory");
+    *length = block->data_length;
+    if(block->data_file->version < SKY_DATA_FILE_COLUMNAR_VERSION) {
+        return 0;
+    }
+
+    void *block_ptr;
+    rc = sky_block_get_data_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block data pointer");
+
+    // Replace the length of each columnar path with the length of its rows.
+    uint32_t i;
+    bool wide = sky_block_is_wide(block);
+    for(i=0; i<block->path_ref_count; i++) {
+        void *path_ptr = block_ptr + block->path_refs[i].offset;
+        size_t hdrlen = sky_path_sizeof_raw_hdr(path_ptr, wide);
+        void *ptr = path_ptr + hdrlen;
+        size_t event_data_length = sky_path_sizeof_raw(path_ptr, wide) - hdrlen;
+        if(sky_columnar_is_columnar(ptr, event_data_length)) {
+            sky_columnar_path path;
+            rc = sky_columnar_path_init(&path, ptr, event_data_length);
+            check(rc == 0, "Unable to read columnar path");
+            rc = sky_columnar_unpack(&path, true, NULL, &sz);
+            check(rc == 0, "Unable to measure columnar path");
+            *length = *length - event_data_length + sz;
+        }
+    }
+
+    return 0;
+
+error:
+    if(length) *length = 0;
+    return -1;
+}
+
+
+//--------------------------------------
+// Spanning
+//--------------------------------------
+
+// Determines the number of blocks that this block's object spans. This
+// function only works on the starting block of a span of blocks.
+//
+// block - The initial block in a block span.
+// count - A pointer to where the number of spanned blocks should be stored.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_get_span_count(sky_block *block, uint32_t *count)
+{
+    check(block != NULL, "Block required");
+    check(block->data_file != NULL, "Data file required");
+    check(count != NULL, "Span count address required");
+    
+    // If this block is not spanned then return 1.
+    if(!block->spanned) {
+        *count = 1;
+    }
+    // Otherwise count the blocks from this block's position in the
+    // directory to the end of the span.
+    else {
+        int rc;
+        uint32_t position;
+        sky_block *first_block;
+        rc = sky_data_file_get_block_position(block->data_file, block, &position);
+        check(rc == 0, "Unable to find block position");
+        rc = sky_data_file_get_object_blocks(block->data_file, block->min_object_id, &first_block, count);
+        check(rc == 0 && first_block != NULL, "Unable to find object blocks");
+
+        uint32_t first_position;
+        rc = sky_data_file_get_block_position(block->data_file, first_block, &first_position);
+        check(rc == 0, "Unable to find first block position");
+        *count -= (position - first_position);
+    }
+    
+    return 0;
+
+error:
+    *count = 0;
+    return -1;
+}
+
+// Spans a path across multiple blocks.
+int sky_block_span_with_event(sky_block *block, sky_event *new_event,
+                              void *path_ptr, uint32_t target_size,
+                              sky_block **target_block)
+{
+    int rc;
+    size_t _sz;
+    check(block != NULL, "Block required");
+    check(new_event != NULL, "Event required");
+    check(path_ptr != NULL, "Path pointer required");
+    check(target_size > 0, "Target size must be greater than zero");
+    check(target_block > 0, "Target block pointer required");
+    
+    // Initialize events stats.
+    uint32_t event_count = 0;
+    sky_path_event_stat *events;
+
+    // Retrieve block size.
+    sky_data_file *data_file = block->data_file;
+    uint32_t block_size = data_file->block_size;
+    
+    // Retrieve block pointer.
+    void *block_ptr = NULL;
+    rc = sky_block_get_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+
+    // Retrieve a list of event sizes in the current block (plus new event).
+    bool wide = sky_block_is_wide(block);
+    rc = sky_path_get_event_stats(path_ptr, wide, new_event, &events, &event_count);
+    check(rc == 0, "Unable to calculate event stats on path");
+    
+    // Initialize the return value.
+    *target_block = block;
+
+    // Retrieve path info.
+    bool is_first_path_in_block = (path_ptr == block_ptr);
+    sky_object_id_t object_id;
+    rc = sky_path_unpack_hdr(&object_id, NULL, wide, path_ptr, &_sz);
+    check(rc == 0, "Unable to unpack path header");
+    size_t hdrlen = _sz;
+
+    // Distribute events across blocks.
+    uint32_t i;
+    uint32_t last_index = 0;
+    size_t sz = hdrlen;
+    bool segment_started = false;
+    for(i=0; i<event_count; i++) {
+        sky_path_event_stat *event = &(events[i]);
+        sky_path_event_stat *next_event = (i < event_count-1 ? &(events[i+1]) : NULL);
+
+        // If we exceed the block size then create a spanned block.
+        if(hdrlen + event->sz > block_size) {
+            sentinel("Event is too large for block");
+        }
+        
+        // Add the event size to the running total. The first event of each
+        // span is stored relative to zero if it is delta encoded.
+        if(!segment_started && event->end_pos > event->start_pos) {
+            sz += sky_event_sizeof_raw_rebased(path_ptr + event->start_pos, event->timestamp, 0);
+            segment_started = true;
+        }
+        else {
+            sz += event->sz;
+        }
+
+        // If we exceeded the target size or if there is remaining data
+        // in an already split block then move everything to a new block.
+        bool exceeds_target_size = (sz >= target_size);
+        bool is_last_event = (i == event_count-1 && last_index > 0);
+        bool next_event_exceeds_max = (next_event != NULL && sz + next_event->sz > block_size);
+        if(exceeds_target_size || is_last_event || next_event_exceeds_max) {
+            sky_path_event_stat *last_event = &(events[last_index]);
+
+            // Calculate lengths and positions of event range.
+            size_t start_pos = last_event->start_pos;
+            size_t end_pos   = event->end_pos;
+            size_t len = end_pos - start_pos;
+            void *ptr = path_ptr + start_pos;
+
+            // If this is the first span of the first path of a block then
+            // just leave the data where it is.
+            sky_block *new_block = NULL;
+            void *new_block_ptr = NULL;
+            if(is_first_path_in_block && last_index == 0) {
+                new_block = block;
+                new_block_ptr = path_ptr;
+            }
+            // Otherwise move the data to a new block.
+            else {
+                // Save path pointer.
+                off_t path_off = path_ptr - data_file->data;
+
+                // Create a new block.
+                rc = sky_data_file_create_block(data_file, &new_block);
+                check(rc == 0, "Unable to create new block");
+
+                // Restore path pointer.
+                path_ptr = data_file->data + path_off;
+                ptr = path_ptr + start_pos;
+
+                // Retrieve the new block's pointer.
+                rc = sky_block_get_ptr(new_block, &new_block_ptr);
+                check(rc == 0, "Unable to retrieve new block's data pointer");
+
+                // Move data. The first event is rebased since it no longer
+                // follows the previous event in the path.
+                if(len > 0) {
+                    uint32_t first_index = last_index;
+                    while(events[first_index].end_pos == events[first_index].start_pos) {
+                        first_index++;
+                    }
+                    size_t event_sz = sky_event_sizeof_raw(ptr);
+                    rc = sky_event_rebase_raw(ptr, events[first_index].timestamp, 0, new_block_ptr + hdrlen, &_sz);
+                    check(rc == 0, "Unable to rebase event");
+                    memmove(new_block_ptr + hdrlen + _sz, ptr + event_sz, len - event_sz);
+                    memset(ptr, 0, len);
+                    len = len - event_sz + _sz;
+                }
+            }
+
+            // Clear out original header.
+            if(last_index == 0) {
+                memset(path_ptr, 0, hdrlen);
+            }
+
+            // If we are leaving an empty block then clear the path header.
+            if(len == 0) {
+                memset(new_block_ptr, 0, hdrlen);
+            }
+            // Otherwise write the header.
+            else {
+                rc = sky_path_pack_hdr(object_id, len, wide, new_block_ptr, &_sz);
+                check(rc == 0, "Unable to write path header");
+            }
+
+            // Update block ranges. The original block still holds the events
+            // that have not been moved yet so it is updated at the end.
+            if(new_block != block) {
+                rc = sky_block_full_update(new_block);
+                check(rc == 0, "Unable to update block ranges");
+            }
+
+            // The event belongs in the last block that starts at or before
+            // its timestamp.
+            if(new_event->timestamp >= last_event->timestamp) {
+                *target_block = new_block;
+            }
+            
+            // Flag block as spanned.
+            new_block->spanned = true;
+            
+            // Save where we left off.
+            last_index = i+1;
+            sz = hdrlen;
+            segment_started = false;
+        }
+    }
+
+    // Update block range on the original block if a split occurred.
+    if(last_index > 0) {
+        rc = sky_block_full_update(block);
+        check(rc == 0, "Unable to update block ranges");
+    }
     
+    free(events);
+    return 0;
+
+error:
+    *target_block = NULL;
+    free(events);
+    return -1;
+}
+
+
+//--------------------------------------
+// Path Directory
+//--------------------------------------
+
+// Builds the directory of paths in the block by walking each path once. If
+// the directory is already loaded then nothing is done.
+//
+// block - The block.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_load_path_refs(sky_block *block)
+{
+    int rc;
+    check(block != NULL, "Block required");
+
+    if(block->path_refs_loaded) {
+        return 0;
+    }
+
+    // Initialize path iterator.
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    rc = sky_path_iterator_set_block(&iterator, block);
+    check(rc == 0, "Unable to set path iterator block");
+
+    // Add a reference for each path.
+    block->path_ref_count = 0;
+    while(!iterator.eof) {
+        if(block->path_ref_count == block->path_ref_capacity) {
+            block->path_ref_capacity = (block->path_ref_capacity > 0 ? block->path_ref_capacity * 2 : 16);
+            block->path_refs = realloc(block->path_refs, sizeof(*block->path_refs) * block->path_ref_capacity);
+            check_mem(block->path_refs);
+        }
+
+        sky_block_path_ref *ref = &block->path_refs[block->path_ref_count++];
+        ref->object_id = iterator.current_object_id;
+        ref->offset = iterator.byte_index;
+
+        rc = sky_path_iterator_next(&iterator);
+        check(rc == 0, "Unable to move to next path");
+    }
+
+    // The data length is only known once the iterator reaches the end.
+    block->data_length = iterator.block_data_length;
+    block->path_refs_loaded = true;
+
+    return 0;
+
+error:
+    sky_block_unload_path_refs(block);
+    return -1;
+}
+
+// Removes the directory of paths from memory. It is rebuilt the next time
+// that it is needed.
+//
+// block - The block.
+void sky_block_unload_path_refs(sky_block *block)
+{
+    if(block) {
+        free(block->path_refs);
+        block->path_refs = NULL;
+        block->path_ref_count = 0;
+        block->path_ref_capacity = 0;
+        block->data_length = 0;
+        block->path_refs_loaded = false;
+    }
+}
+
+// Finds the path for an object within the block.
+//
+// block     - The block.
+// object_id - The object id of the path to find.
+// path_ptr  - A pointer to where the path pointer is returned. This is NULL
+//             if the block does not contain a path for the object.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_get_path_ptr(sky_block *block, sky_object_id_t object_id,
+                           void **path_ptr)
+{
+    int rc;
+    check(block != NULL, "Block required");
+    check(path_ptr != NULL, "Path pointer address required");
+
+    *path_ptr = NULL;
+
+    rc = sky_block_load_path_refs(block);
+    check(rc == 0, "Unable to load path directory");
+
+    uint32_t index = sky_block_path_ref_lower_bound(block, object_id);
+    if(index < block->path_ref_count && block->path_refs[index].object_id == object_id) {
+        void *block_ptr;
+        rc = sky_block_get_data_ptr(block, &block_ptr);
+        check(rc == 0, "Unable to retrieve block data pointer");
+        *path_ptr = block_ptr + block->path_refs[index].offset;
+    }
+
+    return 0;
+
+error:
+    *path_ptr = NULL;
+    return -1;
+}
+
+// Finds the index of the first path in the directory whose object id is
+// greater than or equal to a given object id.
+//
+// block     - The block.
+// object_id - The object id to search for.
+//
+// Returns the index of the path or the path count if there is none.
+uint32_t sky_block_path_ref_lower_bound(sky_block *block,
+                                        sky_object_id_t object_id)
+{
+    uint32_t min = 0;
+    uint32_t max = block->path_ref_count;
+    while(min < max) {
+        uint32_t mid = min + ((max - min) / 2);
+        if(block->path_refs[mid].object_id < object_id) {
+            min = mid + 1;
+        }
+        else {
+            max = mid;
+        }
+    }
+    return min;
+}
+
+// Updates the directory after bytes have been inserted into the block. Every
+// path at or after the insertion offset is moved down and a reference is
+// added if a new path was inserted.
+//
+// block       - The block.
+// offset      - The offset in the block where the bytes were inserted.
+// sz          - The number of bytes inserted.
+// object_id   - The object id of the path that the bytes were inserted into.
+// path_exists - A flag stating if the path existed before the insertion.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_shift_path_refs(sky_block *block, uint32_t offset,
+                              size_t sz, sky_object_id_t object_id,
+                              bool path_exists)
+{
+    check(block != NULL, "Block required");
+
+    if(!block->path_refs_loaded) {
+        return 0;
+    }
+
+    // Shift the offsets of the paths after the insertion point.
+    uint32_t i;
+    for(i=0; i<block->path_ref_count; i++) {
+        if(block->path_refs[i].offset >= offset) {
+            block->path_refs[i].offset += sz;
+        }
+    }
+    block->data_length += sz;
+
+    // Insert a reference for a new path.
+    if(!path_exists) {
+        if(block->path_ref_count == block->path_ref_capacity) {
+            block->path_ref_capacity = (block->path_ref_capacity > 0 ? block->path_ref_capacity * 2 : 16);
+            block->path_refs = realloc(block->path_refs, sizeof(*block->path_refs) * block->path_ref_capacity);
+            check_mem(block->path_refs);
+        }
+        
+        uint32_t index = sky_block_path_ref_lower_bound(block, object_id);
+        memmove(&block->path_refs[index+1], &block->path_refs[index], sizeof(*block->path_refs) * (block->path_ref_count-index));
+        block->path_refs[index].object_id = object_id;
+        block->path_refs[index].offset = offset;
+        block->path_ref_count++;
+    }
+
+    return 0;
+
+error:
+    sky_block_unload_path_refs(block);
+    return -1;
+}
+
+
+//--------------------------------------
+// Zone Map
+//--------------------------------------
+
+// Builds the zone map of the block by reading each event once. If the zone
+// map is already loaded then nothing is done.
+//
+// block - The block.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_load_zone_map(sky_block *block)
+{
+    int rc;
+    sky_event *event = NULL;
+    check(block != NULL, "Block required");
+
+    if(block->zone_map_loaded) {
+        return 0;
+    }
+
     // Initialize path iterator.
     sky_path_iterator iterator;
     sky_path_iterator_init(&iterator);
     rc = sky_path_iterator_set_block(&iterator, block);
     check(rc == 0, "Unable to set path iterator block");
 
-    // Calculate size of the event.
-    size_t event_length = (event != NULL ? sky_event_sizeof(event) : 0);
+    // Add every event in every path.
+    sky_zone_map_clear(&block->zone_map);
+    while(!iterator.eof) {
+        void *ptr;
+        rc = sky_path_iterator_get_ptr(&iterator, &ptr);
+        check(rc == 0, "Unable to retrieve iterator's current pointer");
+
+        sky_cursor cursor;
+        sky_cursor_init(&cursor);
+        cursor.wide = sky_block_is_wide(block);
+        rc = sky_cursor_set_path(&cursor, ptr);
+        check(rc == 0, "Unable to set cursor path");
+
+        while(!cursor.eof) {
+            event = sky_event_create(0, 0, 0); check_mem(event);
+            rc = sky_cursor_get_event(&cursor, event);
+            check(rc == 0, "Unable to read event");
+            rc = sky_zone_map_add_event(&block->zone_map, event);
+            check(rc == 0, "Unable to add event to zone map");
+            sky_event_free(event);
+            event = NULL;
+
+            rc = sky_cursor_next(&cursor);
+            check(rc == 0, "Unable to move to next event");
+        }
+
+        rc = sky_path_iterator_next(&iterator);
+        check(rc == 0, "Unable to move to next path");
+    }
+
+    block->zone_map_loaded = true;
+    return 0;
+
+error:
+    sky_event_free(event);
+    sky_block_unload_zone_map(block);
+    return -1;
+}
+
+// Removes the zone map from memory. It is rebuilt the next time that it is
+// needed.
+//
+// block - The block.
+void sky_block_unload_zone_map(sky_block *block)
+{
+    if(block) {
+        sky_zone_map_clear(&block->zone_map);
+        block->zone_map_loaded = false;
+    }
+}
+
+// Checks if the block could contain an event that matches a predicate. The
+// time window is checked against the block's timestamp range first and the
+// zone map is only loaded if the predicate has an action or a property.
+//
+// block     - The block.
+// predicate - The predicate to check.
+// match     - A pointer to where the result is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_matches(sky_block *block, sky_zone_map_predicate *predicate,
+                      bool *match)
+{
+    int rc;
+    check(block != NULL, "Block required");
+    check(match != NULL, "Match return address required");
+
+    *match = true;
+    if(sky_zone_map_predicate_is_empty(predicate)) {
+        return 0;
+    }
+
+    // Check the time window against the block's timestamp range.
+    if(sky_zone_map_predicate_has_window(predicate) && (block->max_timestamp < predicate->start_timestamp || block->min_timestamp >= predicate->end_timestamp)) {
+        *match = false;
+        return 0;
+    }
+    if(predicate->action_id == 0 && predicate->property_id == 0) {
+        return 0;
+    }
+
+    rc = sky_block_load_zone_map(block);
+    check(rc == 0, "Unable to load zone map");
+    *match = sky_zone_map_matches(&block->zone_map, predicate);
+
+    return 0;
+
+error:
+    *match = true;
+    return -1;
+}
+
+
+//--------------------------------------
+// Path Stats
+//--------------------------------------
+
+// Generates an index of stats on all the paths in the block. If an event is
+// passed in then it also generates stats on the path the event would be
+// added to or a new path that would be created from that event.
+//
+// block      - The block to calculate stats on.
+// event      - A soon-to-be-added event to calculate into the paths. If null then
+//              the stats are calculated as they exist in the block.
+// paths      - A pointer to where the stats should be returned.
+// path_count - A pointer to where the number of paths should be returned.
+int sky_block_get_path_stats(sky_block *block, sky_event *event,
+                             sky_block_path_stat **paths,
+                             uint32_t *path_count)
+{
+    int rc;
+    check(block != NULL, "Block required");
+    check(paths != NULL, "Paths return address required");
+    check(path_count != NULL, "Path count return address required");
 
     // Initialize return values.
     *path_count = 0;
     *paths = NULL;
+
+    // Load the path directory.
+    rc = sky_block_load_path_refs(block);
+    check(rc == 0, "Unable to load path directory");
+
+    // Calculate the number of bytes that the event adds to its path.
+    size_t event_length = 0;
+    if(event != NULL) {
+        void *path_ptr, *event_ptr;
+        size_t block_data_length, encoded_length;
+        sky_timestamp_t base;
+        rc = sky_block_get_insertion_info(block, event, &path_ptr, &event_ptr, &base, &block_data_length);
+        check(rc == 0, "Unable to determine insertion info");
+        rc = sky_block_get_insertion_length(event, sky_block_is_delta_encoded(block), sky_block_is_indexed(block), sky_block_is_wide(block), path_ptr, event_ptr, base, &encoded_length, &event_length);
+        check(rc == 0, "Unable to determine insertion length");
+    }
+
+    // Allocate room for every path plus a possible new path.
+    *paths = calloc(block->path_ref_count + 1, sizeof(sky_block_path_stat));
+    check_mem(*paths);
  
-    // Loop over iterator to calculate sizes of the paths.
+    // Loop over the directory to calculate sizes of the paths.
     sky_object_id_t last_object_id = 0;
-    while(!iterator.eof) {
-        // Retrieve path pointer.
-        void *path_ptr = NULL;
-        rc = sky_path_iterator_get_ptr(&iterator, &path_ptr);
-        check(rc == 0, "Unable to retrieve iterator's current pointer");
+    uint32_t i;
+    for(i=0; i<block->path_ref_count; i++) {
+        sky_block_path_ref *ref = &block->path_refs[i];
+        size_t end_pos = (i < block->path_ref_count-1 ? block->path_refs[i+1].offset : block->data_length);
 
         // Check if event is a new path inserted between the last path and
         // this current path.
-        if(event != NULL && event->object_id > last_object_id && event->object_id < iterator.current_object_id) {
-            // Increment paths array.
-            (*path_count)++;
-            *paths = realloc(*paths, sizeof(sky_block_path_stat) * (*path_count));
-            sky_block_path_stat *stat = &((*paths)[(*path_count)-1]);
+        if(event != NULL && event->object_id > last_object_id && event->object_id < ref->object_id) {
+            sky_block_path_stat *stat = &((*paths)[(*path_count)++]);
             stat->object_id = event->object_id;
-            stat->start_pos = stat->end_pos = (path_ptr - block_ptr);
-            stat->sz = SKY_PATH_HEADER_LENGTH + event_length;
+            stat->start_pos = stat->end_pos = ref->offset;
+            stat->sz = event_length;
         }
         
         // Calculate current path stats.
-        size_t path_length = sky_path_sizeof_raw(path_ptr);
-        (*path_count)++;
-        *paths = realloc(*paths, sizeof(sky_block_path_stat) * (*path_count));
-        sky_block_path_stat *stat = &((*paths)[(*path_count)-1]);
-        stat->object_id = iterator.current_object_id;
-        stat->start_pos = path_ptr - block_ptr;
-        stat->end_pos = stat->start_pos + path_length;
-        stat->sz = path_length;
+        sky_block_path_stat *stat = &((*paths)[(*path_count)++]);
+        stat->object_id = ref->object_id;
+        stat->start_pos = ref->offset;
+        stat->end_pos = end_pos;
+        stat->sz = end_pos - ref->offset;
     
         // Add insertion event length if this is the matching path.
-        if(event != NULL && event->object_id == iterator.current_object_id) {
+        if(event != NULL && event->object_id == ref->object_id) {
             stat->sz += event_length;
         }
 
         // Save off this object id.
-        last_object_id = iterator.current_object_id;
-    
-        // Move to next path.
-        rc = sky_path_iterator_next(&iterator);
-        check(rc == 0, "Unable to move to next path");
+        last_object_id = ref->object_id;
     }
 
     // Check if event is a new path inserted at the end.
     if(event != NULL && event->object_id > last_object_id) {
-        (*path_count)++;
-        *paths = realloc(*paths, sizeof(sky_block_path_stat) * (*path_count));
-        sky_block_path_stat *stat = &((*paths)[(*path_count)-1]);
+        sky_block_path_stat *stat = &((*paths)[(*path_count)++]);
         stat->object_id = event->object_id;
-        stat->start_pos = stat->end_pos = iterator.block_data_length;
-        stat->sz = SKY_PATH_HEADER_LENGTH + event_length;
+        stat->start_pos = stat->end_pos = block->data_length;
+        stat->sz = event_length;
     }
     
     return 0;
@@ -763,6 +1503,37 @@ error:
 // Event Management
 //--------------------------------------
 
+// Checks if new events in the block are written with the delta encoding.
+//
+// block - The block.
+//
+// Returns true if the block's data file uses the delta encoding.
+bool sky_block_is_delta_encoded(sky_block *block)
+{
+    return (block->data_file != NULL && block->data_file->version >= SKY_DATA_FILE_DELTA_VERSION);
+}
+
+// Checks if new events in the block are written with an index of their data
+// section.
+//
+// block - The block.
+//
+// Returns true if the block's data file supports indexed events.
+bool sky_block_is_indexed(sky_block *block)
+{
+    return (block->data_file != NULL && block->data_file->version >= SKY_DATA_FILE_INDEXED_VERSION);
+}
+
+// Checks if the block's paths store wide object ids.
+//
+// block - The block.
+//
+// Returns true if the block's data file has wide object ids.
+bool sky_block_is_wide(sky_block *block)
+{
+    return sky_data_file_is_wide(block->data_file);
+}
+
 // Adds an event to the block. If the size of the block exceeds the block size
 // then a new empty block is allocated and half the paths in the block are
 // moved to the new block.
@@ -779,27 +1550,36 @@ int sky_block_add_event(sky_block *block, sky_event *event)
     check(block->data_file != NULL, "Block data file required");
     check(block->data_file->block_size > 0, "Block data file must have a nonzero block size");
 
+    rc = sky_data_file_touch_block(block->data_file, block);
+    check(rc == 0, "Unable to touch block");
+
+    // Compressed blocks are decompressed and columnar paths are expanded
+    // before they are changed.
+    rc = sky_block_expand_columns(block);
+    check(rc == 0, "Unable to expand columns");
+    rc = sky_block_decompress(block);
+    check(rc == 0, "Unable to decompress block");
+
     // Store the block pointer.
     void *block_ptr;
     rc = sky_block_get_ptr(block, &block_ptr);
     check(rc == 0, "Unable to retrieve block pointer");
 
-    // Initialize path iterator.
-    sky_path_iterator iterator;
-    sky_path_iterator_init(&iterator);
-    rc = sky_path_iterator_set_block(&iterator, block);
-    check(rc == 0, "Unable to set path iterator block");
-
     // Retrieve insertion points and block info.
     void *path_ptr, *event_ptr;
     size_t block_data_length;
-    rc = sky_block_get_insertion_info(block, event, &path_ptr, &event_ptr, &block_data_length);
+    sky_timestamp_t base;
+    rc = sky_block_get_insertion_info(block, event, &path_ptr, &event_ptr, &base, &block_data_length);
     check(rc == 0, "Unable to determine insertion info to add event");
 
     // Determine size.
+    bool delta = sky_block_is_delta_encoded(block);
+    bool indexed = sky_block_is_indexed(block);
+    bool wide = sky_block_is_wide(block);
     bool path_exists = (event_ptr != NULL);
-    size_t event_length = sky_event_sizeof(event);
-    size_t sz = event_length + (!path_exists ? SKY_PATH_HEADER_LENGTH : 0);
+    size_t event_length, sz;
+    rc = sky_block_get_insertion_length(event, delta, indexed, wide, path_ptr, event_ptr, base, &event_length, &sz);
+    check(rc == 0, "Unable to determine insertion length");
     
     // If adding the event will cause a split then go ahead and split and
     // recall this function.
@@ -823,35 +1603,59 @@ int sky_block_add_event(sky_block *block, sky_event *event)
         path_ptr = block_ptr + block_data_length;
     }
 
+    // Retrieve the timestamp of the event after the insertion point.
+    bool has_next = (path_exists && event_ptr < path_ptr + sky_path_sizeof_raw(path_ptr, wide));
+    sky_timestamp_t next_timestamp = 0;
+    if(has_next) {
+        sky_action_id_t action_id;
+        sky_event_data_length_t data_length;
+        rc = sky_event_unpack_hdr_delta(&next_timestamp, &action_id, &data_length, base, event_ptr, NULL);
+        check(rc == 0, "Unable to unpack next event header");
+    }
+
     // Shift data down in the block so we have enough room.
     void *ptr = (path_exists ? event_ptr : path_ptr);
     memmove(ptr+sz, ptr, block_data_length-(ptr-block_ptr));
     
     // Pack the path first if it is missing.
+    size_t _sz;
     if(!path_exists) {
-        rc = sky_path_pack_hdr(event->object_id, event_length, ptr, &sz);
+        rc = sky_path_pack_hdr(event->object_id, event_length, wide, ptr, &_sz);
         check(rc == 0, "Unable to pack path header");
         
         // Point event pointer at the beginning of the path event data.
-        event_ptr = path_ptr + SKY_PATH_HEADER_LENGTH;
+        event_ptr = path_ptr + _sz;
     }
-    // Or update the path event length if a path exists.
+    // Or update the path event length if a path exists. The length is the
+    // last field in the header.
     else {
-        *(sky_path_event_data_length_t*)(path_ptr+sizeof(sky_object_id_t)) += event_length;
+        *(sky_path_event_data_length_t*)(path_ptr + sky_path_sizeof_raw_hdr(path_ptr, wide) - sizeof(sky_path_event_data_length_t)) += sz;
+    }
+
+    // The next event now follows the new event so rebase it into place.
+    if(has_next) {
+        rc = sky_event_rebase_raw(event_ptr+sz, next_timestamp, event->timestamp, event_ptr+event_length, NULL);
+        check(rc == 0, "Unable to rebase next event");
     }
     
     // Pack event.
-    size_t event_sz;
-    rc = sky_event_pack(event, event_ptr, &event_sz);
+    rc = sky_block_pack_event(event, delta, indexed, base, event_ptr, &_sz);
     check(rc == 0, "Unable to pack event");
+
+    // Move the paths after the insertion point in the directory.
+    rc = sky_block_shift_path_refs(block, ptr - block_ptr, sz, event->object_id, path_exists);
+    check(rc == 0, "Unable to update path directory");
     
-    // Save block to disk.
-    rc = sky_block_save(block);
-    check(rc == 0, "Unable to save block");
-    
-    // Update header.
+    // Update header. The block itself is synced to disk when the data file
+    // is flushed.
     rc = sky_block_update(block, event->object_id, event->timestamp);
     check(rc == 0, "Unable to write block to header");
+
+    // Widen the zone map if it is loaded.
+    if(block->zone_map_loaded) {
+        rc = sky_zone_map_add_event(&block->zone_map, event);
+        check(rc == 0, "Unable to update zone map");
+    }
     
     return 0;
 
@@ -862,105 +1666,148 @@ error:
 // Calculates the information needed to perform an insertion of an event into
 // a block. The path pointer points to where the path is or should be inserted
 // into. The event pointer points to where the event should be inserted into.
-// If the event pointer is NULL then a path was not found. Finally, the block
-// data length is how many bytes in the block are actually used to store data
-// (and are not empty).
+// If the event pointer is NULL then a path was not found. The base is the
+// timestamp of the event before the insertion point or zero if there is none.
+// Finally, the block data length is how many bytes in the block are actually
+// used to store data (and are not empty).
 //
 // block     - The block to add the event to.
 // event     - The event to add to the block.
 // path_ptr  - A pointer to where the path pointer should be returned to.
 // event_ptr - A pointer to where the event pointer should be returned to.
+// base      - A pointer to where the base timestamp should be returned to.
 // block_data_length - A pointer to where the length of the block's data
 //                     should be returned to.
 //
 // Returns 0 if successful, otherwise returns -1.
 int sky_block_get_insertion_info(sky_block *block, sky_event *event,
                                  void **path_ptr, void **event_ptr,
+                                 sky_timestamp_t *base,
                                  size_t *block_data_length)
 {
     int rc;
     check(block != NULL, "Block required");
     check(event != NULL, "Event required");
 
-    // Initialize path iterator.
-    sky_path_iterator iterator;
-    sky_path_iterator_init(&iterator);
-    rc = sky_path_iterator_set_block(&iterator, block);
-    check(rc == 0, "Unable to set path iterator block");
-
     // Initialize path and event pointers.
     *path_ptr  = NULL;
     *event_ptr = NULL;
-    
-    // Loop over iterator until we find the path or insertion point.
-    while(!iterator.eof) {
-        // If we reached the correct path then retrieve the path pointer
-        // and then use a cursor to find the insertion point.
-        if(event->object_id == iterator.current_object_id) {
-            // Save path pointer.
-            rc = sky_path_iterator_get_ptr(&iterator, path_ptr);
-            check(rc == 0, "Unable to retrieve iterator's current pointer");
-            
-            // Use cursor to find event insertion point.
-            sky_cursor cursor;
-            sky_cursor_init(&cursor);
-            sky_cursor_set_path(&cursor, *path_ptr);
-            check(rc == 0, "Unable to set cursor path");
-            
-            // Loop over cursor until we reach the event insertion point.
-            while(!cursor.eof) {
-                sky_timestamp_t timestamp;
-                sky_action_id_t action_id;
-                sky_event_data_length_t data_length;
-
-                // Retrieve current timestamp in cursor.
-                size_t hdrsz;
-                rc = sky_event_unpack_hdr(&timestamp, &action_id, &data_length, cursor.ptr, &hdrsz);
-                check(rc == 0, "Unable to unpack event header");
-                
-                // Retrieve event insertion pointer once the timestamp is
-                // reached.
-                if(timestamp >= event->timestamp) {
-                    *event_ptr = cursor.ptr;
-                    break;
-                }
-                
-                // Move to next event.
-                rc = sky_cursor_next(&cursor);
-                check(rc == 0, "Unable to move to next event");
+    *base = 0;
+
+    // Load the path directory.
+    rc = sky_block_load_path_refs(block);
+    check(rc == 0, "Unable to load path directory");
+
+    void *block_ptr;
+    rc = sky_block_get_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+
+    // Find the path or the path that the new path should be inserted before.
+    uint32_t index = sky_block_path_ref_lower_bound(block, event->object_id);
+    if(index < block->path_ref_count) {
+        *path_ptr = block_ptr + block->path_refs[index].offset;
+    }
+
+    // If we found the correct path then use a cursor to find the insertion
+    // point.
+    if(index < block->path_ref_count && block->path_refs[index].object_id == event->object_id) {
+        sky_cursor cursor;
+        sky_cursor_init(&cursor);
+        cursor.wide = sky_block_is_wide(block);
+        rc = sky_cursor_set_path(&cursor, *path_ptr);
+        check(rc == 0, "Unable to set cursor path");
+        
+        // Loop over cursor until we reach the event insertion point.
+        while(!cursor.eof) {
+            // Retrieve event insertion pointer once the timestamp is
+            // reached.
+            if(cursor.timestamp >= event->timestamp) {
+                *event_ptr = cursor.ptr;
+                break;
             }
+            *base = cursor.timestamp;
             
-            // If no insertion point was found then append the event to the
-            // end of the path.
-            if(*event_ptr == NULL) {
-                *event_ptr = (*path_ptr) + sky_path_sizeof_raw(*path_ptr);
-            }
-        }
-        // If we are beyond the object id then exit and use the current
-        // pointer as the insertion point.
-        else if(*path_ptr == NULL && iterator.current_object_id > event->object_id) {
-            rc = sky_path_iterator_get_ptr(&iterator, path_ptr);
-            check(rc == 0, "Unable to retrieve iterator's current pointer");
+            // Move to next event.
+            rc = sky_cursor_next(&cursor);
+            check(rc == 0, "Unable to move to next event");
         }
         
-        // Move to next path.
-        rc = sky_path_iterator_next(&iterator);
-        check(rc == 0, "Unable to move to next path");
+        // If no insertion point was found then append the event to the
+        // end of the path.
+        if(*event_ptr == NULL) {
+            *event_ptr = (*path_ptr) + sky_path_sizeof_raw(*path_ptr, cursor.wide);
+        }
     }
     
-    // Save the length of the data in the block. This value can only be 
-    // determined after the iterator has reached EOF.
-    *block_data_length = iterator.block_data_length;
+    // Save the length of the data in the block.
+    *block_data_length = block->data_length;
 
     return 0;
 
 error:
     *path_ptr  = NULL;
     *event_ptr = NULL;
+    *base = 0;
     *block_data_length = 0;
     return -1;
 }
 
+// Calculates the number of bytes that an event adds to a block when it is
+// inserted at a given insertion point. A delta encoded event that follows the
+// insertion point is rebased onto the new event so its size can change too.
+//
+// event        - The event to insert.
+// delta        - A flag stating if the event is delta encoded.
+// indexed      - A flag stating if the event is indexed.
+// wide         - A flag stating if the path header uses a varint object id.
+// path_ptr     - A pointer to the path or NULL if a new path is created.
+// event_ptr    - A pointer to the insertion point or NULL if a new path is
+//                created.
+// base         - The timestamp of the event before the insertion point.
+// event_length - A pointer to where the encoded event length is returned.
+// sz           - A pointer to where the total number of bytes is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_get_insertion_length(sky_event *event, bool delta,
+                                   bool indexed, bool wide, void *path_ptr,
+                                   void *event_ptr, sky_timestamp_t base,
+                                   size_t *event_length, size_t *sz)
+{
+    int rc;
+    check(event != NULL, "Event required");
+    check(event_length != NULL, "Event length return address required");
+    check(sz != NULL, "Size return address required");
+
+    // New paths require a header and start from a zero base.
+    if(event_ptr == NULL) {
+        rc = sky_block_pack_event(event, delta, indexed, 0, NULL, event_length);
+        check(rc == 0, "Unable to determine event length");
+        *sz = sky_path_sizeof_hdr(event->object_id, wide) + *event_length;
+        return 0;
+    }
+
+    rc = sky_block_pack_event(event, delta, indexed, base, NULL, event_length);
+    check(rc == 0, "Unable to determine event length");
+    *sz = *event_length;
+
+    // Add the change in size of the next event once it is rebased.
+    if(event_ptr < path_ptr + sky_path_sizeof_raw(path_ptr, wide)) {
+        sky_timestamp_t timestamp;
+        sky_action_id_t action_id;
+        sky_event_data_length_t data_length;
+        rc = sky_event_unpack_hdr_delta(&timestamp, &action_id, &data_length, base, event_ptr, NULL);
+        check(rc == 0, "Unable to unpack event header");
+        *sz = (*sz + sky_event_sizeof_raw_rebased(event_ptr, timestamp, event->timestamp)) - sky_event_sizeof_raw(event_ptr);
+    }
+
+    return 0;
+
+error:
+    if(event_length) *event_length = 0;
+    if(sz) *sz = 0;
+    return -1;
+}
+
 // Iterates over a block and splits it into smaller blocks. The block attempts
 // to create blocks which are half the maximum size although this is not
 // always possible because of path sizes.
@@ -1131,6 +1978,490 @@ error:
 }
 
 
+// Adds a batch of events to a block in a single pass. The existing paths are
+// merged with the new events into a buffer which is then copied over the block
+// and the block header is updated once.
+//
+// The events must be sorted by object id and then timestamp and they must all
+// belong in this block. Events with the same object id and timestamp are
+// inserted in reverse order, which matches adding them one at a time. If the
+// block is spanned or if the events do not fit in the block then the block is
+// left unchanged and the events should be added individually.
+//
+// block       - The block to add the events to.
+// events      - The sorted events to add.
+// event_count - The number of events.
+// added       - A flag stating if the events were added.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_add_events(sky_block *block, sky_event **events,
+                         uint32_t event_count, bool *added)
+{
+    int rc;
+    size_t sz;
+    void *buffer = NULL;
+    check(block != NULL, "Block required");
+    check(events != NULL, "Events required");
+    check(added != NULL, "Added flag address required");
+
+    *added = false;
+
+    // Spanned blocks are split by timestamp so they are handled per event.
+    if(block->spanned || event_count == 0) {
+        return 0;
+    }
+
+    // Columnar paths are expanded before they are measured.
+    rc = sky_block_expand_columns(block);
+    check(rc == 0, "Unable to expand columns");
+
+    // Load the path directory.
+    rc = sky_block_load_path_refs(block);
+    check(rc == 0, "Unable to load path directory");
+    size_t block_data_length = block->data_length;
+
+    // The size of delta encoded events depends on their neighbors so the
+    // merge is measured without writing it.
+    uint32_t i;
+    size_t merged_length = 0;
+    if(sky_block_is_delta_encoded(block)) {
+        rc = sky_block_merge_paths(block, events, event_count, NULL, &merged_length);
+        check(rc == 0, "Unable to measure merged paths");
+    }
+    // Otherwise calculate the number of bytes that are added by the events.
+    else {
+        size_t added_length = 0;
+        for(i=0; i<event_count; i++) {
+            added_length += sky_event_sizeof(events[i]);
+            if(i == 0 || events[i]->object_id != events[i-1]->object_id) {
+                added_length += SKY_PATH_HEADER_LENGTH;
+            }
+        }
+
+        // Subtract path headers for objects that already have a path.
+        uint32_t index = 0;
+        for(i=0; i<block->path_ref_count; i++) {
+            sky_object_id_t object_id = block->path_refs[i].object_id;
+            while(index < event_count && events[index]->object_id < object_id) {
+                index++;
+            }
+            if(index < event_count && events[index]->object_id == object_id) {
+                added_length -= SKY_PATH_HEADER_LENGTH;
+            }
+        }
+        merged_length = block_data_length + added_length;
+    }
+    
+    // If the events don't fit then let the caller add them individually.
+    if(merged_length > block->data_file->block_size) {
+        return 0;
+    }
+
+    // Compressed blocks are decompressed before they are changed.
+    rc = sky_block_decompress(block);
+    check(rc == 0, "Unable to decompress block");
+
+    // Merge the existing paths and the new events into a buffer.
+    buffer = calloc(1, merged_length); check_mem(buffer);
+    rc = sky_block_merge_paths(block, events, event_count, buffer, &sz);
+    check(rc == 0, "Unable to merge paths");
+    check(sz == merged_length, "Unexpected merged block length: %ld", (long)sz);
+
+    // Copy the merged paths over the block.
+    rc = sky_data_file_touch_block(block->data_file, block);
+    check(rc == 0, "Unable to touch block");
+    void *block_ptr;
+    rc = sky_block_get_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+    memcpy(block_ptr, buffer, merged_length);
+    if(merged_length < block_data_length) {
+        memset(block_ptr + merged_length, 0, block_data_length - merged_length);
+    }
+    free(buffer);
+    buffer = NULL;
+    sky_block_unload_path_refs(block);
+    
+    // Update ranges and write the header once.
+    for(i=0; i<event_count; i++) {
+        bool is_empty = (block->min_object_id == 0 && block->max_object_id == 0);
+        if(is_empty || events[i]->object_id < block->min_object_id) {
+            block->min_object_id = events[i]->object_id;
+        }
+        if(is_empty || events[i]->object_id > block->max_object_id) {
+            block->max_object_id = events[i]->object_id;
+        }
+        if(is_empty || events[i]->timestamp < block->min_timestamp) {
+            block->min_timestamp = events[i]->timestamp;
+        }
+        if(is_empty || events[i]->timestamp > block->max_timestamp) {
+            block->max_timestamp = events[i]->timestamp;
+        }
+    }
+    rc = sky_block_save_header(block);
+    check(rc == 0, "Unable to save block header");
+
+    // Widen the zone map if it is loaded.
+    if(block->zone_map_loaded) {
+        for(i=0; i<event_count; i++) {
+            rc = sky_zone_map_add_event(&block->zone_map, events[i]);
+            check(rc == 0, "Unable to update zone map");
+        }
+    }
+
+    *added = true;
+    return 0;
+
+error:
+    if(buffer) free(buffer);
+    return -1;
+}
+
+// Writes the existing paths of a block merged with new events. If no pointer
+// is passed in then the merged length is calculated without writing anything.
+//
+// block       - The block.
+// events      - The new events, sorted by object id and timestamp.
+// event_count - The number of new events.
+// ptr         - A pointer to where the merged paths should be written or NULL.
+// sz          - A pointer to where the number of bytes is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_merge_paths(sky_block *block, sky_event **events,
+                          uint32_t event_count, void *ptr, size_t *sz)
+{
+    int rc;
+    size_t _sz;
+    check(block != NULL, "Block required");
+    check(sz != NULL, "Size return address required");
+
+    bool delta = sky_block_is_delta_encoded(block);
+    bool indexed = sky_block_is_indexed(block);
+    bool wide = sky_block_is_wide(block);
+    size_t length = 0;
+    uint32_t index = 0;
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    rc = sky_path_iterator_set_block(&iterator, block);
+    check(rc == 0, "Unable to set path iterator block");
+    while(index < event_count || !iterator.eof) {
+        // Determine the next object id to write.
+        sky_object_id_t object_id = (!iterator.eof ? iterator.current_object_id : 0);
+        if(index < event_count && (iterator.eof || events[index]->object_id < object_id)) {
+            object_id = events[index]->object_id;
+        }
+        
+        // Find the new events for the object.
+        uint32_t count = 0;
+        while(index+count < event_count && events[index+count]->object_id == object_id) {
+            count++;
+        }
+
+        // Retrieve the existing path if there is one.
+        void *path_ptr = NULL;
+        if(!iterator.eof && iterator.current_object_id == object_id) {
+            rc = sky_path_iterator_get_ptr(&iterator, &path_ptr);
+            check(rc == 0, "Unable to retrieve iterator's current pointer");
+        }
+
+        // Write the merged path.
+        rc = sky_block_merge_path(path_ptr, &events[index], count, delta, indexed, wide, (ptr != NULL ? ptr + length : NULL), &_sz);
+        check(rc == 0, "Unable to merge path");
+        length += _sz;
+        index += count;
+
+        if(path_ptr != NULL) {
+            rc = sky_path_iterator_next(&iterator);
+            check(rc == 0, "Unable to move to next path");
+        }
+    }
+
+    *sz = length;
+    return 0;
+
+error:
+    if(sz) *sz = 0;
+    return -1;
+}
+
+// Writes a path that merges an existing path's events with new events. New
+// events are inserted before existing events with the same timestamp. If no
+// pointer is passed in then the merged length is calculated without writing
+// anything.
+//
+// path_ptr    - A pointer to the existing path or NULL if there is none.
+// events      - The new events for the path, sorted by timestamp.
+// event_count - The number of new events.
+// delta       - A flag stating if new events are delta encoded.
+// indexed     - A flag stating if new events are indexed.
+// wide        - A flag stating if the path header uses a varint object id.
+// ptr         - A pointer to where the merged path should be written or NULL.
+// sz          - A pointer to where the number of bytes written is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_merge_path(void *path_ptr, sky_event **events,
+                         uint32_t event_count, bool delta, bool indexed,
+                         bool wide, void *ptr, size_t *sz)
+{
+    int rc;
+    size_t _sz;
+    check(path_ptr != NULL || event_count > 0, "Path or events required");
+
+    // Determine the object id and the existing event range.
+    sky_object_id_t object_id;
+    void *event_ptr = NULL;
+    void *endptr = NULL;
+    if(path_ptr != NULL) {
+        rc = sky_path_unpack_hdr(&object_id, NULL, wide, path_ptr, &_sz);
+        check(rc == 0, "Unable to unpack path header");
+        event_ptr = path_ptr + _sz;
+        endptr = path_ptr + sky_path_sizeof_raw(path_ptr, wide);
+    }
+    else {
+        object_id = events[0]->object_id;
+    }
+    size_t hdrlen = sky_path_sizeof_hdr(object_id, wide);
+    void *data_ptr = (ptr != NULL ? ptr + hdrlen : NULL);
+
+    // Merge events by timestamp. Each event is written relative to the
+    // previous event that was written.
+    uint32_t index = 0;
+    size_t length = 0;
+    sky_timestamp_t base = 0;
+    sky_timestamp_t existing_base = 0;
+    while(event_ptr != NULL && event_ptr < endptr) {
+        sky_timestamp_t timestamp;
+        sky_action_id_t action_id;
+        sky_event_data_length_t data_length;
+        rc = sky_event_unpack_hdr_delta(&timestamp, &action_id, &data_length, existing_base, event_ptr, &_sz);
+        check(rc == 0, "Unable to unpack event header");
+        existing_base = timestamp;
+
+        // Write new events that come before the existing event.
+        while(index < event_count && events[index]->timestamp <= timestamp) {
+            rc = sky_block_pack_event(events[index], delta, indexed, base, (data_ptr != NULL ? data_ptr + length : NULL), &_sz);
+            check(rc == 0, "Unable to pack event");
+            length += _sz;
+            base = events[index]->timestamp;
+            index++;
+        }
+
+        // Copy the existing event.
+        size_t event_sz = sky_event_sizeof_raw(event_ptr);
+        if(data_ptr != NULL) {
+            rc = sky_event_rebase_raw(event_ptr, timestamp, base, data_ptr + length, &_sz);
+            check(rc == 0, "Unable to copy event");
+        }
+        else {
+            _sz = sky_event_sizeof_raw_rebased(event_ptr, timestamp, base);
+        }
+        length += _sz;
+        base = timestamp;
+        event_ptr += event_sz;
+    }
+
+    // Write any remaining events to the end of the path.
+    while(index < event_count) {
+        rc = sky_block_pack_event(events[index], delta, indexed, base, (data_ptr != NULL ? data_ptr + length : NULL), &_sz);
+        check(rc == 0, "Unable to pack event");
+        length += _sz;
+        base = events[index]->timestamp;
+        index++;
+    }
+
+    // Write the path header now that the event data length is known.
+    if(ptr != NULL) {
+        rc = sky_path_pack_hdr(object_id, length, wide, ptr, &_sz);
+        check(rc == 0, "Unable to pack path header");
+    }
+
+    *sz = hdrlen + length;
+    return 0;
+
+error:
+    if(sz) *sz = 0;
+    return -1;
+}
+
+// Writes a new event with the block's encoding. If no pointer is passed in
+// then only the encoded length is calculated.
+//
+// event   - The event to write.
+// delta   - A flag stating if the event is delta encoded.
+// indexed - A flag stating if the event is indexed. Indexed events are also
+//           delta encoded.
+// base    - The timestamp of the previous event in the path.
+// ptr     - A pointer to where the event should be written or NULL.
+// sz      - A pointer to where the number of bytes is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_pack_event(sky_event *event, bool delta, bool indexed,
+                         sky_timestamp_t base, void *ptr, size_t *sz)
+{
+    if(ptr == NULL) {
+        if(indexed) {
+            *sz = sky_event_sizeof_indexed(event, base);
+        }
+        else {
+            *sz = (delta ? sky_event_sizeof_delta(event, base) : sky_event_sizeof(event));
+        }
+        return 0;
+    }
+    else if(indexed) {
+        return sky_event_pack_indexed(event, base, ptr, sz);
+    }
+    else if(delta) {
+        return sky_event_pack_delta(event, base, ptr, sz);
+    }
+    else {
+        return sky_event_pack(event, ptr, sz);
+    }
+}
+
+
+//--------------------------------------
+// Retention
+//--------------------------------------
+
+// Removes the events before a given timestamp from every path in the block.
+// The remaining events are rewritten in place with the first event of each
+// path re-encoded relative to zero. Paths without any remaining events are
+// removed. Compressed blocks are decompressed and columnar paths are expanded
+// first.
+//
+// block     - The block.
+// timestamp - The timestamp of the oldest event to keep.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_expire(sky_block *block, sky_timestamp_t timestamp)
+{
+    int rc;
+    size_t sz;
+    void *buffer = NULL;
+    check(block != NULL, "Block required");
+    check(block->data_file != NULL, "Block data file required");
+
+    rc = sky_data_file_touch_block(block->data_file, block);
+    check(rc == 0, "Unable to touch block");
+    rc = sky_block_expand_columns(block);
+    check(rc == 0, "Unable to expand columns");
+    rc = sky_block_decompress(block);
+    check(rc == 0, "Unable to decompress block");
+
+    void *block_ptr;
+    rc = sky_block_get_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+
+    // Write the remaining events of each path to a buffer.
+    size_t block_size = block->data_file->block_size;
+    bool wide = sky_block_is_wide(block);
+    size_t min_header_length = (wide ? SKY_WIDE_PATH_MIN_HEADER_LENGTH : SKY_PATH_HEADER_LENGTH);
+    buffer = calloc(1, block_size); check_mem(buffer);
+    size_t offset = 0;
+    size_t length = 0;
+    while(offset + min_header_length <= block_size) {
+        void *path_ptr = block_ptr + offset;
+        bool is_null = (wide ? *((uint8_t*)path_ptr) == 0 : *((uint32_t*)path_ptr) == 0);
+        if(is_null) {
+            break;
+        }
+
+        sky_object_id_t object_id;
+        rc = sky_path_unpack_hdr(&object_id, NULL, wide, path_ptr, &sz);
+        check(rc == 0, "Unable to unpack path header");
+        void *ptr = path_ptr + sz;
+        void *endptr = path_ptr + sky_path_sizeof_raw(path_ptr, wide);
+        size_t hdrlen = sky_path_sizeof_hdr(object_id, wide);
+
+        // Copy the events that are kept after the path header.
+        sky_timestamp_t base = 0;
+        sky_timestamp_t existing_base = 0;
+        size_t event_data_length = 0;
+        while(ptr < endptr) {
+            sky_timestamp_t event_timestamp;
+            sky_action_id_t action_id;
+            sky_event_data_length_t data_length;
+            rc = sky_event_unpack_hdr_delta(&event_timestamp, &action_id, &data_length, existing_base, ptr, &sz);
+            check(rc == 0, "Unable to unpack event header");
+            existing_base = event_timestamp;
+
+            if(event_timestamp >= timestamp) {
+                size_t event_length = sky_event_sizeof_raw_rebased(ptr, event_timestamp, base);
+                check(length + hdrlen + event_data_length + event_length <= block_size, "Expired path does not fit in block: %d", block->index);
+                rc = sky_event_rebase_raw(ptr, event_timestamp, base, buffer + length + hdrlen + event_data_length, &sz);
+                check(rc == 0, "Unable to copy event");
+                event_data_length += sz;
+                base = event_timestamp;
+            }
+            ptr += sky_event_sizeof_raw(ptr);
+        }
+
+        // Write the header of paths that still have events.
+        if(event_data_length > 0) {
+            rc = sky_path_pack_hdr(object_id, event_data_length, wide, buffer + length, &sz);
+            check(rc == 0, "Unable to pack path header");
+            length += hdrlen + event_data_length;
+        }
+        offset = endptr - block_ptr;
+    }
+
+    // Replace the block data and recalculate its ranges.
+    memcpy(block_ptr, buffer, block_size);
+    free(buffer);
+    buffer = NULL;
+
+    rc = sky_block_full_update(block);
+    check(rc == 0, "Unable to update block");
+
+    return 0;
+
+error:
+    free(buffer);
+    return -1;
+}
+
+// Removes every path from the block and resets its ranges so that the block
+// can be added to the free list. The block is detached from any archived data.
+//
+// block - The block.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_block_clear(sky_block *block)
+{
+    int rc;
+    check(block != NULL, "Block required");
+    check(block->data_file != NULL, "Block data file required");
+
+    rc = sky_data_file_touch_block(block->data_file, block);
+    check(rc == 0, "Unable to touch block");
+
+    void *block_ptr;
+    rc = sky_block_get_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+    memset(block_ptr, 0, block->data_file->block_size);
+
+    block->min_object_id = 0;
+    block->max_object_id = 0;
+    block->min_timestamp = 0;
+    block->max_timestamp = 0;
+    block->spanned = false;
+    block->compressed_length = 0;
+    block->archived = false;
+    if(sky_block_read_buffer_block == block) {
+        sky_block_read_buffer_block = NULL;
+    }
+    sky_block_unload_path_refs(block);
+    sky_block_unload_zone_map(block);
+
+    rc = sky_block_save_header(block);
+    check(rc == 0, "Unable to save block header");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
 //--------------------------------------
 // Debugging
 //--------------------------------------
@@ -11,6 +11,7 @@ typedef struct sky_block sky_block;
 #include "types.h"
 #include "data_file.h"
 #include "event.h"
+#include "zone_map.h"
 
 //==============================================================================
 //
@@ -24,6 +25,39 @@ typedef struct sky_block sky_block;
 //
 // The block also stores whether it is spanned, meaning that the
 // object that it contains is stored across multiple blocks.
+//
+// A block in a version 4 data file can hold columnar paths, which are
+// expanded back into rows in place before the block is changed. Blocks are
+// filled by the length of their rows so that the expanded paths always fit.
+//
+// A block in a version 5 data file stores a 64-bit object id range in its
+// header entry and its paths store their object ids as varints.
+//
+// A block in a version 2 data file can be compressed. Compressed blocks are
+// read through a per-thread buffer that holds the decompressed data of the
+// most recently read compressed block. A compressed block is decompressed in
+// place before it is changed.
+//
+// A compressed block can also be archived, in which case its compressed data
+// is stored in the data file's archive and its slot only holds the offset of
+// that data. Archived blocks are flagged by the high bit of the compressed
+// length in their header entry. An archived block is decompressed back into
+// its slot before it is changed.
+//
+// Each block keeps an in-memory directory of the paths that it contains. The
+// directory maps each object id to the byte offset of its path within the
+// block and is sorted by object id so that a path can be found with a binary
+// search instead of walking every path before it. The directory is built the
+// first time it is needed, kept up to date as events are added and rebuilt
+// after the block is split or rewritten.
+//
+// Each block also keeps a zone map of the actions and numeric property ranges
+// of its events so that queries can skip blocks that cannot match. The zone
+// map is built the same way as the path directory. It is widened as events
+// are added and is discarded and rebuilt after the block is split.
+//
+// A snapshot's copy of a block is read through the mapping that the data file
+// had when the snapshot was pinned instead of its current mapping.
 
 
 //==============================================================================
@@ -32,7 +66,20 @@ typedef struct sky_block sky_block;
 //
 //==============================================================================
 
-#define SKY_BLOCK_HEADER_SIZE (sizeof(sky_object_id_t) * 2) + (sizeof(sky_timestamp_t) * 2)
+#define SKY_BLOCK_HEADER_SIZE (sizeof(uint32_t) * 2) + (sizeof(sky_timestamp_t) * 2)
+
+#define SKY_COMPRESSED_BLOCK_HEADER_SIZE (SKY_BLOCK_HEADER_SIZE) + sizeof(uint32_t)
+
+#define SKY_WIDE_BLOCK_HEADER_SIZE (sizeof(sky_object_id_t) * 2) + (sizeof(sky_timestamp_t) * 2) + sizeof(uint32_t)
+
+#define SKY_BLOCK_ARCHIVED_FLAG 0x80000000
+
+// This structure is an entry in a block's path directory. It stores the
+// object id of a path and the offset of the path from the start of the block.
+typedef struct sky_block_path_ref {
+    sky_object_id_t object_id;
+    uint32_t offset;
+} sky_block_path_ref;
 
 struct sky_block {
     sky_data_file *data_file;
@@ -42,6 +89,21 @@ struct sky_block {
     sky_timestamp_t min_timestamp;
     sky_timestamp_t max_timestamp;
     bool spanned;
+    uint32_t compressed_length;
+    bool archived;
+    sky_block_path_ref *path_refs;
+    uint32_t path_ref_count;
+    uint32_t path_ref_capacity;
+    uint32_t data_length;
+    bool path_refs_loaded;
+    sky_zone_map zone_map;
+    bool zone_map_loaded;
+    bool dirty;
+    bool published;
+    bool shared;
+    bool retired;
+    uint32_t retired_epoch;
+    void *mapping;
 };
 
 // This structure is used for splitting blocks. It contains positional
@@ -85,6 +147,8 @@ int sky_block_unpack(sky_block *block, void *ptr, size_t *sz);
 
 int sky_block_get_header_offset(sky_block *block, off_t *offset);
 
+int sky_block_save_header(sky_block *block);
+
 int sky_block_full_update(sky_block *block);
 
 
@@ -96,6 +160,30 @@ int sky_block_get_offset(sky_block *block, size_t *offset);
 
 int sky_block_get_ptr(sky_block *block, void **ptr);
 
+int sky_block_get_data_ptr(sky_block *block, void **ptr);
+
+int sky_block_get_compressed_ptr(sky_block *block, void **ptr);
+
+
+//--------------------------------------
+// Compression
+//--------------------------------------
+
+int sky_block_compress(sky_block *block);
+
+int sky_block_decompress(sky_block *block);
+
+int sky_block_archive(sky_block *block, uint64_t offset, uint32_t length);
+
+
+//--------------------------------------
+// Columns
+//--------------------------------------
+
+int sky_block_expand_columns(sky_block *block);
+
+int sky_block_get_row_length(sky_block *block, size_t *length);
+
 
 //--------------------------------------
 // Spanning
@@ -104,6 +192,30 @@ int sky_block_get_ptr(sky_block *block, void **ptr);
 int sky_block_get_span_count(sky_block *block, uint32_t *count);
 
 
+//--------------------------------------
+// Path Directory
+//--------------------------------------
+
+int sky_block_load_path_refs(sky_block *block);
+
+void sky_block_unload_path_refs(sky_block *block);
+
+int sky_block_get_path_ptr(sky_block *block, sky_object_id_t object_id,
+    void **path_ptr);
+
+
+//--------------------------------------
+// Zone Map
+//--------------------------------------
+
+int sky_block_load_zone_map(sky_block *block);
+
+void sky_block_unload_zone_map(sky_block *block);
+
+int sky_block_matches(sky_block *block, sky_zone_map_predicate *predicate,
+    bool *match);
+
+
 //--------------------------------------
 // Stats
 //--------------------------------------
@@ -118,6 +230,18 @@ int sky_block_get_path_stats(sky_block *block, sky_event *event,
 
 int sky_block_add_event(sky_block *block, sky_event *event);
 
+int sky_block_add_events(sky_block *block, sky_event **events,
+    uint32_t event_count, bool *added);
+
+
+//--------------------------------------
+// Retention
+//--------------------------------------
+
+int sky_block_expire(sky_block *block, sky_timestamp_t timestamp);
+
+int sky_block_clear(sky_block *block);
+
 
 //--------------------------------------
 // Debugging
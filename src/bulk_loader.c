@@ -0,0 +1,603 @@
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "dbg.h"
+#include "mem.h"
+#include "bstring.h"
+#include "block.h"
+#include "path.h"
+#include "path_iterator.h"
+#include "cursor.h"
+#include "columnar.h"
+#include "bulk_loader.h"
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+int sky_bulk_loader_write_path(sky_bulk_loader *loader);
+
+int sky_bulk_loader_write_block(sky_bulk_loader *loader);
+
+int sky_bulk_loader_append_path(sky_bulk_loader *loader, void *ptr,
+    size_t sz, sky_timestamp_t base);
+
+int sky_bulk_loader_pack_columns(sky_bulk_loader *loader);
+
+bool sky_bulk_loader_is_wide(sky_bulk_loader *loader);
+
+size_t sky_bulk_loader_sizeof_hdr(sky_bulk_loader *loader);
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a bulk loader.
+//
+// Returns a reference to the new bulk loader if successful. Otherwise returns
+// null.
+sky_bulk_loader *sky_bulk_loader_create()
+{
+    sky_bulk_loader *loader = calloc(sizeof(sky_bulk_loader), 1);
+    check_mem(loader);
+    loader->version = SKY_DATA_FILE_RAW_VERSION;
+    loader->block_size = SKY_DEFAULT_BLOCK_SIZE;
+    loader->fill_factor = SKY_BULK_LOADER_DEFAULT_FILL_FACTOR;
+    return loader;
+
+error:
+    sky_bulk_loader_free(loader);
+    return NULL;
+}
+
+// Removes a bulk loader from memory. Any open files are closed without
+// writing the pending path.
+//
+// loader - The bulk loader to free.
+void sky_bulk_loader_free(sky_bulk_loader *loader)
+{
+    if(loader) {
+        if(loader->path) bdestroy(loader->path);
+        loader->path = NULL;
+        if(loader->header_path) bdestroy(loader->header_path);
+        loader->header_path = NULL;
+        if(loader->data_file) fclose(loader->data_file);
+        loader->data_file = NULL;
+        if(loader->header_file) fclose(loader->header_file);
+        loader->header_file = NULL;
+        free(loader->block_data);
+        loader->block_data = NULL;
+        free(loader->path_data);
+        loader->path_data = NULL;
+        free(loader);
+    }
+}
+
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+// Creates the data file and header file that the bulk loader writes to. Any
+// existing files at these paths are replaced.
+//
+// loader - The bulk loader.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_bulk_loader_open(sky_bulk_loader *loader)
+{
+    int rc;
+    check(loader != NULL, "Bulk loader required");
+    check(loader->path != NULL, "Data file path required");
+    check(loader->header_path != NULL, "Header file path required");
+    check(loader->data_file == NULL, "Bulk loader is already open");
+    check(loader->version >= SKY_DATA_FILE_RAW_VERSION && loader->version <= SKY_DATA_FILE_VERSION, "Unsupported data file version: %d", loader->version);
+    check(loader->block_size > SKY_PATH_HEADER_LENGTH, "Invalid block size: %d", loader->block_size);
+    check(loader->fill_factor > 0 && loader->fill_factor <= 1, "Fill factor must be greater than 0 and at most 1");
+
+    // Open files.
+    loader->data_file = fopen(bdata(loader->path), "w");
+    check(loader->data_file != NULL, "Unable to open data file: %s", bdata(loader->path));
+    loader->header_file = fopen(bdata(loader->header_path), "w");
+    check(loader->header_file != NULL, "Unable to open header file: %s", bdata(loader->header_path));
+
+    // Write database format version, block size and LSN.
+    rc = fwrite(&loader->version, sizeof(loader->version), 1, loader->header_file);
+    check(rc == 1, "Unable to write version");
+    rc = fwrite(&loader->block_size, sizeof(loader->block_size), 1, loader->header_file);
+    check(rc == 1, "Unable to write block size");
+    if(loader->version >= SKY_DATA_FILE_LSN_VERSION) {
+        rc = fwrite(&loader->lsn, sizeof(loader->lsn), 1, loader->header_file);
+        check(rc == 1, "Unable to write LSN");
+    }
+
+    // Allocate the block buffer.
+    loader->block_data = calloc(1, loader->block_size); check_mem(loader->block_data);
+    loader->block_data_length = 0;
+    memset(&loader->block, 0, sizeof(loader->block));
+    loader->block_count = 0;
+
+    // Reset the current path.
+    loader->object_id = 0;
+    loader->timestamp = 0;
+    loader->path_data_length = 0;
+    loader->event_count = 0;
+
+    return 0;
+
+error:
+    if(loader->data_file) fclose(loader->data_file);
+    loader->data_file = NULL;
+    if(loader->header_file) fclose(loader->header_file);
+    loader->header_file = NULL;
+    return -1;
+}
+
+// Writes any pending path and block and closes the files.
+//
+// loader - The bulk loader.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_bulk_loader_close(sky_bulk_loader *loader)
+{
+    int rc;
+    check(loader != NULL, "Bulk loader required");
+    check(loader->data_file != NULL, "Bulk loader is not open");
+
+    // Write the last path and block. A data file always has at least one
+    // block so write an empty one if nothing was loaded.
+    rc = sky_bulk_loader_write_path(loader);
+    check(rc == 0, "Unable to write path");
+    if(loader->block_data_length > 0 || loader->block_count == 0) {
+        rc = sky_bulk_loader_write_block(loader);
+        check(rc == 0, "Unable to write block");
+    }
+
+    // Close files.
+    rc = fclose(loader->data_file);
+    loader->data_file = NULL;
+    check(rc == 0, "Unable to close data file");
+    rc = fclose(loader->header_file);
+    loader->header_file = NULL;
+    check(rc == 0, "Unable to close header file");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Event Management
+//--------------------------------------
+
+// Adds an event to the bulk loader. Events must be added in order of object
+// id and then timestamp.
+//
+// loader - The bulk loader.
+// event  - The event to add.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_bulk_loader_add_event(sky_bulk_loader *loader, sky_event *event)
+{
+    int rc;
+    size_t sz;
+    check(loader != NULL, "Bulk loader required");
+    check(loader->data_file != NULL, "Bulk loader is not open");
+    check(event != NULL, "Event required");
+    check(event->object_id != 0, "Event object id required");
+    check(event->object_id > loader->object_id || (event->object_id == loader->object_id && event->timestamp >= loader->timestamp),
+        "Events must be sorted by object id and timestamp: oid:%llu, ts:%lld", (unsigned long long)event->object_id, (long long)event->timestamp);
+    check(loader->version >= SKY_DATA_FILE_WIDE_VERSION || event->object_id <= SKY_NARROW_OBJECT_ID_MAX,
+        "Object id requires a wide data file: oid:%llu", (unsigned long long)event->object_id);
+
+    // Write out the previous path when the object changes.
+    if(event->object_id != loader->object_id) {
+        rc = sky_bulk_loader_write_path(loader);
+        check(rc == 0, "Unable to write path");
+        loader->object_id = event->object_id;
+    }
+
+    // Delta encoded events are relative to the previous event in the path.
+    bool delta = (loader->version >= SKY_DATA_FILE_DELTA_VERSION);
+    bool indexed = (loader->version >= SKY_DATA_FILE_INDEXED_VERSION);
+    sky_timestamp_t base = (loader->path_data_length > 0 ? loader->timestamp : 0);
+    loader->timestamp = event->timestamp;
+
+    // Resize the path buffer if necessary.
+    size_t event_length;
+    if(indexed) {
+        event_length = sky_event_sizeof_indexed(event, base);
+    }
+    else {
+        event_length = (delta ? sky_event_sizeof_delta(event, base) : sky_event_sizeof(event));
+    }
+    check(sky_bulk_loader_sizeof_hdr(loader) + event_length <= loader->block_size, "Event is too large for block");
+    if(loader->path_data_length + event_length > loader->path_data_capacity) {
+        size_t capacity = (loader->path_data_capacity > 0 ? loader->path_data_capacity * 2 : loader->block_size);
+        while(capacity < loader->path_data_length + event_length) {
+            capacity *= 2;
+        }
+        loader->path_data = realloc(loader->path_data, capacity);
+        check_mem(loader->path_data);
+        loader->path_data_capacity = capacity;
+    }
+
+    // Append the event to the current path.
+    if(indexed) {
+        rc = sky_event_pack_indexed(event, base, loader->path_data + loader->path_data_length, &sz);
+    }
+    else if(delta) {
+        rc = sky_event_pack_delta(event, base, loader->path_data + loader->path_data_length, &sz);
+    }
+    else {
+        rc = sky_event_pack(event, loader->path_data + loader->path_data_length, &sz);
+    }
+    check(rc == 0, "Unable to pack event");
+    loader->path_data_length += sz;
+    loader->event_count++;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Adds every event in a data file to the bulk loader. Blocks are read in
+// order of object id so that the events are added in sorted order.
+//
+// loader    - The bulk loader.
+// data_file - The data file to read from.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_bulk_loader_add_data_file(sky_bulk_loader *loader,
+                                  sky_data_file *data_file)
+{
+    int rc;
+    sky_event *event = NULL;
+    check(loader != NULL, "Bulk loader required");
+    check(data_file != NULL, "Data file required");
+
+    event = sky_event_create(0, 0, 0); check_mem(event);
+
+    // Read each block separately so that every segment of a spanned path is
+    // visited.
+    uint32_t i;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_path_iterator iterator;
+        sky_path_iterator_init(&iterator);
+        rc = sky_path_iterator_set_block(&iterator, data_file->blocks[i]);
+        check(rc == 0, "Unable to set path iterator block");
+
+        while(!iterator.eof) {
+            void *path_ptr;
+            rc = sky_path_iterator_get_ptr(&iterator, &path_ptr);
+            check(rc == 0, "Unable to retrieve iterator's current pointer");
+
+            // Add each event in the path.
+            sky_cursor cursor;
+            sky_cursor_init(&cursor);
+            cursor.wide = sky_data_file_is_wide(data_file);
+            sky_cursor_set_path(&cursor, path_ptr);
+            while(!cursor.eof) {
+                rc = sky_cursor_get_event(&cursor, event);
+                check(rc == 0, "Unable to unpack event");
+                event->object_id = iterator.current_object_id;
+
+                rc = sky_bulk_loader_add_event(loader, event);
+                check(rc == 0, "Unable to add event");
+
+                rc = sky_cursor_next(&cursor);
+                check(rc == 0, "Unable to move to next event");
+            }
+
+            rc = sky_path_iterator_next(&iterator);
+            check(rc == 0, "Unable to move to next path");
+        }
+    }
+
+    sky_event_free(event);
+    return 0;
+
+error:
+    sky_event_free(event);
+    return -1;
+}
+
+
+//--------------------------------------
+// Format
+//--------------------------------------
+
+// Checks if the loader is writing wide object ids.
+//
+// loader - The bulk loader.
+//
+// Returns true if path headers store the object id as a varint.
+bool sky_bulk_loader_is_wide(sky_bulk_loader *loader)
+{
+    return (loader->version >= SKY_DATA_FILE_WIDE_VERSION);
+}
+
+// Calculates the length of the path header of the current object.
+//
+// loader - The bulk loader.
+//
+// Returns the length of the path header.
+size_t sky_bulk_loader_sizeof_hdr(sky_bulk_loader *loader)
+{
+    return sky_path_sizeof_hdr(loader->object_id, sky_bulk_loader_is_wide(loader));
+}
+
+
+//--------------------------------------
+// Block Management
+//--------------------------------------
+
+// Writes the current path into the current block. If the path doesn't fit
+// within the fill factor of the block then a new block is started. Paths that
+// are larger than the fill factor of a block are spanned across blocks.
+//
+// loader - The bulk loader.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_bulk_loader_write_path(sky_bulk_loader *loader)
+{
+    int rc;
+    check(loader != NULL, "Bulk loader required");
+
+    // Nothing to write if there is no current path.
+    if(loader->object_id == 0 || loader->path_data_length == 0) {
+        return 0;
+    }
+
+    // Determine the number of bytes to fill each block to.
+    size_t hdrlen = sky_bulk_loader_sizeof_hdr(loader);
+    size_t fill_length = (size_t)(loader->block_size * loader->fill_factor);
+    if(fill_length < hdrlen) {
+        fill_length = hdrlen;
+    }
+
+    // If the path fits in a single block then add it to the current block or
+    // start a new block if the current one is full.
+    size_t path_length = hdrlen + loader->path_data_length;
+    if(path_length <= loader->block_size) {
+        if(loader->block_data_length > 0 && loader->block_data_length + path_length > fill_length) {
+            rc = sky_bulk_loader_write_block(loader);
+            check(rc == 0, "Unable to write block");
+        }
+
+        rc = sky_bulk_loader_append_path(loader, loader->path_data, loader->path_data_length, 0);
+        check(rc == 0, "Unable to append path");
+    }
+    // Otherwise span the path across multiple blocks.
+    else {
+        if(loader->block_data_length > 0) {
+            rc = sky_bulk_loader_write_block(loader);
+            check(rc == 0, "Unable to write block");
+        }
+
+        void *ptr = loader->path_data;
+        void *endptr = loader->path_data + loader->path_data_length;
+        sky_timestamp_t base = 0;
+        while(ptr < endptr) {
+            // Find the events that fit in this block. The first event of the
+            // segment is rebased to zero when it is written.
+            void *segment_endptr = ptr;
+            sky_timestamp_t segment_base = base;
+            size_t sz = hdrlen;
+            while(segment_endptr < endptr) {
+                sky_timestamp_t timestamp;
+                sky_action_id_t action_id;
+                sky_event_data_length_t data_length;
+                rc = sky_event_unpack_hdr_delta(&timestamp, &action_id, &data_length, base, segment_endptr, NULL);
+                check(rc == 0, "Unable to unpack event header");
+
+                size_t event_length = sky_event_sizeof_raw(segment_endptr);
+                size_t length = (segment_endptr == ptr ? sky_event_sizeof_raw_rebased(segment_endptr, timestamp, 0) : event_length);
+                if(segment_endptr > ptr && sz + length > fill_length) {
+                    break;
+                }
+                sz += length;
+                segment_endptr += event_length;
+                base = timestamp;
+            }
+
+            // Write the segment into its own block.
+            rc = sky_bulk_loader_append_path(loader, ptr, segment_endptr - ptr, segment_base);
+            check(rc == 0, "Unable to append path segment");
+            loader->block.spanned = true;
+            rc = sky_bulk_loader_write_block(loader);
+            check(rc == 0, "Unable to write block");
+
+            ptr = segment_endptr;
+        }
+    }
+
+    loader->path_data_length = 0;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Appends a path for the current object to the current block and updates the
+// block's ranges. The first event is rebased to zero since each path in a
+// block starts a new sequence of delta encoded timestamps.
+//
+// loader - The bulk loader.
+// ptr    - A pointer to the event data for the path.
+// sz     - The length of the event data.
+// base   - The timestamp that the first event is relative to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_bulk_loader_append_path(sky_bulk_loader *loader, void *ptr,
+                                size_t sz, sky_timestamp_t base)
+{
+    int rc;
+    size_t hdrsz;
+    sky_timestamp_t timestamp;
+    sky_action_id_t action_id;
+    sky_event_data_length_t data_length;
+    check(sz > 0, "Path event data required");
+
+    // Determine the length of the first event once it is rebased.
+    rc = sky_event_unpack_hdr_delta(&timestamp, &action_id, &data_length, base, ptr, NULL);
+    check(rc == 0, "Unable to unpack event header");
+    size_t event_length = sky_event_sizeof_raw(ptr);
+    size_t rebased_length = sky_event_sizeof_raw_rebased(ptr, timestamp, 0);
+    size_t length = sz - event_length + rebased_length;
+    check(loader->block_data_length + sky_bulk_loader_sizeof_hdr(loader) + length <= loader->block_size, "Path is too large for block");
+
+    // Write path header and events.
+    void *block_ptr = loader->block_data + loader->block_data_length;
+    rc = sky_path_pack_hdr(loader->object_id, length, sky_bulk_loader_is_wide(loader), block_ptr, &hdrsz);
+    check(rc == 0, "Unable to pack path header");
+    rc = sky_event_rebase_raw(ptr, timestamp, 0, block_ptr + hdrsz, NULL);
+    check(rc == 0, "Unable to rebase event");
+    memcpy(block_ptr + hdrsz + rebased_length, ptr + event_length, sz - event_length);
+    loader->block_data_length += hdrsz + length;
+
+    // Update object id ranges.
+    sky_block *block = &loader->block;
+    bool is_empty = (block->min_object_id == 0 && block->max_object_id == 0);
+    if(is_empty) {
+        block->min_object_id = loader->object_id;
+    }
+    block->max_object_id = loader->object_id;
+
+    // Update timestamp ranges.
+    void *endptr = ptr + sz;
+    while(ptr < endptr) {
+        rc = sky_event_unpack_hdr_delta(&timestamp, &action_id, &data_length, base, ptr, &hdrsz);
+        check(rc == 0, "Unable to unpack event header");
+        base = timestamp;
+        if(is_empty || timestamp < block->min_timestamp) {
+            block->min_timestamp = timestamp;
+        }
+        if(is_empty || timestamp > block->max_timestamp) {
+            block->max_timestamp = timestamp;
+        }
+        is_empty = false;
+        ptr += sky_event_sizeof_raw(ptr);
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes the current block and its header entry and then starts a new block.
+//
+// loader - The bulk loader.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_bulk_loader_write_block(sky_bulk_loader *loader)
+{
+    int rc;
+    size_t sz;
+    uint8_t buffer[SKY_WIDE_BLOCK_HEADER_SIZE];
+    check(loader != NULL, "Bulk loader required");
+
+    // Store paths in columns when the version supports it.
+    if(loader->version >= SKY_DATA_FILE_COLUMNAR_VERSION) {
+        rc = sky_bulk_loader_pack_columns(loader);
+        check(rc == 0, "Unable to pack block columns");
+    }
+
+    // Write block data.
+    rc = fwrite(loader->block_data, loader->block_size, 1, loader->data_file);
+    check(rc == 1, "Unable to write block #%d", loader->block_count);
+
+    // Write block header. Blocks are written uncompressed so the compressed
+    // length is zero in files that store it. The block is packed against a
+    // data file of the loader's version so that it uses the same format.
+    sky_data_file format;
+    memset(&format, 0, sizeof(format));
+    format.version = loader->version;
+    memset(buffer, 0, sizeof(buffer));
+    loader->block.data_file = &format;
+    rc = sky_block_pack(&loader->block, buffer, &sz);
+    loader->block.data_file = NULL;
+    check(rc == 0, "Unable to pack block header");
+    size_t header_size = sky_data_file_block_header_size(loader->version);
+    rc = fwrite(buffer, header_size, 1, loader->header_file);
+    check(rc == 1, "Unable to write block header #%d", loader->block_count);
+
+    // Reset block.
+    memset(loader->block_data, 0, loader->block_size);
+    loader->block_data_length = 0;
+    memset(&loader->block, 0, sizeof(loader->block));
+    loader->block_count++;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Rewrites the paths of the current block in columns. A path is only stored
+// in columns if that makes it smaller. The block is filled by the length of
+// its rows so the space that is saved is left free.
+//
+// loader - The bulk loader.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_bulk_loader_pack_columns(sky_bulk_loader *loader)
+{
+    int rc;
+    size_t sz, hdrsz;
+    void *buffer = NULL;
+    check(loader != NULL, "Bulk loader required");
+
+    buffer = calloc(1, loader->block_size); check_mem(buffer);
+    bool wide = sky_bulk_loader_is_wide(loader);
+    size_t length = 0;
+    void *ptr = loader->block_data;
+    void *endptr = loader->block_data + loader->block_data_length;
+    while(ptr < endptr) {
+        sky_object_id_t object_id;
+        size_t hdrlen;
+        rc = sky_path_unpack_hdr(&object_id, NULL, wide, ptr, &hdrlen);
+        check(rc == 0, "Unable to unpack path header");
+        size_t path_length = sky_path_sizeof_raw(ptr, wide);
+        size_t event_data_length = path_length - hdrlen;
+
+        rc = sky_columnar_pack(ptr + hdrlen, event_data_length, NULL, &sz);
+        check(rc == 0, "Unable to measure columnar path");
+        if(sz < event_data_length) {
+            rc = sky_path_pack_hdr(object_id, sz, wide, buffer + length, &hdrsz);
+            check(rc == 0, "Unable to pack path header");
+            rc = sky_columnar_pack(ptr + hdrlen, event_data_length, buffer + length + hdrsz, &sz);
+            check(rc == 0, "Unable to pack columnar path");
+            length += hdrsz + sz;
+        }
+        else {
+            memcpy(buffer + length, ptr, path_length);
+            length += path_length;
+        }
+
+        ptr += path_length;
+    }
+
+    memcpy(loader->block_data, buffer, loader->block_size);
+    loader->block_data_length = length;
+
+    free(buffer);
+    return 0;
+
+error:
+    free(buffer);
+    return -1;
+}
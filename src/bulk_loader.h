@@ -0,0 +1,108 @@
+#ifndef _bulk_loader_h
+#define _bulk_loader_h
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_bulk_loader sky_bulk_loader;
+
+#include "bstring.h"
+#include "types.h"
+#include "event.h"
+#include "data_file.h"
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The bulk loader builds a new data file and header file from a stream of
+// events that are sorted by object id and then by timestamp. Instead of
+// inserting events one at a time and splitting blocks as they fill, the bulk
+// loader packs whole paths into blocks from the bottom up and writes each
+// block and its header entry sequentially.
+//
+// Blocks are filled up to the fill factor so that there is room left for
+// later inserts. A path that does not fit in the remaining space of a block
+// starts a new block and a path that is larger than a block is spanned
+// across as many blocks as it needs.
+//
+// Files are written as version 1 unless another version is set. Events are
+// delta encoded when the version supports it and the first event of each
+// path segment is stored relative to zero. Events with many properties are
+// also indexed in version 6 files.
+//
+// Version 4 files store each path in columns when that makes the path
+// smaller. Blocks are still filled by the length of their rows so that a
+// block can be expanded back into rows when it is changed.
+//
+// Version 7 files record the LSN that is set on the loader so that a data
+// file rewritten from another one keeps the log position it was at.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+#define SKY_BULK_LOADER_DEFAULT_FILL_FACTOR SKY_DEFAULT_FILL_FACTOR
+
+struct sky_bulk_loader {
+    bstring path;
+    bstring header_path;
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t lsn;
+    double fill_factor;
+    FILE *data_file;
+    FILE *header_file;
+    void *block_data;
+    size_t block_data_length;
+    sky_block block;
+    uint32_t block_count;
+    sky_object_id_t object_id;
+    sky_timestamp_t timestamp;
+    void *path_data;
+    size_t path_data_length;
+    size_t path_data_capacity;
+    uint64_t event_count;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_bulk_loader *sky_bulk_loader_create();
+
+void sky_bulk_loader_free(sky_bulk_loader *loader);
+
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+int sky_bulk_loader_open(sky_bulk_loader *loader);
+
+int sky_bulk_loader_close(sky_bulk_loader *loader);
+
+
+//--------------------------------------
+// Event Management
+//--------------------------------------
+
+int sky_bulk_loader_add_event(sky_bulk_loader *loader, sky_event *event);
+
+int sky_bulk_loader_add_data_file(sky_bulk_loader *loader,
+    sky_data_file *data_file);
+
+#endif
@@ -0,0 +1,906 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "mem.h"
+#include "event.h"
+#include "minipack.h"
+#include "varint.h"
+#include "columnar.h"
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// This structure is used while packing a path. It tracks whether a property
+// can be stored in a column and how many bytes it uses in the rows.
+typedef struct sky_columnar_candidate {
+    sky_property_id_t property_id;
+    int type;
+    int64_t min_value;
+    int64_t max_value;
+    uint32_t last_index;
+    size_t row_length;
+    uint8_t width;
+    bool selected;
+} sky_columnar_candidate;
+
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+int sky_columnar_get_value_type(void *ptr);
+
+uint8_t sky_columnar_get_int_width(int64_t min_value, int64_t max_value);
+
+size_t sky_columnar_sizeof_bitmap(uint32_t count);
+
+size_t sky_columnar_sizeof_column(int type, uint8_t width, uint32_t count);
+
+sky_columnar_candidate *sky_columnar_find_candidate(
+    sky_columnar_candidate *candidates, uint32_t candidate_count,
+    sky_property_id_t property_id);
+
+size_t sky_columnar_get_remaining_length(sky_columnar_candidate *candidates,
+    uint32_t candidate_count, void *ptr, size_t sz);
+
+void sky_column_set_int(sky_column *column, uint32_t index, int64_t value);
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Layout
+//--------------------------------------
+
+// Checks if the event data of a path is stored in columns.
+//
+// ptr - A pointer to the start of the event data of a path.
+// sz  - The length of the event data.
+//
+// Returns true if the path is a columnar path.
+bool sky_columnar_is_columnar(void *ptr, size_t sz)
+{
+    return (sz > 0 && *((uint8_t*)ptr) == SKY_COLUMNAR_MARKER);
+}
+
+// Initializes a view of the columns of a columnar path.
+//
+// path - The columnar path view to initialize.
+// ptr  - A pointer to the start of the event data of a path.
+// sz   - The length of the event data.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_columnar_path_init(sky_columnar_path *path, void *ptr, size_t sz)
+{
+    size_t _sz;
+    check(path != NULL, "Columnar path required");
+    check(sky_columnar_is_columnar(ptr, sz), "Path is not columnar: %p", ptr);
+
+    memset(path, 0, sizeof(*path));
+    path->endptr = ptr + sz;
+    ptr += sizeof(uint8_t);
+
+    // Read counts.
+    path->event_count = (uint32_t)sky_varint_unpack(ptr, &_sz);
+    ptr += _sz;
+    path->column_count = (uint32_t)sky_varint_unpack(ptr, &_sz);
+    ptr += _sz;
+    check(path->column_count <= SKY_COLUMNAR_MAX_COLUMNS, "Too many columns in path: %d", path->column_count);
+    path->timestamps_length = (size_t)sky_varint_unpack(ptr, &_sz);
+    ptr += _sz;
+    size_t data_length = (size_t)sky_varint_unpack(ptr, &_sz);
+    ptr += _sz;
+
+    // Locate timestamp and action columns.
+    path->timestamps = ptr;
+    ptr += path->timestamps_length;
+    path->action_ids = ptr;
+    ptr += path->event_count * sizeof(sky_action_id_t);
+
+    // Locate property columns.
+    uint32_t i;
+    for(i=0; i<path->column_count; i++) {
+        sky_column *column = &path->columns[i];
+        column->property_id = *((sky_property_id_t*)ptr);
+        ptr += sizeof(sky_property_id_t);
+        column->type = *((uint8_t*)ptr);
+        ptr += sizeof(uint8_t);
+        column->width = *((uint8_t*)ptr);
+        ptr += sizeof(uint8_t);
+        column->count = path->event_count;
+        check(column->type == SKY_COLUMN_TYPE_INT || column->type == SKY_COLUMN_TYPE_FLOAT || column->type == SKY_COLUMN_TYPE_BOOLEAN, "Invalid column type: %d", column->type);
+
+        column->presence = ptr;
+        ptr += sky_columnar_sizeof_bitmap(path->event_count);
+        column->values = ptr;
+        if(column->type == SKY_COLUMN_TYPE_BOOLEAN) {
+            ptr += sky_columnar_sizeof_bitmap(path->event_count);
+        }
+        else {
+            ptr += column->width * path->event_count;
+        }
+    }
+
+    // The remaining data of each event follows the columns.
+    path->data = (data_length > 0 ? ptr : NULL);
+    check(ptr + data_length == path->endptr, "Invalid columnar path length");
+
+    return 0;
+
+error:
+    if(path) memset(path, 0, sizeof(*path));
+    return -1;
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Packs the row encoded events of a path into columns. The events can use the
+// fixed or the delta encoding and the first event must be relative to zero.
+// If no destination is passed then only the length of the columnar event data
+// is calculated.
+//
+// ptr     - A pointer to the row encoded event data of the path.
+// sz      - The length of the row encoded event data.
+// dest    - A pointer to where the columnar event data should be written.
+// dest_sz - A pointer to where the length of the columnar data is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_columnar_pack(void *ptr, size_t sz, void *dest, size_t *dest_sz)
+{
+    int rc;
+    size_t hdrsz, elemsz;
+    sky_timestamp_t timestamp, base;
+    sky_action_id_t action_id;
+    sky_event_data_length_t data_length;
+    sky_columnar_candidate candidates[SKY_COLUMNAR_MAX_COLUMNS];
+    uint32_t candidate_count = 0;
+    check(ptr != NULL, "Pointer required");
+    check(sz > 0, "Event data required");
+    check(dest_sz != NULL, "Length return pointer required");
+
+    // Find the properties in the path and the bytes they use in the rows.
+    uint32_t event_count = 0;
+    size_t timestamps_length = 0;
+    void *endptr = ptr + sz;
+    void *event_ptr = ptr;
+    base = 0;
+    while(event_ptr < endptr) {
+        rc = sky_event_unpack_hdr_delta(&timestamp, &action_id, &data_length, base, event_ptr, &hdrsz);
+        check(rc == 0, "Unable to unpack event header");
+        timestamps_length += sky_varint_sizeof_signed(timestamp - base);
+        base = timestamp;
+        event_count++;
+
+        void *data_ptr = event_ptr + hdrsz;
+        void *data_endptr = data_ptr + data_length;
+        while(data_ptr < data_endptr) {
+            sky_property_id_t property_id = *((sky_property_id_t*)data_ptr);
+            data_ptr += sizeof(sky_property_id_t);
+            elemsz = minipack_sizeof_elem_and_data(data_ptr);
+            check(elemsz > 0, "Invalid data found in event");
+
+            // Track the property unless there are already too many columns.
+            sky_columnar_candidate *candidate = sky_columnar_find_candidate(candidates, candidate_count, property_id);
+            if(candidate == NULL && candidate_count < SKY_COLUMNAR_MAX_COLUMNS) {
+                candidate = &candidates[candidate_count++];
+                memset(candidate, 0, sizeof(*candidate));
+                candidate->property_id = property_id;
+                candidate->type = sky_columnar_get_value_type(data_ptr);
+            }
+            if(candidate != NULL) {
+                // Properties with mixed types or that occur more than once in
+                // an event are left in the rows.
+                if(candidate->last_index == event_count || candidate->type != sky_columnar_get_value_type(data_ptr)) {
+                    candidate->type = 0;
+                }
+                else if(candidate->type == SKY_COLUMN_TYPE_INT) {
+                    int64_t value = minipack_unpack_int(data_ptr, &hdrsz);
+                    if(candidate->row_length == 0 || value < candidate->min_value) {
+                        candidate->min_value = value;
+                    }
+                    if(candidate->row_length == 0 || value > candidate->max_value) {
+                        candidate->max_value = value;
+                    }
+                }
+                candidate->last_index = event_count;
+                candidate->row_length += sizeof(sky_property_id_t) + elemsz;
+            }
+            data_ptr += elemsz;
+        }
+        event_ptr = data_endptr;
+    }
+
+    // Select the properties whose column is no larger than their rows.
+    uint32_t i, column_count = 0;
+    size_t columns_length = 0;
+    for(i=0; i<candidate_count; i++) {
+        sky_columnar_candidate *candidate = &candidates[i];
+        if(candidate->type == SKY_COLUMN_TYPE_INT) {
+            candidate->width = sky_columnar_get_int_width(candidate->min_value, candidate->max_value);
+        }
+        else if(candidate->type == SKY_COLUMN_TYPE_FLOAT) {
+            candidate->width = sizeof(double);
+        }
+        else if(candidate->type != SKY_COLUMN_TYPE_BOOLEAN) {
+            continue;
+        }
+
+        size_t column_length = sky_columnar_sizeof_column(candidate->type, candidate->width, event_count);
+        if(column_length <= candidate->row_length) {
+            candidate->selected = true;
+            columns_length += column_length;
+            column_count++;
+        }
+    }
+
+    // Determine the length of the data that is not stored in a column. The
+    // section is left out if every property is stored in a column.
+    size_t data_sz = 0;
+    bool has_remaining_data = false;
+    event_ptr = ptr;
+    while(event_ptr < endptr) {
+        rc = sky_event_unpack_hdr_delta(&timestamp, &action_id, &data_length, 0, event_ptr, &hdrsz);
+        check(rc == 0, "Unable to unpack event header");
+        size_t remaining_length = sky_columnar_get_remaining_length(candidates, candidate_count, event_ptr + hdrsz, data_length);
+        data_sz += sky_varint_sizeof(remaining_length) + remaining_length;
+        has_remaining_data = has_remaining_data || (remaining_length > 0);
+        event_ptr += hdrsz + data_length;
+    }
+    if(!has_remaining_data) {
+        data_sz = 0;
+    }
+
+    // Determine the position of each column.
+    size_t header_length = sizeof(uint8_t) + sky_varint_sizeof(event_count) + sky_varint_sizeof(column_count) + sky_varint_sizeof(timestamps_length) + sky_varint_sizeof(data_sz);
+    size_t action_ids_length = event_count * sizeof(sky_action_id_t);
+    size_t data_offset = header_length + timestamps_length + action_ids_length + columns_length;
+    *dest_sz = data_offset + data_sz;
+    if(dest == NULL) {
+        return 0;
+    }
+
+    // Write the header and the column headers.
+    memset(dest, 0, data_offset);
+    *((uint8_t*)dest) = SKY_COLUMNAR_MARKER;
+    void *hdr_ptr = dest + sizeof(uint8_t);
+    sky_varint_pack(hdr_ptr, event_count, &hdrsz);
+    hdr_ptr += hdrsz;
+    sky_varint_pack(hdr_ptr, column_count, &hdrsz);
+    hdr_ptr += hdrsz;
+    sky_varint_pack(hdr_ptr, timestamps_length, &hdrsz);
+    hdr_ptr += hdrsz;
+    sky_varint_pack(hdr_ptr, data_sz, &hdrsz);
+
+    sky_columnar_path path;
+    memset(&path, 0, sizeof(path));
+    path.event_count = event_count;
+    path.timestamps = dest + header_length;
+    path.action_ids = path.timestamps + timestamps_length;
+    void *column_ptr = path.action_ids + action_ids_length;
+    for(i=0; i<candidate_count; i++) {
+        if(candidates[i].selected) {
+            sky_column *column = &path.columns[path.column_count++];
+            column->property_id = candidates[i].property_id;
+            column->type = candidates[i].type;
+            column->width = candidates[i].width;
+            column->count = event_count;
+            *((sky_property_id_t*)column_ptr) = column->property_id;
+            *((uint8_t*)(column_ptr + sizeof(sky_property_id_t))) = (uint8_t)column->type;
+            *((uint8_t*)(column_ptr + sizeof(sky_property_id_t) + sizeof(uint8_t))) = column->width;
+            column->presence = column_ptr + sizeof(sky_property_id_t) + (sizeof(uint8_t) * 2);
+            column->values = ((void*)column->presence) + sky_columnar_sizeof_bitmap(event_count);
+            column_ptr += sky_columnar_sizeof_column(column->type, column->width, event_count);
+        }
+    }
+
+    // Write each event into the columns and append the data that is not
+    // stored in a column.
+    void *timestamp_ptr = path.timestamps;
+    void *remaining_ptr = dest + data_offset;
+    event_ptr = ptr;
+    base = 0;
+    uint32_t index = 0;
+    while(event_ptr < endptr) {
+        rc = sky_event_unpack_hdr_delta(&timestamp, &action_id, &data_length, base, event_ptr, &hdrsz);
+        check(rc == 0, "Unable to unpack event header");
+        void *data_ptr = event_ptr + hdrsz;
+        void *data_endptr = data_ptr + data_length;
+
+        // Write timestamp and action.
+        sky_varint_pack_signed(timestamp_ptr, timestamp - base, &hdrsz);
+        timestamp_ptr += hdrsz;
+        memcpy(path.action_ids + (index * sizeof(sky_action_id_t)), &action_id, sizeof(action_id));
+
+        // Write column values and the remaining data.
+        if(has_remaining_data) {
+            size_t remaining_length = sky_columnar_get_remaining_length(candidates, candidate_count, data_ptr, data_length);
+            sky_varint_pack(remaining_ptr, remaining_length, &hdrsz);
+            remaining_ptr += hdrsz;
+        }
+        void *prop_ptr = data_ptr;
+        while(prop_ptr < data_endptr) {
+            sky_property_id_t property_id = *((sky_property_id_t*)prop_ptr);
+            void *value_ptr = prop_ptr + sizeof(sky_property_id_t);
+            elemsz = minipack_sizeof_elem_and_data(value_ptr);
+            sky_column *column = sky_columnar_path_get_column(&path, property_id);
+            if(column != NULL) {
+                column->presence[index / 8] |= (1 << (index % 8));
+                if(column->type == SKY_COLUMN_TYPE_INT) {
+                    sky_column_set_int(column, index, minipack_unpack_int(value_ptr, &hdrsz));
+                }
+                else if(column->type == SKY_COLUMN_TYPE_FLOAT) {
+                    double value = minipack_unpack_double(value_ptr, &hdrsz);
+                    memcpy(column->values + (index * sizeof(double)), &value, sizeof(value));
+                }
+                else if(minipack_unpack_bool(value_ptr, &hdrsz)) {
+                    ((uint8_t*)column->values)[index / 8] |= (1 << (index % 8));
+                }
+            }
+            else {
+                memcpy(remaining_ptr, prop_ptr, sizeof(sky_property_id_t) + elemsz);
+                remaining_ptr += sizeof(sky_property_id_t) + elemsz;
+            }
+            prop_ptr = value_ptr + elemsz;
+        }
+
+        base = timestamp;
+        index++;
+        event_ptr = data_endptr;
+    }
+
+    return 0;
+
+error:
+    if(dest_sz) *dest_sz = 0;
+    return -1;
+}
+
+// Unpacks a columnar path into row encoded events. If no destination is
+// passed then only the length of the row encoded event data is calculated.
+//
+// path    - The columnar path.
+// delta   - A flag stating if the events should use the delta encoding.
+// dest    - A pointer to where the row encoded events should be written.
+// dest_sz - A pointer to where the length of the row encoded events is
+//           returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_columnar_unpack(sky_columnar_path *path, bool delta, void *dest,
+                        size_t *dest_sz)
+{
+    int rc;
+    size_t sz;
+    check(path != NULL, "Columnar path required");
+    check(dest_sz != NULL, "Length return pointer required");
+
+    size_t total = 0;
+    void *timestamp_ptr = path->timestamps;
+    void *data_ptr = path->data;
+    sky_timestamp_t timestamp = 0, base = 0;
+    uint32_t i;
+    for(i=0; i<path->event_count; i++) {
+        timestamp += sky_varint_unpack_signed(timestamp_ptr, &sz);
+        timestamp_ptr += sz;
+
+        rc = sky_columnar_pack_event(path, i, data_ptr, timestamp, delta, base, (dest != NULL ? dest + total : NULL), &sz);
+        check(rc == 0, "Unable to pack event: %d", i);
+        total += sz;
+        base = timestamp;
+
+        // Move to the remaining data of the next event.
+        if(data_ptr != NULL) {
+            uint64_t data_length = sky_varint_unpack(data_ptr, &sz);
+            data_ptr += sz + data_length;
+        }
+    }
+
+    *dest_sz = total;
+    return 0;
+
+error:
+    if(dest_sz) *dest_sz = 0;
+    return -1;
+}
+
+// Packs a single event of a columnar path as a row encoded event. If no
+// destination is passed then only the length of the event is calculated.
+//
+// path      - The columnar path.
+// index     - The index of the event in the path.
+// data_ptr  - A pointer to the remaining data of the event or NULL if the
+//             path has no remaining data.
+// timestamp - The timestamp of the event.
+// delta     - A flag stating if the event should use the delta encoding.
+// base      - The timestamp that a delta encoded event is relative to.
+// dest      - A pointer to where the event should be written.
+// dest_sz   - A pointer to where the length of the event is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_columnar_pack_event(sky_columnar_path *path, uint32_t index,
+                            void *data_ptr, sky_timestamp_t timestamp,
+                            bool delta, sky_timestamp_t base, void *dest,
+                            size_t *dest_sz)
+{
+    int rc;
+    size_t sz;
+    check(path != NULL, "Columnar path required");
+    check(index < path->event_count, "Event index out of range: %d", index);
+    check(dest_sz != NULL, "Length return pointer required");
+
+    // Determine the length of the event data.
+    sky_action_id_t action_id = sky_columnar_path_get_action_id(path, index);
+    size_t remaining_length = 0;
+    void *remaining_ptr = NULL;
+    if(data_ptr != NULL) {
+        remaining_length = (size_t)sky_varint_unpack(data_ptr, &sz);
+        remaining_ptr = data_ptr + sz;
+    }
+    size_t data_length = remaining_length;
+    uint32_t i;
+    for(i=0; i<path->column_count; i++) {
+        sky_column *column = &path->columns[i];
+        if(sky_column_is_present(column, index)) {
+            data_length += sizeof(sky_property_id_t);
+            if(column->type == SKY_COLUMN_TYPE_INT) {
+                data_length += minipack_sizeof_int(sky_column_get_int(column, index));
+            }
+            else if(column->type == SKY_COLUMN_TYPE_FLOAT) {
+                data_length += minipack_sizeof_double();
+            }
+            else {
+                data_length += minipack_sizeof_bool();
+            }
+        }
+    }
+
+    // Determine the length of the event header.
+    size_t hdr_length = sizeof(sky_event_flag_t);
+    if(delta) {
+        hdr_length += sky_varint_sizeof_signed(timestamp - base);
+        if(action_id != 0) hdr_length += sky_varint_sizeof(action_id);
+        if(data_length > 0) hdr_length += sky_varint_sizeof(data_length);
+    }
+    else {
+        hdr_length += sizeof(sky_timestamp_t);
+        if(action_id != 0) hdr_length += sizeof(sky_action_id_t);
+        if(data_length > 0) hdr_length += sizeof(sky_event_data_length_t);
+    }
+
+    // Write the event.
+    if(dest != NULL) {
+        if(delta) {
+            rc = sky_event_pack_hdr_delta(timestamp, base, action_id, (sky_event_data_length_t)data_length, dest, &sz);
+        }
+        else {
+            rc = sky_event_pack_hdr(timestamp, action_id, (sky_event_data_length_t)data_length, dest, &sz);
+        }
+        check(rc == 0 && sz == hdr_length, "Unable to pack event header");
+        void *ptr = dest + sz;
+
+        for(i=0; i<path->column_count; i++) {
+            sky_column *column = &path->columns[i];
+            if(sky_column_is_present(column, index)) {
+                *((sky_property_id_t*)ptr) = column->property_id;
+                ptr += sizeof(sky_property_id_t);
+                if(column->type == SKY_COLUMN_TYPE_INT) {
+                    minipack_pack_int(ptr, sky_column_get_int(column, index), &sz);
+                }
+                else if(column->type == SKY_COLUMN_TYPE_FLOAT) {
+                    minipack_pack_double(ptr, sky_column_get_float(column, index), &sz);
+                }
+                else {
+                    minipack_pack_bool(ptr, sky_column_get_boolean(column, index), &sz);
+                }
+                check(sz > 0, "Unable to pack column value");
+                ptr += sz;
+            }
+        }
+        if(remaining_length > 0) {
+            memcpy(ptr, remaining_ptr, remaining_length);
+        }
+    }
+
+    *dest_sz = hdr_length + data_length;
+    return 0;
+
+error:
+    if(dest_sz) *dest_sz = 0;
+    return -1;
+}
+
+
+//--------------------------------------
+// Row Access
+//--------------------------------------
+
+// Retrieves the action id of an event in a columnar path.
+//
+// path  - The columnar path.
+// index - The index of the event in the path.
+//
+// Returns the action id of the event or zero if it does not have an action.
+sky_action_id_t sky_columnar_path_get_action_id(sky_columnar_path *path,
+                                                uint32_t index)
+{
+    sky_action_id_t action_id;
+    memcpy(&action_id, path->action_ids + (index * sizeof(sky_action_id_t)), sizeof(action_id));
+    return action_id;
+}
+
+// Finds the column of a property in a columnar path.
+//
+// path        - The columnar path.
+// property_id - The property id.
+//
+// Returns the column or null if the property is not stored in a column.
+sky_column *sky_columnar_path_get_column(sky_columnar_path *path,
+                                         sky_property_id_t property_id)
+{
+    uint32_t i;
+    for(i=0; i<path->column_count; i++) {
+        if(path->columns[i].property_id == property_id) {
+            return &path->columns[i];
+        }
+    }
+    return NULL;
+}
+
+// Checks if an event has a value for the property of a column.
+//
+// column - The column.
+// index  - The index of the event in the path.
+//
+// Returns true if the event has a value.
+bool sky_column_is_present(sky_column *column, uint32_t index)
+{
+    return (column->presence[index / 8] & (1 << (index % 8))) != 0;
+}
+
+// Retrieves a value from an int column.
+//
+// column - The column.
+// index  - The index of the event in the path.
+//
+// Returns the value.
+int64_t sky_column_get_int(sky_column *column, uint32_t index)
+{
+    void *ptr = column->values + (index * column->width);
+    switch(column->width) {
+        case 1: {
+            int8_t value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+        case 2: {
+            int16_t value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+        case 4: {
+            int32_t value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+        default: {
+            int64_t value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+    }
+}
+
+// Stores a value in an int column.
+//
+// column - The column.
+// index  - The index of the event in the path.
+// value  - The value.
+void sky_column_set_int(sky_column *column, uint32_t index, int64_t value)
+{
+    void *ptr = column->values + (index * column->width);
+    switch(column->width) {
+        case 1: {
+            int8_t _value = (int8_t)value;
+            memcpy(ptr, &_value, sizeof(_value));
+            break;
+        }
+        case 2: {
+            int16_t _value = (int16_t)value;
+            memcpy(ptr, &_value, sizeof(_value));
+            break;
+        }
+        case 4: {
+            int32_t _value = (int32_t)value;
+            memcpy(ptr, &_value, sizeof(_value));
+            break;
+        }
+        default: {
+            memcpy(ptr, &value, sizeof(value));
+            break;
+        }
+    }
+}
+
+// Retrieves a value from a float column.
+//
+// column - The column.
+// index  - The index of the event in the path.
+//
+// Returns the value.
+double sky_column_get_float(sky_column *column, uint32_t index)
+{
+    double value;
+    memcpy(&value, column->values + (index * sizeof(double)), sizeof(value));
+    return value;
+}
+
+// Retrieves a value from a boolean column.
+//
+// column - The column.
+// index  - The index of the event in the path.
+//
+// Returns the value.
+bool sky_column_get_boolean(sky_column *column, uint32_t index)
+{
+    return (((uint8_t*)column->values)[index / 8] & (1 << (index % 8))) != 0;
+}
+
+
+//--------------------------------------
+// Column Readers
+//--------------------------------------
+
+// Reads the timestamps of every event in a columnar path into an array.
+//
+// path       - The columnar path.
+// timestamps - An array with room for the timestamp of every event.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_columnar_path_read_timestamps(sky_columnar_path *path,
+                                      sky_timestamp_t *timestamps)
+{
+    size_t sz;
+    check(path != NULL, "Columnar path required");
+    check(timestamps != NULL, "Timestamp array required");
+
+    void *ptr = path->timestamps;
+    sky_timestamp_t timestamp = 0;
+    uint32_t i;
+    for(i=0; i<path->event_count; i++) {
+        timestamp += sky_varint_unpack_signed(ptr, &sz);
+        timestamps[i] = timestamp;
+        ptr += sz;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Reads the action ids of every event in a columnar path into an array.
+//
+// path       - The columnar path.
+// action_ids - An array with room for the action id of every event.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_columnar_path_read_action_ids(sky_columnar_path *path,
+                                      sky_action_id_t *action_ids)
+{
+    check(path != NULL, "Columnar path required");
+    check(action_ids != NULL, "Action id array required");
+    memcpy(action_ids, path->action_ids, path->event_count * sizeof(sky_action_id_t));
+    return 0;
+
+error:
+    return -1;
+}
+
+// Reads every value of an int column into an array. Events without a value
+// are read as zero.
+//
+// column - The column.
+// values - An array with room for the value of every event.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_column_read_ints(sky_column *column, int64_t *values)
+{
+    check(column != NULL, "Column required");
+    check(column->type == SKY_COLUMN_TYPE_INT, "Column is not an int column");
+    check(values != NULL, "Value array required");
+
+    uint32_t i;
+    if(column->width == sizeof(int64_t)) {
+        memcpy(values, column->values, column->count * sizeof(int64_t));
+    }
+    else {
+        for(i=0; i<column->count; i++) {
+            values[i] = sky_column_get_int(column, i);
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Reads every value of a float column into an array. Events without a value
+// are read as zero.
+//
+// column - The column.
+// values - An array with room for the value of every event.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_column_read_floats(sky_column *column, double *values)
+{
+    check(column != NULL, "Column required");
+    check(column->type == SKY_COLUMN_TYPE_FLOAT, "Column is not a float column");
+    check(values != NULL, "Value array required");
+    memcpy(values, column->values, column->count * sizeof(double));
+    return 0;
+
+error:
+    return -1;
+}
+
+// Reads every value of a boolean column into an array. Events without a value
+// are read as false.
+//
+// column - The column.
+// values - An array with room for the value of every event.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_column_read_booleans(sky_column *column, bool *values)
+{
+    check(column != NULL, "Column required");
+    check(column->type == SKY_COLUMN_TYPE_BOOLEAN, "Column is not a boolean column");
+    check(values != NULL, "Value array required");
+
+    uint32_t i;
+    for(i=0; i<column->count; i++) {
+        values[i] = sky_column_get_boolean(column, i);
+    }
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Utility
+//--------------------------------------
+
+// Determines the column type of a packed property value.
+//
+// ptr - A pointer to the packed value.
+//
+// Returns the column type or zero if the value cannot be stored in a column.
+int sky_columnar_get_value_type(void *ptr)
+{
+    if(minipack_sizeof_int_elem(ptr) > 0) {
+        return SKY_COLUMN_TYPE_INT;
+    }
+    else if(minipack_is_double(ptr)) {
+        return SKY_COLUMN_TYPE_FLOAT;
+    }
+    else if(minipack_is_bool(ptr)) {
+        return SKY_COLUMN_TYPE_BOOLEAN;
+    }
+    else {
+        return 0;
+    }
+}
+
+// Determines the smallest width that can store every value in a range.
+//
+// min_value - The smallest value.
+// max_value - The largest value.
+//
+// Returns the width in bytes.
+uint8_t sky_columnar_get_int_width(int64_t min_value, int64_t max_value)
+{
+    if(min_value >= INT8_MIN && max_value <= INT8_MAX) {
+        return sizeof(int8_t);
+    }
+    else if(min_value >= INT16_MIN && max_value <= INT16_MAX) {
+        return sizeof(int16_t);
+    }
+    else if(min_value >= INT32_MIN && max_value <= INT32_MAX) {
+        return sizeof(int32_t);
+    }
+    else {
+        return sizeof(int64_t);
+    }
+}
+
+// Calculates the number of bytes needed for a bitmap with one bit per event.
+//
+// count - The number of events.
+//
+// Returns the number of bytes.
+size_t sky_columnar_sizeof_bitmap(uint32_t count)
+{
+    return (count + 7) / 8;
+}
+
+// Calculates the number of bytes needed for a property column, including its
+// header and presence bitmap.
+//
+// type  - The column type.
+// width - The width of each value.
+// count - The number of events.
+//
+// Returns the number of bytes.
+size_t sky_columnar_sizeof_column(int type, uint8_t width, uint32_t count)
+{
+    size_t sz = sizeof(sky_property_id_t) + (sizeof(uint8_t) * 2);
+    sz += sky_columnar_sizeof_bitmap(count);
+    if(type == SKY_COLUMN_TYPE_BOOLEAN) {
+        sz += sky_columnar_sizeof_bitmap(count);
+    }
+    else {
+        sz += width * count;
+    }
+    return sz;
+}
+
+// Finds the tracking information for a property while a path is packed.
+//
+// candidates      - The properties found so far.
+// candidate_count - The number of properties found so far.
+// property_id     - The property id.
+//
+// Returns the tracking information or null if the property was not found.
+sky_columnar_candidate *sky_columnar_find_candidate(
+    sky_columnar_candidate *candidates, uint32_t candidate_count,
+    sky_property_id_t property_id)
+{
+    uint32_t i;
+    for(i=0; i<candidate_count; i++) {
+        if(candidates[i].property_id == property_id) {
+            return &candidates[i];
+        }
+    }
+    return NULL;
+}
+
+// Calculates the length of the properties of an event that are not stored in
+// a column.
+//
+// candidates      - The properties found in the path.
+// candidate_count - The number of properties found in the path.
+// ptr             - A pointer to the data section of the event.
+// sz              - The length of the data section.
+//
+// Returns the number of bytes.
+size_t sky_columnar_get_remaining_length(sky_columnar_candidate *candidates,
+                                         uint32_t candidate_count, void *ptr,
+                                         size_t sz)
+{
+    size_t length = 0;
+    void *endptr = ptr + sz;
+    while(ptr < endptr) {
+        sky_columnar_candidate *candidate = sky_columnar_find_candidate(candidates, candidate_count, *((sky_property_id_t*)ptr));
+        size_t elemsz = sizeof(sky_property_id_t) + minipack_sizeof_elem_and_data(ptr + sizeof(sky_property_id_t));
+        if(candidate == NULL || !candidate->selected) {
+            length += elemsz;
+        }
+        ptr += elemsz;
+    }
+    return length;
+}
@@ -0,0 +1,155 @@
+#ifndef _columnar_h
+#define _columnar_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "types.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A columnar path stores the events of a path as a set of column segments
+// instead of one row after another. Timestamps, action ids and each int, float
+// and boolean property are stored in their own column so that a query that
+// only needs the action ids or a single property reads just those columns.
+//
+// The event data of a columnar path starts with a marker byte that is never a
+// valid event flag so that readers can tell the two layouts apart. The marker
+// is followed by:
+//
+//   1. The event count, the property column count, the length of the
+//      timestamp column and the length of the remaining data as varints.
+//
+//   2. The timestamp column. Each timestamp is a zigzag varint offset from
+//      the previous timestamp in the path. The first is relative to zero.
+//
+//   3. The action id column. Each action id is stored as a fixed-width
+//      integer and events without an action have an action id of zero.
+//
+//   4. The property columns. Each column has a header with its property id,
+//      its type and the width of its values followed by a presence bitmap and
+//      one fixed-width value per event. Int values use the smallest width
+//      that fits every value in the column. Boolean values are stored as a
+//      second bitmap.
+//
+//   5. The remaining data of each event as a varint length and the packed
+//      properties that are not stored in a column, such as strings. This
+//      section is left out if every property is stored in a column.
+//
+// A property is only stored in a column if it always has the same type in the
+// path and the column is no larger than storing the property in each event.
+// A path is only stored in columns if the result is smaller than its rows.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+#define SKY_COLUMNAR_MARKER 0x80
+
+#define SKY_COLUMNAR_MAX_COLUMNS 32
+
+typedef enum {
+    SKY_COLUMN_TYPE_INT = 1,
+    SKY_COLUMN_TYPE_FLOAT = 2,
+    SKY_COLUMN_TYPE_BOOLEAN = 3,
+} sky_column_type_e;
+
+// A property column within a columnar path. Values of events that do not
+// have the property are zero.
+typedef struct sky_column {
+    sky_property_id_t property_id;
+    sky_column_type_e type;
+    uint8_t width;
+    uint32_t count;
+    uint8_t *presence;
+    void *values;
+} sky_column;
+
+// A view of the columns of a columnar path. The view points into the raw
+// path data and does not copy any values.
+typedef struct sky_columnar_path {
+    uint32_t event_count;
+    void *timestamps;
+    size_t timestamps_length;
+    void *action_ids;
+    uint32_t column_count;
+    sky_column columns[SKY_COLUMNAR_MAX_COLUMNS];
+    void *data;
+    void *endptr;
+} sky_columnar_path;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Layout
+//--------------------------------------
+
+bool sky_columnar_is_columnar(void *ptr, size_t sz);
+
+int sky_columnar_path_init(sky_columnar_path *path, void *ptr, size_t sz);
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+int sky_columnar_pack(void *ptr, size_t sz, void *dest, size_t *dest_sz);
+
+int sky_columnar_unpack(sky_columnar_path *path, bool delta, void *dest,
+    size_t *dest_sz);
+
+int sky_columnar_pack_event(sky_columnar_path *path, uint32_t index,
+    void *data_ptr, sky_timestamp_t timestamp, bool delta,
+    sky_timestamp_t base, void *dest, size_t *dest_sz);
+
+
+//--------------------------------------
+// Row Access
+//--------------------------------------
+
+sky_action_id_t sky_columnar_path_get_action_id(sky_columnar_path *path,
+    uint32_t index);
+
+sky_column *sky_columnar_path_get_column(sky_columnar_path *path,
+    sky_property_id_t property_id);
+
+bool sky_column_is_present(sky_column *column, uint32_t index);
+
+int64_t sky_column_get_int(sky_column *column, uint32_t index);
+
+double sky_column_get_float(sky_column *column, uint32_t index);
+
+bool sky_column_get_boolean(sky_column *column, uint32_t index);
+
+
+//--------------------------------------
+// Column Readers
+//--------------------------------------
+
+int sky_columnar_path_read_timestamps(sky_columnar_path *path,
+    sky_timestamp_t *timestamps);
+
+int sky_columnar_path_read_action_ids(sky_columnar_path *path,
+    sky_action_id_t *action_ids);
+
+int sky_column_read_ints(sky_column *column, int64_t *values);
+
+int sky_column_read_floats(sky_column *column, double *values);
+
+int sky_column_read_booleans(sky_column *column, bool *values);
+
+#endif
@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "compression.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+// Compresses a range of bytes. If the compressed data does not fit in the
+// destination then the returned size is zero.
+//
+// src         - A pointer to the data to compress.
+// src_length  - The number of bytes to compress.
+// dest        - A pointer to where the compressed data should be written.
+// dest_length - The number of bytes available at the destination.
+// sz          - A pointer to where the compressed length is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_compress(void *src, size_t src_length, void *dest,
+                 size_t dest_length, size_t *sz)
+{
+    check(src != NULL || src_length == 0, "Source required");
+    check(dest != NULL, "Destination required");
+    check(sz != NULL, "Size return address required");
+
+    uint8_t *in = (uint8_t*)src;
+    uint8_t *in_end = in + src_length;
+    uint8_t *ip = in;
+    uint8_t *out = (uint8_t*)dest;
+    uint8_t *out_end = out + dest_length;
+    uint8_t *op = out;
+
+    // Positions are stored plus one so that zero means no position.
+    uint32_t table[1 << SKY_COMPRESSION_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    *sz = 0;
+    if(src_length == 0) {
+        return 0;
+    }
+
+    // Reserve the control byte for the first literal run.
+    if(op >= out_end) return 0;
+    uint8_t *ctrl = op++;
+    uint32_t literal_length = 0;
+
+    while(ip < in_end) {
+        // Look up the last position of the next three bytes.
+        uint8_t *ref = NULL;
+        if(ip + 2 < in_end) {
+            uint32_t value = (ip[0] << 16) | (ip[1] << 8) | ip[2];
+            uint32_t hash = (value * 2654435761U) >> (32 - SKY_COMPRESSION_HASH_BITS);
+            if(table[hash] > 0) {
+                ref = in + table[hash] - 1;
+            }
+            table[hash] = (ip - in) + 1;
+        }
+
+        // Write a back reference if the bytes match a recent position.
+        size_t offset = (ref != NULL ? (size_t)(ip - ref - 1) : 0);
+        if(ref != NULL && offset < SKY_COMPRESSION_MAX_OFFSET && ref[0] == ip[0] && ref[1] == ip[1] && ref[2] == ip[2]) {
+            size_t max_length = in_end - ip;
+            if(max_length > SKY_COMPRESSION_MAX_MATCH_LENGTH) {
+                max_length = SKY_COMPRESSION_MAX_MATCH_LENGTH;
+            }
+            size_t length = 3;
+            while(length < max_length && ref[length] == ip[length]) {
+                length++;
+            }
+
+            // Close the current literal run or drop its unused control byte.
+            if(literal_length > 0) {
+                *ctrl = literal_length - 1;
+            }
+            else {
+                op--;
+            }
+
+            // Write the reference followed by the next literal control byte.
+            size_t encoded_length = length - 2;
+            if(op + (encoded_length < 7 ? 3 : 4) > out_end) return 0;
+            if(encoded_length < 7) {
+                *op++ = (encoded_length << 5) | (offset >> 8);
+            }
+            else {
+                *op++ = (7 << 5) | (offset >> 8);
+                *op++ = encoded_length - 7;
+            }
+            *op++ = offset & 0xFF;
+            ip += length;
+
+            ctrl = op++;
+            literal_length = 0;
+        }
+        // Otherwise copy the byte as a literal.
+        else {
+            if(op >= out_end) return 0;
+            *op++ = *ip++;
+            literal_length++;
+
+            if(literal_length == SKY_COMPRESSION_MAX_LITERAL_LENGTH) {
+                *ctrl = literal_length - 1;
+                if(op >= out_end) return 0;
+                ctrl = op++;
+                literal_length = 0;
+            }
+        }
+    }
+
+    // Close the final literal run.
+    if(literal_length > 0) {
+        *ctrl = literal_length - 1;
+    }
+    else {
+        op--;
+    }
+
+    *sz = op - out;
+    return 0;
+
+error:
+    if(sz) *sz = 0;
+    return -1;
+}
+
+// Decompresses a range of bytes that was compressed with sky_compress().
+//
+// src         - A pointer to the compressed data.
+// src_length  - The number of compressed bytes.
+// dest        - A pointer to where the decompressed data should be written.
+// dest_length - The number of bytes available at the destination.
+// sz          - A pointer to where the decompressed length is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_decompress(void *src, size_t src_length, void *dest,
+                   size_t dest_length, size_t *sz)
+{
+    check(src != NULL || src_length == 0, "Source required");
+    check(dest != NULL, "Destination required");
+    check(sz != NULL, "Size return address required");
+
+    uint8_t *ip = (uint8_t*)src;
+    uint8_t *in_end = ip + src_length;
+    uint8_t *out = (uint8_t*)dest;
+    uint8_t *out_end = out + dest_length;
+    uint8_t *op = out;
+
+    while(ip < in_end) {
+        uint32_t ctrl = *ip++;
+
+        // Copy a literal run.
+        if(ctrl < 32) {
+            size_t length = ctrl + 1;
+            check(ip + length <= in_end, "Compressed literal run is truncated");
+            check(op + length <= out_end, "Decompressed data is too large");
+            memcpy(op, ip, length);
+            ip += length;
+            op += length;
+        }
+        // Copy a back reference. The ranges can overlap so copy bytewise.
+        else {
+            size_t length = ctrl >> 5;
+            if(length == 7) {
+                check(ip < in_end, "Compressed reference is truncated");
+                length += *ip++;
+            }
+            length += 2;
+            check(ip < in_end, "Compressed reference is truncated");
+            size_t offset = ((ctrl & 0x1F) << 8) | *ip++;
+            check(op - out > (ptrdiff_t)offset, "Compressed reference is out of range");
+            check(op + length <= out_end, "Decompressed data is too large");
+            uint8_t *ref = op - offset - 1;
+            while(length--) {
+                *op++ = *ref++;
+            }
+        }
+    }
+
+    *sz = op - out;
+    return 0;
+
+error:
+    if(sz) *sz = 0;
+    return -1;
+}
@@ -0,0 +1,54 @@
+#ifndef _compression_h
+#define _compression_h
+
+#include <inttypes.h>
+#include <stddef.h>
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// This file provides a small LZ77 codec that is used to compress blocks. The
+// compressed stream is a sequence of literal runs and back references. Each
+// item starts with a control byte:
+//
+//     000LLLLL                     - A run of L+1 literal bytes follows.
+//     LLLOOOOO OOOOOOOO            - A back reference of L+2 bytes.
+//     111OOOOO LLLLLLLL OOOOOOOO   - A back reference of L+9 bytes.
+//
+// The offset of a back reference is the distance from the current output
+// position minus one. The codec favors speed over ratio since blocks are
+// decompressed every time they are scanned.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+#define SKY_COMPRESSION_HASH_BITS 13
+
+#define SKY_COMPRESSION_MAX_LITERAL_LENGTH 32
+
+#define SKY_COMPRESSION_MAX_OFFSET 8192
+
+#define SKY_COMPRESSION_MAX_MATCH_LENGTH (7 + 255 + 2)
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+int sky_compress(void *src, size_t src_length, void *dest,
+    size_t dest_length, size_t *sz);
+
+int sky_decompress(void *src, size_t src_length, void *dest,
+    size_t dest_length, size_t *sz);
+
+#endif
@@ -1,6 +1,7 @@
 #include "cursor.h"
 #include "path.h"
 #include "event.h"
+#include "varint.h"
 #include "mem.h"
 #include "dbg.h"
 
@@ -13,6 +14,9 @@
 
 int sky_cursor_set_ptr(sky_cursor *cursor, void *ptr);
 int sky_cursor_set_eof(sky_cursor *cursor);
+void sky_cursor_read_timestamp(sky_cursor *cursor, sky_timestamp_t base);
+int sky_cursor_select_source(sky_cursor *cursor);
+void sky_cursor_free_sources(sky_cursor *cursor);
 
 
 //==============================================================================
@@ -52,6 +56,19 @@ void sky_cursor_init(sky_cursor *cursor)
     memset(cursor, 0, sizeof(sky_cursor));
 }
 
+// Releases the paths and sources of a cursor that was initialized in place
+// and resets it.
+//
+// cursor - The cursor.
+void sky_cursor_uninit(sky_cursor *cursor)
+{
+    if(cursor) {
+        if(cursor->paths) free(cursor->paths);
+        sky_cursor_free_sources(cursor);
+        sky_cursor_init(cursor);
+    }
+}
+
 // Removes a cursor reference from memory.
 //
 // cursor - The cursor to free.
@@ -59,10 +76,26 @@ void sky_cursor_free(sky_cursor *cursor)
 {
     if(cursor) {
         if(cursor->paths) free(cursor->paths);
+        sky_cursor_free_sources(cursor);
         free(cursor);
     }
 }
 
+// Frees the cursors of each source of a merged cursor.
+//
+// cursor - The cursor.
+void sky_cursor_free_sources(sky_cursor *cursor)
+{
+    uint32_t i;
+    for(i=0; i<cursor->source_count; i++) {
+        if(cursor->sources[i].paths) free(cursor->sources[i].paths);
+    }
+    if(cursor->sources) free(cursor->sources);
+    cursor->sources = NULL;
+    cursor->source_count = 0;
+    cursor->source = NULL;
+}
+
 
 //--------------------------------------
 // Path Management
@@ -100,7 +133,8 @@ error:
     return -1;
 }
 
-// Assigns a list of path pointers to the cursor.
+// Assigns a list of path pointers to the cursor. Any sources that were
+// added to the cursor are removed.
 // 
 // cursor - The cursor.
 // ptrs   - An array to pointers of raw paths.
@@ -111,16 +145,18 @@ int sky_cursor_set_paths(sky_cursor *cursor, void **ptrs, int count)
     int rc;
     check(cursor != NULL, "Cursor required");
     
-    // Free old path list.
+    // Free old path list and sources.
     if(cursor->paths != NULL) {
         free(cursor->paths);
     }
+    sky_cursor_free_sources(cursor);
 
     // Assign path data list.
     cursor->paths = ptrs;
     cursor->path_count = count;
     cursor->path_index = 0;
     cursor->event_index = 0;
+    cursor->windowed = false;
     cursor->eof = (count == 0);
     
     // Position the pointer at the first path if paths are passed.
@@ -141,6 +177,85 @@ error:
 }
 
 
+// Adds a source to a merged cursor. The source is a list of the segments of
+// the path where the source stores it and the cursor takes ownership of the
+// list. The cursor is positioned at the earliest event of all of its sources
+// so sources must be added before the cursor is moved.
+//
+// cursor - The cursor.
+// ptrs   - An array of pointers to the raw path segments of the source.
+// count  - The number of segments.
+// wide   - A flag stating if the source's path headers have wide object ids.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_add_source(sky_cursor *cursor, void **ptrs, int count,
+                          bool wide)
+{
+    int rc;
+    check(cursor != NULL, "Cursor required");
+    check(cursor->paths == NULL, "Cursor already has paths");
+
+    // Add a cursor for the source.
+    sky_cursor *sources = realloc(cursor->sources, sizeof(*sources) * (cursor->source_count+1));
+    check_mem(sources);
+    cursor->sources = sources;
+    sky_cursor *source = &cursor->sources[cursor->source_count];
+    sky_cursor_init(source);
+    source->wide = wide;
+    cursor->source_count++;
+    rc = sky_cursor_set_paths(source, ptrs, count);
+    check(rc == 0, "Unable to set source paths");
+
+    // Move to the first event of the merged path.
+    cursor->event_index = 0;
+    cursor->windowed = false;
+    rc = sky_cursor_select_source(cursor);
+    check(rc == 0, "Unable to select source");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+// Limits the cursor to the events from a start timestamp up to but not
+// including an end timestamp. The cursor is moved to the first event in the
+// window or to EOF if there is none. The window is removed when new paths are
+// assigned to the cursor.
+//
+// cursor - The cursor.
+// start  - The first timestamp in the window.
+// end    - The timestamp after the window.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_set_window(sky_cursor *cursor, sky_timestamp_t start,
+                          sky_timestamp_t end)
+{
+    int rc;
+    check(cursor != NULL, "Cursor required");
+
+    cursor->windowed = false;
+    while(!cursor->eof && cursor->timestamp < start) {
+        rc = sky_cursor_next(cursor);
+        check(rc == 0, "Unable to move to start of window");
+    }
+
+    cursor->windowed = true;
+    cursor->window_start = start;
+    cursor->window_end = end;
+    if(!cursor->eof && cursor->timestamp >= end) {
+        rc = sky_cursor_set_eof(cursor);
+        check(rc == 0, "Unable to set EOF on cursor");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
 //--------------------------------------
 // Pointer Management
 //--------------------------------------
@@ -156,9 +271,27 @@ int sky_cursor_set_ptr(sky_cursor *cursor, void *ptr)
     check(cursor != NULL, "Cursor required");
     check(ptr != NULL, "Pointer required");
     
+    int rc;
+
     // Store position of first event and store position of end of path.
-    cursor->ptr    = ptr + SKY_PATH_HEADER_LENGTH;
-    cursor->endptr = ptr + sky_path_sizeof_raw(ptr);
+    cursor->ptr    = ptr + sky_path_sizeof_raw_hdr(ptr, cursor->wide);
+    cursor->endptr = ptr + sky_path_sizeof_raw(ptr, cursor->wide);
+    cursor->row_index = 0;
+
+    // Columnar paths are iterated over their timestamp column.
+    cursor->columnar = sky_columnar_is_columnar(cursor->ptr, cursor->endptr - cursor->ptr);
+    if(cursor->columnar) {
+        rc = sky_columnar_path_init(&cursor->columnar_path, cursor->ptr, cursor->endptr - cursor->ptr);
+        check(rc == 0, "Unable to read columnar path");
+        cursor->ptr = cursor->columnar_path.timestamps;
+        cursor->endptr = cursor->ptr + cursor->columnar_path.timestamps_length;
+        cursor->data_ptr = cursor->columnar_path.data;
+    }
+
+    // The first event in a path is relative to zero.
+    if(cursor->ptr < cursor->endptr) {
+        sky_cursor_read_timestamp(cursor, 0);
+    }
     
     return 0;
 
@@ -179,29 +312,61 @@ int sky_cursor_next(sky_cursor *cursor)
     check(cursor != NULL, "Cursor required");
     check(!cursor->eof, "No more events are available");
 
-    // Move to next event.
-    size_t event_length = sky_event_sizeof_raw(cursor->ptr);
-    cursor->ptr += event_length;
-    cursor->event_index++;
-
-    // If pointer is beyond the last event then move to next path.
-    if(cursor->ptr >= cursor->endptr) {
-        cursor->path_index++;
+    // Move the current source of a merged cursor and then switch to the
+    // source with the next earliest event.
+    if(cursor->sources != NULL) {
+        rc = sky_cursor_next(cursor->source);
+        check(rc == 0, "Unable to move source cursor");
+        cursor->event_index++;
+        rc = sky_cursor_select_source(cursor);
+        check(rc == 0, "Unable to select source");
+    }
+    else {
+        // Move to next event.
+        if(cursor->columnar) {
+            size_t sz;
+            cursor->ptr += sky_varint_sizeof_raw(cursor->ptr);
+            if(cursor->data_ptr != NULL) {
+                uint64_t data_length = sky_varint_unpack(cursor->data_ptr, &sz);
+                cursor->data_ptr += sz + data_length;
+            }
+            cursor->row_index++;
+        }
+        else {
+            size_t event_length = sky_event_sizeof_raw(cursor->ptr);
+            cursor->ptr += event_length;
+        }
+        cursor->event_index++;
 
-        // Move to the next path if more paths are remaining.
-        if(cursor->path_index < cursor->path_count) {
-            rc = sky_cursor_set_ptr(cursor, cursor->paths[cursor->path_index]);
-            check(rc == 0, "Unable to set pointer to path");
+        // Read the timestamp relative to the previous event.
+        if(cursor->ptr < cursor->endptr) {
+            sky_cursor_read_timestamp(cursor, cursor->timestamp);
         }
-        // Otherwise set EOF.
+        // If pointer is beyond the last event then move to next path.
         else {
-            rc = sky_cursor_set_eof(cursor);
-            check(rc == 0, "Unable to set EOF on cursor");
+            cursor->path_index++;
+
+            // Move to the next path if more paths are remaining.
+            if(cursor->path_index < cursor->path_count) {
+                rc = sky_cursor_set_ptr(cursor, cursor->paths[cursor->path_index]);
+                check(rc == 0, "Unable to set pointer to path");
+            }
+            // Otherwise set EOF.
+            else {
+                rc = sky_cursor_set_eof(cursor);
+                check(rc == 0, "Unable to set EOF on cursor");
+            }
         }
     }
 
+    // Stop at the end of the window.
+    if(!cursor->eof && cursor->windowed && cursor->timestamp >= cursor->window_end) {
+        rc = sky_cursor_set_eof(cursor);
+        check(rc == 0, "Unable to set EOF on cursor");
+    }
+
     // Make sure that we are point at an event.
-    if(!cursor->eof) {
+    if(!cursor->eof && !cursor->columnar) {
         sky_event_flag_t flag = *((sky_event_flag_t*)cursor->ptr);
         check(flag & SKY_EVENT_FLAG_ACTION || flag & SKY_EVENT_FLAG_DATA, "Cursor pointing at invalid raw event data: %p", cursor->ptr);
     }
@@ -226,6 +391,56 @@ int sky_cursor_set_eof(sky_cursor *cursor)
     cursor->eof         = true;
     cursor->ptr         = NULL;
     cursor->endptr      = NULL;
+    cursor->timestamp   = 0;
+    cursor->columnar    = false;
+    cursor->row_index   = 0;
+    cursor->data_ptr    = NULL;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+// Points a merged cursor at the source with the earliest current event. When
+// sources have events with the same timestamp, the source that was added last
+// is chosen. The position of the source is copied to the merged cursor so
+// that it can be read in the same way as a cursor over a single source.
+//
+// cursor - The merged cursor.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_select_source(sky_cursor *cursor)
+{
+    int rc;
+    check(cursor != NULL, "Cursor required");
+
+    uint32_t i;
+    sky_cursor *source = NULL;
+    for(i=0; i<cursor->source_count; i++) {
+        sky_cursor *candidate = &cursor->sources[i];
+        if(!candidate->eof && (source == NULL || candidate->timestamp <= source->timestamp)) {
+            source = candidate;
+        }
+    }
+
+    // Set EOF once every source is exhausted.
+    cursor->source = source;
+    if(source == NULL) {
+        rc = sky_cursor_set_eof(cursor);
+        check(rc == 0, "Unable to set EOF on cursor");
+        return 0;
+    }
+
+    cursor->eof       = false;
+    cursor->ptr       = source->ptr;
+    cursor->endptr    = source->endptr;
+    cursor->timestamp = source->timestamp;
+    cursor->columnar  = source->columnar;
+    cursor->row_index = source->row_index;
+    cursor->data_ptr  = source->data_ptr;
+    cursor->wide      = source->wide;
 
     return 0;
 
@@ -238,6 +453,44 @@ error:
 // Event Management
 //--------------------------------------
 
+// Reads the timestamp of the event that the cursor is pointing at.
+//
+// cursor - The cursor.
+// base   - The timestamp of the previous event in the path.
+void sky_cursor_read_timestamp(sky_cursor *cursor, sky_timestamp_t base)
+{
+    void *ptr = cursor->ptr + sizeof(sky_event_flag_t);
+    if(cursor->columnar) {
+        cursor->timestamp = base + sky_varint_unpack_signed(cursor->ptr, NULL);
+    }
+    else if(*((sky_event_flag_t*)cursor->ptr) & SKY_EVENT_FLAG_DELTA) {
+        cursor->timestamp = base + sky_varint_unpack_signed(ptr, NULL);
+    }
+    else {
+        cursor->timestamp = *((sky_timestamp_t*)ptr);
+    }
+}
+
+// Retrieves the timestamp of the current event.
+//
+// cursor    - The cursor.
+// timestamp - A pointer to where the timestamp should be returned to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_get_timestamp(sky_cursor *cursor, sky_timestamp_t *timestamp)
+{
+    check(cursor != NULL, "Cursor required");
+    check(!cursor->eof, "Cursor cannot be EOF");
+    check(timestamp != NULL, "Timestamp return pointer required");
+
+    *timestamp = cursor->timestamp;
+    return 0;
+
+error:
+    if(timestamp) *timestamp = 0;
+    return -1;
+}
+
 // Retrieves a the action identifier of the current event.
 //
 // cursor    - The cursor.
@@ -250,8 +503,22 @@ int sky_cursor_get_action_id(sky_cursor *cursor, sky_action_id_t *action_id)
     check(!cursor->eof, "Cursor cannot be EOF");
     check(action_id != NULL, "Action id return pointer required");
 
+    // Read the event from the current source of a merged cursor.
+    if(cursor->source != NULL) {
+        cursor = cursor->source;
+    }
+
     // Retrieve the action id.
-    if(*((sky_event_flag_t*)cursor->ptr) & SKY_EVENT_FLAG_ACTION) {
+    sky_event_flag_t flag = *((sky_event_flag_t*)cursor->ptr);
+    if(cursor->columnar) {
+        *action_id = sky_columnar_path_get_action_id(&cursor->columnar_path, cursor->row_index);
+    }
+    else if(flag & SKY_EVENT_FLAG_ACTION && flag & SKY_EVENT_FLAG_DELTA) {
+        void *ptr = cursor->ptr + sizeof(sky_event_flag_t);
+        ptr += sky_varint_sizeof_raw(ptr);
+        *action_id = (sky_action_id_t)sky_varint_unpack(ptr, NULL);
+    }
+    else if(flag & SKY_EVENT_FLAG_ACTION) {
         *action_id = *((sky_action_id_t*)(cursor->ptr + sizeof(sky_event_flag_t) + sizeof(sky_timestamp_t)));
     }
     else {
@@ -266,7 +533,9 @@ error:
 }
 
 // Retrieves the pointer to where the data section of an event starts as
-// well of the length of the data.
+// well of the length of the data. The data section of an event in a columnar
+// path only contains the properties that are not stored in a column. The
+// index of an indexed event is not included.
 //
 // cursor      - The cursor.
 // data_ptr    - A pointer to where the memory location of the data starts.
@@ -281,8 +550,38 @@ int sky_cursor_get_data_ptr(sky_cursor *cursor, void **data_ptr,
     check(data_ptr != NULL, "Data return pointer required");
     check(data_length != NULL, "Data length return pointer required");
 
+    // Read the event from the current source of a merged cursor.
+    if(cursor->source != NULL) {
+        cursor = cursor->source;
+    }
+
+    // Retrieve the remaining data of an event in a columnar path.
+    sky_event_flag_t flag = *((sky_event_flag_t*)cursor->ptr);
+    if(cursor->columnar) {
+        size_t sz;
+        *data_length = (cursor->data_ptr != NULL ? (uint32_t)sky_varint_unpack(cursor->data_ptr, &sz) : 0);
+        *data_ptr = (*data_length > 0 ? cursor->data_ptr + sz : NULL);
+    }
+    // Retrieve the data section of a delta encoded event.
+    else if(flag & SKY_EVENT_FLAG_DATA && flag & SKY_EVENT_FLAG_DELTA) {
+        size_t sz;
+        void *ptr = cursor->ptr + sizeof(sky_event_flag_t);
+        ptr += sky_varint_sizeof_raw(ptr);
+        if(flag & SKY_EVENT_FLAG_ACTION) {
+            ptr += sky_varint_sizeof_raw(ptr);
+        }
+        *data_length = (uint32_t)sky_varint_unpack(ptr, &sz);
+        *data_ptr = ptr + sz;
+
+        // Skip over the index of an indexed event.
+        if(flag & SKY_EVENT_FLAG_INDEXED) {
+            size_t index_length = sky_event_sizeof_index_raw(*data_ptr);
+            *data_ptr += index_length;
+            *data_length -= index_length;
+        }
+    }
     // Retrieve the data section if this event has data.
-    if(*((sky_event_flag_t*)cursor->ptr) & SKY_EVENT_FLAG_DATA) {
+    else if(*((sky_event_flag_t*)cursor->ptr) & SKY_EVENT_FLAG_DATA) {
         // Move past the initial header (flag, timestamp, action_id).
         void *ptr = cursor->ptr;
         ptr += sizeof(sky_event_flag_t) + sizeof(sky_timestamp_t);
@@ -310,3 +609,119 @@ error:
     return -1;
 }
 
+// Retrieves the index of the current event's data section. Only indexed
+// events in row encoded paths have an index.
+//
+// cursor    - The cursor.
+// index_ptr - A pointer to where the location of the index is returned. This
+//             is set to NULL if the event is not indexed.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_get_data_index(sky_cursor *cursor, void **index_ptr)
+{
+    check(cursor != NULL, "Cursor required");
+    check(!cursor->eof, "Cursor cannot be EOF");
+    check(index_ptr != NULL, "Index return pointer required");
+
+    // Read the event from the current source of a merged cursor.
+    if(cursor->source != NULL) {
+        cursor = cursor->source;
+    }
+
+    *index_ptr = NULL;
+    sky_event_flag_t flag = *((sky_event_flag_t*)cursor->ptr);
+    if(!cursor->columnar && flag & SKY_EVENT_FLAG_INDEXED) {
+        void *ptr = cursor->ptr + sizeof(sky_event_flag_t);
+        ptr += sky_varint_sizeof_raw(ptr);
+        if(flag & SKY_EVENT_FLAG_ACTION) {
+            ptr += sky_varint_sizeof_raw(ptr);
+        }
+        ptr += sky_varint_sizeof_raw(ptr);
+        *index_ptr = ptr;
+    }
+
+    return 0;
+
+error:
+    if(index_ptr) *index_ptr = NULL;
+    return -1;
+}
+
+// Retrieves the column that stores a property in the current path. The value
+// of the current event is at the cursor's row index within the column.
+//
+// cursor      - The cursor.
+// property_id - The property id.
+// column      - A pointer to where the column should be returned to. This is
+//               NULL if the path is not columnar or if the property is not
+//               stored in a column.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_get_column(sky_cursor *cursor, sky_property_id_t property_id,
+                          sky_column **column)
+{
+    check(cursor != NULL, "Cursor required");
+    check(!cursor->eof, "Cursor cannot be EOF");
+    check(column != NULL, "Column return pointer required");
+
+    // Read the event from the current source of a merged cursor.
+    if(cursor->source != NULL) {
+        cursor = cursor->source;
+    }
+
+    *column = NULL;
+    if(cursor->columnar) {
+        *column = sky_columnar_path_get_column(&cursor->columnar_path, property_id);
+    }
+
+    return 0;
+
+error:
+    if(column) *column = NULL;
+    return -1;
+}
+
+// Unpacks the current event into an event object. Events in columnar paths
+// are combined from their columns.
+//
+// cursor - The cursor.
+// event  - The event to unpack into.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_cursor_get_event(sky_cursor *cursor, sky_event *event)
+{
+    int rc;
+    size_t sz;
+    void *buffer = NULL;
+    check(cursor != NULL, "Cursor required");
+    check(!cursor->eof, "Cursor cannot be EOF");
+    check(event != NULL, "Event required");
+
+    // Read the event from the current source of a merged cursor.
+    if(cursor->source != NULL) {
+        cursor = cursor->source;
+    }
+
+    if(cursor->columnar) {
+        sky_columnar_path *path = &cursor->columnar_path;
+        rc = sky_columnar_pack_event(path, cursor->row_index, cursor->data_ptr, cursor->timestamp, false, 0, NULL, &sz);
+        check(rc == 0, "Unable to measure columnar event");
+        buffer = malloc(sz); check_mem(buffer);
+        rc = sky_columnar_pack_event(path, cursor->row_index, cursor->data_ptr, cursor->timestamp, false, 0, buffer, &sz);
+        check(rc == 0, "Unable to pack columnar event");
+        rc = sky_event_unpack(event, buffer, &sz);
+        check(rc == 0, "Unable to unpack event");
+    }
+    else {
+        rc = sky_event_unpack(event, cursor->ptr, &sz);
+        check(rc == 0, "Unable to unpack event");
+    }
+    event->timestamp = cursor->timestamp;
+
+    free(buffer);
+    return 0;
+
+error:
+    free(buffer);
+    return -1;
+}
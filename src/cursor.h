@@ -7,6 +7,8 @@
 
 #include "bstring.h"
 #include "types.h"
+#include "event.h"
+#include "columnar.h"
 
 
 //==============================================================================
@@ -20,6 +22,29 @@
 // data file. It also abstracts away the underlying storage of the events by
 // seamlessly combining spanned blocks into a single path.
 //
+// The cursor keeps the timestamp of the current event since delta encoded
+// events only store the offset from the previous event in the path.
+//
+// Columnar paths are read one column position at a time. The properties of a
+// columnar path that are stored in columns are read with
+// sky_cursor_get_column() and only the remaining properties are returned as
+// the data section of the event.
+//
+// Paths from a data file with wide object ids have a varint object id in
+// their header. The cursor's wide flag must be set before those paths are
+// assigned to it.
+//
+// A cursor can be limited to a time window with sky_cursor_set_window(). The
+// cursor moves past the events before the window and reaches EOF at the
+// first event at or after the end of the window.
+//
+// A cursor can also merge several sources of the same path, such as the base
+// blocks of a data file and the runs that were flushed after them. Each
+// source is added with sky_cursor_add_source() and is read by its own cursor.
+// The merged cursor returns the events of every source in timestamp order.
+// Events with the same timestamp are returned from the source that was added
+// last first since later sources hold newer events.
+//
 // The current API to the cursor is simple. It provides forward-only access to
 // basic event data in a path. However, future releases will allow bidirectional
 // traversal, event search, & object state management.
@@ -38,7 +63,19 @@ typedef struct sky_cursor {
     uint32_t event_index;
     void *ptr;
     void *endptr;
+    sky_timestamp_t timestamp;
+    bool columnar;
+    sky_columnar_path columnar_path;
+    uint32_t row_index;
+    void *data_ptr;
+    bool wide;
+    bool windowed;
+    sky_timestamp_t window_start;
+    sky_timestamp_t window_end;
     bool eof;
+    struct sky_cursor *sources;
+    uint32_t source_count;
+    struct sky_cursor *source;
 } sky_cursor;
 
 
@@ -58,6 +95,8 @@ sky_cursor *sky_cursor_alloc();
 
 void sky_cursor_init(sky_cursor *);
 
+void sky_cursor_uninit(sky_cursor *cursor);
+
 void sky_cursor_free(sky_cursor *cursor);
 
 
@@ -69,6 +108,12 @@ int sky_cursor_set_path(sky_cursor *cursor, void *ptr);
 
 int sky_cursor_set_paths(sky_cursor *cursor, void **ptrs, int count);
 
+int sky_cursor_add_source(sky_cursor *cursor, void **ptrs, int count,
+    bool wide);
+
+int sky_cursor_set_window(sky_cursor *cursor, sky_timestamp_t start,
+    sky_timestamp_t end);
+
 
 //--------------------------------------
 // Iteration
@@ -81,10 +126,19 @@ int sky_cursor_next(sky_cursor *cursor);
 // Event Management
 //--------------------------------------
 
+int sky_cursor_get_timestamp(sky_cursor *cursor, sky_timestamp_t *timestamp);
+
 int sky_cursor_get_action_id(sky_cursor *cursor, sky_action_id_t *action_id);
 
 int sky_cursor_get_data_ptr(sky_cursor *cursor, void **data_ptr,
     uint32_t *data_length);
 
+int sky_cursor_get_data_index(sky_cursor *cursor, void **index_ptr);
+
+int sky_cursor_get_column(sky_cursor *cursor, sky_property_id_t property_id,
+    sky_column **column);
+
+int sky_cursor_get_event(sky_cursor *cursor, sky_event *event);
+
 
 #endif
@@ -9,6 +9,12 @@
 #include "bstring.h"
 #include "file.h"
 #include "data_file.h"
+#include "snapshot.h"
+#include "compression.h"
+#include "wal.h"
+#include "bulk_loader.h"
+#include "path_iterator.h"
+#include "cursor.h"
 
 //==============================================================================
 //
@@ -21,9 +27,77 @@ int sky_data_file_unmap(sky_data_file *data_file);
 int sky_data_file_load_header(sky_data_file *data_file);
 int sky_data_file_unload_header(sky_data_file *data_file);
 int sky_data_file_create_header(sky_data_file *data_file);
+int sky_data_file_map_header(sky_data_file *data_file);
+
+int sky_data_file_load_zone_maps(sky_data_file *data_file);
+int sky_data_file_unpack_zone_maps(sky_data_file *data_file, void *ptr,
+    size_t length);
+int sky_data_file_save_zone_maps(sky_data_file *data_file);
 
 int sky_data_file_normalize(sky_data_file *data_file);
 
+int sky_data_file_advise_mapping(sky_data_file *data_file);
+
+int sky_data_file_sync_blocks(sky_data_file *data_file);
+
+int sky_data_file_publish_header(sky_data_file *data_file);
+
+int sky_data_file_sync_lsn(sky_data_file *data_file);
+
+int sky_data_file_release_retired_blocks(sky_data_file *data_file);
+
+uint32_t sky_data_file_get_min_epoch(sky_data_file *data_file);
+
+int sky_data_file_retire_mapping(sky_data_file *data_file);
+
+void sky_data_file_release_retired_mappings(sky_data_file *data_file);
+
+int sky_data_file_clear_free_blocks(sky_data_file *data_file);
+
+uint32_t sky_data_file_get_allocated_block_count(sky_data_file *data_file);
+
+void sky_data_file_allocate(sky_data_file *data_file, size_t length);
+
+uint32_t sky_data_file_lower_bound(sky_data_file *data_file,
+    sky_object_id_t object_id);
+
+uint32_t sky_data_file_upper_bound(sky_data_file *data_file,
+    sky_object_id_t object_id);
+
+int sky_data_file_move_block(sky_data_file *data_file, uint32_t position);
+
+int sky_data_file_search_insertion_block(sky_data_file *data_file,
+    sky_event *event, sky_block **ret);
+
+int sky_data_file_load_free_blocks(sky_data_file *data_file);
+
+int sky_data_file_add_free_block(sky_data_file *data_file, sky_block *block);
+
+sky_block *sky_data_file_pop_free_block(sky_data_file *data_file);
+
+int sky_data_file_merge_blocks(sky_data_file *data_file, sky_block *block,
+    size_t block_length, sky_block *next_block, size_t next_block_length);
+
+int sky_data_file_truncate_free_blocks(sky_data_file *data_file);
+
+int sky_data_file_upgrade(sky_data_file *data_file);
+
+int sky_data_file_load_runs(sky_data_file *data_file);
+
+int sky_data_file_unload_runs(sky_data_file *data_file);
+
+int sky_data_file_count_run_events(sky_data_file *data_file,
+    sky_timestamp_t min_timestamp, uint32_t *ret);
+
+int sky_data_file_write_merge_manifest(sky_data_file *data_file,
+    uint32_t run_count);
+
+int sky_data_file_recover_merge(sky_data_file *data_file);
+
+int sky_data_file_sync_path(bstring path);
+
+int sky_data_file_sync_dir(bstring path);
+
 int compare_blocks(const void *_a, const void *_b);
 
 
@@ -46,6 +120,8 @@ sky_data_file *sky_data_file_create()
     sky_data_file *data_file = calloc(sizeof(sky_data_file), 1);
     check_mem(data_file);
     data_file->block_size = SKY_DEFAULT_BLOCK_SIZE;
+    data_file->extent_size = SKY_DEFAULT_EXTENT_SIZE;
+    check(pthread_mutex_init(&data_file->lock, NULL) == 0, "Unable to initialize data file lock");
     return data_file;
     
 error:
@@ -62,7 +138,16 @@ void sky_data_file_free(sky_data_file *data_file)
         if(data_file->path) bdestroy(data_file->path);
         data_file->path = NULL;
         sky_data_file_unload(data_file);
+        bdestroy(data_file->zone_map_path);
+        data_file->zone_map_path = NULL;
+        bdestroy(data_file->archive_path);
+        data_file->archive_path = NULL;
+        bdestroy(data_file->run_path);
+        data_file->run_path = NULL;
+        sky_memtable_free(data_file->memtable);
+        data_file->memtable = NULL;
         sky_data_file_unload_header(data_file);
+        pthread_mutex_destroy(&data_file->lock);
         free(data_file);
     }
 }
@@ -138,8 +223,13 @@ int sky_data_file_load(sky_data_file *data_file)
     check(data_file != NULL, "Data file required");
     check(data_file->path != NULL, "Data file path required");
 
-    // Load header if not loaded yet.
+    // Load header if not loaded yet. A merge of the runs that was
+    // interrupted is finished or discarded first.
     if(data_file->blocks == NULL) {
+        if(data_file->run_path != NULL) {
+            rc = sky_data_file_recover_merge(data_file);
+            check(rc == 0, "Unable to recover merge");
+        }
         rc = sky_data_file_load_header(data_file);
         check(rc == 0, "Unable to load header");
     }
@@ -147,17 +237,31 @@ int sky_data_file_load(sky_data_file *data_file)
     // There should always be at least one block.
     check(data_file->block_size > 0, "Data file should have at least one block");
     
-    // Calculate the data length.
+    // Calculate the data length and the number of blocks that the mapping
+    // has room for.
     size_t data_length = data_file->block_count * data_file->block_size;
+    uint32_t allocated_block_count = sky_data_file_get_allocated_block_count(data_file);
+    size_t capacity = allocated_block_count * data_file->block_size;
+    bool grow = (allocated_block_count != data_file->allocated_block_count);
+
+    // A mapping that snapshots read through can't be moved or unmapped so a
+    // new region is mapped beside it when it needs to grow.
+    bool retire = (grow && data_file->data != NULL && data_file->snapshot_count > 0);
+    if(retire) {
+        rc = sky_data_file_retire_mapping(data_file);
+        check(rc == 0, "Unable to retire data file mapping");
+    }
 
-    // Close mapping if remapping isn't supported.
-    if(!MREMAP_AVAILABLE) {
+    // Close mapping if it needs to grow and remapping isn't supported.
+    if(!MREMAP_AVAILABLE && grow && !retire) {
         rc = sky_data_file_unmap(data_file);
         check(rc == 0, "Unable to unmap data file");
     }
 
     // Open the data file and map it if it is not currently open.
-    if(data_file->data_fd == 0) {
+    ptr = data_file->data;
+    bool opened = (data_file->data_fd == 0);
+    if(opened) {
         data_file->data_fd = open(bdata(data_file->path), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
         check(data_file->data_fd != -1, "Failed to open data file descriptor: %s",  bdata(data_file->path));
 
@@ -165,22 +269,62 @@ int sky_data_file_load(sky_data_file *data_file)
         rc = ftruncate(data_file->data_fd, data_length);
         check(rc == 0, "Unable to truncate data file");
 
-        // Memory map the data file.
-        ptr = mmap(0, data_length, PROT_READ | PROT_WRITE, MAP_SHARED, data_file->data_fd, 0);
+        // Memory map the whole extent. Only the pages within the file can
+        // be accessed until the file is extended.
+        sky_data_file_allocate(data_file, capacity);
+        ptr = mmap(0, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, data_file->data_fd, 0);
         check(ptr != MAP_FAILED, "Unable to memory map data file");
     }
-    // If we already have the data mapped then simply remap it to the
-    // appropriate size.
+    // If we already have the data mapped then resize the file within the
+    // mapping and only remap it once the extent is full.
     else {
+        if(data_length != data_file->data_length) {
+            rc = ftruncate(data_file->data_fd, data_length);
+            check(rc == 0, "Unable to truncate data file");
+        }
+
+        if(retire) {
+            sky_data_file_allocate(data_file, capacity);
+            ptr = mmap(0, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, data_file->data_fd, 0);
+            check(ptr != MAP_FAILED, "Unable to memory map data file");
+        }
 #if MREMAP_AVAILABLE
-        ptr = mremap(data_file->data, data_file->data_length, data_length, MREMAP_MAYMOVE);
-        check(ptr != MAP_FAILED, "Unable to remap data file");
+        else if(grow) {
+            sky_data_file_allocate(data_file, capacity);
+            ptr = mremap(data_file->data, data_file->allocated_block_count * data_file->block_size, capacity, MREMAP_MAYMOVE);
+            check(ptr != MAP_FAILED, "Unable to remap data file");
+        }
 #endif
     }
 
     // Update the data file.
     data_file->data = ptr;
     data_file->data_length = data_length;
+    data_file->allocated_block_count = allocated_block_count;
+
+    // Back the mapping with huge pages if requested.
+    rc = sky_data_file_advise_mapping(data_file);
+    check(rc == 0, "Unable to advise data file mapping");
+
+    // Retired blocks may not have been cleared before the last shutdown.
+    if(opened && data_file->shadow_blocks) {
+        rc = sky_data_file_clear_free_blocks(data_file);
+        check(rc == 0, "Unable to clear free blocks");
+    }
+
+    // Open the archive that holds the data of archived blocks.
+    if(data_file->archive_path != NULL && data_file->archive == NULL) {
+        data_file->archive = sky_archive_create(); check_mem(data_file->archive);
+        data_file->archive->path = bstrcpy(data_file->archive_path); check_mem(data_file->archive->path);
+        rc = sky_archive_open(data_file->archive);
+        check(rc == 0, "Unable to open archive");
+    }
+
+    // Load the runs that were written beside the data file.
+    if(opened && data_file->run_path != NULL) {
+        rc = sky_data_file_load_runs(data_file);
+        check(rc == 0, "Unable to load runs");
+    }
 
     return 0;
 
@@ -196,11 +340,24 @@ error:
 // Returns 0 if successful, otherwise returns -1.
 int sky_data_file_unload(sky_data_file *data_file)
 {
+    // Write back pending changes.
+    sky_data_file_flush(data_file);
+
+    // Save the zone maps so they don't need to be rebuilt on the next load.
+    sky_data_file_save_zone_maps(data_file);
+
     // Unload header.
     sky_data_file_unload_header(data_file);
     
     // Unmap the data file.
     sky_data_file_unmap(data_file);
+
+    // Close the archive.
+    sky_archive_free(data_file->archive);
+    data_file->archive = NULL;
+
+    // Close the runs.
+    sky_data_file_unload_runs(data_file);
     
     return 0;
 }
@@ -214,8 +371,17 @@ int sky_data_file_unmap(sky_data_file *data_file)
 {
     // Unmap file.
     if(data_file->data != NULL) {
-        munmap(data_file->data, data_file->data_length);
+        munmap(data_file->data, data_file->allocated_block_count * data_file->block_size);
+    }
+
+    // Unmap the mappings that were kept for snapshots.
+    uint32_t i;
+    for(i=0; i<data_file->retired_mapping_count; i++) {
+        munmap(data_file->retired_mappings[i].data, data_file->retired_mappings[i].length);
     }
+    free(data_file->retired_mappings);
+    data_file->retired_mappings = NULL;
+    data_file->retired_mapping_count = 0;
     
     // Close file descriptor.
     if(data_file->data_fd != 0) {
@@ -225,425 +391,3127 @@ int sky_data_file_unmap(sky_data_file *data_file)
     data_file->data_fd = 0;
     data_file->data = NULL;
     data_file->data_length = 0;
+    data_file->allocated_block_count = 0;
     
     return 0;
 }
 
 
-//--------------------------------------
-// Header File Management
-//--------------------------------------
-
-// Loads header information for the data file.
+// Syncs all pending block and header changes to disk. Changes to the data
+// file are made in memory and are only guaranteed to be persisted after a
+// flush. Only blocks that have changed since the last flush are synced. When
+// shadow blocks are enabled the new header is published after the blocks are
+// on disk and the retired blocks are then freed.
 //
-// data_file - The data file object associated with the header file.
+// data_file - The data file to flush.
 //
 // Returns 0 if successful, otherwise returns -1.
-int sky_data_file_load_header(sky_data_file *data_file)
+int sky_data_file_flush(sky_data_file *data_file)
 {
     int rc;
-    size_t sz;
-    FILE *file;
-    uint32_t version = 1;
-    uint8_t buffer[SKY_BLOCK_HEADER_SIZE];
+    check(data_file != NULL, "Data file required");
 
-    // Unload existing header information.
-    rc = sky_data_file_unload_header(data_file);
-    check(rc == 0, "Unable to unload header");
+    // Sync block data.
+    rc = sky_data_file_sync_blocks(data_file);
+    check(rc == 0, "Unable to sync data file to disk");
 
-    // If header doesn't exist then create a new one.
-    if(!sky_file_exists(data_file->header_path)) {
-        rc = sky_data_file_create_header(data_file);
-        check(rc == 0, "Unable to create header file");
+    // Switch to the new header once all of its blocks are on disk.
+    if(data_file->shadow_blocks && data_file->header != NULL) {
+        rc = sky_data_file_publish_header(data_file);
+        check(rc == 0, "Unable to publish header");
     }
-    
-    file = fopen(bdata(data_file->header_path), "r");
-    check(file, "Failed to open header file for reading: %s",  bdata(data_file->header_path));
-
-    // Read database format version.
-    rc = fread(&version, sizeof(version), 1, file);
-    check(rc == 1, "Unable to read version");
-
-    // Read block size.
-    rc = fread(&data_file->block_size, sizeof(data_file->block_size), 1, file);
-    check(rc == 1, "Unable to read block size");
-
-    // Read blocks until end of file.
-    off_t file_length = sky_file_get_size(data_file->header_path);
-    while(ftell(file) < file_length && !feof(file)) {
-        sky_block *block = sky_block_create(data_file); check_mem(block);
-        block->index = data_file->block_count;
-
-        // Read into buffer.
-        rc = fread(buffer, SKY_BLOCK_HEADER_SIZE, 1, file);
-        check(rc == 1, "Unable to read block #%d", block->index);
-        
-        // Unpack from buffer.
-        rc = sky_block_unpack(block, buffer, &sz);
-        check(rc == 0, "Unable to unpack block #%d", block->index);
+    // Only sync the header if it has changed since the last flush.
+    else if(data_file->header != NULL && data_file->header_dirty_end > data_file->header_dirty_start) {
+        // Align the start of the dirty range to the page size.
+        long page_size = sysconf(_SC_PAGE_SIZE);
+        size_t start = data_file->header_dirty_start - (data_file->header_dirty_start % page_size);
         
-        // Append to blocks
-        data_file->block_count++;
-        data_file->blocks = realloc(data_file->blocks, sizeof(sky_block*) * data_file->block_count);
-        check_mem(data_file->blocks);
-        data_file->blocks[data_file->block_count-1] = block;
+        rc = msync(data_file->header + start, data_file->header_dirty_end - start, MS_SYNC);
+        check(rc == 0, "Unable to sync header to disk");
     }
 
-    // Close the file.
-    fclose(file);
+    data_file->header_dirty_start = 0;
+    data_file->header_dirty_end = 0;
 
-    rc = sky_data_file_normalize(data_file);
-    check(rc == 0, "Unable to normalize data file");
-    
+    // Free the retired slots that are no longer referenced.
+    if(data_file->blocks != NULL) {
+        rc = sky_data_file_release_retired_blocks(data_file);
+        check(rc == 0, "Unable to release retired blocks");
+    }
+
+    // Write the LSN once the blocks that it covers are on disk.
+    rc = sky_data_file_sync_lsn(data_file);
+    check(rc == 0, "Unable to sync LSN");
 
     return 0;
 
 error:
-    if(file) fclose(file);
-    sky_data_file_unload_header(data_file);
     return -1;
 }
 
-// Unloads header information from memory.
+
+//--------------------------------------
+// Shadow Blocks
+//--------------------------------------
+
+// Prepares a block to be changed. This must be called before the block's
+// data is changed so that the change is synced on the next flush.
 //
-// data_file - The data file object associated with the header file.
+// When shadow blocks are enabled, the first change to a published block
+// after a flush is made to a copy of the block in another slot and the
+// original slot is retired until the next flush. Spanned blocks are changed
+// in place since their order in the directory depends on their slots.
+//
+// Blocks that are shared with a pinned snapshot are always copied before
+// they change. The retired slot is kept until the snapshots that can read it
+// are released.
+//
+// Creating the copy can remap the data file so block pointers must be
+// retrieved after the block is touched.
+//
+// data_file - The data file.
+// block     - The block that is about to change.
 //
 // Returns 0 if successful, otherwise returns -1.
-int sky_data_file_unload_header(sky_data_file *data_file)
+int sky_data_file_touch_block(sky_data_file *data_file, sky_block *block)
 {
+    int rc;
     check(data_file != NULL, "Data file required");
-    
-    if(data_file->blocks) {
-        uint32_t i;
-        for(i=0; i<data_file->block_count; i++) {
-            sky_block *block = data_file->blocks[i];
-            if(block) {
-                sky_block_free(block);
-                data_file->blocks[i] = NULL;
-            }
-        }
-        free(data_file->blocks);
+    check(block != NULL, "Block required");
+
+    bool shadow = (!block->dirty && data_file->shadow_blocks && block->published && !block->spanned);
+    block->dirty = true;
+    if(!shadow && !block->shared) {
+        return 0;
     }
-    data_file->blocks = NULL;
-    data_file->block_count = 0;
-    
+
+    // Find a new slot for the block.
+    sky_block *slot = NULL;
+    rc = sky_data_file_create_block(data_file, &slot);
+    check(rc == 0, "Unable to create shadow block");
+
+    // Swap slots so that the empty block keeps the original slot. The
+    // original slot is still referenced by the header on disk if it has
+    // been published.
+    uint32_t index = slot->index;
+    slot->index = block->index;
+    slot->dirty = false;
+    slot->published = (data_file->shadow_blocks && block->published);
+    slot->retired = true;
+    slot->retired_epoch = data_file->epoch;
+    block->index = index;
+    block->published = false;
+    block->shared = false;
+
+    // Copy the data into the new slot.
+    void *ptr, *slot_ptr;
+    rc = sky_block_get_ptr(block, &ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+    rc = sky_block_get_ptr(slot, &slot_ptr);
+    check(rc == 0, "Unable to retrieve original block pointer");
+    memcpy(ptr, slot_ptr, data_file->block_size);
+
+    // Header files that aren't shadowed are updated in place.
+    rc = sky_block_save_header(block);
+    check(rc == 0, "Unable to save block header");
+    rc = sky_block_save_header(slot);
+    check(rc == 0, "Unable to save original block header");
+
+    // Keep the original slot until it is no longer referenced.
+    data_file->retired_block_count++;
+    data_file->retired_blocks = realloc(data_file->retired_blocks, sizeof(*data_file->retired_blocks) * data_file->retired_block_count);
+    check_mem(data_file->retired_blocks);
+    data_file->retired_blocks[data_file->retired_block_count-1] = slot;
+
     return 0;
-    
+
 error:
     return -1;
 }
 
-// Creates a new header file. The header file will only be created if one
-// does not already exist.
+// Syncs the blocks that have changed since the last flush. Neighboring
+// blocks are synced together.
 //
-// data_file - The data file object associated with the header file.
+// data_file - The data file.
 //
 // Returns 0 if successful, otherwise returns -1.
-int sky_data_file_create_header(sky_data_file *data_file)
+int sky_data_file_sync_blocks(sky_data_file *data_file)
 {
     int rc;
+    bool *dirty = NULL;
     check(data_file != NULL, "Data file required");
-    check(data_file->header_path != NULL, "Data file header path required");
-    check(!sky_file_exists(data_file->header_path), "Header file already exists");
 
-    // Open the file for writing.
-    FILE *file = fopen(bdata(data_file->header_path), "w");
-    check(file, "Failed to open header file for writing: %s",  bdata(data_file->header_path));
+    if(data_file->data == NULL || data_file->block_count == 0) {
+        return 0;
+    }
 
-    // Write database format version.
-    uint32_t version = SKY_DATA_FILE_VERSION;
-    rc = fwrite(&version, sizeof(version), 1, file);
-    check(rc == 1, "Unable to write version");
+    // Mark changed blocks by their slot in the file.
+    uint32_t i;
+    dirty = calloc(data_file->block_count, sizeof(*dirty)); check_mem(dirty);
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        if(block->dirty && block->index < data_file->block_count) {
+            dirty[block->index] = true;
+        }
+        block->dirty = false;
+    }
 
-    // Write block size.
-    rc = fwrite(&data_file->block_size, sizeof(data_file->block_size), 1, file);
-    check(rc == 1, "Unable to write block size");
-    
-    // Write a single empty block.
-    uint8_t *buffer[SKY_BLOCK_HEADER_SIZE];
-    memset(buffer, 0, SKY_BLOCK_HEADER_SIZE);
-    rc = fwrite(buffer, SKY_BLOCK_HEADER_SIZE, 1, file);
-    check(rc == 1, "Unable to write initial block header");
-    
-    // Close file.
-    fclose(file);
-    
+    // Sync each run of changed blocks. The start of the run is aligned to
+    // the page size.
+    long page_size = sysconf(_SC_PAGE_SIZE);
+    i = 0;
+    while(i < data_file->block_count) {
+        if(!dirty[i]) {
+            i++;
+            continue;
+        }
+
+        uint32_t j = i+1;
+        while(j < data_file->block_count && dirty[j]) {
+            j++;
+        }
+
+        size_t start = i * data_file->block_size;
+        start -= start % page_size;
+        size_t end = j * data_file->block_size;
+        rc = msync(data_file->data + start, end - start, MS_SYNC);
+        check(rc == 0, "Unable to sync blocks %d-%d", i, j-1);
+
+        i = j;
+    }
+
+    free(dirty);
     return 0;
-    
+
 error:
-    if(file) fclose(file);
+    free(dirty);
     return -1;
 }
 
-//--------------------------------------
-// Block Management
-//--------------------------------------
-
-// Appends an empty block at the end of the data file.
+// Writes the header for the current blocks to a new file and renames it over
+// the existing header file so that every block change is published at once.
+// The header is only rewritten if it has changed.
 //
 // data_file - The data file.
-// ret       - A pointer to where the new block should be returned to.
 //
 // Returns 0 if successful, otherwise returns -1.
-int sky_data_file_create_block(sky_data_file *data_file, sky_block **ret)
+int sky_data_file_publish_header(sky_data_file *data_file)
 {
     int rc;
-    
-    // Increment block count and resize block memory.
-    data_file->block_count++;
-    data_file->blocks = realloc(data_file->blocks, sizeof(sky_block*) * data_file->block_count);
-    if(data_file->block_count > 0) check_mem(data_file->blocks);
-
-    // Create new block.
-    sky_block *block = sky_block_create(data_file); check_mem(block);
-    block->index = data_file->block_count-1;
-    data_file->blocks[data_file->block_count-1] = block;
-
-    // Remap data file.
-    rc = sky_data_file_load(data_file);
-    check(rc == 0, "Unable to reload data file");
+    int fd = -1;
+    void *buffer = NULL;
+    bstring tmp_path = NULL;
+    bstring dir_path = NULL;
+    check(data_file != NULL, "Data file required");
+    check(data_file->header != NULL, "Header file must be loaded");
+
+    // Pack each block at the entry for its slot.
+    size_t header_length = sky_data_file_header_file_hdr_size(data_file->version) + (data_file->block_count * data_file->block_header_size);
+    buffer = calloc(1, header_length); check_mem(buffer);
+    *((uint32_t*)buffer) = data_file->version;
+    *((uint32_t*)(buffer + sizeof(uint32_t))) = data_file->block_size;
+    if(data_file->version >= SKY_DATA_FILE_LSN_VERSION) {
+        *((uint64_t*)(buffer + (SKY_HEADER_FILE_HDR_SIZE))) = data_file->lsn;
+    }
 
-    // Clear block.
-    void *ptr;
-    rc = sky_block_get_ptr(block, &ptr);
-    check(rc == 0, "Unable to retrieve block pointer");
-    memset(ptr, 0, data_file->block_size);
+    uint32_t i;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        off_t offset;
+        rc = sky_block_get_header_offset(block, &offset);
+        check(rc == 0, "Unable to determine block offset in header file");
+        check(offset + data_file->block_header_size <= header_length, "Block is outside of header file: %d", block->index);
+
+        size_t sz;
+        rc = sky_block_pack(block, buffer + offset, &sz);
+        check(rc == 0, "Unable to pack block header data");
+        block->published = (block->min_object_id != 0 || block->max_object_id != 0);
+    }
 
-    // Re-sort blocks.
-    qsort(data_file->blocks, data_file->block_count, sizeof(sky_block*), compare_blocks);
+    if(header_length == data_file->header_length && memcmp(buffer, data_file->header, header_length) == 0) {
+        free(buffer);
+        return 0;
+    }
 
-    // Return the new block.
-    *ret = block;
+    // Write the new header to a temporary file.
+    tmp_path = bformat("%s.tmp", bdata(data_file->header_path)); check_mem(tmp_path);
+    fd = open(bdata(tmp_path), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    check(fd != -1, "Failed to open header file: %s", bdata(tmp_path));
+    ssize_t written = write(fd, buffer, header_length);
+    check(written == (ssize_t)header_length, "Unable to write header file: %s", bdata(tmp_path));
+    rc = fsync(fd);
+    check(rc == 0, "Unable to sync header file: %s", bdata(tmp_path));
+
+    // Replace the old header and sync the directory entry.
+    rc = rename(bdata(tmp_path), bdata(data_file->header_path));
+    check(rc == 0, "Unable to replace header file: %s", bdata(data_file->header_path));
+    int pos = bstrrchr(data_file->header_path, '/');
+    dir_path = (pos != BSTR_ERR ? bmidstr(data_file->header_path, 0, (pos > 0 ? pos : 1)) : bfromcstr(".")); check_mem(dir_path);
+    int dir_fd = open(bdata(dir_path), O_RDONLY);
+    if(dir_fd != -1) {
+        fsync(dir_fd);
+        close(dir_fd);
+    }
 
+    // Map the new header in place of the old one.
+    munmap(data_file->header, data_file->header_capacity);
+    close(data_file->header_fd);
+    data_file->header_fd = fd;
+    fd = -1;
+    data_file->header = mmap(0, header_length, PROT_READ | PROT_WRITE, MAP_SHARED, data_file->header_fd, 0);
+    check(data_file->header != MAP_FAILED, "Unable to memory map header file");
+    data_file->header_length = header_length;
+    data_file->header_capacity = header_length;
+    data_file->header_dirty_start = 0;
+    data_file->header_dirty_end = 0;
+
+    bdestroy(tmp_path);
+    bdestroy(dir_path);
+    free(buffer);
     return 0;
 
 error:
+    if(fd != -1) close(fd);
+    if(data_file->header == MAP_FAILED) data_file->header = NULL;
+    bdestroy(tmp_path);
+    bdestroy(dir_path);
+    free(buffer);
     return -1;
 }
 
-// Finds the correct block to add an event to.
-//
-// Insertion has several rules to ensure consistency. There are two types of
-// blocks: single object blocks and multi-object blocks. Single object blocks
-// are spans of two or more blocks that have a single object. Multi-object
-// blocks are single blocks that have multiple object ids. An object that is
-// stored in a single block (i.e. doesn't span blocks) is considered a
-// multi-object block since there is probably room to add more objects.
-// 
-// 1. An object id range is unique to a block. If a block has object ids 5 - 8
-//    then no other block can overlap into those ids.
-//
-// 2. Only multi-object blocks can have object ids outside its range added.
-//
-// 3. Objects are added to the first block where the object id is included in
-//    the object id range or is less than the minimum object id of the block.
+// Frees the slots that were retired by shadow copies once they are no longer
+// referenced. A slot is referenced until a header that doesn't include it
+// has been published and until every snapshot pinned before it was retired
+// has been released.
 //
-// 4. If no block is found by the end then the last block is used for insertion.
-//
-// data_file - The data file that the event is being added to.
-// event     - The event to add to the table.
-// ret       - A pointer to where the insertion block is returned to.
+// data_file - The data file.
 //
-// Returns 0 if successfully finds a block. Otherwise returns -1.
-int sky_data_file_find_insertion_block(sky_data_file *data_file,
-                                       sky_event *event,
-                                       sky_block **ret)
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_release_retired_blocks(sky_data_file *data_file)
 {
     int rc;
     check(data_file != NULL, "Data file required");
-    check(event != NULL, "Event required");
-    check(event->object_id != 0, "Event object id required");
-    
-    // Initialize return value to NULL.
-    *ret = NULL;
-    
-    // Extract object id and timestamp from event.
-    sky_object_id_t object_id = event->object_id;
-    sky_timestamp_t timestamp = event->timestamp;
 
-    // Loop over sorted blocks to find the appropriate insertion point.
     uint32_t i;
-    sky_block *block = NULL;
-    for(i=0; i<data_file->block_count; i++) {
-        block = data_file->blocks[i];
-        
-        // If block is within range then use the block.
-        if(object_id >= block->min_object_id && object_id <= block->max_object_id) {
-            // If this is a single object block then find the appropriate block
-            // based on timestamp.
-            if(block->spanned) {
-                // Find first block where timestamp is before the max.
-                while(i<data_file->block_count && data_file->blocks[i]->min_object_id == object_id) {
-                    if(timestamp <= data_file->blocks[i]->max_timestamp) {
-                        *ret = block;
-                        break;
-                    }
-                    i++;
-                }
-                
-                // If this event is being appended to the object path then use
-                // the last block.
-                if(*ret == NULL) {
-                    *ret = data_file->blocks[i-1];
-                }
+    uint32_t min_epoch = sky_data_file_get_min_epoch(data_file);
 
-                break;
-            }
-            // If this is a multi-object block then simply use it.
-            else {
-                *ret = block;
-                break;
-            }
-        }
-        // If block is before this object id range, then use the block if it
-        // is a multi-object block.
-        else if(object_id < block->min_object_id && !block->spanned) {
-            *ret = block;
-            break;
+    uint32_t retired_block_count = 0;
+    for(i=0; i<data_file->retired_block_count; i++) {
+        sky_block *block = data_file->retired_blocks[i];
+
+        // Keep slots that can still be read.
+        if(block->published || block->retired_epoch >= min_epoch) {
+            data_file->retired_blocks[retired_block_count++] = block;
+            continue;
         }
+
+        void *ptr;
+        rc = sky_block_get_ptr(block, &ptr);
+        check(rc == 0, "Unable to retrieve block pointer");
+        memset(ptr, 0, data_file->block_size);
+        block->dirty = true;
+        block->retired = false;
+
+        rc = sky_data_file_add_free_block(data_file, block);
+        check(rc == 0, "Unable to add free block");
     }
-    
-    // If we haven't found a block then it means that the object id is after all
-    // other object ids or that we are inserting before a single object block or
-    // that we have no blocks.
-    if(*ret == NULL) {
-        // Find the last block if one exists.
-        sky_block *last_block = (data_file->block_count > 0 ? data_file->blocks[data_file->block_count-1] : NULL);
-        
-        // If the last block available is unspanned then use it.
-        if(last_block != NULL && !last_block->spanned) {
-            *ret = last_block;
-        }
-        // Otherwise just create a new block.
-        else {
-            rc = sky_data_file_create_block(data_file, ret);
-            check(rc == 0, "Unable to create block");
-        }
+
+    data_file->retired_block_count = retired_block_count;
+    if(retired_block_count == 0) {
+        free(data_file->retired_blocks);
+        data_file->retired_blocks = NULL;
     }
-    
+
     return 0;
 
 error:
     return -1;
 }
 
-// Updates the block information to mark blocks as spanned or not.
+// Clears the data of every free block. Retired blocks are freed in memory
+// after the header is published so a crash can leave their data on disk.
 //
 // data_file - The data file.
 //
 // Returns 0 if successful, otherwise returns -1.
-int sky_data_file_normalize(sky_data_file *data_file)
+int sky_data_file_clear_free_blocks(sky_data_file *data_file)
 {
-    // Sort ranges by starting object id.
+    int rc;
+    check(data_file != NULL, "Data file required");
+
+    uint32_t i;
+    for(i=0; i<data_file->free_block_count; i++) {
+        sky_block *block = data_file->free_blocks[i];
+        uint8_t *ptr;
+        rc = sky_block_get_ptr(block, (void**)&ptr);
+        check(rc == 0, "Unable to retrieve block pointer");
+
+        // Only write to blocks that aren't already cleared.
+        uint32_t j;
+        for(j=0; j<data_file->block_size && ptr[j] == 0; j++);
+        if(j < data_file->block_size) {
+            memset(ptr, 0, data_file->block_size);
+            block->dirty = true;
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Snapshots
+//--------------------------------------
+
+// Acquires the lock of the data file. Writers hold the lock while they change
+// the data file so that snapshots are only pinned and released between
+// changes.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_lock(sky_data_file *data_file)
+{
+    check(data_file != NULL, "Data file required");
+    check(pthread_mutex_lock(&data_file->lock) == 0, "Unable to lock data file");
+    return 0;
+
+error:
+    return -1;
+}
+
+// Releases the lock of the data file.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_unlock(sky_data_file *data_file)
+{
+    check(data_file != NULL, "Data file required");
+    check(pthread_mutex_unlock(&data_file->lock) == 0, "Unable to unlock data file");
+    return 0;
+
+error:
+    return -1;
+}
+
+// Pins a snapshot of the current blocks, runs and memtable of the data file.
+// Every block is shared with the snapshot until it is released so that
+// changes to the blocks are made to copies.
+//
+// data_file - The data file.
+// ret       - A pointer to where the snapshot is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_pin_snapshot(sky_data_file *data_file, sky_snapshot **ret)
+{
+    int rc;
+    bool locked = false;
+    sky_snapshot *snapshot = NULL;
+    check(data_file != NULL, "Data file required");
+    check(ret != NULL, "Snapshot return address required");
+
+    rc = sky_data_file_lock(data_file);
+    check(rc == 0, "Unable to lock data file");
+    locked = true;
+    check(data_file->data != NULL, "Data file must be loaded");
+
+    snapshot = sky_snapshot_create(); check_mem(snapshot);
+    snapshot->data_file = data_file;
+    snapshot->epoch = data_file->epoch + 1;
+    snapshot->data = data_file->data;
+
+    // Copy the directory. Empty blocks are left out since their slots can be
+    // reused.
+    uint32_t i;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        if(block->min_object_id == 0 && block->max_object_id == 0) {
+            continue;
+        }
+        rc = sky_snapshot_add_block(snapshot, block);
+        check(rc == 0, "Unable to add block to snapshot");
+    }
+
+    // Runs are immutable and aren't merged while the snapshot is pinned so
+    // only the list is copied. The memtable keeps changing so it is copied.
+    if(data_file->run_count > 0) {
+        snapshot->runs = calloc(data_file->run_count, sizeof(*snapshot->runs));
+        check_mem(snapshot->runs);
+        memcpy(snapshot->runs, data_file->runs, sizeof(*snapshot->runs) * data_file->run_count);
+        snapshot->run_count = data_file->run_count;
+    }
+    if(data_file->memtable != NULL && data_file->memtable->event_count > 0) {
+        rc = sky_memtable_copy(data_file->memtable, &snapshot->memtable);
+        check(rc == 0, "Unable to copy memtable");
+    }
+
+    // Track the snapshot on the data file.
+    data_file->snapshots = realloc(data_file->snapshots, sizeof(*data_file->snapshots) * (data_file->snapshot_count+1));
+    check_mem(data_file->snapshots);
+    data_file->snapshots[data_file->snapshot_count++] = snapshot;
+    data_file->epoch = snapshot->epoch;
+
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        block->shared = (block->min_object_id != 0 || block->max_object_id != 0);
+    }
+
+    sky_data_file_unlock(data_file);
+
+    *ret = snapshot;
+    return 0;
+
+error:
+    if(locked) sky_data_file_unlock(data_file);
+    sky_snapshot_free(snapshot);
+    if(ret) *ret = NULL;
+    return -1;
+}
+
+// Releases a snapshot that was pinned on the data file and frees it. Blocks
+// are no longer shared once every snapshot is released. The slots that were
+// retired and the mappings that were replaced while the snapshot was pinned
+// are freed if nothing else references them.
+//
+// data_file - The data file.
+// snapshot  - The snapshot to release.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_release_snapshot(sky_data_file *data_file,
+                                   sky_snapshot *snapshot)
+{
+    int rc;
+    bool locked = false;
+    check(data_file != NULL, "Data file required");
+    check(snapshot != NULL, "Snapshot required");
+
+    rc = sky_data_file_lock(data_file);
+    check(rc == 0, "Unable to lock data file");
+    locked = true;
+
+    // Remove the snapshot from the data file.
+    uint32_t i;
+    for(i=0; i<data_file->snapshot_count; i++) {
+        if(data_file->snapshots[i] == snapshot) {
+            memmove(&data_file->snapshots[i], &data_file->snapshots[i+1], sizeof(*data_file->snapshots) * (data_file->snapshot_count-i-1));
+            data_file->snapshot_count--;
+            break;
+        }
+    }
+    sky_snapshot_free(snapshot);
+
+    if(data_file->snapshot_count == 0) {
+        for(i=0; i<data_file->block_count; i++) {
+            data_file->blocks[i]->shared = false;
+        }
+    }
+
+    if(data_file->data != NULL) {
+        rc = sky_data_file_release_retired_blocks(data_file);
+        check(rc == 0, "Unable to release retired blocks");
+    }
+    sky_data_file_release_retired_mappings(data_file);
+
+    sky_data_file_unlock(data_file);
+    return 0;
+
+error:
+    if(locked) sky_data_file_unlock(data_file);
+    return -1;
+}
+
+// Determines the epoch of the oldest pinned snapshot. Slots and mappings that
+// were retired in an earlier epoch can no longer be read.
+//
+// data_file - The data file.
+//
+// Returns the oldest pinned epoch or the next epoch if no snapshot is pinned.
+uint32_t sky_data_file_get_min_epoch(sky_data_file *data_file)
+{
+    uint32_t i;
+    uint32_t min_epoch = data_file->epoch + 1;
+    for(i=0; i<data_file->snapshot_count; i++) {
+        if(data_file->snapshots[i]->epoch < min_epoch) {
+            min_epoch = data_file->snapshots[i]->epoch;
+        }
+    }
+    return min_epoch;
+}
+
+// Keeps the current mapping of the data file for the pinned snapshots that
+// read through it. The data file must be mapped again afterward.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_retire_mapping(sky_data_file *data_file)
+{
+    check(data_file != NULL, "Data file required");
+    check(data_file->data != NULL, "Data file must be mapped");
+
+    data_file->retired_mappings = realloc(data_file->retired_mappings, sizeof(*data_file->retired_mappings) * (data_file->retired_mapping_count+1));
+    check_mem(data_file->retired_mappings);
+    sky_data_file_mapping *mapping = &data_file->retired_mappings[data_file->retired_mapping_count++];
+    mapping->data = data_file->data;
+    mapping->length = data_file->allocated_block_count * data_file->block_size;
+    mapping->epoch = data_file->epoch;
+    data_file->data = NULL;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Unmaps the replaced mappings that no pinned snapshot can read through.
+//
+// data_file - The data file.
+void sky_data_file_release_retired_mappings(sky_data_file *data_file)
+{
+    uint32_t i;
+    uint32_t min_epoch = sky_data_file_get_min_epoch(data_file);
+    uint32_t retired_mapping_count = 0;
+    for(i=0; i<data_file->retired_mapping_count; i++) {
+        sky_data_file_mapping *mapping = &data_file->retired_mappings[i];
+        if(mapping->epoch >= min_epoch) {
+            data_file->retired_mappings[retired_mapping_count++] = *mapping;
+            continue;
+        }
+        munmap(mapping->data, mapping->length);
+    }
+
+    data_file->retired_mapping_count = retired_mapping_count;
+    if(retired_mapping_count == 0) {
+        free(data_file->retired_mappings);
+        data_file->retired_mappings = NULL;
+    }
+}
+
+
+//--------------------------------------
+// Extents
+//--------------------------------------
+
+// Calculates the number of blocks that the data file mapping should have
+// room for. The mapping is grown by an extent once the blocks no longer fit.
+// Each extent is as large as the current allocation so that the number of
+// remaps stays logarithmic in the size of the file. Extents are at least the
+// data file's extent size and at most SKY_DATA_FILE_MAX_EXTENT_LENGTH bytes.
+//
+// data_file - The data file.
+//
+// Returns the number of blocks to allocate.
+uint32_t sky_data_file_get_allocated_block_count(sky_data_file *data_file)
+{
+    if(data_file->block_count <= data_file->allocated_block_count) {
+        return data_file->allocated_block_count;
+    }
+
+    uint32_t max_extent_size = SKY_DATA_FILE_MAX_EXTENT_LENGTH / data_file->block_size;
+    uint32_t extent_size = data_file->allocated_block_count;
+    if(extent_size > max_extent_size) {
+        extent_size = max_extent_size;
+    }
+    if(extent_size < data_file->extent_size) {
+        extent_size = data_file->extent_size;
+    }
+
+    uint32_t allocated_block_count = data_file->allocated_block_count + extent_size;
+    if(allocated_block_count < data_file->block_count) {
+        allocated_block_count = data_file->block_count;
+    }
+    return allocated_block_count;
+}
+
+// Reserves disk space for the data file up to a given length without
+// changing the length of the file. This keeps the blocks of an extent close
+// together on disk and stops writes to new blocks from failing because the
+// disk is full. Reserving space is only a hint and is ignored if the file
+// system doesn't support it.
+//
+// data_file - The data file.
+// length    - The number of bytes to reserve.
+void sky_data_file_allocate(sky_data_file *data_file, size_t length)
+{
+#ifdef FALLOC_FL_KEEP_SIZE
+    if(length > 0 && fallocate(data_file->data_fd, FALLOC_FL_KEEP_SIZE, 0, length) != 0) {
+        debug("Unable to reserve data file extent: %s", bdata(data_file->path));
+    }
+#else
+    (void)data_file;
+    (void)length;
+#endif
+}
+
+
+//--------------------------------------
+// Access Hints
+//--------------------------------------
+
+// Applies the mapping-wide hints of the data file after it is mapped or
+// remapped. Huge pages are only a hint and are not supported by every kernel
+// or file system so a failure to enable them is ignored.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_advise_mapping(sky_data_file *data_file)
+{
+    check(data_file != NULL, "Data file required");
+
+#ifdef MADV_HUGEPAGE
+    if(data_file->huge_pages && data_file->data != NULL) {
+        if(madvise(data_file->data, data_file->data_length, MADV_HUGEPAGE) != 0) {
+            debug("Huge pages are not available for data file: %s", bdata(data_file->path));
+        }
+    }
+#endif
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Tells the kernel how the whole data file mapping is about to be accessed.
+// Scans that read every block in order should use MADV_SEQUENTIAL and reset
+// the mapping to MADV_NORMAL when they finish.
+//
+// data_file - The data file.
+// advice    - The madvise() advice to apply.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_advise(sky_data_file *data_file, int advice)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+
+    if(data_file->data != NULL) {
+        rc = madvise(data_file->data, data_file->data_length, advice);
+        check(rc == 0, "Unable to advise data file mapping");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Starts reading a block into the page cache ahead of the time that it is
+// needed. The read happens asynchronously in the kernel
+// so this returns without waiting for the disk.
+//
+// data_file - The data file.
+// block     - The block to prefetch.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_prefetch_block(sky_data_file *data_file, sky_block *block)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+    check(block != NULL, "Block required");
+
+    // A snapshot's copy of a block is read through the snapshot's mapping. Its
+    // slot stays in the file while the snapshot is pinned.
+    size_t offset = (size_t)block->index * data_file->block_size;
+    void *data = (block->mapping != NULL ? block->mapping : data_file->data);
+    if(data != NULL && (block->mapping != NULL || offset + data_file->block_size <= data_file->data_length)) {
+        // Align the start of the block to the page size.
+        long page_size = sysconf(_SC_PAGE_SIZE);
+        size_t start = offset - (offset % page_size);
+
+        rc = madvise(data + start, (offset + data_file->block_size) - start, MADV_WILLNEED);
+        check(rc == 0, "Unable to prefetch block: %d", block->index);
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Starts reading the whole data file and header file into the page cache so
+// that the first query after the data file is loaded doesn't stall on page
+// faults. The read happens asynchronously in the kernel while the caller
+// continues.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_warm(sky_data_file *data_file)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+
+    if(data_file->header != NULL) {
+        rc = madvise(data_file->header, data_file->header_length, MADV_WILLNEED);
+        check(rc == 0, "Unable to warm header file");
+    }
+    rc = sky_data_file_advise(data_file, MADV_WILLNEED);
+    check(rc == 0, "Unable to warm data file");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Header File Management
+//--------------------------------------
+
+// Loads header information for the data file. The header file is memory
+// mapped so that block updates can be written without any file I/O.
+//
+// data_file - The data file object associated with the header file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_load_header(sky_data_file *data_file)
+{
+    int rc;
+    size_t sz;
+
+    // Unload existing header information.
+    rc = sky_data_file_unload_header(data_file);
+    check(rc == 0, "Unable to unload header");
+
+    // If header doesn't exist then create a new one.
+    if(!sky_file_exists(data_file->header_path)) {
+        rc = sky_data_file_create_header(data_file);
+        check(rc == 0, "Unable to create header file");
+    }
+    
+    // Open the header file.
+    data_file->header_fd = open(bdata(data_file->header_path), O_RDWR);
+    check(data_file->header_fd != -1, "Failed to open header file: %s",  bdata(data_file->header_path));
+
+    // Map the entire header file into memory.
+    off_t file_length = sky_file_get_size(data_file->header_path);
+    check(file_length >= (off_t)(SKY_HEADER_FILE_HDR_SIZE), "Header file is too small: %s", bdata(data_file->header_path));
+    data_file->header = mmap(0, file_length, PROT_READ | PROT_WRITE, MAP_SHARED, data_file->header_fd, 0);
+    check(data_file->header != MAP_FAILED, "Unable to memory map header file");
+    data_file->header_length = file_length;
+    data_file->header_capacity = file_length;
+
+    // Read database format version and block size.
+    void *ptr = data_file->header;
+    uint32_t version = *((uint32_t*)ptr);
+    ptr += sizeof(version);
+    check(version > 0 && version <= SKY_DATA_FILE_VERSION, "Unsupported data file version: %d", version);
+    check(file_length >= (off_t)sky_data_file_header_file_hdr_size(version), "Header file is too small: %s", bdata(data_file->header_path));
+    data_file->version = version;
+    data_file->block_header_size = sky_data_file_block_header_size(version);
+    data_file->block_size = *((uint32_t*)ptr);
+    ptr += sizeof(data_file->block_size);
+
+    // Read the LSN of the last applied log record.
+    data_file->lsn = 0;
+    if(version >= SKY_DATA_FILE_LSN_VERSION) {
+        data_file->lsn = *((uint64_t*)ptr);
+        ptr += sizeof(data_file->lsn);
+    }
+
+    // Allocate blocks.
+    data_file->block_count = (file_length - sky_data_file_header_file_hdr_size(version)) / data_file->block_header_size;
+    if(data_file->block_count > 0) {
+        data_file->blocks = calloc(data_file->block_count, sizeof(sky_block*));
+        check_mem(data_file->blocks);
+    }
+
+    // Unpack each block from the header.
+    uint32_t i;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = sky_block_create(data_file); check_mem(block);
+        block->index = i;
+        data_file->blocks[i] = block;
+
+        rc = sky_block_unpack(block, ptr, &sz);
+        check(rc == 0, "Unable to unpack block #%d", block->index);
+        block->published = (block->min_object_id != 0 || block->max_object_id != 0);
+        ptr += sz;
+    }
+
+    rc = sky_data_file_normalize(data_file);
+    check(rc == 0, "Unable to normalize data file");
+
+    rc = sky_data_file_load_free_blocks(data_file);
+    check(rc == 0, "Unable to load free blocks");
+
+    rc = sky_data_file_load_zone_maps(data_file);
+    check(rc == 0, "Unable to load zone maps");
+
+    return 0;
+
+error:
+    sky_data_file_unload_header(data_file);
+    return -1;
+}
+
+// Unloads header information from memory.
+//
+// data_file - The data file object associated with the header file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_unload_header(sky_data_file *data_file)
+{
+    check(data_file != NULL, "Data file required");
+    
+    if(data_file->blocks) {
+        uint32_t i;
+        for(i=0; i<data_file->block_count; i++) {
+            sky_block *block = data_file->blocks[i];
+            if(block) {
+                sky_block_free(block);
+                data_file->blocks[i] = NULL;
+            }
+        }
+        free(data_file->blocks);
+    }
+    data_file->blocks = NULL;
+    data_file->block_count = 0;
+    free(data_file->free_blocks);
+    data_file->free_blocks = NULL;
+    data_file->free_block_count = 0;
+    free(data_file->retired_blocks);
+    data_file->retired_blocks = NULL;
+    data_file->retired_block_count = 0;
+    free(data_file->snapshots);
+    data_file->snapshots = NULL;
+    data_file->snapshot_count = 0;
+    
+    // Unmap the header file.
+    if(data_file->header != NULL && data_file->header != MAP_FAILED) {
+        munmap(data_file->header, data_file->header_capacity);
+    }
+    if(data_file->header_fd > 0) {
+        close(data_file->header_fd);
+    }
+    data_file->header_fd = 0;
+    data_file->header = NULL;
+    data_file->header_length = 0;
+    data_file->header_capacity = 0;
+    data_file->header_dirty_start = 0;
+    data_file->header_dirty_end = 0;
+
+    return 0;
+    
+error:
+    return -1;
+}
+
+// Creates a new header file. The header file will only be created if one
+// does not already exist.
+//
+// data_file - The data file object associated with the header file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_create_header(sky_data_file *data_file)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+    check(data_file->header_path != NULL, "Data file header path required");
+    check(!sky_file_exists(data_file->header_path), "Header file already exists");
+
+    // Open the file for writing.
+    FILE *file = fopen(bdata(data_file->header_path), "w");
+    check(file, "Failed to open header file for writing: %s",  bdata(data_file->header_path));
+
+    // Write database format version. New data files are uncompressed unless
+    // a version has been set.
+    uint32_t version = (data_file->version > 0 ? data_file->version : SKY_DATA_FILE_RAW_VERSION);
+    rc = fwrite(&version, sizeof(version), 1, file);
+    check(rc == 1, "Unable to write version");
+
+    // Write block size.
+    rc = fwrite(&data_file->block_size, sizeof(data_file->block_size), 1, file);
+    check(rc == 1, "Unable to write block size");
+
+    // Write the LSN of the last applied log record.
+    if(version >= SKY_DATA_FILE_LSN_VERSION) {
+        rc = fwrite(&data_file->lsn, sizeof(data_file->lsn), 1, file);
+        check(rc == 1, "Unable to write LSN");
+    }
+    
+    // Write a single empty block.
+    size_t block_header_size = sky_data_file_block_header_size(version);
+    uint8_t buffer[SKY_WIDE_BLOCK_HEADER_SIZE];
+    memset(buffer, 0, sizeof(buffer));
+    rc = fwrite(buffer, block_header_size, 1, file);
+    check(rc == 1, "Unable to write initial block header");
+    
+    // Close file.
+    fclose(file);
+    
+    return 0;
+    
+error:
+    if(file) fclose(file);
+    return -1;
+}
+
+// Resizes the header file to fit the current number of blocks. The mapping
+// is only grown once it no longer fits the header and it is then grown to fit
+// every block allocated in the data file.
+//
+// data_file - The data file object associated with the header file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_map_header(sky_data_file *data_file)
+{
+    int rc;
+    void *ptr;
+    check(data_file != NULL, "Data file required");
+    check(data_file->header != NULL, "Header file must be loaded");
+
+    // Shadowed headers are only written when they are published.
+    if(data_file->shadow_blocks) {
+        return 0;
+    }
+
+    // Calculate the header length.
+    size_t header_length = sky_data_file_header_file_hdr_size(data_file->version) + (data_file->block_count * data_file->block_header_size);
+    if(header_length == data_file->header_length) {
+        return 0;
+    }
+
+    // Resize the file. New block entries are zero filled.
+    rc = ftruncate(data_file->header_fd, header_length);
+    check(rc == 0, "Unable to truncate header file");
+
+    // Grow the mapping if the header no longer fits.
+    if(header_length > data_file->header_capacity) {
+        uint32_t block_count = (data_file->allocated_block_count > data_file->block_count ? data_file->allocated_block_count : data_file->block_count);
+        size_t header_capacity = sky_data_file_header_file_hdr_size(data_file->version) + (block_count * data_file->block_header_size);
+
+#if MREMAP_AVAILABLE
+        ptr = mremap(data_file->header, data_file->header_capacity, header_capacity, MREMAP_MAYMOVE);
+        check(ptr != MAP_FAILED, "Unable to remap header file");
+#else
+        // Write back changes before remapping.
+        rc = sky_data_file_flush(data_file);
+        check(rc == 0, "Unable to flush header");
+        munmap(data_file->header, data_file->header_capacity);
+        ptr = mmap(0, header_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, data_file->header_fd, 0);
+        check(ptr != MAP_FAILED, "Unable to memory map header file");
+#endif
+
+        data_file->header = ptr;
+        data_file->header_capacity = header_capacity;
+    }
+
+    data_file->header_length = header_length;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Marks a region of the header as changed so that it is synced on the next
+// flush.
+//
+// data_file - The data file object associated with the header file.
+// offset    - The byte offset of the change within the header file.
+// sz        - The number of bytes changed.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_set_header_dirty(sky_data_file *data_file, off_t offset,
+                                   size_t sz)
+{
+    check(data_file != NULL, "Data file required");
+    check(offset + sz <= data_file->header_length, "Header change out of range");
+
+    if(data_file->header_dirty_end == 0 || (size_t)offset < data_file->header_dirty_start) {
+        data_file->header_dirty_start = offset;
+    }
+    if(offset + sz > data_file->header_dirty_end) {
+        data_file->header_dirty_end = offset + sz;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Records the LSN of the last write-ahead log record applied to the data
+// file. The LSN is only kept in memory until the data file is flushed so that
+// it never reaches the disk before the blocks that it covers.
+//
+// data_file - The data file.
+// lsn       - The log sequence number.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_set_lsn(sky_data_file *data_file, uint64_t lsn)
+{
+    check(data_file != NULL, "Data file required");
+    data_file->lsn = lsn;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes the LSN of the data file to a header file that is updated in place.
+// This must only be called once the blocks have been synced. The LSN is
+// written through the file rather than the header mapping since the kernel
+// can write a changed page of the mapping back at any time. Shadowed headers
+// are published with the LSN instead.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_sync_lsn(sky_data_file *data_file)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+
+    if(data_file->version < SKY_DATA_FILE_LSN_VERSION || data_file->header == NULL || data_file->shadow_blocks) {
+        return 0;
+    }
+    if(*((uint64_t*)(data_file->header + (SKY_HEADER_FILE_HDR_SIZE))) == data_file->lsn) {
+        return 0;
+    }
+
+    ssize_t bytes = pwrite(data_file->header_fd, &data_file->lsn, sizeof(data_file->lsn), SKY_HEADER_FILE_HDR_SIZE);
+    check(bytes == (ssize_t)sizeof(data_file->lsn), "Unable to write LSN: %s", bdata(data_file->header_path));
+    rc = fdatasync(data_file->header_fd);
+    check(rc == 0, "Unable to sync LSN: %s", bdata(data_file->header_path));
+
+    return 0;
+
+error:
+    return -1;
+}
+
+//--------------------------------------
+// Format
+//--------------------------------------
+
+// Calculates the size of the fields at the start of the header file that come
+// before the block entries for a given data file version.
+//
+// version - The data file version.
+//
+// Returns the size of the header file fields, in bytes.
+size_t sky_data_file_header_file_hdr_size(uint32_t version)
+{
+    if(version >= SKY_DATA_FILE_LSN_VERSION) {
+        return SKY_LSN_HEADER_FILE_HDR_SIZE;
+    }
+    else {
+        return SKY_HEADER_FILE_HDR_SIZE;
+    }
+}
+
+// Calculates the size of each block entry in the header file of a given data
+// file version.
+//
+// version - The data file version.
+//
+// Returns the size of a block entry, in bytes.
+size_t sky_data_file_block_header_size(uint32_t version)
+{
+    if(version >= SKY_DATA_FILE_WIDE_VERSION) {
+        return SKY_WIDE_BLOCK_HEADER_SIZE;
+    }
+    else if(version >= SKY_DATA_FILE_COMPRESSED_VERSION) {
+        return SKY_COMPRESSED_BLOCK_HEADER_SIZE;
+    }
+    else {
+        return SKY_BLOCK_HEADER_SIZE;
+    }
+}
+
+// Checks if a data file stores wide object ids.
+//
+// data_file - The data file.
+//
+// Returns true if the data file's object ids can be larger than 32 bits.
+bool sky_data_file_is_wide(sky_data_file *data_file)
+{
+    return (data_file != NULL && data_file->version >= SKY_DATA_FILE_WIDE_VERSION);
+}
+
+
+//--------------------------------------
+// Zone Maps
+//--------------------------------------
+
+// Reads the zone maps of the blocks from the zone map file and removes the
+// file. The file is ignored if it was saved with a different header or if it
+// is incomplete.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_load_zone_maps(sky_data_file *data_file)
+{
+    int rc;
+    void *buffer = NULL;
+    FILE *file = NULL;
+    check(data_file != NULL, "Data file required");
+
+    if(data_file->zone_map_path == NULL || !sky_file_exists(data_file->zone_map_path)) {
+        return 0;
+    }
+
+    // Read the entire file into memory and remove it.
+    off_t length = sky_file_get_size(data_file->zone_map_path);
+    if(length > 0) {
+        buffer = malloc(length); check_mem(buffer);
+        file = fopen(bdata(data_file->zone_map_path), "r");
+        check(file != NULL, "Unable to open zone map file: %s", bdata(data_file->zone_map_path));
+        rc = fread(buffer, length, 1, file);
+        check(rc == 1, "Unable to read zone map file");
+        fclose(file);
+        file = NULL;
+    }
+    rc = sky_file_rm(data_file->zone_map_path);
+    check(rc == 0, "Unable to remove zone map file: %s", bdata(data_file->zone_map_path));
+
+    // Only use the zone maps if the header hasn't changed since they were
+    // saved. Zone maps that can't be read are rebuilt when they are needed.
+    if(length >= (off_t)sizeof(uint32_t) && *((uint32_t*)buffer) == sky_wal_checksum(data_file->header, data_file->header_length)) {
+        rc = sky_data_file_unpack_zone_maps(data_file, buffer + sizeof(uint32_t), length - sizeof(uint32_t));
+        if(rc != 0) {
+            uint32_t i;
+            for(i=0; i<data_file->block_count; i++) {
+                sky_block_unload_zone_map(data_file->blocks[i]);
+            }
+        }
+    }
+
+    free(buffer);
+    return 0;
+
+error:
+    if(file) fclose(file);
+    free(buffer);
+    return -1;
+}
+
+// Assigns packed zone maps to the blocks that they were saved from.
+//
+// data_file - The data file.
+// ptr       - A pointer to the block count and zone maps.
+// length    - The number of bytes available to read.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_unpack_zone_maps(sky_data_file *data_file, void *ptr,
+                                   size_t length)
+{
+    int rc;
+    size_t sz;
+    sky_block **blocks_by_index = NULL;
+    void *endptr = ptr + length;
+    check(length >= sizeof(uint32_t), "Zone map file is truncated");
+
+    // Index the blocks by their position in the file.
+    blocks_by_index = calloc(data_file->block_count, sizeof(*blocks_by_index));
+    check_mem(blocks_by_index);
+    uint32_t i;
+    for(i=0; i<data_file->block_count; i++) {
+        blocks_by_index[data_file->blocks[i]->index] = data_file->blocks[i];
+    }
+
+    uint32_t count = *((uint32_t*)ptr);
+    ptr += sizeof(uint32_t);
+    for(i=0; i<count; i++) {
+        check(ptr + sizeof(uint32_t) <= endptr, "Zone map file is truncated");
+        uint32_t index = *((uint32_t*)ptr);
+        ptr += sizeof(uint32_t);
+        check(index < data_file->block_count, "Invalid zone map block index: %d", index);
+
+        sky_block *block = blocks_by_index[index];
+        rc = sky_zone_map_unpack(&block->zone_map, ptr, endptr - ptr, &sz);
+        check(rc == 0, "Unable to unpack zone map for block: %d", index);
+        block->zone_map_loaded = true;
+        ptr += sz;
+    }
+
+    free(blocks_by_index);
+    return 0;
+
+error:
+    free(blocks_by_index);
+    return -1;
+}
+
+// Writes the loaded zone maps of the blocks to the zone map file along with
+// a checksum of the header file.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_save_zone_maps(sky_data_file *data_file)
+{
+    int rc;
+    size_t sz;
+    void *buffer = NULL;
+    FILE *file = NULL;
+    check(data_file != NULL, "Data file required");
+
+    if(data_file->zone_map_path == NULL || data_file->header == NULL) {
+        return 0;
+    }
+
+    // Calculate the file size.
+    uint32_t i, count = 0;
+    size_t length = sizeof(uint32_t) * 2;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        if(block->zone_map_loaded) {
+            length += sizeof(uint32_t) + sky_zone_map_sizeof(&block->zone_map);
+            count++;
+        }
+    }
+    if(count == 0) {
+        return 0;
+    }
+
+    // Pack the checksum and each loaded zone map.
+    buffer = malloc(length); check_mem(buffer);
+    void *ptr = buffer;
+    *((uint32_t*)ptr) = sky_wal_checksum(data_file->header, data_file->header_length);
+    ptr += sizeof(uint32_t);
+    *((uint32_t*)ptr) = count;
+    ptr += sizeof(uint32_t);
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        if(block->zone_map_loaded) {
+            *((uint32_t*)ptr) = block->index;
+            ptr += sizeof(uint32_t);
+            rc = sky_zone_map_pack(&block->zone_map, ptr, &sz);
+            check(rc == 0, "Unable to pack zone map for block: %d", block->index);
+            ptr += sz;
+        }
+    }
+
+    // Write the file.
+    file = fopen(bdata(data_file->zone_map_path), "w");
+    check(file != NULL, "Unable to open zone map file: %s", bdata(data_file->zone_map_path));
+    rc = fwrite(buffer, length, 1, file);
+    check(rc == 1, "Unable to write zone map file");
+    fclose(file);
+
+    free(buffer);
+    return 0;
+
+error:
+    if(file) fclose(file);
+    free(buffer);
+    return -1;
+}
+
+
+//--------------------------------------
+// Block Management
+//--------------------------------------
+
+// Creates an empty block. A block from the free list is reused if one is
+// available. Otherwise a new block is appended to the end of the data file.
+//
+// data_file - The data file.
+// ret       - A pointer to where the new block should be returned to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_create_block(sky_data_file *data_file, sky_block **ret)
+{
+    int rc;
+    
+    // Reuse a free block if there is one. Free blocks are already cleared and
+    // are in position at the start of the directory.
+    sky_block *free_block = sky_data_file_pop_free_block(data_file);
+    if(free_block != NULL) {
+        free_block->dirty = true;
+        *ret = free_block;
+        return 0;
+    }
+
+    // Increment block count and resize block memory.
+    data_file->block_count++;
+    data_file->blocks = realloc(data_file->blocks, sizeof(sky_block*) * data_file->block_count);
+    if(data_file->block_count > 0) check_mem(data_file->blocks);
+
+    // Create new block.
+    sky_block *block = sky_block_create(data_file); check_mem(block);
+    block->index = data_file->block_count-1;
+    block->dirty = true;
+    data_file->blocks[data_file->block_count-1] = block;
+
+    // Remap data file and header.
+    rc = sky_data_file_load(data_file);
+    check(rc == 0, "Unable to reload data file");
+    rc = sky_data_file_map_header(data_file);
+    check(rc == 0, "Unable to remap header file");
+
+    // Clear block.
+    void *ptr;
+    rc = sky_block_get_ptr(block, &ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+    memset(ptr, 0, data_file->block_size);
+
+    // Move the block into its sorted position in the directory.
+    rc = sky_data_file_move_block(data_file, data_file->block_count-1);
+    check(rc == 0, "Unable to position new block");
+
+    // Return the new block.
+    *ret = block;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Finds the correct block to add an event to.
+//
+// Insertion has several rules to ensure consistency. There are two types of
+// blocks: single object blocks and multi-object blocks. Single object blocks
+// are spans of two or more blocks that have a single object. Multi-object
+// blocks are single blocks that have multiple object ids. An object that is
+// stored in a single block (i.e. doesn't span blocks) is considered a
+// multi-object block since there is probably room to add more objects.
+// 
+// 1. An object id range is unique to a block. If a block has object ids 5 - 8
+//    then no other block can overlap into those ids.
+//
+// 2. Only multi-object blocks can have object ids outside its range added.
+//
+// 3. Objects are added to the first block where the object id is included in
+//    the object id range or is less than the minimum object id of the block.
+//
+// 4. If no block is found by the end then the last block is used for insertion.
+//
+// The rules are applied against the sorted block directory using binary
+// searches so the lookup does not depend on the number of blocks.
+//
+// data_file - The data file that the event is being added to.
+// event     - The event to add to the table.
+// ret       - A pointer to where the insertion block is returned to.
+//
+// Returns 0 if successfully finds a block. Otherwise returns -1.
+int sky_data_file_find_insertion_block(sky_data_file *data_file,
+                                       sky_event *event,
+                                       sky_block **ret)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+    check(event != NULL, "Event required");
+    check(event->object_id != 0, "Event object id required");
+    
+    // Search the existing blocks.
+    rc = sky_data_file_search_insertion_block(data_file, event, ret);
+    check(rc == 0, "Unable to search for insertion block");
+    
+    // If no block is available then create a new one.
+    if(*ret == NULL) {
+        rc = sky_data_file_create_block(data_file, ret);
+        check(rc == 0, "Unable to create block");
+    }
+    
+    return 0;
+
+error:
+    return -1;
+}
+
+// Searches the existing blocks for the block to add an event to using the
+// rules described in sky_data_file_find_insertion_block(). A new block is not
+// created if one is needed.
+//
+// data_file - The data file that the event is being added to.
+// event     - The event to add to the table.
+// ret       - A pointer to where the insertion block is returned to. This is
+//             NULL if a new block needs to be created.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_search_insertion_block(sky_data_file *data_file,
+                                         sky_event *event,
+                                         sky_block **ret)
+{
+    check(data_file != NULL, "Data file required");
+    check(event != NULL, "Event required");
+    
+    // Initialize return value to NULL.
+    *ret = NULL;
+    
+    // Extract object id and timestamp from event.
+    sky_object_id_t object_id = event->object_id;
+    sky_timestamp_t timestamp = event->timestamp;
+
+    // Find the blocks that start with this object id as well as the first
+    // block that starts after it.
+    sky_block **blocks = data_file->blocks;
+    uint32_t start = sky_data_file_lower_bound(data_file, object_id);
+    uint32_t end   = sky_data_file_upper_bound(data_file, object_id);
+
+    // If a block starts with this object id then use it.
+    if(start < end) {
+        // If this is a single object block then find the first block in the
+        // span where the timestamp is before the max. The blocks in a span
+        // are ordered by timestamp so the search can be done with bisection.
+        if(blocks[start]->spanned) {
+            uint32_t min = start, max = end;
+            while(min < max) {
+                uint32_t mid = min + ((max - min) / 2);
+                if(timestamp <= blocks[mid]->max_timestamp) {
+                    max = mid;
+                }
+                else {
+                    min = mid + 1;
+                }
+            }
+            
+            // If this event is being appended to the object path then use
+            // the last block.
+            *ret = blocks[(min < end ? min : end-1)];
+        }
+        // If this is a multi-object block then simply use it.
+        else {
+            *ret = blocks[start];
+        }
+    }
+    // If the previous block's range includes the object id then use it.
+    else if(start > 0 && blocks[start-1]->min_object_id != 0 && object_id <= blocks[start-1]->max_object_id) {
+        *ret = blocks[start-1];
+    }
+    // Otherwise use the first multi-object block that comes after the object
+    // id. Spans are skipped over as a whole.
+    else {
+        uint32_t index = end;
+        while(index < data_file->block_count && blocks[index]->spanned) {
+            index = sky_data_file_upper_bound(data_file, blocks[index]->min_object_id);
+        }
+        if(index < data_file->block_count) {
+            *ret = blocks[index];
+        }
+    }
+    
+    // If we haven't found a block then it means that the object id is after all
+    // other object ids or that we are inserting before a single object block or
+    // that we have no blocks. Use the last block if it is unspanned. Otherwise
+    // a new block is needed.
+    if(*ret == NULL) {
+        sky_block *last_block = (data_file->block_count > 0 ? data_file->blocks[data_file->block_count-1] : NULL);
+        if(last_block != NULL && !last_block->spanned) {
+            *ret = last_block;
+        }
+    }
+    
+    return 0;
+
+error:
+    return -1;
+}
+
+// Updates the block information to mark blocks as spanned or not.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_normalize(sky_data_file *data_file)
+{
+    // Sort ranges by starting object id.
     qsort(data_file->blocks, data_file->block_count, sizeof(*data_file->blocks), compare_blocks);
 
-    // Determine spanned blocks.
+    // Determine spanned blocks.
+    uint32_t i;
+    sky_object_id_t last_object_id = -1;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        
+        // If this is a single object block then track the object id to
+        // possibly mark it as spanned.
+        if(block->min_object_id == block->max_object_id && block->min_object_id > 0) {
+            // If it has spanned since the last block then mark it and the
+            // previous block.
+            if(block->min_object_id == last_object_id) {
+                block->spanned = true;
+                data_file->blocks[i-1]->spanned = true;
+            }
+            // If this is the first block with one object then store the id.
+            else {
+                last_object_id = block->min_object_id;
+            }
+        }
+        // Clear out last object id for multi-object blocks.
+        else {
+            last_object_id = -1;
+        }
+    }
+
+    return 0;
+}
+
+// Moves a specific number of bytes from a given pointer to a newly created
+// block. The pointer passed in may change if the data file is remapped to a
+// different memory location.
+//
+// data_file - The data file that contains the pointer.
+// ptr       - A pointer to a location on the data file.
+// sz        - The number of bytes to move to a new block.
+// new_block - A pointer to where the new block should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_move_to_new_block(sky_data_file *data_file, void **ptr,
+                                    size_t sz, sky_block **new_block)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+
+    // Store offset before data file remap.
+    off_t ptr_off = (*ptr) - data_file->data;
+
+    // Create block.
+    rc = sky_data_file_create_block(data_file, new_block);
+    check(rc == 0, "Unable to create new block");
+    
+    // Restore pointers in case remap relocated data.
+    *ptr = data_file->data + ptr_off;
+
+    // Retrieve new block's pointer.
+    void *new_block_ptr = NULL;
+    rc = sky_block_get_ptr(*new_block, &new_block_ptr);
+    check(rc == 0, "Unable to determine new block pointer");
+    
+    // Copy over everything since the checkpoint.
+    memmove(new_block_ptr, (*ptr), sz);
+
+    // Clear out data from the source block.
+    memset((*ptr), 0, sz);
+    
+    // Perform a full update on the block header. This is probably not
+    // needed but we're going to be safe. The amortized cost of this
+    // should be small considering splits shouldn't happen often.
+    rc = sky_block_full_update(*new_block);
+    check(rc == 0, "Unable to update block ranges on new block");
+
+    return 0;
+    
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Block Directory
+//--------------------------------------
+
+// The block directory is the list of blocks sorted by object id range. Since
+// object id ranges do not overlap between blocks, the directory can be
+// searched by bisection instead of scanning every block.
+
+// Finds the position of the first block in the directory whose minimum object
+// id is greater than or equal to a given object id.
+//
+// data_file - The data file.
+// object_id - The object id to search for.
+//
+// Returns the position of the block or the block count if none is found.
+uint32_t sky_data_file_lower_bound(sky_data_file *data_file,
+                                   sky_object_id_t object_id)
+{
+    uint32_t min = 0, max = data_file->block_count;
+    while(min < max) {
+        uint32_t mid = min + ((max - min) / 2);
+        if(data_file->blocks[mid]->min_object_id < object_id) {
+            min = mid + 1;
+        }
+        else {
+            max = mid;
+        }
+    }
+    return min;
+}
+
+// Finds the position of the first block in the directory whose minimum object
+// id is greater than a given object id.
+//
+// data_file - The data file.
+// object_id - The object id to search for.
+//
+// Returns the position of the block or the block count if none is found.
+uint32_t sky_data_file_upper_bound(sky_data_file *data_file,
+                                   sky_object_id_t object_id)
+{
+    uint32_t min = 0, max = data_file->block_count;
+    while(min < max) {
+        uint32_t mid = min + ((max - min) / 2);
+        if(data_file->blocks[mid]->min_object_id <= object_id) {
+            min = mid + 1;
+        }
+        else {
+            max = mid;
+        }
+    }
+    return min;
+}
+
+// Finds the position of a block within the directory.
+//
+// data_file - The data file.
+// block     - The block to search for.
+// position  - A pointer to where the position should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_get_block_position(sky_data_file *data_file,
+                                     sky_block *block,
+                                     uint32_t *position)
+{
+    check(data_file != NULL, "Data file required");
+    check(block != NULL, "Block required");
+    check(position != NULL, "Position address required");
+
+    sky_block **ptr = bsearch(&block, data_file->blocks, data_file->block_count, sizeof(*data_file->blocks), compare_blocks);
+    check(ptr != NULL, "Block not found in directory: %d", block->index);
+    *position = (uint32_t)(ptr - data_file->blocks);
+    
+    return 0;
+
+error:
+    if(position) *position = 0;
+    return -1;
+}
+
+// Moves a block whose range has changed to its sorted position in the
+// directory. All other blocks are expected to be in sorted order.
+//
+// data_file - The data file.
+// position  - The current position of the block in the directory.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_move_block(sky_data_file *data_file, uint32_t position)
+{
+    check(data_file != NULL, "Data file required");
+    check(position < data_file->block_count, "Block position out of range");
+
+    // Remove the block from the directory.
+    sky_block **blocks = data_file->blocks;
+    sky_block *block = blocks[position];
+    memmove(&blocks[position], &blocks[position+1], sizeof(*blocks) * (data_file->block_count-position-1));
+
+    // Find the new position among the remaining blocks.
+    uint32_t min = 0, max = data_file->block_count-1;
+    while(min < max) {
+        uint32_t mid = min + ((max - min) / 2);
+        if(compare_blocks(&blocks[mid], &block) < 0) {
+            min = mid + 1;
+        }
+        else {
+            max = mid;
+        }
+    }
+
+    // Reinsert the block.
+    memmove(&blocks[min+1], &blocks[min], sizeof(*blocks) * (data_file->block_count-min-1));
+    blocks[min] = block;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Retrieves the first block containing a given object and the number of
+// blocks that the object's path spans. If the object is stored in a
+// multi-object block then the span count is 1.
+//
+// data_file  - The data file.
+// object_id  - The object id to search for.
+// block      - A pointer to where the first block should be returned.
+// span_count - A pointer to where the number of blocks should be returned.
+//
+// Returns 0 if successful, otherwise returns -1. The block is returned as
+// NULL if no block contains the object id range.
+int sky_data_file_get_object_blocks(sky_data_file *data_file,
+                                    sky_object_id_t object_id,
+                                    sky_block **block,
+                                    uint32_t *span_count)
+{
+    check(data_file != NULL, "Data file required");
+    check(block != NULL, "Block address required");
+    check(span_count != NULL, "Span count address required");
+    
+    *block = NULL;
+    *span_count = 0;
+
+    uint32_t start = sky_data_file_lower_bound(data_file, object_id);
+    uint32_t end   = sky_data_file_upper_bound(data_file, object_id);
+
+    // If blocks start with the object id then use them. Only spanned blocks
+    // can share the same minimum object id.
+    if(object_id > 0 && start < end) {
+        *block = data_file->blocks[start];
+        *span_count = ((*block)->spanned ? end - start : 1);
+    }
+    // Otherwise check if the previous block's range includes the object.
+    else if(start > 0) {
+        sky_block *prev = data_file->blocks[start-1];
+        if(prev->min_object_id != 0 && object_id <= prev->max_object_id) {
+            *block = prev;
+            *span_count = 1;
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Event Management
+//--------------------------------------
+
+// Adds an event to the data file.
+//
+// data_file - The data file to add the event to..
+// event     - The event to add.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_add_event(sky_data_file *data_file, sky_event *event)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+    check(event != NULL, "Event required");
+    check(sky_data_file_is_wide(data_file) || event->object_id <= SKY_NARROW_OBJECT_ID_MAX, "Object id requires a data file with wide object ids: %llu", (unsigned long long)event->object_id);
+    
+    // Find insertion block.
+    sky_block *block;
+    rc = sky_data_file_find_insertion_block(data_file, event, &block);
+    check(rc == 0, "Unable to find insertion block");
+    
+    // Find the block's current position in the directory.
+    uint32_t position;
+    rc = sky_data_file_get_block_position(data_file, block, &position);
+    check(rc == 0, "Unable to find block position");
+    uint32_t block_count = data_file->block_count;
+    uint32_t free_block_count = data_file->free_block_count;
+
+    // Add the event to the block.
+    rc = sky_block_add_event(block, event);
+    check(rc == 0, "Unable to add event to block");
+
+    // If the block was split then re-sort all blocks. Otherwise only the
+    // insertion block's range has changed so just move it into place.
+    if(data_file->block_count != block_count || data_file->free_block_count != free_block_count) {
+        qsort(data_file->blocks, data_file->block_count, sizeof(sky_block*), compare_blocks);
+    }
+    else {
+        rc = sky_data_file_move_block(data_file, position);
+        check(rc == 0, "Unable to reposition block");
+    }
+    
+    return 0;
+
+error:
+    return -1;
+}
+
+
+// Adds a batch of events to the data file. The events are sorted by object id
+// and timestamp and each run of events that belongs to the same block is
+// added in a single pass over the block. Runs that would cause a block to
+// split or that belong to a spanned block are added one event at a time.
+//
+// data_file   - The data file to add the events to.
+// events      - The events to add.
+// event_count - The number of events.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_add_events(sky_data_file *data_file, sky_event **events,
+                             uint32_t event_count)
+{
+    int rc;
+    sky_event_ref *refs = NULL;
+    sky_event **sorted = NULL;
+    check(data_file != NULL, "Data file required");
+    check(events != NULL || event_count == 0, "Events required");
+    
+    if(event_count == 0) {
+        return 0;
+    }
+
+    // Sort the events. Events with the same object id and timestamp are
+    // ordered last-to-first since that is how individual inserts order them.
+    refs = calloc(event_count, sizeof(*refs)); check_mem(refs);
+    sorted = calloc(event_count, sizeof(*sorted)); check_mem(sorted);
+    uint32_t i;
+    for(i=0; i<event_count; i++) {
+        check(events[i] != NULL && events[i]->object_id != 0, "Event object id required");
+        check(sky_data_file_is_wide(data_file) || events[i]->object_id <= SKY_NARROW_OBJECT_ID_MAX, "Object id requires a data file with wide object ids: %llu", (unsigned long long)events[i]->object_id);
+        refs[i].event = events[i];
+        refs[i].index = i;
+    }
+    qsort(refs, event_count, sizeof(*refs), sky_event_ref_compare);
+    for(i=0; i<event_count; i++) {
+        sorted[i] = refs[i].event;
+    }
+    free(refs);
+    refs = NULL;
+    
+    // Add each run of events that share an insertion block.
+    i = 0;
+    while(i < event_count) {
+        sky_block *block;
+        rc = sky_data_file_find_insertion_block(data_file, sorted[i], &block);
+        check(rc == 0, "Unable to find insertion block");
+        
+        // Find the end of the run.
+        uint32_t count = 1;
+        while(i+count < event_count) {
+            sky_block *next_block;
+            rc = sky_data_file_search_insertion_block(data_file, sorted[i+count], &next_block);
+            check(rc == 0, "Unable to search for insertion block");
+            if(next_block != block) break;
+            count++;
+        }
+
+        // Add the run to the block in one pass.
+        uint32_t position;
+        rc = sky_data_file_get_block_position(data_file, block, &position);
+        check(rc == 0, "Unable to find block position");
+        uint32_t block_count = data_file->block_count;
+        uint32_t free_block_count = data_file->free_block_count;
+        bool added;
+        rc = sky_block_add_events(block, &sorted[i], count, &added);
+        check(rc == 0, "Unable to add events to block");
+
+        // Shadowing the block may have added a block to the directory.
+        if(added && (data_file->block_count != block_count || data_file->free_block_count != free_block_count)) {
+            qsort(data_file->blocks, data_file->block_count, sizeof(sky_block*), compare_blocks);
+        }
+        else if(added) {
+            rc = sky_data_file_move_block(data_file, position);
+            check(rc == 0, "Unable to reposition block");
+        }
+        // If the run couldn't be added at once then add each event.
+        else {
+            uint32_t j;
+            for(j=0; j<count; j++) {
+                rc = sky_data_file_add_event(data_file, sorted[i+j]);
+                check(rc == 0, "Unable to add event");
+            }
+        }
+        
+        i += count;
+    }
+
+    free(sorted);
+    return 0;
+
+error:
+    if(refs) free(refs);
+    if(sorted) free(sorted);
+    return -1;
+}
+
+
+//--------------------------------------
+// Free Blocks
+//--------------------------------------
+
+// Adds every empty block to the free list after the header is loaded. If all
+// blocks are empty then the last block in the directory is kept out of the
+// free list since new events are inserted into it.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_load_free_blocks(sky_data_file *data_file)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+
+    free(data_file->free_blocks);
+    data_file->free_blocks = NULL;
+    data_file->free_block_count = 0;
+
+    // Empty blocks are sorted to the start of the directory.
+    uint32_t i;
+    for(i=0; i+1<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        if(block->min_object_id != 0 || block->max_object_id != 0) {
+            break;
+        }
+        rc = sky_data_file_add_free_block(data_file, block);
+        check(rc == 0, "Unable to add free block");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Adds an empty block to the free list.
+//
+// data_file - The data file.
+// block     - The block to add.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_add_free_block(sky_data_file *data_file, sky_block *block)
+{
+    check(data_file != NULL, "Data file required");
+    check(block != NULL, "Block required");
+
+    data_file->free_block_count++;
+    data_file->free_blocks = realloc(data_file->free_blocks, sizeof(*data_file->free_blocks) * data_file->free_block_count);
+    check_mem(data_file->free_blocks);
+    data_file->free_blocks[data_file->free_block_count-1] = block;
+
+    return 0;
+
+error:
+    data_file->free_block_count = 0;
+    return -1;
+}
+
+// Removes the free block with the lowest index from the free list. Using the
+// lowest index first keeps data toward the start of the file so that the end
+// can be truncated.
+//
+// data_file - The data file.
+//
+// Returns the free block or NULL if there are no free blocks.
+sky_block *sky_data_file_pop_free_block(sky_data_file *data_file)
+{
+    if(data_file->free_block_count == 0) {
+        return NULL;
+    }
+
+    // Find the lowest index.
+    uint32_t i, min = 0;
+    for(i=1; i<data_file->free_block_count; i++) {
+        if(data_file->free_blocks[i]->index < data_file->free_blocks[min]->index) {
+            min = i;
+        }
+    }
+
+    // Remove it from the list.
+    sky_block *block = data_file->free_blocks[min];
+    data_file->free_blocks[min] = data_file->free_blocks[data_file->free_block_count-1];
+    data_file->free_block_count--;
+
+    return block;
+}
+
+
+//--------------------------------------
+// Compaction
+//--------------------------------------
+
+// Merges neighboring multi-object blocks in the directory while their
+// combined data fits within the fill factor of the block size. Spanned and
+// archived blocks are never merged. The emptied blocks are added to the free list and any
+// free blocks at the end of the file are truncated away.
+//
+// Compaction can be performed incrementally by limiting the number of merges
+// per call. Each call starts from the beginning of the directory and skips
+// over blocks that can no longer be merged.
+//
+// data_file       - The data file.
+// fill_factor     - The fraction of the block size to fill blocks up to.
+// max_merge_count - The maximum number of merges to perform or 0 for no
+//                   limit.
+// merge_count     - A pointer to where the number of merges is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_compact(sky_data_file *data_file, double fill_factor,
+                          uint32_t max_merge_count, uint32_t *merge_count)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+    check(data_file->data != NULL, "Data file must be loaded");
+    check(data_file->snapshot_count == 0, "Cannot compact while snapshots are pinned");
+    check(fill_factor > 0 && fill_factor <= 1, "Fill factor must be greater than 0 and at most 1");
+
+    uint32_t _merge_count = 0;
+    size_t fill_length = (size_t)(data_file->block_size * fill_factor);
+
+    // Loop over each run of unspanned blocks in the directory.
+    uint32_t i = 0;
+    while(i < data_file->block_count && (max_merge_count == 0 || _merge_count < max_merge_count)) {
+        sky_block *block = data_file->blocks[i];
+        bool is_empty = (block->min_object_id == 0 && block->max_object_id == 0);
+        if(is_empty || block->spanned || block->archived) {
+            i++;
+            continue;
+        }
+
+        // Columnar paths are measured by the length of their rows so that
+        // the merged block can still be expanded in place.
+        rc = sky_block_load_path_refs(block);
+        check(rc == 0, "Unable to load path directory");
+        size_t block_length = block->data_length;
+        size_t block_row_length;
+        rc = sky_block_get_row_length(block, &block_row_length);
+        check(rc == 0, "Unable to determine block row length");
+
+        // Merge following blocks into this block until it is full.
+        uint32_t j = i+1;
+        while(j < data_file->block_count && (max_merge_count == 0 || _merge_count < max_merge_count)) {
+            sky_block *next_block = data_file->blocks[j];
+            if(next_block->spanned || next_block->archived) {
+                break;
+            }
+
+            rc = sky_block_load_path_refs(next_block);
+            check(rc == 0, "Unable to load path directory");
+            size_t next_block_length = next_block->data_length;
+            size_t next_block_row_length;
+            rc = sky_block_get_row_length(next_block, &next_block_row_length);
+            check(rc == 0, "Unable to determine block row length");
+            if(block_row_length + next_block_row_length > fill_length) {
+                break;
+            }
+
+            uint32_t block_count = data_file->block_count;
+            rc = sky_data_file_merge_blocks(data_file, block, block_length, next_block, next_block_length);
+            check(rc == 0, "Unable to merge blocks");
+            block_length += next_block_length;
+            block_row_length += next_block_row_length;
+            _merge_count++;
+            j++;
+
+            // Blocks added for shadow copies are empty so they are inserted
+            // at the start of the directory.
+            i += data_file->block_count - block_count;
+            j += data_file->block_count - block_count;
+        }
+
+        i = j;
+    }
+
+    // Emptied blocks now sort to the start of the directory.
+    if(_merge_count > 0) {
+        qsort(data_file->blocks, data_file->block_count, sizeof(sky_block*), compare_blocks);
+    }
+
+    // Shrink the file if there are free blocks at the end.
+    rc = sky_data_file_truncate_free_blocks(data_file);
+    check(rc == 0, "Unable to truncate free blocks");
+
+    if(merge_count != NULL) *merge_count = _merge_count;
+    return 0;
+
+error:
+    if(merge_count != NULL) *merge_count = 0;
+    return -1;
+}
+
+// Appends the paths of one block to the end of the previous block in the
+// directory and adds the emptied block to the free list. The directory is not
+// re-sorted.
+//
+// data_file         - The data file.
+// block             - The block to merge into.
+// block_length      - The number of bytes of data in the block.
+// next_block        - The block to merge from.
+// next_block_length - The number of bytes of data in the next block.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_merge_blocks(sky_data_file *data_file, sky_block *block,
+                               size_t block_length, sky_block *next_block,
+                               size_t next_block_length)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+    check(block != NULL, "Block required");
+    check(next_block != NULL, "Next block required");
+    check(block->max_object_id < next_block->min_object_id, "Blocks must be in object id order");
+
+    // Both blocks change so they are shadowed before they are decompressed.
+    rc = sky_data_file_touch_block(data_file, block);
+    check(rc == 0, "Unable to touch block");
+    rc = sky_data_file_touch_block(data_file, next_block);
+    check(rc == 0, "Unable to touch next block");
+
+    // Compressed blocks are decompressed before they are merged.
+    rc = sky_block_decompress(block);
+    check(rc == 0, "Unable to decompress block");
+    rc = sky_block_decompress(next_block);
+    check(rc == 0, "Unable to decompress next block");
+
+    // Move the paths.
+    void *block_ptr, *next_block_ptr;
+    rc = sky_block_get_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve block pointer");
+    rc = sky_block_get_ptr(next_block, &next_block_ptr);
+    check(rc == 0, "Unable to retrieve next block pointer");
+    memcpy(block_ptr + block_length, next_block_ptr, next_block_length);
+    memset(next_block_ptr, 0, next_block_length);
+
+    // Combine the ranges.
+    block->max_object_id = next_block->max_object_id;
+    if(next_block->min_timestamp < block->min_timestamp) {
+        block->min_timestamp = next_block->min_timestamp;
+    }
+    if(next_block->max_timestamp > block->max_timestamp) {
+        block->max_timestamp = next_block->max_timestamp;
+    }
+    sky_block_unload_path_refs(block);
+    rc = sky_block_save_header(block);
+    check(rc == 0, "Unable to save block header");
+
+    // Combine the zone maps if they are both loaded.
+    if(block->zone_map_loaded && next_block->zone_map_loaded) {
+        rc = sky_zone_map_merge(&block->zone_map, &next_block->zone_map);
+        check(rc == 0, "Unable to merge zone maps");
+    }
+    else {
+        sky_block_unload_zone_map(block);
+    }
+
+    // Clear the next block and free it.
+    next_block->min_object_id = 0;
+    next_block->max_object_id = 0;
+    next_block->min_timestamp = 0;
+    next_block->max_timestamp = 0;
+    sky_block_unload_path_refs(next_block);
+    sky_block_unload_zone_map(next_block);
+    rc = sky_block_save_header(next_block);
+    check(rc == 0, "Unable to save next block header");
+    rc = sky_data_file_add_free_block(data_file, next_block);
+    check(rc == 0, "Unable to add free block");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Shrinks the data file and header file by removing free blocks from the end
+// of the file. Unspanned blocks at the end of the file are moved into free
+// blocks earlier in the file so that the file can shrink further. Blocks are
+// not moved when shadow blocks are enabled since their slots are referenced
+// by the published header.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_truncate_free_blocks(sky_data_file *data_file)
+{
+    int rc;
+    sky_block **blocks_by_index = NULL;
+    check(data_file != NULL, "Data file required");
+
+    if(data_file->free_block_count == 0) {
+        return 0;
+    }
+
+    // Index the blocks by their position in the file.
+    blocks_by_index = calloc(data_file->block_count, sizeof(*blocks_by_index));
+    check_mem(blocks_by_index);
+    uint32_t i;
+    for(i=0; i<data_file->block_count; i++) {
+        blocks_by_index[data_file->blocks[i]->index] = data_file->blocks[i];
+    }
+
+    while(data_file->free_block_count > 0 && data_file->block_count > 1) {
+        sky_block *last_block = blocks_by_index[data_file->block_count-1];
+
+        // Find the last block in the free list.
+        uint32_t free_index;
+        for(free_index=0; free_index<data_file->free_block_count; free_index++) {
+            if(data_file->free_blocks[free_index] == last_block) {
+                break;
+            }
+        }
+
+        // If the last block is free then remove it.
+        if(free_index < data_file->free_block_count) {
+            data_file->free_blocks[free_index] = data_file->free_blocks[data_file->free_block_count-1];
+            data_file->free_block_count--;
+
+            // Free blocks are at the start of the directory.
+            for(i=0; i<data_file->block_count; i++) {
+                if(data_file->blocks[i] == last_block) {
+                    break;
+                }
+            }
+            check(i < data_file->block_count, "Free block not found in directory: %d", last_block->index);
+            memmove(&data_file->blocks[i], &data_file->blocks[i+1], sizeof(*data_file->blocks) * (data_file->block_count-i-1));
+            data_file->block_count--;
+            sky_block_free(last_block);
+        }
+        // Otherwise move the last block into the lowest free block. Spans are
+        // left in place since their order depends on the block index and slots
+        // that snapshots can read are left in place.
+        else {
+            if(last_block->spanned || last_block->shared || last_block->retired || data_file->shadow_blocks) {
+                break;
+            }
+            sky_block *free_block = sky_data_file_pop_free_block(data_file);
+            if(free_block->index > last_block->index) {
+                rc = sky_data_file_add_free_block(data_file, free_block);
+                check(rc == 0, "Unable to add free block");
+                break;
+            }
+
+            // Copy the data.
+            void *ptr, *free_ptr;
+            rc = sky_block_get_ptr(last_block, &ptr);
+            check(rc == 0, "Unable to retrieve block pointer");
+            rc = sky_block_get_ptr(free_block, &free_ptr);
+            check(rc == 0, "Unable to retrieve free block pointer");
+            memcpy(free_ptr, ptr, data_file->block_size);
+            memset(ptr, 0, data_file->block_size);
+            free_block->dirty = true;
+            last_block->dirty = true;
+
+            // Swap the block positions and write both headers.
+            uint32_t index = free_block->index;
+            free_block->index = last_block->index;
+            last_block->index = index;
+            blocks_by_index[free_block->index] = free_block;
+            blocks_by_index[last_block->index] = last_block;
+            rc = sky_block_save_header(free_block);
+            check(rc == 0, "Unable to save free block header");
+            rc = sky_block_save_header(last_block);
+            check(rc == 0, "Unable to save block header");
+
+            rc = sky_data_file_add_free_block(data_file, free_block);
+            check(rc == 0, "Unable to add free block");
+        }
+    }
+    free(blocks_by_index);
+    blocks_by_index = NULL;
+
+    // Resize the files to the remaining blocks.
+    size_t header_length = sky_data_file_header_file_hdr_size(data_file->version) + (data_file->block_count * data_file->block_header_size);
+    if(data_file->header_dirty_end > header_length) {
+        data_file->header_dirty_end = header_length;
+    }
+    rc = sky_data_file_load(data_file);
+    check(rc == 0, "Unable to resize data file");
+    rc = sky_data_file_map_header(data_file);
+    check(rc == 0, "Unable to resize header file");
+
+    // Block indices changed so restore the directory order.
+    qsort(data_file->blocks, data_file->block_count, sizeof(sky_block*), compare_blocks);
+
+    return 0;
+
+error:
+    free(blocks_by_index);
+    return -1;
+}
+
+
+
+//--------------------------------------
+// Compression
+//--------------------------------------
+
+// Upgrades the data file to the compressed format version. Every block entry
+// in the header is rewritten with room for its compressed length.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_upgrade(sky_data_file *data_file)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+    check(data_file->header != NULL, "Header file must be loaded");
+
+    if(data_file->version >= SKY_DATA_FILE_COMPRESSED_VERSION) {
+        return 0;
+    }
+
+    // Resize the header for the larger block entries.
+    data_file->version = SKY_DATA_FILE_COMPRESSED_VERSION;
+    data_file->block_header_size = sky_data_file_block_header_size(data_file->version);
+    rc = sky_data_file_map_header(data_file);
+    check(rc == 0, "Unable to remap header file");
+
+    // Shadowed headers are rewritten with the new version when they are
+    // published.
+    if(data_file->shadow_blocks) {
+        return 0;
+    }
+
+    // Write the new version and rewrite each block entry.
+    *((uint32_t*)data_file->header) = data_file->version;
+    rc = sky_data_file_set_header_dirty(data_file, 0, sizeof(uint32_t));
+    check(rc == 0, "Unable to mark header as changed");
+
+    uint32_t i;
+    for(i=0; i<data_file->block_count; i++) {
+        rc = sky_block_save_header(data_file->blocks[i]);
+        check(rc == 0, "Unable to save block header");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Compresses every block in the data file. Version 1 data files are upgraded
+// to version 2 first. Blocks that do not shrink are left uncompressed.
+//
+// data_file - The data file.
+// count     - A pointer to where the number of compressed blocks is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_compress(sky_data_file *data_file, uint32_t *count)
+{
+    int rc;
+    check(data_file != NULL, "Data file required");
+    check(data_file->data != NULL, "Data file must be loaded");
+    check(data_file->snapshot_count == 0, "Cannot compress while snapshots are pinned");
+
+    rc = sky_data_file_upgrade(data_file);
+    check(rc == 0, "Unable to upgrade data file");
+
+    uint32_t _count = 0;
+    uint32_t i;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        uint32_t block_count = data_file->block_count;
+        rc = sky_block_compress(block);
+        check(rc == 0, "Unable to compress block: %d", block->index);
+        if(block->compressed_length > 0) {
+            _count++;
+        }
+
+        // Blocks added for shadow copies are inserted at the start of the
+        // directory.
+        i += data_file->block_count - block_count;
+    }
+
+    if(count != NULL) {
+        *count = _count;
+    }
+    return 0;
+
+error:
+    if(count != NULL) *count = 0;
+    return -1;
+}
+
+
+//--------------------------------------
+// Archive
+//--------------------------------------
+
+// Moves the blocks whose events are all older than a timestamp into the data
+// file's archive. The compressed data of each block is appended to the
+// archive and synced before any block refers to it. Blocks that are already
+// compressed are archived as they are and blocks that don't shrink are still
+// archived since archived data isn't limited to the size of a slot. Version 1
+// data files are upgraded to version 2 first.
+//
+// data_file - The data file.
+// timestamp - The timestamp that every event of an archived block is before.
+// count     - A pointer to where the number of archived blocks is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_archive(sky_data_file *data_file, sky_timestamp_t timestamp,
+                          uint32_t *count)
+{
+    int rc;
+    void *buffer = NULL;
+    sky_block **blocks = NULL;
+    uint64_t *offsets = NULL;
+    uint32_t *lengths = NULL;
+    check(data_file != NULL, "Data file required");
+    check(data_file->data != NULL, "Data file must be loaded");
+    check(data_file->archive != NULL, "Data file archive required");
+    check(data_file->snapshot_count == 0, "Cannot archive while snapshots are pinned");
+
+    rc = sky_data_file_upgrade(data_file);
+    check(rc == 0, "Unable to upgrade data file");
+
+    // Allocate room for the worst case expansion of a block.
+    size_t buffer_length = data_file->block_size + (data_file->block_size / SKY_COMPRESSION_MAX_LITERAL_LENGTH) + 2;
+    buffer = malloc(buffer_length); check_mem(buffer);
+    blocks = calloc(data_file->block_count, sizeof(*blocks)); check_mem(blocks);
+    offsets = calloc(data_file->block_count, sizeof(*offsets)); check_mem(offsets);
+    lengths = calloc(data_file->block_count, sizeof(*lengths)); check_mem(lengths);
+
+    // Append the compressed data of each cold block to the archive.
     uint32_t i;
-    sky_object_id_t last_object_id = -1;
+    uint32_t _count = 0;
     for(i=0; i<data_file->block_count; i++) {
         sky_block *block = data_file->blocks[i];
-        
-        // If this is a single object block then track the object id to
-        // possibly mark it as spanned.
-        if(block->min_object_id == block->max_object_id && block->min_object_id > 0) {
-            // If it has spanned since the last block then mark it and the
-            // previous block.
-            if(block->min_object_id == last_object_id) {
-                block->spanned = true;
-                data_file->blocks[i-1]->spanned = true;
-            }
-            // If this is the first block with one object then store the id.
-            else {
-                last_object_id = block->min_object_id;
-            }
+        bool is_empty = (block->min_object_id == 0 && block->max_object_id == 0);
+        if(is_empty || block->archived || block->max_timestamp >= timestamp) {
+            continue;
+        }
+
+        void *ptr;
+        size_t length;
+        if(block->compressed_length > 0) {
+            rc = sky_block_get_ptr(block, &ptr);
+            check(rc == 0, "Unable to retrieve block pointer");
+            length = block->compressed_length;
         }
-        // Clear out last object id for multi-object blocks.
         else {
-            last_object_id = -1;
+            rc = sky_block_load_path_refs(block);
+            check(rc == 0, "Unable to load path directory");
+            if(block->data_length == 0) {
+                continue;
+            }
+            rc = sky_block_get_ptr(block, &ptr);
+            check(rc == 0, "Unable to retrieve block pointer");
+            rc = sky_compress(ptr, block->data_length, buffer, buffer_length, &length);
+            check(rc == 0 && length > 0, "Unable to compress block: %d", block->index);
+            ptr = buffer;
         }
+
+        rc = sky_archive_append(data_file->archive, ptr, length, &offsets[_count]);
+        check(rc == 0, "Unable to append block to archive: %d", block->index);
+        blocks[_count] = block;
+        lengths[_count] = (uint32_t)length;
+        _count++;
+    }
+
+    // Make the archived data durable and then point the blocks at it.
+    rc = sky_archive_sync(data_file->archive);
+    check(rc == 0, "Unable to sync archive");
+    for(i=0; i<_count; i++) {
+        rc = sky_block_archive(blocks[i], offsets[i], lengths[i]);
+        check(rc == 0, "Unable to archive block: %d", blocks[i]->index);
     }
 
+    free(buffer);
+    free(blocks);
+    free(offsets);
+    free(lengths);
+    if(count != NULL) *count = _count;
     return 0;
+
+error:
+    free(buffer);
+    free(blocks);
+    free(offsets);
+    free(lengths);
+    if(count != NULL) *count = 0;
+    return -1;
 }
 
-// Moves a specific number of bytes from a given pointer to a newly created
-// block. The pointer passed in may change if the data file is remapped to a
-// different memory location.
+
+//--------------------------------------
+// Retention
+//--------------------------------------
+
+// Removes the events before a timestamp from the data file. Blocks whose
+// events are all older than the timestamp are cleared and added to the free
+// list. Blocks with some older events have the expired events removed from
+// the start of each path. A span that is left with a single block is no
+// longer marked as spanned.
 //
-// data_file - The data file that contains the pointer.
-// ptr       - A pointer to a location on the data file.
-// sz        - The number of bytes to move to a new block.
-// new_block - A pointer to where the new block should be returned.
+// data_file     - The data file.
+// timestamp     - The timestamp of the oldest event to keep.
+// dropped_count - A pointer to where the number of cleared blocks is
+//                 returned.
+// trimmed_count - A pointer to where the number of rewritten blocks is
+//                 returned.
 //
 // Returns 0 if successful, otherwise returns -1.
-int sky_data_file_move_to_new_block(sky_data_file *data_file, void **ptr,
-                                    size_t sz, sky_block **new_block)
+int sky_data_file_expire(sky_data_file *data_file, sky_timestamp_t timestamp,
+                         uint32_t *dropped_count, uint32_t *trimmed_count)
 {
     int rc;
     check(data_file != NULL, "Data file required");
+    check(data_file->data != NULL, "Data file must be loaded");
+    check(data_file->snapshot_count == 0, "Cannot expire while snapshots are pinned");
 
-    // Store offset before data file remap.
-    off_t ptr_off = (*ptr) - data_file->data;
+    uint32_t i;
+    uint32_t _dropped_count = 0;
+    uint32_t _trimmed_count = 0;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        bool is_empty = (block->min_object_id == 0 && block->max_object_id == 0);
+        if(is_empty || block->retired || block->min_timestamp >= timestamp) {
+            continue;
+        }
 
-    // Create block.
-    rc = sky_data_file_create_block(data_file, new_block);
-    check(rc == 0, "Unable to create new block");
-    
-    // Restore pointers in case remap relocated data.
-    *ptr = data_file->data + ptr_off;
+        // Drop the block if every event has expired. Otherwise rewrite it.
+        uint32_t block_count = data_file->block_count;
+        if(block->max_timestamp < timestamp) {
+            rc = sky_block_clear(block);
+            check(rc == 0, "Unable to clear block: %d", block->index);
+            _dropped_count++;
+        }
+        else {
+            rc = sky_block_expire(block, timestamp);
+            check(rc == 0, "Unable to expire block: %d", block->index);
+            _trimmed_count++;
+        }
+        if(block->min_object_id == 0 && block->max_object_id == 0) {
+            rc = sky_data_file_add_free_block(data_file, block);
+            check(rc == 0, "Unable to add free block");
+        }
 
-    // Retrieve new block's pointer.
-    void *new_block_ptr = NULL;
-    rc = sky_block_get_ptr(*new_block, &new_block_ptr);
-    check(rc == 0, "Unable to determine new block pointer");
-    
-    // Copy over everything since the checkpoint.
-    memmove(new_block_ptr, (*ptr), sz);
+        // Blocks added for shadow copies are inserted at the start of the
+        // directory.
+        i += data_file->block_count - block_count;
+    }
 
-    // Clear out data from the source block.
-    memset((*ptr), 0, sz);
-    
-    // Perform a full update on the block header. This is probably not
-    // needed but we're going to be safe. The amortized cost of this
-    // should be small considering splits shouldn't happen often.
-    rc = sky_block_full_update(*new_block);
-    check(rc == 0, "Unable to update block ranges on new block");
+    if(_dropped_count > 0 || _trimmed_count > 0) {
+        // Emptied blocks now sort to the start of the directory and the
+        // blocks of a span are kept in order of their new ranges.
+        qsort(data_file->blocks, data_file->block_count, sizeof(sky_block*), compare_blocks);
+
+        // Unmark spans that only have a single block left.
+        for(i=0; i<data_file->block_count; i++) {
+            sky_block *block = data_file->blocks[i];
+            if(block->spanned) {
+                sky_block *first_block;
+                uint32_t span_count;
+                rc = sky_data_file_get_object_blocks(data_file, block->min_object_id, &first_block, &span_count);
+                check(rc == 0, "Unable to find object blocks");
+                if(span_count == 1) {
+                    block->spanned = false;
+                    rc = sky_block_save_header(block);
+                    check(rc == 0, "Unable to save block header");
+                }
+            }
+        }
 
+        // Shrink the file if there are free blocks at the end.
+        rc = sky_data_file_truncate_free_blocks(data_file);
+        check(rc == 0, "Unable to truncate free blocks");
+    }
+
+    if(dropped_count != NULL) *dropped_count = _dropped_count;
+    if(trimmed_count != NULL) *trimmed_count = _trimmed_count;
     return 0;
-    
+
 error:
+    if(dropped_count != NULL) *dropped_count = 0;
+    if(trimmed_count != NULL) *trimmed_count = 0;
     return -1;
 }
 
 
 //--------------------------------------
-// Event Management
+// Runs
 //--------------------------------------
 
-// Adds an event to the data file.
+// Loads the runs of the data file. Runs are numbered consecutively from zero
+// and a run without a header file was never completely written.
 //
-// data_file - The data file to add the event to..
-// event     - The event to add.
+// data_file - The data file.
 //
 // Returns 0 if successful, otherwise returns -1.
-int sky_data_file_add_event(sky_data_file *data_file, sky_event *event)
+int sky_data_file_load_runs(sky_data_file *data_file)
 {
     int rc;
+    sky_data_file *run = NULL;
     check(data_file != NULL, "Data file required");
-    check(event != NULL, "Event required");
-    
-    // Find insertion block.
-    sky_block *block;
-    rc = sky_data_file_find_insertion_block(data_file, event, &block);
-    check(rc == 0, "Unable to find insertion block");
-    
-    // Add the event to the block.
-    rc = sky_block_add_event(block, event);
-    check(rc == 0, "Unable to add event to block");
+    check(data_file->run_path != NULL, "Run path required");
 
-    // Re-sort blocks.
-    qsort(data_file->blocks, data_file->block_count, sizeof(sky_block*), compare_blocks);
-    
+    sky_data_file_unload_runs(data_file);
+
+    while(true) {
+        bstring header_path = bformat("%s.%d.header", bdata(data_file->run_path), data_file->run_count);
+        check_mem(header_path);
+        if(!sky_file_exists(header_path)) {
+            bdestroy(header_path);
+            break;
+        }
+
+        run = sky_data_file_create(); check_mem(run);
+        run->header_path = header_path;
+        run->path = bformat("%s.%d", bdata(data_file->run_path), data_file->run_count);
+        check_mem(run->path);
+        rc = sky_data_file_load(run);
+        check(rc == 0, "Unable to load run: %s", bdata(run->path));
+
+        data_file->runs = realloc(data_file->runs, sizeof(*data_file->runs) * (data_file->run_count+1));
+        check_mem(data_file->runs);
+        data_file->runs[data_file->run_count++] = run;
+        run = NULL;
+    }
+
+    return 0;
+
+error:
+    sky_data_file_free(run);
+    sky_data_file_unload_runs(data_file);
+    return -1;
+}
+
+// Closes the runs of the data file. The run files are left in place.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_unload_runs(sky_data_file *data_file)
+{
+    check(data_file != NULL, "Data file required");
+
+    uint32_t i;
+    for(i=0; i<data_file->run_count; i++) {
+        sky_data_file_free(data_file->runs[i]);
+    }
+    free(data_file->runs);
+    data_file->runs = NULL;
+    data_file->run_count = 0;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Opens a bulk loader that writes the next run of the data file. Events must
+// be added to the loader in order of object id and timestamp. The run is
+// written with the version and block size of the data file and its blocks
+// are filled completely since runs are never changed. The run records the
+// LSN of the last log record that it holds.
+//
+// data_file - The data file.
+// lsn       - The LSN of the last log record written to the run.
+// ret       - A pointer to where the loader is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_open_run(sky_data_file *data_file, uint64_t lsn,
+                           struct sky_bulk_loader **ret)
+{
+    int rc;
+    sky_bulk_loader *loader = NULL;
+    check(data_file != NULL, "Data file required");
+    check(data_file->run_path != NULL, "Run path required");
+    check(ret != NULL, "Bulk loader return address required");
+
+    // The header is written to a temporary file until the run is closed.
+    loader = sky_bulk_loader_create(); check_mem(loader);
+    loader->version = data_file->version;
+    loader->block_size = data_file->block_size;
+    loader->lsn = lsn;
+    loader->fill_factor = 1.0;
+    loader->path = bformat("%s.%d", bdata(data_file->run_path), data_file->run_count);
+    check_mem(loader->path);
+    loader->header_path = bformat("%s.%d.header.tmp", bdata(data_file->run_path), data_file->run_count);
+    check_mem(loader->header_path);
+    rc = sky_bulk_loader_open(loader);
+    check(rc == 0, "Unable to open run: %s", bdata(loader->path));
+
+    *ret = loader;
+    return 0;
+
+error:
+    sky_bulk_loader_free(loader);
+    if(ret != NULL) *ret = NULL;
+    return -1;
+}
+
+// Closes a bulk loader opened with sky_data_file_open_run() and adds the run
+// to the data file. The run is synced to disk before its header file is
+// renamed into place. The loader is freed.
+//
+// data_file - The data file.
+// loader    - The bulk loader.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_close_run(sky_data_file *data_file,
+                            struct sky_bulk_loader *loader)
+{
+    int rc;
+    bstring header_path = NULL;
+    sky_data_file *run = NULL;
+    check(data_file != NULL, "Data file required");
+    check(loader != NULL, "Bulk loader required");
+
+    rc = sky_bulk_loader_close(loader);
+    check(rc == 0, "Unable to close run: %s", bdata(loader->path));
+    rc = sky_data_file_sync_path(loader->path);
+    check(rc == 0, "Unable to sync run: %s", bdata(loader->path));
+    rc = sky_data_file_sync_path(loader->header_path);
+    check(rc == 0, "Unable to sync run header: %s", bdata(loader->header_path));
+
+    // Publish the run.
+    header_path = bformat("%s.%d.header", bdata(data_file->run_path), data_file->run_count);
+    check_mem(header_path);
+    rc = rename(bdata(loader->header_path), bdata(header_path));
+    check(rc == 0, "Unable to publish run header: %s", bdata(header_path));
+
+    // Load the run.
+    run = sky_data_file_create(); check_mem(run);
+    run->path = bstrcpy(loader->path); check_mem(run->path);
+    run->header_path = header_path;
+    header_path = NULL;
+    rc = sky_data_file_load(run);
+    check(rc == 0, "Unable to load run: %s", bdata(run->path));
+    data_file->runs = realloc(data_file->runs, sizeof(*data_file->runs) * (data_file->run_count+1));
+    check_mem(data_file->runs);
+    data_file->runs[data_file->run_count++] = run;
+
+    sky_bulk_loader_free(loader);
+    return 0;
+
+error:
+    bdestroy(header_path);
+    sky_data_file_free(run);
+    sky_bulk_loader_free(loader);
+    return -1;
+}
+
+// Merges the runs into the data file. The paths of the data file and of its
+// runs are read together in order of object id and written sequentially to a
+// new data file and header file with the bulk loader. Events older than the
+// minimum timestamp have expired and are dropped instead of merged.
+//
+// The merge is committed by writing a manifest with the number of runs that
+// it covers once the new files are on disk. The new files then replace the
+// data file and the merged runs are removed. A merge that is interrupted is
+// finished or discarded the next time the data file is loaded depending on
+// whether its manifest was written.
+//
+// data_file     - The data file.
+// min_timestamp - The timestamp of the oldest event to keep or zero to keep
+//                 every event.
+// count         - A pointer to where the number of merged events is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_merge_runs(sky_data_file *data_file,
+                             sky_timestamp_t min_timestamp, uint32_t *count)
+{
+    int rc;
+    sky_event *event = NULL;
+    sky_bulk_loader *loader = NULL;
+    sky_cursor cursor;
+    sky_cursor_init(&cursor);
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    check(data_file != NULL, "Data file required");
+    check(data_file->run_path != NULL, "Run path required");
+    check(data_file->snapshot_count == 0, "Cannot merge runs while snapshots are pinned");
+    check(data_file->memtable == NULL || data_file->memtable->event_count == 0, "Memtable must be applied before runs are merged");
+
+    uint32_t _count = 0;
+    uint32_t run_count = data_file->run_count;
+    if(run_count == 0) {
+        if(count != NULL) *count = 0;
+        return 0;
+    }
+
+    // Count the run events that are kept.
+    rc = sky_data_file_count_run_events(data_file, min_timestamp, &_count);
+    check(rc == 0, "Unable to count run events");
+
+    // Write pending changes so that they are read into the merge.
+    rc = sky_data_file_flush(data_file);
+    check(rc == 0, "Unable to flush data file");
+
+    // Write the data file and its runs to new files.
+    loader = sky_bulk_loader_create(); check_mem(loader);
+    loader->version = data_file->version;
+    loader->block_size = data_file->block_size;
+    loader->lsn = sky_data_file_get_applied_lsn(data_file);
+    loader->path = bformat("%s.merge", bdata(data_file->path));
+    check_mem(loader->path);
+    loader->header_path = bformat("%s.merge", bdata(data_file->header_path));
+    check_mem(loader->header_path);
+    rc = sky_bulk_loader_open(loader);
+    check(rc == 0, "Unable to open merged data file: %s", bdata(loader->path));
+
+    event = sky_event_create(0, 0, 0); check_mem(event);
+    rc = sky_path_iterator_set_data_file(&iterator, data_file);
+    check(rc == 0, "Unable to initialize merge iterator");
+    while(!iterator.eof) {
+        rc = sky_path_iterator_set_cursor(&iterator, &cursor);
+        check(rc == 0, "Unable to set cursor to merged path");
+        while(!cursor.eof) {
+            if(min_timestamp == 0 || cursor.timestamp >= min_timestamp) {
+                rc = sky_cursor_get_event(&cursor, event);
+                check(rc == 0, "Unable to unpack merged event");
+                event->object_id = iterator.current_object_id;
+                rc = sky_bulk_loader_add_event(loader, event);
+                check(rc == 0, "Unable to add merged event");
+            }
+            rc = sky_cursor_next(&cursor);
+            check(rc == 0, "Unable to move to next merged event");
+        }
+
+        rc = sky_path_iterator_next(&iterator);
+        check(rc == 0, "Unable to move to next merged path");
+    }
+    sky_path_iterator_uninit(&iterator);
+    sky_cursor_uninit(&cursor);
+    sky_event_free(event);
+    event = NULL;
+
+    rc = sky_bulk_loader_close(loader);
+    check(rc == 0, "Unable to close merged data file");
+    rc = sky_data_file_sync_path(loader->path);
+    check(rc == 0, "Unable to sync merged data file");
+    rc = sky_data_file_sync_path(loader->header_path);
+    check(rc == 0, "Unable to sync merged header file");
+    sky_bulk_loader_free(loader);
+    loader = NULL;
+
+    // Commit the merge and then swap in the new files.
+    rc = sky_data_file_write_merge_manifest(data_file, run_count);
+    check(rc == 0, "Unable to write merge manifest");
+    rc = sky_data_file_unload(data_file);
+    check(rc == 0, "Unable to unload data file");
+    rc = sky_data_file_recover_merge(data_file);
+    check(rc == 0, "Unable to publish merged data file");
+    rc = sky_data_file_load(data_file);
+    check(rc == 0, "Unable to load merged data file");
+
+    if(count != NULL) *count = _count;
+    return 0;
+
+error:
+    sky_path_iterator_uninit(&iterator);
+    sky_cursor_uninit(&cursor);
+    sky_event_free(event);
+    sky_bulk_loader_free(loader);
+    if(count != NULL) *count = 0;
+    return -1;
+}
+
+// Calculates the LSN of the last log record applied to the data file or to
+// any of its runs.
+//
+// data_file - The data file.
+//
+// Returns the LSN of the last applied log record.
+uint64_t sky_data_file_get_applied_lsn(sky_data_file *data_file)
+{
+    uint32_t i;
+    uint64_t lsn = data_file->lsn;
+    for(i=0; i<data_file->run_count; i++) {
+        if(data_file->runs[i]->lsn > lsn) {
+            lsn = data_file->runs[i]->lsn;
+        }
+    }
+    return lsn;
+}
+
+// Counts the events in the runs of a data file.
+//
+// data_file     - The data file.
+// min_timestamp - The timestamp of the oldest event to count or zero to count
+//                 every event.
+// ret           - A pointer to where the number of events is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_count_run_events(sky_data_file *data_file,
+                                   sky_timestamp_t min_timestamp,
+                                   uint32_t *ret)
+{
+    int rc;
+    sky_cursor cursor;
+    sky_cursor_init(&cursor);
+    check(data_file != NULL, "Data file required");
+    check(ret != NULL, "Return address required");
+
+    uint32_t i;
+    uint32_t count = 0;
+    for(i=0; i<data_file->run_count; i++) {
+        sky_path_iterator iterator;
+        sky_path_iterator_init(&iterator);
+        rc = sky_path_iterator_set_data_file(&iterator, data_file->runs[i]);
+        check(rc == 0, "Unable to initialize run iterator");
+        while(!iterator.eof) {
+            rc = sky_path_iterator_set_cursor(&iterator, &cursor);
+            check(rc == 0, "Unable to set cursor to run path");
+            while(!cursor.eof) {
+                if(min_timestamp == 0 || cursor.timestamp >= min_timestamp) {
+                    count++;
+                }
+                rc = sky_cursor_next(&cursor);
+                check(rc == 0, "Unable to move to next run event");
+            }
+            rc = sky_path_iterator_next(&iterator);
+            check(rc == 0, "Unable to move to next run path");
+        }
+    }
+
+    sky_cursor_uninit(&cursor);
+    *ret = count;
+    return 0;
+
+error:
+    sky_cursor_uninit(&cursor);
+    if(ret != NULL) *ret = 0;
+    return -1;
+}
+
+// Writes the manifest that commits a merge. The manifest holds the number of
+// runs that were merged and is written to a temporary file that is renamed
+// into place.
+//
+// data_file - The data file.
+// run_count - The number of runs that were merged.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_write_merge_manifest(sky_data_file *data_file,
+                                       uint32_t run_count)
+{
+    int rc;
+    int fd = -1;
+    bstring path = NULL;
+    bstring tmp_path = NULL;
+    check(data_file != NULL, "Data file required");
+    check(data_file->run_path != NULL, "Run path required");
+
+    path = bformat("%s.merged", bdata(data_file->run_path)); check_mem(path);
+    tmp_path = bformat("%s.tmp", bdata(path)); check_mem(tmp_path);
+    fd = open(bdata(tmp_path), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    check(fd != -1, "Unable to open merge manifest: %s", bdata(tmp_path));
+    ssize_t written = write(fd, &run_count, sizeof(run_count));
+    check(written == sizeof(run_count), "Unable to write merge manifest: %s", bdata(tmp_path));
+    rc = fsync(fd);
+    check(rc == 0, "Unable to sync merge manifest: %s", bdata(tmp_path));
+    close(fd);
+    fd = -1;
+
+    rc = rename(bdata(tmp_path), bdata(path));
+    check(rc == 0, "Unable to publish merge manifest: %s", bdata(path));
+    rc = sky_data_file_sync_dir(path);
+    check(rc == 0, "Unable to sync merge manifest directory");
+
+    bdestroy(path);
+    bdestroy(tmp_path);
+    return 0;
+
+error:
+    if(fd != -1) close(fd);
+    bdestroy(path);
+    bdestroy(tmp_path);
+    return -1;
+}
+
+// Finishes or discards a merge of the runs of an unloaded data file. If the
+// merge manifest exists then the merged files replace the data file and the
+// merged runs are removed before the manifest itself is removed. Otherwise
+// any merged files that were left by an interrupted merge are removed.
+//
+// data_file - The data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_recover_merge(sky_data_file *data_file)
+{
+    int rc;
+    FILE *file = NULL;
+    bstring manifest_path = NULL;
+    bstring merge_path = NULL;
+    bstring merge_header_path = NULL;
+    bstring path = NULL;
+    check(data_file != NULL, "Data file required");
+    check(data_file->run_path != NULL, "Run path required");
+
+    manifest_path = bformat("%s.merged", bdata(data_file->run_path)); check_mem(manifest_path);
+    merge_path = bformat("%s.merge", bdata(data_file->path)); check_mem(merge_path);
+    merge_header_path = bformat("%s.merge", bdata(data_file->header_path)); check_mem(merge_header_path);
+
+    // Discard a merge that was never committed.
+    if(!sky_file_exists(manifest_path)) {
+        rc = sky_file_rm(merge_path);
+        check(rc == 0, "Unable to remove merged data file");
+        rc = sky_file_rm(merge_header_path);
+        check(rc == 0, "Unable to remove merged header file");
+
+        bdestroy(manifest_path);
+        bdestroy(merge_path);
+        bdestroy(merge_header_path);
+        return 0;
+    }
+
+    uint32_t run_count = 0;
+    file = fopen(bdata(manifest_path), "r");
+    check(file != NULL, "Unable to open merge manifest: %s", bdata(manifest_path));
+    check(fread(&run_count, sizeof(run_count), 1, file) == 1, "Unable to read merge manifest: %s", bdata(manifest_path));
+    fclose(file);
+    file = NULL;
+
+    // Replace the data file. Either file may already have been renamed.
+    if(sky_file_exists(merge_path)) {
+        rc = rename(bdata(merge_path), bdata(data_file->path));
+        check(rc == 0, "Unable to replace data file: %s", bdata(data_file->path));
+    }
+    if(sky_file_exists(merge_header_path)) {
+        rc = rename(bdata(merge_header_path), bdata(data_file->header_path));
+        check(rc == 0, "Unable to replace header file: %s", bdata(data_file->header_path));
+    }
+    rc = sky_data_file_sync_dir(data_file->header_path);
+    check(rc == 0, "Unable to sync data file directory");
+
+    // Remove the merged runs and then the manifest.
+    uint32_t i;
+    for(i=0; i<run_count; i++) {
+        path = bformat("%s.%d.header", bdata(data_file->run_path), i); check_mem(path);
+        rc = sky_file_rm(path);
+        check(rc == 0, "Unable to remove run header: %s", bdata(path));
+        bdestroy(path);
+
+        path = bformat("%s.%d", bdata(data_file->run_path), i); check_mem(path);
+        rc = sky_file_rm(path);
+        check(rc == 0, "Unable to remove run: %s", bdata(path));
+        bdestroy(path);
+        path = NULL;
+    }
+    rc = sky_data_file_sync_dir(data_file->run_path);
+    check(rc == 0, "Unable to sync run directory");
+    rc = sky_file_rm(manifest_path);
+    check(rc == 0, "Unable to remove merge manifest");
+
+    bdestroy(manifest_path);
+    bdestroy(merge_path);
+    bdestroy(merge_header_path);
+    return 0;
+
+error:
+    if(file != NULL) fclose(file);
+    bdestroy(manifest_path);
+    bdestroy(merge_path);
+    bdestroy(merge_header_path);
+    bdestroy(path);
+    return -1;
+}
+
+// Syncs the contents of a file to disk.
+//
+// path - The path of the file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_sync_path(bstring path)
+{
+    int rc;
+    int fd = open(bdata(path), O_RDONLY);
+    check(fd != -1, "Unable to open file: %s", bdata(path));
+    rc = fsync(fd);
+    close(fd);
+    check(rc == 0, "Unable to sync file: %s", bdata(path));
+    return 0;
+
+error:
+    return -1;
+}
+
+// Syncs the directory that holds a file so that renames and removals of
+// files in it are on disk.
+//
+// path - The path of a file in the directory.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_data_file_sync_dir(bstring path)
+{
+    int rc;
+    int pos = bstrrchr(path, '/');
+    bstring dir_path = (pos != BSTR_ERR ? bmidstr(path, 0, (pos > 0 ? pos : 1)) : bfromcstr("."));
+    check_mem(dir_path);
+    rc = sky_data_file_sync_path(dir_path);
+    bdestroy(dir_path);
+    check(rc == 0, "Unable to sync directory");
     return 0;
 
 error:
@@ -3,14 +3,19 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <pthread.h>
 
 typedef struct sky_data_file sky_data_file;
 
+struct sky_bulk_loader;
+
 #include "bstring.h"
 #include "file.h"
 #include "types.h"
 #include "block.h"
 #include "event.h"
+#include "archive.h"
+#include "memtable.h"
 
 //==============================================================================
 //
@@ -20,8 +25,123 @@ typedef struct sky_data_file sky_data_file;
 
 // The header file stores information about how the table's data file is
 // structured. The beginning of the file lists the database format version
-// (4-bytes), block size (4-bytes) and block count (4-bytes). From there the
-// blocks are listed out in 
+// (4-bytes) and block size (4-bytes). From there the blocks are listed out in
+// order of block index.
+//
+// Version 1 data files store every block uncompressed. Version 2 data files
+// can also store compressed blocks and each block entry in the header records
+// the compressed length of the block (or zero if it is uncompressed). New
+// data files are created as version 1 and are upgraded to version 2 when
+// their blocks are first compressed.
+//
+// Version 3 data files use the same header as version 2 but new events are
+// written with the delta encoding, which stores timestamps as offsets from
+// the previous event in the path and stores action ids and data lengths as
+// varints. Existing tables are rewritten to version 3 with sky-migrate.
+//
+// Version 4 data files are delta encoded and can also store paths in
+// columns. Columnar paths are written by the bulk loader and are expanded
+// back into delta encoded rows when their block is changed.
+//
+// Version 5 data files have wide object ids. Their block entries store 64-bit
+// object id ranges and their path headers store the object id as a varint.
+// Other versions only hold object ids that fit in 32 bits. Existing tables
+// are rewritten to version 5 with sky-migrate.
+//
+// Version 6 data files also index the data section of new events that have
+// many properties so that queries can look up the properties they need
+// without decoding the rest. Existing tables are rewritten to version 6 with
+// sky-migrate.
+//
+// Version 7 data files also store the log sequence number (LSN) of the last
+// write-ahead log record applied to them (8-bytes) after the block size. The
+// LSN is kept in memory until the data file is flushed and is only written
+// to the header file once the blocks that it covers have been synced, or is
+// published with them when shadow blocks are used, so replaying the log
+// after a crash skips the records that the data file already holds.
+// Older versions don't record an LSN and always replay the whole log.
+// Existing tables are rewritten to version 7 with sky-migrate.
+//
+// The header file is memory-mapped while the data file is loaded. Block range
+// changes are written directly into the mapping and the modified region is
+// tracked so that it can be synced back to disk in a single batch when the
+// data file is flushed or unloaded. Block data is synced at the same time.
+//
+// In memory, the blocks are kept sorted by object id range so that they form
+// a directory that can be searched by bisection. This is used to find the
+// insertion block for an event and the blocks that hold a given object.
+//
+// Blocks that are emptied by compaction are kept on a free list and are
+// reused by later splits before the data file is grown. Free blocks at the
+// end of the data file are truncated away.
+//
+// The zone maps of the blocks are saved to a separate zone map file when the
+// data file is unloaded. The file stores a checksum of the header file and is
+// only used if the header still matches. The file is removed once it is read
+// so that zone maps are rebuilt from the blocks if the data file is changed
+// without being unloaded cleanly.
+//
+// The data file grows in extents rather than one block at a time. The file
+// itself is always the exact length of its blocks but the memory mapping and
+// the disk space reserved for the file cover a whole extent so that new
+// blocks are created without remapping. Extents grow with the file up to a
+// fixed maximum so that a large file is remapped only a few times. The
+// header file mapping reserves room for the block entries of the extent too.
+//
+// Blocks that are changed are tracked as dirty and a flush only syncs the
+// dirty blocks rather than the whole data file.
+//
+// A data file can also be opened with shadow blocks, which keeps the files on
+// disk consistent if the process crashes in the middle of an update. The
+// first change to a block after a flush copies the block into a free slot
+// and the change is made to the copy. The original slot is retired but is
+// left intact until the next flush. The header file isn't written in place.
+// Instead a flush syncs the dirty blocks and then writes a new header file
+// that is renamed over the old one so that every moved block is published at
+// once. The retired slots are then freed. Free blocks are only truncated
+// from the end of the file and blocks are not moved to shrink the file.
+//
+// Readers can pin a snapshot of the data file so that they see the blocks as
+// they were when the snapshot was pinned while events continue to be added.
+// Blocks that are shared with a snapshot are copied before they are changed
+// in the same way as shadow blocks. A mapping that has to grow while
+// snapshots are pinned is replaced by a new one and the old mapping is kept
+// until those snapshots are released. Changes to a data file that can have
+// snapshots pinned on other threads must be made while holding its lock. See
+// snapshot.h for details.
+//
+// Blocks whose events are all older than a given timestamp can be moved to
+// the data file's archive, which stores their compressed data end to end in
+// a separate read-only mapping. Archived blocks stay in the block directory
+// and are read like any other compressed block. See archive.h for details.
+//
+// Events older than a retention timestamp are removed by expiring the data
+// file. Blocks whose events have all expired are cleared and added to the
+// free list without reading them. Blocks that hold both expired and current
+// events are rewritten in place without the expired prefix of each path.
+// Expired blocks that were archived leave their data in the archive file.
+//
+// A data file can also have runs, which are immutable data files of sorted
+// events that were written by the bulk loader beside the data file instead
+// of being inserted into its blocks. Runs are numbered in the order they are
+// written and a run is only visible once its header file is in place. Path
+// iterators merge the paths of the runs with the paths of the data file's
+// blocks. Merging the runs writes the merged paths of the data file and its
+// runs sequentially to new files. A manifest that records how many runs were
+// merged is then written to commit the merge before the new files replace
+// the data file and the run files are removed. Loading a data file finishes
+// a committed merge and discards one that was not committed.
+//
+// A data file can also be given a memtable of the events that have been
+// logged for it but not applied yet. Path iterators read the memtable after
+// the runs so that the events are visible before they are applied. The data
+// file frees its memtable.
+//
+// The data file mapping is given access hints so that scans don't stall on
+// single page faults. Scans prefetch the blocks ahead of the one that they
+// are reading and a data file can be warmed after it is loaded, which reads
+// the whole file into the page cache in the background. The mapping can
+// also be backed by huge pages where the kernel supports it.
 
 
 //==============================================================================
@@ -32,19 +152,81 @@ typedef struct sky_data_file sky_data_file;
 
 #define SKY_DEFAULT_BLOCK_SIZE 0x10000
 
-#define SKY_DATA_FILE_VERSION  1
+#define SKY_DATA_FILE_RAW_VERSION 1
+
+#define SKY_DATA_FILE_COMPRESSED_VERSION 2
+
+#define SKY_DATA_FILE_DELTA_VERSION 3
+
+#define SKY_DATA_FILE_COLUMNAR_VERSION 4
+
+#define SKY_DATA_FILE_WIDE_VERSION 5
+
+#define SKY_DATA_FILE_INDEXED_VERSION 6
+
+#define SKY_DATA_FILE_LSN_VERSION 7
+
+#define SKY_DATA_FILE_VERSION SKY_DATA_FILE_LSN_VERSION
+
+#define SKY_DEFAULT_FILL_FACTOR 0.9
+
+#define SKY_DEFAULT_EXTENT_SIZE 16
+
+#define SKY_DATA_FILE_MAX_EXTENT_LENGTH 0x4000000
 
 #define SKY_HEADER_FILE_HDR_SIZE sizeof(uint32_t) + sizeof(uint32_t)
 
+#define SKY_LSN_HEADER_FILE_HDR_SIZE (SKY_HEADER_FILE_HDR_SIZE) + sizeof(uint64_t)
+
+
+// This structure is a mapping of the data file that was replaced while
+// snapshots were pinned. It is unmapped once the snapshots that can read
+// through it are released.
+typedef struct sky_data_file_mapping {
+    void *data;
+    size_t length;
+    uint32_t epoch;
+} sky_data_file_mapping;
+
 struct sky_data_file {
     bstring path;
     bstring header_path;
+    bstring zone_map_path;
+    bstring archive_path;
+    sky_archive *archive;
+    bstring run_path;
+    sky_data_file **runs;
+    uint32_t run_count;
+    sky_memtable *memtable;
+    uint32_t version;
     uint32_t block_size;
+    uint64_t lsn;
+    size_t block_header_size;
     sky_block **blocks;
     uint32_t block_count;
     int data_fd;
     void *data;
     size_t data_length;
+    uint32_t allocated_block_count;
+    uint32_t extent_size;
+    int header_fd;
+    void *header;
+    size_t header_length;
+    size_t header_capacity;
+    size_t header_dirty_start;
+    size_t header_dirty_end;
+    sky_block **free_blocks;
+    uint32_t free_block_count;
+    bool huge_pages;
+    bool shadow_blocks;
+    sky_block **retired_blocks;
+    uint32_t retired_block_count;
+    uint32_t epoch;
+    struct sky_snapshot **snapshots;
+    uint32_t snapshot_count;
+    sky_data_file_mapping *retired_mappings;
+    uint32_t retired_mapping_count;
+    pthread_mutex_t lock;
 };
 
 
@@ -80,6 +262,62 @@ int sky_data_file_load(sky_data_file *data_file);
 
 int sky_data_file_unload(sky_data_file *data_file);
 
+int sky_data_file_flush(sky_data_file *data_file);
+
+
+//--------------------------------------
+// Shadow Blocks
+//--------------------------------------
+
+int sky_data_file_touch_block(sky_data_file *data_file, sky_block *block);
+
+
+//--------------------------------------
+// Snapshots
+//--------------------------------------
+
+int sky_data_file_lock(sky_data_file *data_file);
+
+int sky_data_file_unlock(sky_data_file *data_file);
+
+int sky_data_file_pin_snapshot(sky_data_file *data_file,
+    struct sky_snapshot **ret);
+
+int sky_data_file_release_snapshot(sky_data_file *data_file,
+    struct sky_snapshot *snapshot);
+
+
+//--------------------------------------
+// Access Hints
+//--------------------------------------
+
+int sky_data_file_advise(sky_data_file *data_file, int advice);
+
+int sky_data_file_prefetch_block(sky_data_file *data_file, sky_block *block);
+
+int sky_data_file_warm(sky_data_file *data_file);
+
+
+//--------------------------------------
+// Header File Management
+//--------------------------------------
+
+int sky_data_file_set_header_dirty(sky_data_file *data_file, off_t offset,
+    size_t sz);
+
+int sky_data_file_set_lsn(sky_data_file *data_file, uint64_t lsn);
+
+
+//--------------------------------------
+// Format
+//--------------------------------------
+
+size_t sky_data_file_header_file_hdr_size(uint32_t version);
+
+size_t sky_data_file_block_header_size(uint32_t version);
+
+bool sky_data_file_is_wide(sky_data_file *data_file);
+
 
 //--------------------------------------
 // Block Management
@@ -94,10 +332,71 @@ int sky_data_file_move_to_new_block(sky_data_file *data_file, void **ptr,
     size_t sz, sky_block **new_block);
 
 
+//--------------------------------------
+// Block Directory
+//--------------------------------------
+
+int sky_data_file_get_block_position(sky_data_file *data_file,
+    sky_block *block, uint32_t *position);
+
+int sky_data_file_get_object_blocks(sky_data_file *data_file,
+    sky_object_id_t object_id, sky_block **block, uint32_t *span_count);
+
+
 //--------------------------------------
 // Event Management
 //--------------------------------------
 
 int sky_data_file_add_event(sky_data_file *data_file, sky_event *event);
 
+int sky_data_file_add_events(sky_data_file *data_file, sky_event **events,
+    uint32_t event_count);
+
+
+//--------------------------------------
+// Compaction
+//--------------------------------------
+
+int sky_data_file_compact(sky_data_file *data_file, double fill_factor,
+    uint32_t max_merge_count, uint32_t *merge_count);
+
+
+//--------------------------------------
+// Compression
+//--------------------------------------
+
+int sky_data_file_compress(sky_data_file *data_file, uint32_t *count);
+
+
+//--------------------------------------
+// Archive
+//--------------------------------------
+
+int sky_data_file_archive(sky_data_file *data_file, sky_timestamp_t timestamp,
+    uint32_t *count);
+
+
+//--------------------------------------
+// Retention
+//--------------------------------------
+
+int sky_data_file_expire(sky_data_file *data_file, sky_timestamp_t timestamp,
+    uint32_t *dropped_count, uint32_t *trimmed_count);
+
+
+//--------------------------------------
+// Runs
+//--------------------------------------
+
+int sky_data_file_open_run(sky_data_file *data_file, uint64_t lsn,
+    struct sky_bulk_loader **ret);
+
+int sky_data_file_close_run(sky_data_file *data_file,
+    struct sky_bulk_loader *loader);
+
+int sky_data_file_merge_runs(sky_data_file *data_file,
+    sky_timestamp_t min_timestamp, uint32_t *count);
+
+uint64_t sky_data_file_get_applied_lsn(sky_data_file *data_file);
+
 #endif
@@ -0,0 +1,368 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "dbg.h"
+#include "mem.h"
+#include "bstring.h"
+#include "file.h"
+#include "dictionary.h"
+#include "minipack.h"
+
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+int sky_dictionary_search(sky_dictionary *dictionary, bstring value,
+    uint32_t *position, bool *found);
+
+int sky_dictionary_insert(sky_dictionary *dictionary, bstring value);
+
+int sky_dictionary_sync_dir(sky_dictionary *dictionary);
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a reference to a dictionary.
+//
+// Returns a reference to the new dictionary if successful. Otherwise returns
+// null.
+sky_dictionary *sky_dictionary_create()
+{
+    sky_dictionary *dictionary = calloc(sizeof(sky_dictionary), 1);
+    check_mem(dictionary);
+    return dictionary;
+
+error:
+    sky_dictionary_free(dictionary);
+    return NULL;
+}
+
+// Removes a dictionary reference from memory.
+//
+// dictionary - The dictionary to free.
+void sky_dictionary_free(sky_dictionary *dictionary)
+{
+    if(dictionary) {
+        if(dictionary->path) bdestroy(dictionary->path);
+        dictionary->path = NULL;
+        sky_dictionary_unload(dictionary);
+        free(dictionary);
+    }
+}
+
+
+//--------------------------------------
+// Persistence
+//--------------------------------------
+
+// Loads the dictionary values from file.
+//
+// dictionary - The dictionary to load.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_load(sky_dictionary *dictionary)
+{
+    int rc;
+    FILE *file = NULL;
+    bstring value = NULL;
+    check(dictionary != NULL, "Dictionary required");
+    check(dictionary->path != NULL, "Dictionary path required");
+
+    // Unload any values currently in memory.
+    rc = sky_dictionary_unload(dictionary);
+    check(rc == 0, "Unable to unload dictionary");
+
+    // Read in the dictionary file if it exists.
+    if(sky_file_exists(dictionary->path)) {
+        file = fopen(bdata(dictionary->path), "r");
+        check(file, "Failed to open dictionary: %s",  bdata(dictionary->path));
+
+        // Read values until the end of the file.
+        int c;
+        while((c = fgetc(file)) != EOF) {
+            ungetc(c, file);
+
+            rc = sky_minipack_fread_bstring(file, &value);
+            check(rc == 0, "Unable to read dictionary value at byte: %ld", ftell(file));
+
+            rc = sky_dictionary_insert(dictionary, value);
+            check(rc == 0, "Unable to insert dictionary value");
+            value = NULL;
+        }
+
+        // Close the file.
+        fclose(file);
+        file = NULL;
+    }
+
+    return 0;
+
+error:
+    bdestroy(value);
+    if(file) fclose(file);
+    sky_dictionary_unload(dictionary);
+    return -1;
+}
+
+// Unloads the dictionary values from memory.
+//
+// dictionary - The dictionary.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_unload(sky_dictionary *dictionary)
+{
+    if(dictionary) {
+        uint32_t i;
+        for(i=0; i<dictionary->count; i++) {
+            bdestroy(dictionary->values[i]);
+            dictionary->values[i] = NULL;
+        }
+        free(dictionary->values);
+        dictionary->values = NULL;
+        free(dictionary->index);
+        dictionary->index = NULL;
+        dictionary->count = 0;
+    }
+
+    return 0;
+}
+
+
+// Syncs the directory containing the dictionary file so that a newly created
+// file survives a crash.
+//
+// dictionary - The dictionary.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_sync_dir(sky_dictionary *dictionary)
+{
+    int fd = -1;
+    bstring dir_path = NULL;
+    check(dictionary != NULL, "Dictionary required");
+
+    int pos = bstrrchr(dictionary->path, '/');
+    dir_path = (pos != BSTR_ERR ? bmidstr(dictionary->path, 0, (pos > 0 ? pos : 1)) : bfromcstr("."));
+    check_mem(dir_path);
+
+    fd = open(bdata(dir_path), O_RDONLY);
+    check(fd != -1, "Unable to open directory: %s", bdata(dir_path));
+    check(fsync(fd) == 0, "Unable to sync directory: %s", bdata(dir_path));
+    close(fd);
+    bdestroy(dir_path);
+
+    return 0;
+
+error:
+    if(fd != -1) close(fd);
+    bdestroy(dir_path);
+    return -1;
+}
+
+
+//--------------------------------------
+// Index
+//--------------------------------------
+
+// Performs a binary search on the sorted index for a value.
+//
+// dictionary - The dictionary.
+// value      - The value to search for.
+// position   - A pointer to where the index position of the value (or the
+//              position it would be inserted at) is returned.
+// found      - A pointer to a flag stating if the value exists.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_search(sky_dictionary *dictionary, bstring value,
+                          uint32_t *position, bool *found)
+{
+    uint32_t min = 0;
+    uint32_t max = dictionary->count;
+
+    *found = false;
+    while(min < max) {
+        uint32_t mid = min + ((max - min) / 2);
+        int cmp = bstrcmp(dictionary->values[dictionary->index[mid]], value);
+        if(cmp == 0) {
+            *found = true;
+            min = mid;
+            break;
+        }
+        else if(cmp < 0) {
+            min = mid + 1;
+        }
+        else {
+            max = mid;
+        }
+    }
+    *position = min;
+
+    return 0;
+}
+
+// Appends a value to the in-memory dictionary and its sorted index. The
+// dictionary takes ownership of the value.
+//
+// dictionary - The dictionary.
+// value      - The value to add.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_insert(sky_dictionary *dictionary, bstring value)
+{
+    int rc;
+    uint32_t position;
+    bool found;
+
+    rc = sky_dictionary_search(dictionary, value, &position, &found);
+    check(rc == 0, "Unable to search dictionary");
+    check(!found, "Duplicate dictionary value: %s", bdata(value));
+    check(dictionary->count < UINT32_MAX, "No additional dictionary ids available");
+
+    // Append the value.
+    dictionary->values = realloc(dictionary->values, sizeof(*dictionary->values) * (dictionary->count+1));
+    check_mem(dictionary->values);
+    dictionary->index = realloc(dictionary->index, sizeof(*dictionary->index) * (dictionary->count+1));
+    check_mem(dictionary->index);
+    dictionary->values[dictionary->count] = value;
+
+    // Shift the index over and insert the value in sorted order.
+    memmove(&dictionary->index[position+1], &dictionary->index[position], sizeof(*dictionary->index) * (dictionary->count - position));
+    dictionary->index[position] = dictionary->count;
+    dictionary->count++;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Value Management
+//--------------------------------------
+
+// Retrieves the value for a given id. The returned value is owned by the
+// dictionary.
+//
+// dictionary - The dictionary.
+// id         - The id of the value.
+// ret        - A pointer to where the value should be returned. This is null
+//              if the id does not exist.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_find_by_id(sky_dictionary *dictionary,
+                              sky_dictionary_id_t id, bstring *ret)
+{
+    check(dictionary != NULL, "Dictionary required");
+    check(ret != NULL, "Return address required");
+
+    *ret = (id > 0 && id <= dictionary->count ? dictionary->values[id-1] : NULL);
+    return 0;
+
+error:
+    if(ret) *ret = NULL;
+    return -1;
+}
+
+// Retrieves the id of a given value.
+//
+// dictionary - The dictionary.
+// value      - The value.
+// ret        - A pointer to where the id should be returned. This is zero if
+//              the value does not exist.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_find_by_value(sky_dictionary *dictionary, bstring value,
+                                 sky_dictionary_id_t *ret)
+{
+    int rc;
+    uint32_t position;
+    bool found;
+    check(dictionary != NULL, "Dictionary required");
+    check(value != NULL, "Value required");
+    check(ret != NULL, "Return address required");
+
+    rc = sky_dictionary_search(dictionary, value, &position, &found);
+    check(rc == 0, "Unable to search dictionary");
+    *ret = (found ? dictionary->index[position] + 1 : 0);
+
+    return 0;
+
+error:
+    if(ret) *ret = 0;
+    return -1;
+}
+
+// Retrieves the id of a value, adding it to the dictionary if it does not
+// exist yet. New values are appended to the dictionary file and synced to disk
+// before their id is returned so that a log record can never refer to an id
+// whose value was lost in a crash. The directory is synced as well when the
+// dictionary file is first created.
+//
+// dictionary - The dictionary.
+// value      - The value.
+// ret        - A pointer to where the id should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_dictionary_add_value(sky_dictionary *dictionary, bstring value,
+                             sky_dictionary_id_t *ret)
+{
+    int rc;
+    FILE *file = NULL;
+    bstring copy = NULL;
+    check(dictionary != NULL, "Dictionary required");
+    check(dictionary->path != NULL, "Dictionary path required");
+    check(value != NULL, "Value required");
+    check(ret != NULL, "Return address required");
+
+    // Return the existing id if there is one.
+    rc = sky_dictionary_find_by_value(dictionary, value, ret);
+    check(rc == 0, "Unable to find dictionary value");
+    if(*ret != 0) {
+        return 0;
+    }
+
+    // Append the value to the dictionary file and sync it to disk.
+    bool created = !sky_file_exists(dictionary->path);
+    file = fopen(bdata(dictionary->path), "a");
+    check(file, "Failed to open dictionary: %s", bdata(dictionary->path));
+    rc = sky_minipack_fwrite_bstring(file, value);
+    check(rc == 0, "Unable to write dictionary value");
+    check(fflush(file) == 0, "Unable to flush dictionary");
+    check(fsync(fileno(file)) == 0, "Unable to sync dictionary");
+    check(fclose(file) == 0, "Unable to close dictionary");
+    file = NULL;
+
+    // Sync the directory entry of a new dictionary file.
+    if(created) {
+        rc = sky_dictionary_sync_dir(dictionary);
+        check(rc == 0, "Unable to sync dictionary directory");
+    }
+
+    // Add it to memory.
+    copy = bstrcpy(value); check_mem(copy);
+    rc = sky_dictionary_insert(dictionary, copy);
+    check(rc == 0, "Unable to insert dictionary value");
+    *ret = dictionary->count;
+
+    return 0;
+
+error:
+    if(file) fclose(file);
+    bdestroy(copy);
+    if(ret) *ret = 0;
+    return -1;
+}
@@ -0,0 +1,88 @@
+#ifndef _dictionary_h
+#define _dictionary_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_dictionary sky_dictionary;
+
+#include "bstring.h"
+#include "file.h"
+#include "types.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The dictionary maps the string values of a table's Factor properties to
+// integer ids. Events store the id in place of the string so repeated values
+// only take up the size of a small integer and queries can compare and group
+// on them as integers.
+//
+// Ids are assigned sequentially starting from 1 so that a zero id means that
+// the property has no value. Values are never removed from the dictionary so
+// an id stays valid for the lifetime of the table.
+//
+// The dictionary file is a sequence of raw values where the Nth value has the
+// id N. New values are appended to the end of the file as they are added and
+// are synced to disk before their id is returned, so an event in the
+// write-ahead log never refers to an id that the dictionary file doesn't hold.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+typedef uint32_t sky_dictionary_id_t;
+
+struct sky_dictionary {
+    bstring path;
+    bstring *values;
+    uint32_t *index;
+    uint32_t count;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_dictionary *sky_dictionary_create();
+
+void sky_dictionary_free(sky_dictionary *dictionary);
+
+
+//--------------------------------------
+// Persistence
+//--------------------------------------
+
+int sky_dictionary_load(sky_dictionary *dictionary);
+
+int sky_dictionary_unload(sky_dictionary *dictionary);
+
+
+//--------------------------------------
+// Value Management
+//--------------------------------------
+
+int sky_dictionary_find_by_id(sky_dictionary *dictionary,
+    sky_dictionary_id_t id, bstring *ret);
+
+int sky_dictionary_find_by_value(sky_dictionary *dictionary,
+    bstring value, sky_dictionary_id_t *ret);
+
+int sky_dictionary_add_value(sky_dictionary *dictionary, bstring value,
+    sky_dictionary_id_t *ret);
+
+#endif
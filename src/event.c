@@ -6,6 +6,7 @@
 #include "endian.h"
 #include "bstring.h"
 #include "event.h"
+#include "varint.h"
 #include "mem.h"
 
 //==============================================================================
@@ -243,6 +244,86 @@ sky_event_data_length_t sky_event_sizeof_data(sky_event *event)
     return sz;
 }
 
+// Calculates the total number of bytes needed to store an event with the
+// delta encoding.
+//
+// event - The event.
+// base  - The timestamp of the previous event in the path or zero if this is
+//         the first event.
+size_t sky_event_sizeof_delta(sky_event *event, sky_timestamp_t base)
+{
+    size_t sz = 0;
+
+    // Add event flag and timestamp offset.
+    sz += sizeof(sky_event_flag_t);
+    sz += sky_varint_sizeof_signed(event->timestamp - base);
+
+    // Add action if one is set.
+    if(event->action_id != 0) {
+        sz += sky_varint_sizeof(event->action_id);
+    }
+
+    // Add data if set.
+    sky_event_data_length_t data_length = sky_event_sizeof_data(event);
+    if(data_length > 0) {
+        sz += sky_varint_sizeof(data_length);
+        sz += data_length;
+    }
+
+    return sz;
+}
+
+// Calculates the total number of bytes needed to store an event with the
+// delta encoding and an index of its data section. Events that are not
+// indexed are the same size as with the delta encoding.
+//
+// event - The event.
+// base  - The timestamp of the previous event in the path or zero if this is
+//         the first event.
+size_t sky_event_sizeof_indexed(sky_event *event, sky_timestamp_t base)
+{
+    size_t index_length = sky_event_sizeof_index(event);
+    if(index_length == 0) {
+        return sky_event_sizeof_delta(event, base);
+    }
+
+    size_t sz = 0;
+
+    // Add event flag and timestamp offset.
+    sz += sizeof(sky_event_flag_t);
+    sz += sky_varint_sizeof_signed(event->timestamp - base);
+
+    // Add action if one is set.
+    if(event->action_id != 0) {
+        sz += sky_varint_sizeof(event->action_id);
+    }
+
+    // Add the index and the data.
+    sky_event_data_length_t data_length = index_length + sky_event_sizeof_data(event);
+    sz += sky_varint_sizeof(data_length);
+    sz += data_length;
+
+    return sz;
+}
+
+// Calculates the number of bytes needed to store the index of an event's
+// data section. Events with too few properties are not indexed and neither
+// are events with more properties or data than the index can address.
+//
+// event - The event.
+//
+// Returns the length of the index or zero if the event is not indexed.
+size_t sky_event_sizeof_index(sky_event *event)
+{
+    if(event->data_count < SKY_EVENT_INDEX_MIN_DATA_COUNT || event->data_count > UINT8_MAX) {
+        return 0;
+    }
+    if(sky_event_sizeof_data(event) > UINT16_MAX) {
+        return 0;
+    }
+    return sizeof(uint8_t) + (event->data_count * sizeof(sky_event_index_offset_t));
+}
+
 // Calculates the total length of an event element stored in raw format at the
 // given pointer.
 //
@@ -254,6 +335,22 @@ size_t sky_event_sizeof_raw(void *ptr)
     size_t sz = 0;
     char event_flag = *((sky_event_flag_t*)ptr);
 
+    // Delta encoded events store each header field as a varint.
+    if(event_flag & SKY_EVENT_FLAG_DELTA) {
+        sz += sizeof(sky_event_flag_t);
+        sz += sky_varint_sizeof_raw(ptr+sz);
+        if(event_flag & SKY_EVENT_FLAG_ACTION) {
+            sz += sky_varint_sizeof_raw(ptr+sz);
+        }
+        if(event_flag & SKY_EVENT_FLAG_DATA) {
+            size_t _sz;
+            sky_event_data_length_t data_length = (sky_event_data_length_t)sky_varint_unpack(ptr+sz, &_sz);
+            sz += _sz;
+            sz += data_length;
+        }
+        return sz;
+    }
+
     // Add event flag and timestamp.
     sz += sizeof(sky_event_flag_t);
     sz += sizeof(sky_timestamp_t);
@@ -273,6 +370,36 @@ size_t sky_event_sizeof_raw(void *ptr)
     return sz;
 }    
 
+// Calculates the length of the index of an indexed event's data section.
+//
+// ptr - A pointer to the start of the index.
+//
+// Returns the length of the index.
+size_t sky_event_sizeof_index_raw(void *ptr)
+{
+    return sizeof(uint8_t) + (*((uint8_t*)ptr) * sizeof(sky_event_index_offset_t));
+}
+
+// Calculates the length of a raw event once its timestamp is re-encoded
+// relative to a new base timestamp. Events with the fixed encoding do not
+// change size.
+//
+// ptr       - A pointer to the raw event data.
+// timestamp - The timestamp of the event.
+// base      - The new base timestamp.
+//
+// Returns the length of the rebased event data.
+size_t sky_event_sizeof_raw_rebased(void *ptr, sky_timestamp_t timestamp,
+                                    sky_timestamp_t base)
+{
+    size_t sz = sky_event_sizeof_raw(ptr);
+    if(*((sky_event_flag_t*)ptr) & SKY_EVENT_FLAG_DELTA) {
+        sz -= sky_varint_sizeof_raw(ptr + sizeof(sky_event_flag_t));
+        sz += sky_varint_sizeof_signed(timestamp - base);
+    }
+    return sz;
+}
+
 
 
 //--------------------------------------
@@ -374,7 +501,179 @@ error:
     return -1;
 }
 
-// Deserializes an event from a given file at the file's current offset.
+// Serializes an event to memory with the delta encoding.
+//
+// event - The event to pack.
+// base  - The timestamp of the previous event in the path or zero if this is
+//         the first event.
+// ptr   - The pointer to the current location.
+// sz    - The number of bytes written.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_pack_delta(sky_event *event, sky_timestamp_t base, void *ptr,
+                         size_t *sz)
+{
+    int rc;
+    size_t _sz;
+    void *start = ptr;
+
+    // Validate.
+    check(event != NULL, "Event required");
+    check(ptr != NULL, "Pointer required");
+
+    // Pack header.
+    size_t data_length = sky_event_sizeof_data(event);
+    rc = sky_event_pack_hdr_delta(event->timestamp, base, event->action_id, data_length, ptr, &_sz);
+    check(rc == 0, "Unable to pack event header");
+    ptr += _sz;
+
+    // Pack data.
+    uint64_t i;
+    for(i=0; i<event->data_count; i++) {
+        rc = sky_event_data_pack(event->data[i], ptr, &_sz);
+        check(rc == 0, "Unable to pack event data at %p", ptr);
+        ptr += _sz;
+    }
+
+    // Store number of bytes written.
+    if(sz != NULL) {
+        *sz = (ptr-start);
+    }
+
+    return 0;
+
+error:
+    if(sz) *sz = 0;
+    return -1;
+}
+
+// Serializes the header of an event to memory with the delta encoding.
+//
+// timestamp   - The timestamp of the event.
+// base        - The timestamp of the previous event in the path or zero if
+//               this is the first event.
+// action_id   - The action id of the event.
+// data_length - The length, in bytes, of the data section of the event.
+// ptr         - The pointer to the current location.
+// sz          - The number of bytes written.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_pack_hdr_delta(sky_timestamp_t timestamp, sky_timestamp_t base,
+                             sky_action_id_t action_id,
+                             sky_event_data_length_t data_length,
+                             void *ptr, size_t *sz)
+{
+    size_t _sz;
+    void *start = ptr;
+
+    // Validate.
+    check(ptr != NULL, "Pointer required");
+
+    // Write event flag.
+    sky_event_flag_t flag = sky_event_get_flag(action_id, data_length) | SKY_EVENT_FLAG_DELTA;
+    *((sky_event_flag_t*)ptr) = flag;
+    ptr += sizeof(flag);
+
+    // Write the offset from the previous timestamp.
+    sky_varint_pack_signed(ptr, timestamp - base, &_sz);
+    ptr += _sz;
+
+    // Write action id.
+    if(action_id != 0) {
+        sky_varint_pack(ptr, action_id, &_sz);
+        ptr += _sz;
+    }
+
+    // Write data length.
+    if(data_length > 0) {
+        sky_varint_pack(ptr, data_length, &_sz);
+        ptr += _sz;
+    }
+
+    // Store number of bytes written.
+    if(sz != NULL) {
+        *sz = (ptr-start);
+    }
+
+    return 0;
+
+error:
+    if(sz) *sz = 0;
+    return -1;
+}
+
+// Serializes an event to memory with the delta encoding and an index of its
+// data section. The properties are written in order of property id. Events
+// that have too few properties to be indexed are written with the delta
+// encoding.
+//
+// event - The event to pack.
+// base  - The timestamp of the previous event in the path or zero if this is
+//         the first event.
+// ptr   - The pointer to the current location.
+// sz    - The number of bytes written.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_pack_indexed(sky_event *event, sky_timestamp_t base, void *ptr,
+                           size_t *sz)
+{
+    int rc;
+    size_t _sz;
+    void *start = ptr;
+
+    // Validate.
+    check(event != NULL, "Event required");
+    check(ptr != NULL, "Pointer required");
+
+    size_t index_length = sky_event_sizeof_index(event);
+    if(index_length == 0) {
+        return sky_event_pack_delta(event, base, ptr, sz);
+    }
+
+    // Sort the properties by id.
+    uint32_t i, j;
+    uint8_t order[UINT8_MAX];
+    for(i=0; i<event->data_count; i++) {
+        for(j=i; j>0 && event->data[order[j-1]]->key > event->data[i]->key; j--) {
+            order[j] = order[j-1];
+        }
+        order[j] = i;
+    }
+
+    // Pack header and flag the event as indexed.
+    size_t data_length = index_length + sky_event_sizeof_data(event);
+    rc = sky_event_pack_hdr_delta(event->timestamp, base, event->action_id, data_length, ptr, &_sz);
+    check(rc == 0, "Unable to pack event header");
+    *((sky_event_flag_t*)ptr) |= SKY_EVENT_FLAG_INDEXED;
+    ptr += _sz;
+
+    // Pack the index and then the data.
+    *((uint8_t*)ptr) = (uint8_t)event->data_count;
+    sky_event_index_offset_t *offsets = (sky_event_index_offset_t*)(ptr + sizeof(uint8_t));
+    void *data_ptr = ptr + index_length;
+    ptr = data_ptr;
+    for(i=0; i<event->data_count; i++) {
+        offsets[i] = (sky_event_index_offset_t)(ptr - data_ptr);
+        rc = sky_event_data_pack(event->data[order[i]], ptr, &_sz);
+        check(rc == 0, "Unable to pack event data at %p", ptr);
+        ptr += _sz;
+    }
+
+    // Store number of bytes written.
+    if(sz != NULL) {
+        *sz = (ptr-start);
+    }
+
+    return 0;
+
+error:
+    if(sz) *sz = 0;
+    return -1;
+}
+
+// Deserializes an event from a given file at the file's current offset. The
+// timestamp of a delta encoded event is read relative to zero so this should
+// only be used for fixed events or for the first event in a path.
 //
 // event - The event to unpack into.
 // ptr   - The pointer to the current location.
@@ -382,6 +681,21 @@ error:
 //
 // Returns 0 if successful, otherwise returns -1.
 int sky_event_unpack(sky_event *event, void *ptr, size_t *sz)
+{
+    return sky_event_unpack_delta(event, 0, ptr, sz);
+}
+
+// Deserializes an event from memory in either encoding.
+//
+// event - The event to unpack into.
+// base  - The timestamp of the previous event in the path or zero if this is
+//         the first event.
+// ptr   - The pointer to the current location.
+// sz    - The number of bytes read.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_unpack_delta(sky_event *event, sky_timestamp_t base, void *ptr,
+                           size_t *sz)
 {
     int rc;
     size_t _sz;
@@ -393,7 +707,7 @@ int sky_event_unpack(sky_event *event, void *ptr, size_t *sz)
 
     // Read event header.
     sky_event_data_length_t data_length;
-    rc = sky_event_unpack_hdr(&event->timestamp, &event->action_id, &data_length, ptr, &_sz);
+    rc = sky_event_unpack_hdr_delta(&event->timestamp, &event->action_id, &data_length, base, ptr, &_sz);
     check(rc == 0, "Unable to unpack event header");
     ptr += _sz;
 
@@ -424,7 +738,8 @@ error:
     return -1;
 }
 
-// Deserializes an event header from memory.
+// Deserializes an event header from memory. The timestamp of a delta encoded
+// event is read relative to zero.
 //
 // timestamp   - A pointer to where the event timestamp will be returned.
 // action_id   - A pointer to where the event's action id will be returned.
@@ -438,6 +753,26 @@ int sky_event_unpack_hdr(sky_timestamp_t *timestamp,
                          sky_event_data_length_t *data_length,
                          void *ptr, size_t *sz)
 {
+    return sky_event_unpack_hdr_delta(timestamp, action_id, data_length, 0, ptr, sz);
+}
+
+// Deserializes an event header from memory in either encoding.
+//
+// timestamp   - A pointer to where the event timestamp will be returned.
+// action_id   - A pointer to where the event's action id will be returned.
+// data_length - A pointer to where the event's data length will be returned.
+// base        - The timestamp of the previous event in the path or zero if
+//               this is the first event.
+// ptr         - The pointer to the current location.
+// sz          - The number of bytes read.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_unpack_hdr_delta(sky_timestamp_t *timestamp,
+                               sky_action_id_t *action_id,
+                               sky_event_data_length_t *data_length,
+                               sky_timestamp_t base, void *ptr, size_t *sz)
+{
+    size_t _sz;
     void *start = ptr;
 
     // Validate.
@@ -447,6 +782,36 @@ int sky_event_unpack_hdr(sky_timestamp_t *timestamp,
     sky_event_flag_t flag = *((sky_event_flag_t*)ptr);
     ptr += sizeof(flag);
 
+    // Read varint fields if this is a delta encoded event.
+    if(flag & SKY_EVENT_FLAG_DELTA) {
+        *timestamp = base + sky_varint_unpack_signed(ptr, &_sz);
+        ptr += _sz;
+
+        *action_id = 0;
+        if(flag & SKY_EVENT_FLAG_ACTION) {
+            *action_id = (sky_action_id_t)sky_varint_unpack(ptr, &_sz);
+            ptr += _sz;
+        }
+
+        *data_length = 0;
+        if(flag & SKY_EVENT_FLAG_DATA) {
+            *data_length = (sky_event_data_length_t)sky_varint_unpack(ptr, &_sz);
+            ptr += _sz;
+        }
+
+        // Skip over the index of an indexed event.
+        if(flag & SKY_EVENT_FLAG_INDEXED) {
+            size_t index_length = sky_event_sizeof_index_raw(ptr);
+            ptr += index_length;
+            *data_length -= index_length;
+        }
+
+        if(sz != NULL) {
+            *sz = (ptr-start);
+        }
+        return 0;
+    }
+
     // Read timestamp.
     *timestamp = *((sky_timestamp_t*)ptr);
     ptr += sizeof(sky_timestamp_t);
@@ -482,6 +847,72 @@ error:
 }
 
 
+// Copies a raw event to a new location and re-encodes its timestamp relative
+// to a new base timestamp. Events with the fixed encoding are copied as-is.
+// The data section is moved before the header is written so the destination
+// can overlap the event as long as the data section ends up in place or
+// earlier than the source header. The index of an indexed event is moved
+// along with its data section.
+//
+// ptr       - A pointer to the raw event.
+// timestamp - The timestamp of the event.
+// base      - The new base timestamp.
+// dest      - A pointer to where the event should be written.
+// sz        - The number of bytes written.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_rebase_raw(void *ptr, sky_timestamp_t timestamp,
+                         sky_timestamp_t base, void *dest, size_t *sz)
+{
+    int rc;
+    size_t hdrsz, _sz;
+    check(ptr != NULL, "Pointer required");
+    check(dest != NULL, "Destination required");
+
+    // Fixed events do not depend on the previous event.
+    if(!(*((sky_event_flag_t*)ptr) & SKY_EVENT_FLAG_DELTA)) {
+        _sz = sky_event_sizeof_raw(ptr);
+        memmove(dest, ptr, _sz);
+        if(sz != NULL) *sz = _sz;
+        return 0;
+    }
+
+    // Read the header.
+    sky_timestamp_t _timestamp;
+    sky_action_id_t action_id;
+    sky_event_data_length_t data_length;
+    rc = sky_event_unpack_hdr_delta(&_timestamp, &action_id, &data_length, 0, ptr, &hdrsz);
+    check(rc == 0, "Unable to unpack event header");
+
+    // Find the length of the index, which is returned as part of the header.
+    sky_event_flag_t flag = *((sky_event_flag_t*)ptr);
+    size_t index_length = 0;
+    if(flag & SKY_EVENT_FLAG_INDEXED) {
+        void *index_ptr = ptr + sizeof(sky_event_flag_t);
+        index_ptr += sky_varint_sizeof_raw(index_ptr);
+        if(flag & SKY_EVENT_FLAG_ACTION) {
+            index_ptr += sky_varint_sizeof_raw(index_ptr);
+        }
+        index_ptr += sky_varint_sizeof_raw(index_ptr);
+        index_length = sky_event_sizeof_index_raw(index_ptr);
+    }
+
+    // Move the index and data into place and then write the new header.
+    size_t new_hdrsz = sizeof(sky_event_flag_t) + sky_varint_sizeof_signed(timestamp - base);
+    new_hdrsz += hdrsz - sizeof(sky_event_flag_t) - sky_varint_sizeof_raw(ptr + sizeof(sky_event_flag_t));
+    memmove(dest + new_hdrsz - index_length, ptr + hdrsz - index_length, index_length + data_length);
+    rc = sky_event_pack_hdr_delta(timestamp, base, action_id, index_length + data_length, dest, &_sz);
+    check(rc == 0 && _sz == new_hdrsz - index_length, "Unable to pack event header");
+    *((sky_event_flag_t*)dest) |= (flag & SKY_EVENT_FLAG_INDEXED);
+
+    if(sz != NULL) *sz = new_hdrsz + data_length;
+    return 0;
+
+error:
+    if(sz) *sz = 0;
+    return -1;
+}
+
 
 //--------------------------------------
 // Event Data
@@ -602,3 +1033,75 @@ int sky_event_unset_data(sky_event *event, sky_property_id_t key)
 error:
     return -1;
 }
+
+// Finds the value of a property in the data section of an indexed event.
+//
+// index_ptr - A pointer to the index at the start of the data section.
+// key       - The property id to find.
+// ret       - A pointer to where the location of the packed value is
+//             returned. This is set to NULL if the event does not have the
+//             property.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_event_find_indexed_data(void *index_ptr, sky_property_id_t key,
+                                void **ret)
+{
+    check(index_ptr != NULL, "Index pointer required");
+    check(ret != NULL, "Return address required");
+
+    uint32_t count = *((uint8_t*)index_ptr);
+    sky_event_index_offset_t *offsets = (sky_event_index_offset_t*)(index_ptr + sizeof(uint8_t));
+    void *data_ptr = index_ptr + sky_event_sizeof_index_raw(index_ptr);
+
+    // Binary search the offsets since the properties are sorted by id.
+    uint32_t min = 0, max = count;
+    while(min < max) {
+        uint32_t mid = min + ((max - min) / 2);
+        void *ptr = data_ptr + offsets[mid];
+        sky_property_id_t property_id = *((sky_property_id_t*)ptr);
+        if(property_id == key) {
+            *ret = ptr + sizeof(sky_property_id_t);
+            return 0;
+        }
+        else if(property_id < key) {
+            min = mid + 1;
+        }
+        else {
+            max = mid;
+        }
+    }
+
+    *ret = NULL;
+    return 0;
+
+error:
+    if(ret) *ret = NULL;
+    return -1;
+}
+
+
+//--------------------------------------
+// Sorting
+//--------------------------------------
+
+// Compares two event references by object id and timestamp. Events that are
+// equal are sorted in reverse order of their original index, which is the
+// order that inserting them into a path one at a time gives them.
+int sky_event_ref_compare(const void *_a, const void *_b)
+{
+    sky_event_ref *a = (sky_event_ref *)_a;
+    sky_event_ref *b = (sky_event_ref *)_b;
+
+    if(a->event->object_id != b->event->object_id) {
+        return (a->event->object_id > b->event->object_id ? 1 : -1);
+    }
+    else if(a->event->timestamp != b->event->timestamp) {
+        return (a->event->timestamp > b->event->timestamp ? 1 : -1);
+    }
+    else if(a->index != b->index) {
+        return (a->index < b->index ? 1 : -1);
+    }
+    else {
+        return 0;
+    }
+}
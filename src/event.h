@@ -32,6 +32,23 @@
  * change over time without destroying data stored in the past. That also means
  * that searches across the data will take into account the state of an object
  * at a specific point in time.
+ *
+ * Events are stored in one of two encodings. The fixed encoding stores a flag
+ * byte, an 8-byte timestamp, a 2-byte action id and a 4-byte data length.
+ * The delta encoding is marked by the delta flag and stores the timestamp as
+ * a signed varint offset from the previous event in the path (or from zero
+ * for the first event) followed by the action id and data length as unsigned
+ * varints. Delta encoded events can only be read in path order.
+ *
+ * Delta encoded events with many properties can also be indexed, which is
+ * marked by the indexed flag. The data section of an indexed event begins
+ * with the number of properties followed by a 2-byte offset for each of them
+ * to where it is stored in the rest of the data section. The properties are
+ * stored in order of property id so a reader can binary search the offsets
+ * for the properties it needs instead of decoding every value. The data
+ * length in the header includes the index but the data length returned when
+ * unpacking a header does not, so the data section can still be walked one
+ * property at a time.
  */
 
 
@@ -43,13 +60,19 @@
 
 #define sky_event_flag_t uint8_t
 #define sky_event_data_length_t uint32_t
+#define sky_event_index_offset_t uint16_t
 
 
 #define SKY_EVENT_FLAG_ACTION  1
 #define SKY_EVENT_FLAG_DATA    2
+#define SKY_EVENT_FLAG_DELTA   4
+#define SKY_EVENT_FLAG_INDEXED 8
 
 #define SKY_EVENT_HEADER_LENGTH sizeof(sky_event_flag_t) + sizeof(sky_timestamp_t)
 
+// The minimum number of properties an event needs before it is indexed.
+#define SKY_EVENT_INDEX_MIN_DATA_COUNT 8
+
 
 //==============================================================================
 //
@@ -65,6 +88,12 @@ typedef struct sky_event {
     sky_event_data **data;
 } sky_event;
 
+// Used to sort a batch of events while keeping track of their original order.
+typedef struct sky_event_ref {
+    sky_event *event;
+    uint32_t index;
+} sky_event_ref;
+
 
 //==============================================================================
 //
@@ -93,18 +122,49 @@ size_t sky_event_sizeof(sky_event *event);
 
 sky_event_data_length_t sky_event_sizeof_data(sky_event *event);
 
+size_t sky_event_sizeof_delta(sky_event *event, sky_timestamp_t base);
+
+size_t sky_event_sizeof_indexed(sky_event *event, sky_timestamp_t base);
+
+size_t sky_event_sizeof_index(sky_event *event);
+
 size_t sky_event_sizeof_raw(void *ptr);
 
+size_t sky_event_sizeof_index_raw(void *ptr);
+
+size_t sky_event_sizeof_raw_rebased(void *ptr, sky_timestamp_t timestamp,
+    sky_timestamp_t base);
+
 int sky_event_pack(sky_event *event, void *ptr, size_t *sz);
 
 int sky_event_pack_hdr(sky_timestamp_t timestamp, sky_action_id_t action_id,
     sky_event_data_length_t data_length, void *ptr, size_t *sz);
 
+int sky_event_pack_delta(sky_event *event, sky_timestamp_t base, void *ptr,
+    size_t *sz);
+
+int sky_event_pack_hdr_delta(sky_timestamp_t timestamp, sky_timestamp_t base,
+    sky_action_id_t action_id, sky_event_data_length_t data_length, void *ptr,
+    size_t *sz);
+
+int sky_event_pack_indexed(sky_event *event, sky_timestamp_t base, void *ptr,
+    size_t *sz);
+
 int sky_event_unpack(sky_event *event, void *ptr, size_t *sz);
 
 int sky_event_unpack_hdr(sky_timestamp_t *timestamp, sky_action_id_t *action_id,
     sky_event_data_length_t *data_length, void *ptr, size_t *sz);
 
+int sky_event_unpack_delta(sky_event *event, sky_timestamp_t base, void *ptr,
+    size_t *sz);
+
+int sky_event_unpack_hdr_delta(sky_timestamp_t *timestamp,
+    sky_action_id_t *action_id, sky_event_data_length_t *data_length,
+    sky_timestamp_t base, void *ptr, size_t *sz);
+
+int sky_event_rebase_raw(void *ptr, sky_timestamp_t timestamp,
+    sky_timestamp_t base, void *dest, size_t *sz);
+
 
 //--------------------------------------
 // Data Management
@@ -118,5 +178,15 @@ int sky_event_set_data(sky_event *event, sky_property_id_t key,
 
 int sky_event_unset_data(sky_event *event, sky_property_id_t key);
 
+int sky_event_find_indexed_data(void *index_ptr, sky_property_id_t key,
+    void **ret);
+
+
+//--------------------------------------
+// Sorting
+//--------------------------------------
+
+int sky_event_ref_compare(const void *_a, const void *_b);
+
 
 #endif
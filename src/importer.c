@@ -1,4 +1,6 @@
 #include <stdlib.h>
+#include <errno.h>
+#include <string.h>
 
 #include "jsmn/jsmn.h"
 #include "importer.h"
@@ -50,6 +52,9 @@ bool sky_importer_tokstr_equal(bstring source, jsmntok_t *token,
 
 int32_t sky_importer_token_parse_int(bstring source, jsmntok_t *token);
 
+int sky_importer_token_parse_uint64(bstring source, jsmntok_t *token,
+    uint64_t *ret);
+
 bstring sky_importer_token_parse_bstring(bstring source, jsmntok_t *token);
 
 
@@ -530,7 +535,10 @@ int sky_importer_process_event(sky_importer *importer, bstring source,
             bdestroy(timestamp);
         }
         else if(sky_importer_tokstr_equal(source, token, "objectId")) {
-            event->object_id = (sky_object_id_t)sky_importer_token_parse_int(source, &tokens[(*index)++]);
+            uint64_t object_id = 0;
+            rc = sky_importer_token_parse_uint64(source, &tokens[(*index)++], &object_id);
+            check(rc == 0, "Unable to parse object id");
+            event->object_id = (sky_object_id_t)object_id;
         }
         else if(sky_importer_tokstr_equal(source, token, "action")) {
             sky_action *action = NULL;
@@ -548,6 +556,13 @@ int sky_importer_process_event(sky_importer *importer, bstring source,
         }
     }
     
+    // Object ids wider than 32 bits can only go into a data file with wide
+    // object ids.
+    sky_data_file *data_file = NULL;
+    rc = sky_table_get_shard(importer->table, event->object_id, &data_file);
+    check(rc == 0, "Unable to retrieve shard");
+    check(sky_data_file_is_wide(data_file) || event->object_id <= SKY_NARROW_OBJECT_ID_MAX, "Object id requires a data file with wide object ids: %llu", (unsigned long long)event->object_id);
+
     // Add event.
     rc = sky_table_add_event(importer->table, event);
     check(rc == 0, "Unable to add event");
@@ -669,6 +684,44 @@ int32_t sky_importer_token_parse_int(bstring source, jsmntok_t *token)
     return 0;
 }
 
+// Parses a primitive token as an unsigned 64-bit integer. The whole token
+// must be a non-negative decimal number that fits in 64 bits.
+//
+// source - The import file contents.
+// token  - The token.
+// ret    - A pointer to where the parsed value should be returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_importer_token_parse_uint64(bstring source, jsmntok_t *token,
+                                    uint64_t *ret)
+{
+    check(source != NULL, "Source required");
+    check(token != NULL, "Token required");
+    check(ret != NULL, "Return address required");
+    *ret = 0;
+
+    // A 64-bit integer has at most 20 digits.
+    char str[21];
+    int toklen = token->end - token->start;
+    check(token->type == JSMN_PRIMITIVE && toklen > 0, "Expected an integer at char %d", token->start);
+    check(toklen < (int)sizeof(str), "Integer out of range at char %d", token->start);
+    strncpy(str, &bdata(source)[token->start], toklen);
+    str[toklen] = '\x0';
+    check(str[0] >= '0' && str[0] <= '9', "Invalid integer: %s", str);
+
+    char *endptr = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(str, &endptr, 10);
+    check(errno != ERANGE, "Integer out of range: %s", str);
+    check(errno == 0 && *endptr == '\x0', "Invalid integer: %s", str);
+
+    *ret = (uint64_t)value;
+    return 0;
+
+error:
+    return -1;
+}
+
 bstring sky_importer_token_parse_bstring(bstring source, jsmntok_t *token)
 {
     int toklen = token->end - token->start;
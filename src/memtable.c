@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "dbg.h"
+#include "mem.h"
+#include "memtable.h"
+#include "path.h"
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates an empty memtable.
+//
+// Returns a reference to the new memtable if successful. Otherwise returns
+// null.
+sky_memtable *sky_memtable_create()
+{
+    sky_memtable *memtable = calloc(sizeof(sky_memtable), 1); check_mem(memtable);
+    memtable->sorted = true;
+    return memtable;
+
+error:
+    sky_memtable_free(memtable);
+    return NULL;
+}
+
+// Removes a memtable and the events in it from memory.
+//
+// memtable - The memtable to free.
+void sky_memtable_free(sky_memtable *memtable)
+{
+    if(memtable) {
+        sky_memtable_clear(memtable);
+        free(memtable->entries);
+        memtable->entries = NULL;
+        free(memtable);
+    }
+}
+
+// Creates a memtable that holds copies of the events of another memtable in
+// the same order.
+//
+// source - The memtable to copy.
+// target - A pointer to where the new memtable is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_memtable_copy(sky_memtable *source, sky_memtable **target)
+{
+    int rc;
+    sky_memtable *memtable = NULL;
+    check(source != NULL, "Source memtable required");
+    check(target != NULL, "Target memtable address required");
+
+    memtable = sky_memtable_create(); check_mem(memtable);
+    if(source->event_count > 0) {
+        memtable->entries = calloc(source->event_count, sizeof(*memtable->entries));
+        check_mem(memtable->entries);
+        memtable->capacity = source->event_count;
+    }
+
+    uint32_t i;
+    for(i=0; i<source->event_count; i++) {
+        rc = sky_event_copy(source->entries[i].event, &memtable->entries[i].event);
+        check(rc == 0, "Unable to copy event");
+        memtable->entries[i].index = source->entries[i].index;
+        memtable->event_count++;
+    }
+    memtable->sorted = source->sorted;
+
+    *target = memtable;
+    return 0;
+
+error:
+    sky_memtable_free(memtable);
+    if(target) *target = NULL;
+    return -1;
+}
+
+
+//--------------------------------------
+// Event Management
+//--------------------------------------
+
+// Adds a copy of an event to the memtable.
+//
+// memtable - The memtable.
+// event    - The event to add.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_memtable_add_event(sky_memtable *memtable, sky_event *event)
+{
+    int rc;
+    check(memtable != NULL, "Memtable required");
+    check(event != NULL, "Event required");
+    check(event->object_id != 0, "Event object id required");
+
+    // Grow the entry list.
+    if(memtable->event_count == memtable->capacity) {
+        uint32_t capacity = (memtable->capacity > 0 ? memtable->capacity * 2 : SKY_MEMTABLE_INITIAL_CAPACITY);
+        sky_event_ref *entries = realloc(memtable->entries, sizeof(*entries) * capacity);
+        check_mem(entries);
+        memtable->entries = entries;
+        memtable->capacity = capacity;
+    }
+
+    sky_event_ref *entry = &memtable->entries[memtable->event_count];
+    rc = sky_event_copy(event, &entry->event);
+    check(rc == 0, "Unable to copy event");
+    entry->index = memtable->event_count;
+    memtable->event_count++;
+    memtable->sorted = false;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Sorts the events in the memtable by object id and timestamp.
+//
+// memtable - The memtable.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_memtable_sort(sky_memtable *memtable)
+{
+    check(memtable != NULL, "Memtable required");
+
+    if(!memtable->sorted) {
+        qsort(memtable->entries, memtable->event_count, sizeof(*memtable->entries), sky_event_ref_compare);
+        memtable->sorted = true;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Removes every event from the memtable. The entry list is kept so that it
+// can be reused.
+//
+// memtable - The memtable.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_memtable_clear(sky_memtable *memtable)
+{
+    check(memtable != NULL, "Memtable required");
+
+    uint32_t i;
+    for(i=0; i<memtable->event_count; i++) {
+        sky_event_free(memtable->entries[i].event);
+        memtable->entries[i].event = NULL;
+    }
+    memtable->event_count = 0;
+    memtable->sorted = true;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Paths
+//--------------------------------------
+
+// Packs the events of an object in a sorted memtable into a path with a wide
+// header so that it can be read with a cursor. The path is written to a
+// buffer that is grown as needed.
+//
+// memtable - The memtable.
+// index    - The index of the object's first entry.
+// data     - A pointer to the buffer that the path is packed into.
+// capacity - A pointer to the capacity of the buffer.
+// count    - A pointer to where the number of events in the path is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_memtable_pack_path(sky_memtable *memtable, uint32_t index,
+                           void **data, size_t *capacity, uint32_t *count)
+{
+    int rc;
+    size_t sz;
+    check(memtable != NULL, "Memtable required");
+    check(memtable->sorted, "Memtable must be sorted");
+    check(index < memtable->event_count, "Memtable index out of range: %d", index);
+    check(data != NULL && capacity != NULL, "Path buffer required");
+
+    // Measure the events of the object.
+    uint32_t i;
+    size_t event_data_length = 0;
+    sky_object_id_t object_id = memtable->entries[index].event->object_id;
+    for(i=index; i<memtable->event_count && memtable->entries[i].event->object_id == object_id; i++) {
+        event_data_length += sky_event_sizeof(memtable->entries[i].event);
+    }
+    uint32_t _count = i - index;
+
+    // Grow the buffer.
+    size_t length = sky_path_sizeof_hdr(object_id, true) + event_data_length;
+    if(length > *capacity) {
+        void *buffer = realloc(*data, length);
+        check_mem(buffer);
+        *data = buffer;
+        *capacity = length;
+    }
+
+    // Pack the header and then the events.
+    void *ptr = *data;
+    rc = sky_path_pack_hdr(object_id, event_data_length, true, ptr, &sz);
+    check(rc == 0, "Unable to pack memtable path header");
+    ptr += sz;
+    for(i=index; i<index+_count; i++) {
+        rc = sky_event_pack(memtable->entries[i].event, ptr, &sz);
+        check(rc == 0, "Unable to pack memtable event");
+        ptr += sz;
+    }
+
+    if(count != NULL) *count = _count;
+    return 0;
+
+error:
+    if(count != NULL) *count = 0;
+    return -1;
+}
@@ -0,0 +1,86 @@
+#ifndef _memtable_h
+#define _memtable_h
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_memtable sky_memtable;
+
+#include "types.h"
+#include "event.h"
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The memtable holds the events that have been logged for a shard of a table
+// since its last checkpoint. Events are copied into the memtable in the
+// order they arrive so that adding an event never moves the events that are
+// already stored. The memtable is sorted by object id and timestamp when it
+// is read or written out as runs instead of keeping each insert in order.
+//
+// Events with the same object id and timestamp are sorted last-to-first,
+// which is the order that inserting them into a data file one at a time
+// gives them.
+//
+// The memtable of a shard is kept on its data file. Path iterators read it as
+// the newest source of the data file so that queries see events before they
+// are applied. The events of an object are packed into a path on demand for
+// the cursor. A snapshot of the data file holds its own copy of the memtable.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+#define SKY_MEMTABLE_INITIAL_CAPACITY 64
+
+struct sky_memtable {
+    sky_event_ref *entries;
+    uint32_t event_count;
+    uint32_t capacity;
+    bool sorted;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_memtable *sky_memtable_create();
+
+void sky_memtable_free(sky_memtable *memtable);
+
+int sky_memtable_copy(sky_memtable *source, sky_memtable **target);
+
+
+//--------------------------------------
+// Event Management
+//--------------------------------------
+
+int sky_memtable_add_event(sky_memtable *memtable, sky_event *event);
+
+int sky_memtable_sort(sky_memtable *memtable);
+
+int sky_memtable_clear(sky_memtable *memtable);
+
+
+//--------------------------------------
+// Paths
+//--------------------------------------
+
+int sky_memtable_pack_path(sky_memtable *memtable, uint32_t index,
+    void **data, size_t *capacity, uint32_t *count);
+
+#endif
@@ -5,6 +5,7 @@
 #include "dbg.h"
 #include "path.h"
 #include "cursor.h"
+#include "varint.h"
 #include "mem.h"
 
 //==============================================================================
@@ -137,24 +138,54 @@ size_t sky_path_sizeof(sky_path *path)
 
 // Calculates the full length of a path at a given pointer address.
 // 
-// ptr - A pointer to raw, packed path data.
+// ptr  - A pointer to raw, packed path data.
+// wide - A flag stating if the path header uses a varint object id.
 //
 // Returns the length of the path.
-size_t sky_path_sizeof_raw(void *ptr)
+size_t sky_path_sizeof_raw(void *ptr, bool wide)
 {
-    size_t sz = 0;
-        
-    // Read object id to determine element size.
-    sz += sizeof(sky_object_id_t);
+    // Read the header size to determine where the events length is.
+    size_t sz = sky_path_sizeof_raw_hdr(ptr, wide);
     
     // Read events length.
-    size_t event_data_length = *((sky_path_event_data_length_t*)(ptr + sz));
-    sz += sizeof(sky_path_event_data_length_t);
+    size_t event_data_length = *((sky_path_event_data_length_t*)(ptr + sz - sizeof(sky_path_event_data_length_t)));
     sz += event_data_length;
     
     return sz;
 }
 
+// Calculates the number of bytes needed to store the header of a path.
+//
+// object_id - The object id of the path.
+// wide      - A flag stating if the path header uses a varint object id.
+//
+// Returns the length of the path header.
+size_t sky_path_sizeof_hdr(sky_object_id_t object_id, bool wide)
+{
+    if(wide) {
+        return sky_varint_sizeof(object_id) + sizeof(sky_path_event_data_length_t);
+    }
+    else {
+        return SKY_PATH_HEADER_LENGTH;
+    }
+}
+
+// Calculates the length of the header of a path at a given pointer address.
+//
+// ptr  - A pointer to raw, packed path data.
+// wide - A flag stating if the path header uses a varint object id.
+//
+// Returns the length of the path header.
+size_t sky_path_sizeof_raw_hdr(void *ptr, bool wide)
+{
+    if(wide) {
+        return sky_varint_sizeof_raw(ptr) + sizeof(sky_path_event_data_length_t);
+    }
+    else {
+        return SKY_PATH_HEADER_LENGTH;
+    }
+}
+
 // Serializes a path at a given memory location.
 //
 // path - The path to pack.
@@ -174,7 +205,8 @@ int sky_path_pack(sky_path *path, void *ptr, size_t *sz)
 
     // Write header.
     size_t event_data_length = get_event_data_length(path);
-    rc = sky_path_pack_hdr(path->object_id, event_data_length, ptr, &_sz);
+    rc = sky_path_pack_hdr(path->object_id, event_data_length, false, ptr, &_sz);
+    check(rc == 0, "Unable to pack path header");
     ptr += _sz;
 
     // Pack events.
@@ -202,32 +234,96 @@ error:
 //
 // object_id         - The object id of the path.
 // event_data_length - The size, in bytes, of the events.
+// wide              - A flag stating if the object id is written as a varint.
 // ptr               - The pointer to the current location.
 // sz                - The number of bytes written.
 //
 // Returns 0 if successful, otherwise returns -1.
 int sky_path_pack_hdr(sky_object_id_t object_id, uint32_t event_data_length,
-                      void *ptr, size_t *sz)
+                      bool wide, void *ptr, size_t *sz)
 {
+    size_t _sz;
+    void *start = ptr;
+
     // Validate.
     check(ptr != NULL, "Pointer required");
     check(object_id != 0, "Object ID cannot be zero");
     check(event_data_length > 0, "Event data length cannot be zero");
 
-    // Write object id & event data length.
-    *((sky_object_id_t*)ptr) = object_id;
-    ptr += sizeof(sky_object_id_t);
+    // Write object id.
+    if(wide) {
+        sky_varint_pack(ptr, object_id, &_sz);
+        ptr += _sz;
+    }
+    else {
+        check(object_id <= SKY_NARROW_OBJECT_ID_MAX, "Object ID requires wide object ids: %llu", (unsigned long long)object_id);
+        *((uint32_t*)ptr) = (uint32_t)object_id;
+        ptr += sizeof(uint32_t);
+    }
+
+    // Write event data length.
     *((sky_path_event_data_length_t*)ptr) = event_data_length;
+    ptr += sizeof(sky_path_event_data_length_t);
 
     // Store number of bytes written.
     if(sz != NULL) {
-        *sz = SKY_PATH_HEADER_LENGTH;
+        *sz = ptr - start;
     }
 
     return 0;
 
 error:
-    *sz = 0;
+    if(sz != NULL) *sz = 0;
+    return -1;
+}
+
+// Deserializes a path header from a given memory location.
+//
+// object_id         - A pointer to where the object id is returned.
+// event_data_length - A pointer to where the size of the events is returned.
+// wide              - A flag stating if the object id is stored as a varint.
+// ptr               - The pointer to the current location.
+// sz                - The number of bytes read.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_unpack_hdr(sky_object_id_t *object_id, uint32_t *event_data_length,
+                        bool wide, void *ptr, size_t *sz)
+{
+    size_t _sz;
+    void *start = ptr;
+
+    // Validate.
+    check(ptr != NULL, "Pointer required");
+
+    // Read object id.
+    sky_object_id_t _object_id;
+    if(wide) {
+        _object_id = sky_varint_unpack(ptr, &_sz);
+        ptr += _sz;
+    }
+    else {
+        _object_id = *((uint32_t*)ptr);
+        ptr += sizeof(uint32_t);
+    }
+
+    // Read event data length.
+    if(object_id != NULL) {
+        *object_id = _object_id;
+    }
+    if(event_data_length != NULL) {
+        *event_data_length = *((sky_path_event_data_length_t*)ptr);
+    }
+    ptr += sizeof(sky_path_event_data_length_t);
+
+    // Store number of bytes read.
+    if(sz != NULL) {
+        *sz = ptr - start;
+    }
+
+    return 0;
+
+error:
+    if(sz != NULL) *sz = 0;
     return -1;
 }
 
@@ -249,13 +345,15 @@ int sky_path_unpack(sky_path *path, void *ptr, size_t *sz)
     check(ptr != NULL, "Pointer required");
 
     // Read object id & event data length.
-    path->object_id = *((sky_object_id_t*)ptr);
-    ptr += sizeof(sky_object_id_t);
-    size_t event_data_length = *((sky_path_event_data_length_t*)ptr);
-    ptr += sizeof(sky_path_event_data_length_t);
+    uint32_t event_data_length;
+    rc = sky_path_unpack_hdr(&path->object_id, &event_data_length, false, ptr, &_sz);
+    check(rc == 0, "Unable to unpack path header");
+    ptr += _sz;
 
-    // Unpack events.
+    // Unpack events. Delta encoded timestamps are relative to the previous
+    // event.
     int index = 0;
+    sky_timestamp_t base = 0;
     void *endptr = ptr + event_data_length;
     while(ptr < endptr) {
         path->event_count++;
@@ -263,9 +361,10 @@ int sky_path_unpack(sky_path *path, void *ptr, size_t *sz)
         check_mem(path->events);
 
         path->events[index] = sky_event_create(path->object_id, 0, 0);
-        rc = sky_event_unpack(path->events[index], ptr, &_sz);
+        rc = sky_event_unpack_delta(path->events[index], base, ptr, &_sz);
         check(rc == 0, "Unable to unpack event at %p", ptr);
         ptr += _sz;
+        base = path->events[index]->timestamp;
         
         index++;
     }
@@ -291,11 +390,12 @@ error:
 // would be added.
 //
 // path_ptr    - The start of the raw path data.
+// wide        - A flag stating if the path header uses a varint object id.
 // event       - A soon-to-be-added event to calculate into the stats. If null
 //               then the stats are calculated as they exist in the raw data.
 // event       - A pointer to where the stats should be returned.
 // event_count - A pointer to where the number of events should be returned.
-int sky_path_get_event_stats(void *path_ptr, sky_event *event,
+int sky_path_get_event_stats(void *path_ptr, bool wide, sky_event *event,
                              sky_path_event_stat **events,
                              uint32_t *event_count)
 {
@@ -307,11 +407,12 @@ int sky_path_get_event_stats(void *path_ptr, sky_event *event,
     // Initialize cursor.
     sky_cursor cursor;
     sky_cursor_init(&cursor);
+    cursor.wide = wide;
     rc = sky_cursor_set_path(&cursor, path_ptr);
     check(rc == 0, "Unable to set cursor for path");
 
     // Calculate size of the event and path.
-    size_t path_length = sky_path_sizeof_raw(path_ptr);
+    size_t path_length = sky_path_sizeof_raw(path_ptr, wide);
     size_t event_length = (event != NULL ? sky_event_sizeof(event) : 0);
 
     // Initialize return values.
@@ -322,12 +423,7 @@ int sky_path_get_event_stats(void *path_ptr, sky_event *event,
     sky_timestamp_t last_timestamp = SKY_TIMESTAMP_MIN;
     while(!cursor.eof) {
         // Retrieve timestamp from current event.
-        sky_timestamp_t timestamp;
-        sky_action_id_t action_id;
-        sky_event_data_length_t data_length;
-        size_t sz;
-        rc = sky_event_unpack_hdr(&timestamp, &action_id, &data_length, cursor.ptr, &sz);
-        check(rc == 0, "Unable to unpack current event header");
+        sky_timestamp_t timestamp = cursor.timestamp;
         
         // Check if event is inserted between the last event and current event.
         if(event != NULL && event->timestamp >= last_timestamp && event->timestamp < timestamp) {
@@ -394,7 +490,7 @@ int sky_path_add_event(sky_path *path, sky_event *event)
     check(path != NULL, "Path required");
     check(path->object_id != 0, "Path object id cannot be null");
     check(event != NULL, "Event required");
-    check(path->object_id == event->object_id, "Event object id (%d) does not match path object id (%d)", event->object_id, path->object_id);
+    check(path->object_id == event->object_id, "Event object id (%llu) does not match path object id (%llu)", (unsigned long long)event->object_id, (unsigned long long)path->object_id);
 
     // Raise error if event has already been added.
     unsigned int i;
@@ -2,6 +2,7 @@
 #define _path_h
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <inttypes.h>
 
 #include "event.h"
@@ -14,6 +15,14 @@
 //==============================================================================
 
 // A path is a collection of events that is associated with an object.
+//
+// A raw path starts with a header that stores the object id of the path and
+// the length of its event data. The header of a path in a data file with
+// wide object ids stores the object id as a varint so that small ids take
+// less space than a fixed 64-bit id. The event data length is always stored
+// as a fixed 4-byte integer so that the header doesn't change size as events
+// are added to the path. Other data files store the object id as a fixed
+// 4-byte integer.
 
 
 //==============================================================================
@@ -24,7 +33,9 @@
 
 #define sky_path_event_data_length_t uint32_t
 
-#define SKY_PATH_HEADER_LENGTH (sizeof(sky_object_id_t) + sizeof(sky_path_event_data_length_t))
+#define SKY_PATH_HEADER_LENGTH (sizeof(uint32_t) + sizeof(sky_path_event_data_length_t))
+
+#define SKY_WIDE_PATH_MIN_HEADER_LENGTH (sizeof(uint8_t) + sizeof(sky_path_event_data_length_t))
 
 
 //==============================================================================
@@ -72,24 +83,28 @@ void sky_path_free(sky_path *path);
 
 size_t sky_path_sizeof(sky_path *path);
 
-size_t sky_path_sizeof_raw(void *ptr);
+size_t sky_path_sizeof_raw(void *ptr, bool wide);
+
+size_t sky_path_sizeof_hdr(sky_object_id_t object_id, bool wide);
+
+size_t sky_path_sizeof_raw_hdr(void *ptr, bool wide);
 
 int sky_path_pack(sky_path *path, void *addr, size_t *length);
 
 int sky_path_pack_hdr(sky_object_id_t object_id, uint32_t event_data_length,
-    void *addr, size_t *length);
+    bool wide, void *addr, size_t *length);
 
 int sky_path_unpack(sky_path *path, void *addr, size_t *length);
 
 int sky_path_unpack_hdr(sky_object_id_t *object_id, uint32_t *event_data_length,
-    void *addr, size_t *length);
+    bool wide, void *addr, size_t *length);
 
 
 //--------------------------------------
 // Stats
 //--------------------------------------
 
-int sky_path_get_event_stats(void *path_ptr, sky_event *event,
+int sky_path_get_event_stats(void *path_ptr, bool wide, sky_event *event,
     sky_path_event_stat **events, uint32_t *event_count);
 
 
@@ -3,6 +3,7 @@
 #include "path_iterator.h"
 #include "block.h"
 #include "path.h"
+#include "compression.h"
 #include "mem.h"
 #include "dbg.h"
 
@@ -18,8 +19,66 @@ int sky_path_iterator_get_ptr(sky_path_iterator *iterator, void **ptr);
 int sky_path_iterator_get_current_block(sky_path_iterator *iterator,
     sky_block **block);
 
+void sky_path_iterator_get_directory(sky_path_iterator *iterator,
+    sky_block ***blocks, uint32_t *block_count);
+
+int sky_path_iterator_get_span_count(sky_path_iterator *iterator,
+    uint32_t *count);
+
+int sky_path_iterator_move_past_path(sky_path_iterator *iterator);
+
 int sky_path_iterator_fast_forward(sky_path_iterator *iterator);
 
+int sky_path_iterator_matches_filter(sky_path_iterator *iterator,
+    bool *match);
+
+int sky_path_iterator_get_skip_count(sky_path_iterator *iterator,
+    uint32_t *count);
+
+int sky_path_iterator_prefetch(sky_path_iterator *iterator);
+
+int sky_path_iterator_get_segment_ptr(sky_block *block, uint32_t segment,
+    void **ptr);
+
+int sky_path_iterator_start(sky_path_iterator *iterator);
+
+bool sky_path_iterator_has_sources(sky_path_iterator *iterator);
+
+int sky_path_iterator_load_sources(sky_path_iterator *iterator);
+
+void sky_path_iterator_free_sources(sky_path_iterator *iterator);
+
+int sky_path_iterator_select_source(sky_path_iterator *iterator);
+
+int sky_path_iterator_get_source(sky_path_iterator *iterator,
+    sky_path_iterator **ret);
+
+int sky_path_iterator_fast_forward_memtable(sky_path_iterator *iterator);
+
+int sky_path_iterator_next_memtable(sky_path_iterator *iterator);
+
+int sky_path_iterator_get_memtable_ptr(sky_path_iterator *iterator,
+    void **ptr);
+
+
+//==============================================================================
+//
+// Globals
+//
+//==============================================================================
+
+// The pointers to the segments of the most recently retrieved path. Each
+// thread has its own list so iterators on different threads don't share it.
+static __thread void **sky_path_iterator_segments = NULL;
+
+static __thread uint32_t sky_path_iterator_segment_capacity = 0;
+
+// The decompressed data of the compressed blocks of the most recently
+// retrieved spanned path. There is one buffer per segment.
+static __thread void **sky_path_iterator_segment_buffers = NULL;
+
+static __thread uint32_t sky_path_iterator_segment_buffer_count = 0;
+
 
 //==============================================================================
 //
@@ -63,6 +122,16 @@ void sky_path_iterator_init(sky_path_iterator *iterator)
     memset(iterator, 0, sizeof(sky_path_iterator));
 }
 
+// Releases the memory held by an iterator that was initialized in place and
+// reinitializes it.
+//
+// iterator - The iterator to uninitialize.
+void sky_path_iterator_uninit(sky_path_iterator *iterator)
+{
+    sky_path_iterator_free_sources(iterator);
+    sky_path_iterator_init(iterator);
+}
+
 // Removes a path iterator reference from memory.
 //
 // iterator - The path iterator to free.
@@ -70,6 +139,7 @@ void sky_path_iterator_free(sky_path_iterator *iterator)
 {
     if(iterator) {
         iterator->data_file = NULL;
+        sky_path_iterator_free_sources(iterator);
         free(iterator);
     }
 }
@@ -90,12 +160,18 @@ int sky_path_iterator_set_data_file(sky_path_iterator *iterator, sky_data_file *
     int rc;
     check(iterator != NULL, "Iterator required");
     iterator->data_file   = data_file;
+    iterator->snapshot    = NULL;
+    iterator->data_files  = NULL;
+    iterator->snapshots   = NULL;
+    iterator->shard_count = 0;
+    iterator->shard_index = 0;
     iterator->block_index = 0;
     iterator->block       = NULL;
     iterator->byte_index  = 0;
+    iterator->prefetch_index = 0;
 
     // Position iterator at the first path.
-    rc = sky_path_iterator_fast_forward(iterator);
+    rc = sky_path_iterator_start(iterator);
     check(rc == 0, "Unable to find next available path");
 
     return 0;
@@ -116,9 +192,16 @@ int sky_path_iterator_set_block(sky_path_iterator *iterator, sky_block *block)
     check(iterator != NULL, "Iterator required");
     iterator->block       = block;
     iterator->data_file   = NULL;
+    iterator->snapshot    = NULL;
+    iterator->data_files  = NULL;
+    iterator->snapshots   = NULL;
+    iterator->shard_count = 0;
+    iterator->shard_index = 0;
     iterator->block_index = 0;
     iterator->byte_index  = 0;
 
+    sky_path_iterator_free_sources(iterator);
+
     // Position iterator at the first path.
     rc = sky_path_iterator_fast_forward(iterator);
     check(rc == 0, "Unable to find next available path");
@@ -129,6 +212,112 @@ error:
     return -1;
 }
 
+// Assigns a snapshot of a data file as the source.
+// 
+// iterator - The iterator.
+// snapshot - The snapshot to iterate over.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_set_snapshot(sky_path_iterator *iterator,
+                                   sky_snapshot *snapshot)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+    check(snapshot != NULL, "Snapshot required");
+    iterator->data_file   = snapshot->data_file;
+    iterator->snapshot    = snapshot;
+    iterator->data_files  = NULL;
+    iterator->snapshots   = NULL;
+    iterator->shard_count = 0;
+    iterator->shard_index = 0;
+    iterator->block_index = 0;
+    iterator->block       = NULL;
+    iterator->byte_index  = 0;
+    iterator->prefetch_index = 0;
+
+    // Position iterator at the first path.
+    rc = sky_path_iterator_start(iterator);
+    check(rc == 0, "Unable to find next available path");
+
+    return 0;
+    
+error:
+    return -1;
+}
+
+
+// Assigns the data files of a sharded table as the source. The paths of each
+// data file are iterated over in turn.
+// 
+// iterator    - The iterator.
+// data_files  - The data files to iterate over.
+// shard_count - The number of data files.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_set_data_files(sky_path_iterator *iterator,
+                                     sky_data_file **data_files,
+                                     uint32_t shard_count)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+    check(data_files != NULL && shard_count > 0, "Data files required");
+    iterator->data_file   = data_files[0];
+    iterator->snapshot    = NULL;
+    iterator->data_files  = data_files;
+    iterator->snapshots   = NULL;
+    iterator->shard_count = shard_count;
+    iterator->shard_index = 0;
+    iterator->block_index = 0;
+    iterator->block       = NULL;
+    iterator->byte_index  = 0;
+    iterator->prefetch_index = 0;
+
+    // Position iterator at the first path.
+    rc = sky_path_iterator_start(iterator);
+    check(rc == 0, "Unable to find next available path");
+
+    return 0;
+    
+error:
+    return -1;
+}
+
+// Assigns snapshots of the data files of a sharded table as the source. The
+// paths of each snapshot are iterated over in turn.
+// 
+// iterator    - The iterator.
+// snapshots   - The snapshots to iterate over.
+// shard_count - The number of snapshots.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_set_snapshots(sky_path_iterator *iterator,
+                                    sky_snapshot **snapshots,
+                                    uint32_t shard_count)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+    check(snapshots != NULL && shard_count > 0, "Snapshots required");
+    iterator->data_file   = snapshots[0]->data_file;
+    iterator->snapshot    = snapshots[0];
+    iterator->data_files  = NULL;
+    iterator->snapshots   = snapshots;
+    iterator->shard_count = shard_count;
+    iterator->shard_index = 0;
+    iterator->block_index = 0;
+    iterator->block       = NULL;
+    iterator->byte_index  = 0;
+    iterator->prefetch_index = 0;
+
+    // Position iterator at the first path.
+    rc = sky_path_iterator_start(iterator);
+    check(rc == 0, "Unable to find next available path");
+
+    return 0;
+    
+error:
+    return -1;
+}
+
 
 //--------------------------------------
 // Block Management
@@ -148,7 +337,10 @@ int sky_path_iterator_get_current_block(sky_path_iterator *iterator,
     
     // If we are iterating over a data file then return the current block.
     if(iterator->data_file != NULL) {
-        *block = iterator->data_file->blocks[iterator->block_index];
+        sky_block **blocks;
+        uint32_t block_count;
+        sky_path_iterator_get_directory(iterator, &blocks, &block_count);
+        *block = blocks[iterator->block_index];
     }
     // If we are iterating over a single block then just return that block.
     else {
@@ -161,6 +353,52 @@ error:
     return -1;
 }
 
+// Retrieves the block directory of the data file or snapshot that the
+// iterator is iterating over.
+//
+// iterator    - The iterator.
+// blocks      - A pointer to where the directory is returned.
+// block_count - A pointer to where the number of blocks is returned.
+void sky_path_iterator_get_directory(sky_path_iterator *iterator,
+                                     sky_block ***blocks,
+                                     uint32_t *block_count)
+{
+    if(iterator->snapshot != NULL) {
+        *blocks = iterator->snapshot->blocks;
+        *block_count = iterator->snapshot->block_count;
+    }
+    else {
+        *blocks = iterator->data_file->blocks;
+        *block_count = iterator->data_file->block_count;
+    }
+}
+
+// Determines the number of blocks that hold the path at the iterator's
+// current block.
+//
+// iterator - The iterator.
+// count    - A pointer to where the number of blocks is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_get_span_count(sky_path_iterator *iterator,
+                                     uint32_t *count)
+{
+    int rc;
+    if(iterator->snapshot != NULL) {
+        rc = sky_snapshot_get_span_count(iterator->snapshot, iterator->block_index, count);
+        check(rc == 0, "Unable to calculate snapshot span count");
+    }
+    else {
+        rc = sky_block_get_span_count(iterator->data_file->blocks[iterator->block_index], count);
+        check(rc == 0, "Unable to calculate span count");
+    }
+    return 0;
+
+error:
+    *count = 0;
+    return -1;
+}
+
 // Calculates the pointer address for a path that the iterator is currently
 // pointing to.
 //
@@ -171,14 +409,28 @@ int sky_path_iterator_get_ptr(sky_path_iterator *iterator, void **ptr)
 {
     int rc;
 
+    // Pack the path of a memtable source.
+    if(iterator->memtable != NULL) {
+        return sky_path_iterator_get_memtable_ptr(iterator, ptr);
+    }
+
+    // Read the path from the first source that holds it.
+    if(iterator->sources != NULL) {
+        sky_path_iterator *source;
+        rc = sky_path_iterator_get_source(iterator, &source);
+        check(rc == 0, "Unable to retrieve current source");
+        return sky_path_iterator_get_ptr(source, ptr);
+    }
+
     // Retrieve the current block.
     sky_block *block;
     rc = sky_path_iterator_get_current_block(iterator, &block);
     check(rc == 0, "Unable to retrieve current block");
     
-    // Retrieve the block pointer.
-    rc = sky_block_get_ptr(block, ptr);
-    check(rc == 0, "Unable to retrieve block pointer");
+    // Retrieve the block's data pointer. Compressed blocks are read from
+    // the decompression buffer.
+    rc = sky_block_get_data_ptr(block, ptr);
+    check(rc == 0, "Unable to retrieve block data pointer");
 
     // Increment by the byte offset.
     *ptr += iterator->byte_index;
@@ -191,6 +443,228 @@ error:
 }
 
 
+// Retrieves pointers to every segment of the path that the iterator is
+// currently pointing to. A path that is not spanned has a single segment.
+// The segments of a spanned path are returned in the order of their blocks
+// and point directly into the data file unless a block is compressed.
+// Compressed blocks are decompressed into a buffer for each segment.
+//
+// The returned list and any decompressed segments are only valid until the
+// next call on the same thread.
+//
+// iterator - The iterator.
+// ptrs     - A pointer to where the list of segment pointers is returned.
+// count    - A pointer to where the number of segments is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_get_ptrs(sky_path_iterator *iterator, void ***ptrs,
+                               uint32_t *count)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+    check(ptrs != NULL, "Pointer list address required");
+    check(count != NULL, "Count address required");
+
+    // Read the path from the first source that holds it.
+    if(iterator->sources != NULL) {
+        sky_path_iterator *source;
+        rc = sky_path_iterator_get_source(iterator, &source);
+        check(rc == 0, "Unable to retrieve current source");
+        return sky_path_iterator_get_ptrs(source, ptrs, count);
+    }
+
+    // Determine the number of segments. A memtable source has one.
+    if(iterator->memtable != NULL) {
+        if(sky_path_iterator_segment_capacity == 0) {
+            sky_path_iterator_segments = malloc(sizeof(*sky_path_iterator_segments));
+            check_mem(sky_path_iterator_segments);
+            sky_path_iterator_segment_capacity = 1;
+        }
+        rc = sky_path_iterator_get_memtable_ptr(iterator, &sky_path_iterator_segments[0]);
+        check(rc == 0, "Unable to retrieve memtable path");
+        *ptrs = sky_path_iterator_segments;
+        *count = 1;
+        return 0;
+    }
+
+    sky_block *block;
+    rc = sky_path_iterator_get_current_block(iterator, &block);
+    check(rc == 0, "Unable to retrieve current block");
+    uint32_t span_count = 1;
+    if(iterator->data_file != NULL && block->spanned) {
+        rc = sky_path_iterator_get_span_count(iterator, &span_count);
+        check(rc == 0, "Unable to calculate span count");
+    }
+
+    // Grow the segment list.
+    if(span_count > sky_path_iterator_segment_capacity) {
+        sky_path_iterator_segments = realloc(sky_path_iterator_segments, sizeof(*sky_path_iterator_segments) * span_count);
+        check_mem(sky_path_iterator_segments);
+        sky_path_iterator_segment_capacity = span_count;
+    }
+
+    // The first segment starts at the current path.
+    rc = sky_path_iterator_get_ptr(iterator, &sky_path_iterator_segments[0]);
+    check(rc == 0, "Unable to retrieve the current pointer");
+
+    // Each remaining segment starts at the beginning of its block.
+    uint32_t i;
+    for(i=1; i<span_count; i++) {
+        sky_block **blocks;
+        uint32_t block_count;
+        sky_path_iterator_get_directory(iterator, &blocks, &block_count);
+        sky_block *segment_block = blocks[iterator->block_index+i];
+        rc = sky_path_iterator_get_segment_ptr(segment_block, i, &sky_path_iterator_segments[i]);
+        check(rc == 0, "Unable to retrieve segment pointer");
+    }
+
+    *ptrs = sky_path_iterator_segments;
+    *count = span_count;
+    return 0;
+
+error:
+    *ptrs = NULL;
+    *count = 0;
+    return -1;
+}
+
+// Sets a cursor to the events of the path that the iterator is currently
+// pointing to. The cursor reads every segment of a spanned path. When the
+// iterator merges the runs of a data file, the cursor merges the path from
+// every source that holds the object. The cursor owns its lists of segments
+// but decompressed segments are only valid until the next path is retrieved.
+//
+// iterator - The iterator.
+// cursor   - The cursor.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_set_cursor(sky_path_iterator *iterator,
+                                 sky_cursor *cursor)
+{
+    int rc;
+    void **ptrs = NULL;
+    void ***source_ptrs = NULL;
+    uint32_t *source_counts = NULL;
+    uint32_t i;
+    check(iterator != NULL, "Iterator required");
+    check(cursor != NULL, "Cursor required");
+
+    void **segments;
+    uint32_t count;
+    if(iterator->sources == NULL) {
+        rc = sky_path_iterator_get_ptrs(iterator, &segments, &count);
+        check(rc == 0, "Unable to retrieve path pointers");
+        ptrs = malloc(sizeof(*ptrs) * count); check_mem(ptrs);
+        memcpy(ptrs, segments, sizeof(*ptrs) * count);
+
+        sky_data_file *data_file = (iterator->data_file ? iterator->data_file : iterator->block->data_file);
+        cursor->wide = sky_data_file_is_wide(data_file);
+        rc = sky_cursor_set_paths(cursor, ptrs, count);
+        ptrs = NULL;
+        check(rc == 0, "Unable to set cursor paths");
+        return 0;
+    }
+
+    // Runs are never compressed so their segments are retrieved before the
+    // segments of the data file, which can be decompressed into the shared
+    // segment buffers.
+    source_ptrs = calloc(iterator->source_count, sizeof(*source_ptrs)); check_mem(source_ptrs);
+    source_counts = calloc(iterator->source_count, sizeof(*source_counts)); check_mem(source_counts);
+    for(i=iterator->source_count; i>0; i--) {
+        sky_path_iterator *source = &iterator->sources[i-1];
+        if(source->eof || source->current_object_id != iterator->current_object_id) {
+            continue;
+        }
+        rc = sky_path_iterator_get_ptrs(source, &segments, &count);
+        check(rc == 0, "Unable to retrieve source path pointers");
+        source_ptrs[i-1] = malloc(sizeof(**source_ptrs) * count); check_mem(source_ptrs[i-1]);
+        memcpy(source_ptrs[i-1], segments, sizeof(**source_ptrs) * count);
+        source_counts[i-1] = count;
+    }
+
+    // Add the sources in order so newer runs win timestamp ties.
+    rc = sky_cursor_set_paths(cursor, NULL, 0);
+    check(rc == 0, "Unable to reset cursor");
+    for(i=0; i<iterator->source_count; i++) {
+        if(source_ptrs[i] == NULL) {
+            continue;
+        }
+        // Memtable paths always have a wide header.
+        sky_path_iterator *source = &iterator->sources[i];
+        bool wide = (source->memtable != NULL || sky_data_file_is_wide(source->data_file));
+        rc = sky_cursor_add_source(cursor, source_ptrs[i], source_counts[i], wide);
+        source_ptrs[i] = NULL;
+        check(rc == 0, "Unable to add cursor source");
+    }
+
+    free(source_ptrs);
+    free(source_counts);
+    return 0;
+
+error:
+    if(source_ptrs != NULL) {
+        for(i=0; i<iterator->source_count; i++) {
+            free(source_ptrs[i]);
+        }
+    }
+    free(source_ptrs);
+    free(source_counts);
+    free(ptrs);
+    return -1;
+}
+
+// Retrieves a pointer to the data of a block that holds a segment of a
+// spanned path. Compressed blocks are decompressed into the segment's buffer
+// so that earlier segments remain readable.
+//
+// block   - The block.
+// segment - The index of the segment within the path.
+// ptr     - A pointer to where the data's starting address will be set.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_get_segment_ptr(sky_block *block, uint32_t segment,
+                                      void **ptr)
+{
+    int rc;
+
+    // Uncompressed blocks are read in place.
+    if(block->compressed_length == 0) {
+        rc = sky_block_get_ptr(block, ptr);
+        check(rc == 0, "Unable to retrieve block pointer");
+        return 0;
+    }
+
+    // Archived blocks are read from the archive.
+    void *block_ptr;
+    rc = sky_block_get_compressed_ptr(block, &block_ptr);
+    check(rc == 0, "Unable to retrieve compressed data pointer");
+
+    // Allocate a buffer for the segment.
+    if(segment >= sky_path_iterator_segment_buffer_count) {
+        sky_path_iterator_segment_buffers = realloc(sky_path_iterator_segment_buffers, sizeof(*sky_path_iterator_segment_buffers) * (segment+1));
+        check_mem(sky_path_iterator_segment_buffers);
+        memset(&sky_path_iterator_segment_buffers[sky_path_iterator_segment_buffer_count], 0, sizeof(*sky_path_iterator_segment_buffers) * (segment+1-sky_path_iterator_segment_buffer_count));
+        sky_path_iterator_segment_buffer_count = segment+1;
+    }
+    size_t block_size = block->data_file->block_size;
+    sky_path_iterator_segment_buffers[segment] = realloc(sky_path_iterator_segment_buffers[segment], block_size);
+    check_mem(sky_path_iterator_segment_buffers[segment]);
+    void *buffer = sky_path_iterator_segment_buffers[segment];
+
+    size_t sz;
+    rc = sky_decompress(block_ptr, block->compressed_length, buffer, block_size, &sz);
+    check(rc == 0, "Unable to decompress block: %d", block->index);
+    memset(buffer + sz, 0, block_size - sz);
+
+    *ptr = buffer;
+    return 0;
+
+error:
+    *ptr = NULL;
+    return -1;
+}
+
+
 //--------------------------------------
 // Iteration
 //--------------------------------------
@@ -204,9 +678,55 @@ int sky_path_iterator_next(sky_path_iterator *iterator)
 {
     int rc;
     check(iterator != NULL, "Iterator required");
-    check(iterator->data_file != NULL || iterator->block != NULL, "Iterator must have a source");
+    check(iterator->data_file != NULL || iterator->block != NULL || iterator->memtable != NULL, "Iterator must have a source");
     check(!iterator->eof, "Iterator is at end-of-file");
 
+    // Move a memtable source to its next object.
+    if(iterator->memtable != NULL) {
+        rc = sky_path_iterator_next_memtable(iterator);
+        check(rc == 0, "Unable to move to next memtable path");
+        return 0;
+    }
+
+    // Move each source that holds the current object and then move to the
+    // lowest object of the sources.
+    if(iterator->sources != NULL) {
+        uint32_t i;
+        for(i=0; i<iterator->source_count; i++) {
+            sky_path_iterator *source = &iterator->sources[i];
+            if(!source->eof && source->current_object_id == iterator->current_object_id) {
+                rc = sky_path_iterator_next(source);
+                check(rc == 0, "Unable to move source to next path");
+            }
+        }
+        rc = sky_path_iterator_select_source(iterator);
+        check(rc == 0, "Unable to select next source");
+        return 0;
+    }
+
+    rc = sky_path_iterator_move_past_path(iterator);
+    check(rc == 0, "Unable to move past current path");
+    
+    // Move to the next available path or mark the iterator as eof.
+    rc = sky_path_iterator_fast_forward(iterator);
+    check(rc == 0, "Unable to find next available path");
+    
+    return 0;
+    
+error:
+    return -1;
+}
+
+// Moves the iterator's position to the byte after the current path. The
+// iterator may not be on a valid path afterward.
+// 
+// iterator - The iterator.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_move_past_path(sky_path_iterator *iterator)
+{
+    int rc;
+
     // Retrieve some data file info.
     sky_data_file *data_file = (iterator->data_file ? iterator->data_file : iterator->block->data_file);
     
@@ -220,7 +740,7 @@ int sky_path_iterator_next(sky_path_iterator *iterator)
     if(iterator->data_file && block->spanned) {
         // Retrieve span count.
         uint32_t span_count;
-        rc = sky_block_get_span_count(block, &span_count);
+        rc = sky_path_iterator_get_span_count(iterator, &span_count);
         check(rc == 0, "Unable to calculate span count");
         
         // Move to the first block after the span.
@@ -235,7 +755,7 @@ int sky_path_iterator_next(sky_path_iterator *iterator)
         check(rc == 0, "Unable to retrieve the current pointer");
 
         // Read path size and move past it.
-        iterator->byte_index += sky_path_sizeof_raw(ptr);
+        iterator->byte_index += sky_path_sizeof_raw(ptr, sky_data_file_is_wide(data_file));
         
         // If this is a single block iterator then save the byte index so it
         // can be used to determine the block data length.
@@ -249,11 +769,7 @@ int sky_path_iterator_next(sky_path_iterator *iterator)
             iterator->byte_index = 0;
         }
     }
-    
-    // Move to the next available path or mark the iterator as eof.
-    rc = sky_path_iterator_fast_forward(iterator);
-    check(rc == 0, "Unable to find next available path");
-    
+
     return 0;
     
 error:
@@ -279,28 +795,92 @@ int sky_path_iterator_fast_forward(sky_path_iterator *iterator)
     // Keep searching for data or the EOF until we find it.
     while(true) {
         // If the block index is out of range then mark as EOF and exit.
-        uint32_t max_block_index = (data_file != NULL ? data_file->block_count-1 : 0);
-        if(iterator->block_index > max_block_index) {
+        sky_block **blocks = NULL;
+        uint32_t block_count = 1;
+        if(data_file != NULL) {
+            sky_path_iterator_get_directory(iterator, &blocks, &block_count);
+        }
+        if(iterator->block_index >= block_count) {
+            // Continue with the next shard if there is one.
+            if(iterator->shard_index + 1 < iterator->shard_count) {
+                iterator->shard_index++;
+                if(iterator->snapshots != NULL) {
+                    iterator->snapshot = iterator->snapshots[iterator->shard_index];
+                    iterator->data_file = iterator->snapshot->data_file;
+                }
+                else {
+                    iterator->data_file = iterator->data_files[iterator->shard_index];
+                }
+                data_file = iterator->data_file;
+                iterator->block_index = 0;
+                iterator->byte_index  = 0;
+                iterator->prefetch_index = 0;
+                continue;
+            }
+
             iterator->block_index = 0;
             iterator->byte_index  = 0;
             iterator->eof = true;
             break;
         }
         
+        // Skip slots that were replaced by copies but are kept for readers
+        // of older versions of the data file.
+        if(data_file != NULL && blocks[iterator->block_index]->retired) {
+            iterator->block_index++;
+            iterator->byte_index = 0;
+            continue;
+        }
+
+        // Read ahead when entering a new block of a data file.
+        if(data_file != NULL && iterator->byte_index == 0) {
+            rc = sky_path_iterator_prefetch(iterator);
+            check(rc == 0, "Unable to prefetch blocks");
+        }
+
         // If there is null data then move to the next block.
         void *ptr;
         rc = sky_path_iterator_get_ptr(iterator, &ptr);
         check(rc == 0, "Unable to retrieve the current pointer");
         
-        // If there is null data then move to the next block.
-        if(*((uint8_t*)ptr) == 0) {
+        // If there is null data then move to the next block. The whole
+        // object id is checked since ids can have a zero low byte and the
+        // space left is padding if it can't hold a path header. A varint
+        // object id only starts with a zero byte if the id is zero.
+        sky_data_file *block_data_file = (data_file != NULL ? data_file : iterator->block->data_file);
+        bool wide = sky_data_file_is_wide(block_data_file);
+        size_t min_header_length = (wide ? SKY_WIDE_PATH_MIN_HEADER_LENGTH : SKY_PATH_HEADER_LENGTH);
+        bool is_null = (wide ? *((uint8_t*)ptr) == 0 : *((uint32_t*)ptr) == 0);
+        if(iterator->byte_index + min_header_length > block_data_file->block_size || is_null) {
             iterator->block_index++;
             iterator->byte_index = 0;
         }
         // If there is valid data then exit.
         else {
+            // Skip blocks that cannot match the predicate.
+            uint32_t skip_count = 0;
+            if(data_file != NULL && iterator->byte_index == 0) {
+                rc = sky_path_iterator_get_skip_count(iterator, &skip_count);
+                check(rc == 0, "Unable to check block predicate");
+            }
+            if(skip_count > 0) {
+                iterator->block_index += skip_count;
+                continue;
+            }
+
             // Grab the current object id.
-            iterator->current_object_id = *((sky_object_id_t*)ptr);
+            rc = sky_path_unpack_hdr(&iterator->current_object_id, NULL, wide, ptr, NULL);
+            check(rc == 0, "Unable to unpack path header");
+
+            // Skip paths of objects that don't match the action filter.
+            bool match;
+            rc = sky_path_iterator_matches_filter(iterator, &match);
+            check(rc == 0, "Unable to check action filter");
+            if(!match) {
+                rc = sky_path_iterator_move_past_path(iterator);
+                check(rc == 0, "Unable to move past filtered path");
+                continue;
+            }
             break;
         }
     }
@@ -310,3 +890,443 @@ int sky_path_iterator_fast_forward(sky_path_iterator *iterator)
 error:
     return -1;
 }
+
+// Checks if the object of the current path has performed the action of the
+// iterator's action filter. Every path matches if there is no filter.
+//
+// iterator - The iterator.
+// match    - A pointer to where the flag is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_matches_filter(sky_path_iterator *iterator,
+                                     bool *match)
+{
+    int rc;
+    *match = true;
+    if(iterator->action_index != NULL && iterator->filter_action_id != 0) {
+        rc = sky_action_index_contains(iterator->action_index, iterator->filter_action_id, iterator->current_object_id, match);
+        check(rc == 0, "Unable to search action index");
+    }
+    return 0;
+
+error:
+    *match = false;
+    return -1;
+}
+
+// Calculates the number of blocks to skip from the current block because
+// their zone maps cannot match the iterator's predicate or because they don't
+// hold any object in the iterator's action filter. The blocks of a span are
+// only skipped together.
+//
+// iterator - The iterator.
+// count    - A pointer to where the number of blocks to skip is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_get_skip_count(sky_path_iterator *iterator,
+                                     uint32_t *count)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+    check(count != NULL, "Skip count address required");
+
+    *count = 0;
+    bool filtered = (iterator->action_index != NULL && iterator->filter_action_id != 0);
+    if(sky_zone_map_predicate_is_empty(iterator->predicate) && !filtered) {
+        return 0;
+    }
+
+    // Determine the blocks that hold the current path.
+    sky_block **blocks;
+    uint32_t block_count;
+    sky_path_iterator_get_directory(iterator, &blocks, &block_count);
+    uint32_t span_count;
+    rc = sky_path_iterator_get_span_count(iterator, &span_count);
+    check(rc == 0, "Unable to calculate span count");
+
+    // Skip the blocks if no filtered object falls within their range.
+    if(filtered) {
+        sky_object_id_t object_id;
+        sky_block *first_block = blocks[iterator->block_index];
+        sky_block *last_block = blocks[iterator->block_index+span_count-1];
+        rc = sky_action_index_find_next(iterator->action_index, iterator->filter_action_id, first_block->min_object_id, &object_id);
+        check(rc == 0, "Unable to search action index");
+        if(object_id == 0 || object_id > last_block->max_object_id) {
+            *count = span_count;
+            return 0;
+        }
+    }
+
+    // The blocks are kept if any of them can match.
+    if(sky_zone_map_predicate_is_empty(iterator->predicate)) {
+        return 0;
+    }
+    uint32_t i;
+    for(i=0; i<span_count; i++) {
+        bool match;
+        rc = sky_block_matches(blocks[iterator->block_index+i], iterator->predicate, &match);
+        check(rc == 0, "Unable to check block zone map");
+        if(match) {
+            return 0;
+        }
+    }
+    *count = span_count;
+
+    return 0;
+
+error:
+    *count = 0;
+    return -1;
+}
+
+// Prefetches the current block and the blocks that follow it in the data
+// file's directory. Blocks that have already been prefetched by this
+// iterator are not requested again.
+//
+// iterator - The iterator.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_prefetch(sky_path_iterator *iterator)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+
+    sky_data_file *data_file = iterator->data_file;
+    sky_block **blocks;
+    uint32_t block_count;
+    sky_path_iterator_get_directory(iterator, &blocks, &block_count);
+    uint32_t end_index = iterator->block_index + SKY_PATH_ITERATOR_PREFETCH_COUNT + 1;
+    if(end_index > block_count) {
+        end_index = block_count;
+    }
+    if(iterator->prefetch_index < iterator->block_index) {
+        iterator->prefetch_index = iterator->block_index;
+    }
+
+    for(; iterator->prefetch_index<end_index; iterator->prefetch_index++) {
+        rc = sky_data_file_prefetch_block(data_file, blocks[iterator->prefetch_index]);
+        check(rc == 0, "Unable to prefetch block");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Runs
+//--------------------------------------
+
+// Positions an iterator at its first path after a source has been assigned.
+// The data files of the iterator are merged with their runs and memtables if
+// any of them has either.
+//
+// iterator - The iterator.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_start(sky_path_iterator *iterator)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+
+    sky_path_iterator_free_sources(iterator);
+    if(sky_path_iterator_has_sources(iterator)) {
+        rc = sky_path_iterator_load_sources(iterator);
+        check(rc == 0, "Unable to load sources");
+        rc = sky_path_iterator_select_source(iterator);
+        check(rc == 0, "Unable to select source");
+    }
+    else {
+        rc = sky_path_iterator_fast_forward(iterator);
+        check(rc == 0, "Unable to find next available path");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Checks if any of the data files that the iterator reads has runs or
+// events in its memtable.
+//
+// iterator - The iterator.
+//
+// Returns true if the iterator needs to merge sources.
+bool sky_path_iterator_has_sources(sky_path_iterator *iterator)
+{
+    uint32_t i;
+    uint32_t count = (iterator->shard_count > 0 ? iterator->shard_count : 1);
+    for(i=0; i<count; i++) {
+        sky_snapshot *snapshot = (iterator->shard_count > 0 ? (iterator->snapshots != NULL ? iterator->snapshots[i] : NULL) : iterator->snapshot);
+        if(snapshot != NULL) {
+            if(snapshot->run_count > 0 || (snapshot->memtable != NULL && snapshot->memtable->event_count > 0)) {
+                return true;
+            }
+            continue;
+        }
+        sky_data_file *data_file = (iterator->shard_count > 0 ? iterator->data_files[i] : iterator->data_file);
+        if(data_file == NULL) {
+            continue;
+        }
+        if(data_file->run_count > 0 || (data_file->memtable != NULL && data_file->memtable->event_count > 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Creates an iterator over the current data file, or snapshot, of the
+// iterator, over each of the data file's runs and over its memtable if it has
+// events. A snapshot supplies the runs and memtable that it was pinned with.
+// The iterator's predicate and action filter are applied to each of them.
+//
+// iterator - The iterator.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_load_sources(sky_path_iterator *iterator)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+    check(iterator->data_file != NULL, "Data file required");
+
+    // A snapshot supplies the runs and memtable that it was pinned with.
+    sky_data_file *data_file = iterator->data_file;
+    sky_snapshot *snapshot = iterator->snapshot;
+    sky_data_file **runs = (snapshot != NULL ? snapshot->runs : data_file->runs);
+    uint32_t run_count = (snapshot != NULL ? snapshot->run_count : data_file->run_count);
+    sky_memtable *memtable = (snapshot != NULL ? snapshot->memtable : data_file->memtable);
+    if(memtable != NULL && memtable->event_count == 0) {
+        memtable = NULL;
+    }
+
+    // The memtable is read in order so sort it first.
+    if(memtable != NULL) {
+        rc = sky_memtable_sort(memtable);
+        check(rc == 0, "Unable to sort memtable");
+    }
+
+    uint32_t file_count = run_count + 1;
+    iterator->source_count = file_count + (memtable != NULL ? 1 : 0);
+    iterator->sources = calloc(iterator->source_count, sizeof(*iterator->sources));
+    check_mem(iterator->sources);
+
+    uint32_t i;
+    for(i=0; i<iterator->source_count; i++) {
+        sky_path_iterator *source = &iterator->sources[i];
+        sky_path_iterator_init(source);
+        source->predicate = iterator->predicate;
+        source->action_index = iterator->action_index;
+        source->filter_action_id = iterator->filter_action_id;
+        if(i < file_count) {
+            source->data_file = (i == 0 ? data_file : runs[i-1]);
+            source->snapshot = (i == 0 ? iterator->snapshot : NULL);
+            rc = sky_path_iterator_fast_forward(source);
+            check(rc == 0, "Unable to find first path of source");
+        }
+        else {
+            source->memtable = memtable;
+            rc = sky_path_iterator_fast_forward_memtable(source);
+            check(rc == 0, "Unable to find first path of memtable");
+        }
+    }
+
+    return 0;
+
+error:
+    sky_path_iterator_free_sources(iterator);
+    return -1;
+}
+
+// Frees the iterators over the sources of a merging iterator.
+//
+// iterator - The iterator.
+void sky_path_iterator_free_sources(sky_path_iterator *iterator)
+{
+    uint32_t i;
+    for(i=0; i<iterator->source_count; i++) {
+        free(iterator->sources[i].path_data);
+    }
+    free(iterator->sources);
+    iterator->sources = NULL;
+    iterator->source_count = 0;
+}
+
+// Moves a merging iterator to the lowest object id of its sources. Once the
+// sources of a shard are exhausted, the sources of the next shard are loaded.
+// The iterator is flagged as EOF after the last shard.
+//
+// iterator - The iterator.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_select_source(sky_path_iterator *iterator)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+
+    while(true) {
+        uint32_t i;
+        bool found = false;
+        sky_object_id_t object_id = 0;
+        for(i=0; i<iterator->source_count; i++) {
+            sky_path_iterator *source = &iterator->sources[i];
+            if(!source->eof && (!found || source->current_object_id < object_id)) {
+                found = true;
+                object_id = source->current_object_id;
+            }
+        }
+        if(found) {
+            iterator->current_object_id = object_id;
+            iterator->eof = false;
+            break;
+        }
+
+        // Continue with the next shard if there is one.
+        sky_path_iterator_free_sources(iterator);
+        if(iterator->shard_index + 1 < iterator->shard_count) {
+            iterator->shard_index++;
+            if(iterator->snapshots != NULL) {
+                iterator->snapshot = iterator->snapshots[iterator->shard_index];
+                iterator->data_file = iterator->snapshot->data_file;
+            }
+            else {
+                iterator->data_file = iterator->data_files[iterator->shard_index];
+            }
+            rc = sky_path_iterator_load_sources(iterator);
+            check(rc == 0, "Unable to load sources for shard: %d", iterator->shard_index);
+            continue;
+        }
+
+        iterator->current_object_id = 0;
+        iterator->eof = true;
+        break;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Retrieves the first source of a merging iterator that holds the current
+// object. The data file comes before its runs and the memtable is last.
+//
+// iterator - The iterator.
+// ret      - A pointer to where the source is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_get_source(sky_path_iterator *iterator,
+                                 sky_path_iterator **ret)
+{
+    check(iterator != NULL, "Iterator required");
+    check(ret != NULL, "Source return address required");
+
+    uint32_t i;
+    for(i=0; i<iterator->source_count; i++) {
+        sky_path_iterator *source = &iterator->sources[i];
+        if(!source->eof && source->current_object_id == iterator->current_object_id) {
+            *ret = source;
+            return 0;
+        }
+    }
+    sentinel("No source holds the current object: %llu", (unsigned long long)iterator->current_object_id);
+
+error:
+    if(ret != NULL) *ret = NULL;
+    return -1;
+}
+
+
+//--------------------------------------
+// Memtable
+//--------------------------------------
+
+// Moves a memtable source to the first object at or after its current entry
+// that matches its action filter. The source is flagged as EOF once there are
+// no more entries.
+//
+// iterator - The memtable source.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_fast_forward_memtable(sky_path_iterator *iterator)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+    check(iterator->memtable != NULL, "Memtable required");
+
+    sky_memtable *memtable = iterator->memtable;
+    while(iterator->memtable_index < memtable->event_count) {
+        iterator->current_object_id = memtable->entries[iterator->memtable_index].event->object_id;
+        iterator->eof = false;
+
+        // Skip the events of objects that don't match the action filter.
+        bool match;
+        rc = sky_path_iterator_matches_filter(iterator, &match);
+        check(rc == 0, "Unable to check action filter");
+        if(match) {
+            return 0;
+        }
+        while(iterator->memtable_index < memtable->event_count && memtable->entries[iterator->memtable_index].event->object_id == iterator->current_object_id) {
+            iterator->memtable_index++;
+        }
+    }
+
+    iterator->current_object_id = 0;
+    iterator->eof = true;
+    return 0;
+
+error:
+    return -1;
+}
+
+// Moves a memtable source past the events of its current object.
+//
+// iterator - The memtable source.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_next_memtable(sky_path_iterator *iterator)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+    check(iterator->memtable != NULL, "Memtable required");
+
+    sky_memtable *memtable = iterator->memtable;
+    while(iterator->memtable_index < memtable->event_count && memtable->entries[iterator->memtable_index].event->object_id == iterator->current_object_id) {
+        iterator->memtable_index++;
+    }
+    rc = sky_path_iterator_fast_forward_memtable(iterator);
+    check(rc == 0, "Unable to find next memtable path");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Packs the path of the current object of a memtable source. The path is
+// only valid until the source moves to its next object.
+//
+// iterator - The memtable source.
+// ptr      - A pointer to where the path is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_path_iterator_get_memtable_ptr(sky_path_iterator *iterator,
+                                       void **ptr)
+{
+    int rc;
+    check(iterator != NULL, "Iterator required");
+    check(iterator->memtable != NULL, "Memtable required");
+    check(!iterator->eof, "Iterator is at end-of-file");
+
+    rc = sky_memtable_pack_path(iterator->memtable, iterator->memtable_index, &iterator->path_data, &iterator->path_data_capacity, NULL);
+    check(rc == 0, "Unable to pack memtable path");
+    *ptr = iterator->path_data;
+
+    return 0;
+
+error:
+    *ptr = NULL;
+    return -1;
+}
@@ -6,7 +6,10 @@
 
 #include "bstring.h"
 #include "data_file.h"
+#include "snapshot.h"
 #include "cursor.h"
+#include "zone_map.h"
+#include "action_index.h"
 
 
 //==============================================================================
@@ -21,13 +24,54 @@
 // is returned instead of a reference to a deserialized path. The cursor can be
 // used to iterate over the raw path data.
 //
+// An iterator can also be set to a snapshot of a data file, in which case it
+// iterates over the snapshot's blocks, runs and memtable and doesn't see
+// changes made to the data file after the snapshot was pinned.
+//
+// The data files of a sharded table, or snapshots of them, can be set on an
+// iterator together. The iterator returns the paths of each shard in turn so
+// paths are ordered by object id within a shard but not across shards.
+//
+// When iterating over a data file, a predicate can be set on the iterator so
+// that blocks whose zone maps cannot match it are skipped. The paths in
+// skipped blocks are never returned. A spanned path is only skipped if none
+// of its blocks can match.
+//
+// An iterator can also be given an action index and an action id so that it
+// only returns the paths of objects that have performed the action. Blocks
+// whose object id range doesn't hold any of those objects are skipped without
+// being read.
+//
+// A path that spans several blocks is returned by the iterator once. The
+// segments of the path in each block can be retrieved together with
+// `sky_path_iterator_get_ptrs()` and passed to `sky_cursor_set_paths()` so
+// that a cursor reads the whole path where it is stored.
+//
+// A data file can have runs of events that have not been merged into its
+// blocks yet. An iterator over a data file with runs reads the data file and
+// each run with an iterator of their own and returns every object that is in
+// any of them in order of object id. `sky_path_iterator_set_cursor()` sets a
+// cursor to the events of the current object from all of them. The pointers
+// returned by `sky_path_iterator_get_ptrs()` only cover the first of them
+// that holds the object. Runs are read from the data file as they are when
+// the iterator reaches the shard unless it iterates over a snapshot.
+//
+// The memtable of a data file is read the same way after its runs. The events
+// of each object in the memtable are packed into a path when the path is
+// retrieved so that a cursor can read them with the rest of the object.
+//
+// When iterating over a data file, the iterator also asks the kernel to read
+// the next few blocks into memory before it reaches them so that a scan of a
+// cold data file doesn't wait on a page fault for every block.
+//
 // The path iterator operates as a forward-only iterator. Jumping to the
 // previous path or jumping to a path by index is not allowed.
 //
-// The path iterator does not currently support full consistency if events are
-// added or removed after the iterator has been created and before the iteration
-// is complete. The biggest issue is that a block split can cause paths to not
-// be counted. This will be fixed in a future version.
+// An iterator over a data file does not support full consistency if events
+// are added or removed after the iterator has been created and before the
+// iteration is complete. The biggest issue is that a block split can cause
+// paths to not be counted. Iterate over snapshots to read a consistent
+// version of the data files while events are added.
 
 
 //==============================================================================
@@ -36,14 +80,33 @@
 //
 //==============================================================================
 
+// The number of blocks ahead of the current block that are read into memory
+// while iterating over a data file.
+#define SKY_PATH_ITERATOR_PREFETCH_COUNT 4
+
 typedef struct sky_path_iterator {
     sky_block *block;
     sky_data_file *data_file;
+    sky_snapshot *snapshot;
+    sky_data_file **data_files;
+    sky_snapshot **snapshots;
+    uint32_t shard_count;
+    uint32_t shard_index;
     uint32_t block_index;
     uint32_t byte_index;
     bool eof;
     sky_object_id_t current_object_id;
     size_t block_data_length;
+    sky_zone_map_predicate *predicate;
+    sky_action_index *action_index;
+    sky_action_id_t filter_action_id;
+    uint32_t prefetch_index;
+    struct sky_path_iterator *sources;
+    uint32_t source_count;
+    sky_memtable *memtable;
+    uint32_t memtable_index;
+    void *path_data;
+    size_t path_data_capacity;
 } sky_path_iterator;
 
 
@@ -63,6 +126,8 @@ sky_path_iterator *sky_path_iterator_alloc();
 
 void sky_path_iterator_init(sky_path_iterator *iterator);
 
+void sky_path_iterator_uninit(sky_path_iterator *iterator);
+
 void sky_path_iterator_free(sky_path_iterator *iterator);
 
 
@@ -76,6 +141,15 @@ int sky_path_iterator_set_data_file(sky_path_iterator *iterator,
 int sky_path_iterator_set_block(sky_path_iterator *iterator,
     sky_block *block);
 
+int sky_path_iterator_set_snapshot(sky_path_iterator *iterator,
+    sky_snapshot *snapshot);
+
+int sky_path_iterator_set_data_files(sky_path_iterator *iterator,
+    sky_data_file **data_files, uint32_t shard_count);
+
+int sky_path_iterator_set_snapshots(sky_path_iterator *iterator,
+    sky_snapshot **snapshots, uint32_t shard_count);
+
 
 //--------------------------------------
 // Iteration
@@ -83,6 +157,12 @@ int sky_path_iterator_set_block(sky_path_iterator *iterator,
 
 int sky_path_iterator_get_ptr(sky_path_iterator *iterator, void **ptr);
 
+int sky_path_iterator_get_ptrs(sky_path_iterator *iterator, void ***ptrs,
+    uint32_t *count);
+
+int sky_path_iterator_set_cursor(sky_path_iterator *iterator,
+    sky_cursor *cursor);
+
 int sky_path_iterator_next(sky_path_iterator *iterator);
 
 
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
 
 #include "peach_message.h"
 #include "minipack.h"
@@ -17,6 +18,24 @@
 //
 //==============================================================================
 
+struct tagbstring SKY_PEACH_KEY_QUERY = bsStatic("query");
+
+struct tagbstring SKY_PEACH_KEY_ACTION_ID = bsStatic("actionId");
+
+struct tagbstring SKY_PEACH_KEY_PROPERTY_ID = bsStatic("propertyId");
+
+struct tagbstring SKY_PEACH_KEY_MIN = bsStatic("min");
+
+struct tagbstring SKY_PEACH_KEY_MAX = bsStatic("max");
+
+struct tagbstring SKY_PEACH_KEY_START = bsStatic("start");
+
+struct tagbstring SKY_PEACH_KEY_END = bsStatic("end");
+
+struct tagbstring SKY_PEACH_KEY_ACTION_FILTER_ID = bsStatic("actionFilterId");
+
+#define SKY_PEACH_KEY_COUNT 8
+
 typedef void (*sky_qip_path_map_func)(sky_qip_path *path, qip_map *map);
 typedef void (*sky_qip_result_serialize_func)(void *result, qip_serializer *serializer);
 
@@ -68,6 +87,24 @@ void sky_peach_message_free(sky_peach_message *message)
 size_t sky_peach_message_sizeof(sky_peach_message *message)
 {
     size_t sz = 0;
+    if(!sky_zone_map_predicate_is_empty(&message->predicate) || message->action_filter_id != 0) {
+        sz += minipack_sizeof_map(SKY_PEACH_KEY_COUNT);
+        sz += minipack_sizeof_raw(blength(&SKY_PEACH_KEY_QUERY)) + blength(&SKY_PEACH_KEY_QUERY);
+        sz += minipack_sizeof_raw(blength(&SKY_PEACH_KEY_ACTION_ID)) + blength(&SKY_PEACH_KEY_ACTION_ID);
+        sz += minipack_sizeof_uint(message->predicate.action_id);
+        sz += minipack_sizeof_raw(blength(&SKY_PEACH_KEY_PROPERTY_ID)) + blength(&SKY_PEACH_KEY_PROPERTY_ID);
+        sz += minipack_sizeof_int(message->predicate.property_id);
+        sz += minipack_sizeof_raw(blength(&SKY_PEACH_KEY_MIN)) + blength(&SKY_PEACH_KEY_MIN);
+        sz += minipack_sizeof_double(message->predicate.min_value);
+        sz += minipack_sizeof_raw(blength(&SKY_PEACH_KEY_MAX)) + blength(&SKY_PEACH_KEY_MAX);
+        sz += minipack_sizeof_double(message->predicate.max_value);
+        sz += minipack_sizeof_raw(blength(&SKY_PEACH_KEY_START)) + blength(&SKY_PEACH_KEY_START);
+        sz += minipack_sizeof_int(message->predicate.start_timestamp);
+        sz += minipack_sizeof_raw(blength(&SKY_PEACH_KEY_END)) + blength(&SKY_PEACH_KEY_END);
+        sz += minipack_sizeof_int(message->predicate.end_timestamp);
+        sz += minipack_sizeof_raw(blength(&SKY_PEACH_KEY_ACTION_FILTER_ID)) + blength(&SKY_PEACH_KEY_ACTION_FILTER_ID);
+        sz += minipack_sizeof_uint(message->action_filter_id);
+    }
     sz += minipack_sizeof_raw(blength(message->query));
     sz += blength(message->query);
     return sz;
@@ -82,13 +119,58 @@ size_t sky_peach_message_sizeof(sky_peach_message *message)
 int sky_peach_message_pack(sky_peach_message *message, FILE *file)
 {
     int rc;
+    size_t sz;
     check(message != NULL, "Message required");
     check(file != NULL, "File stream required");
 
-    // Database name
+    // Messages without a predicate or action filter are written as the query
+    // text.
+    if(sky_zone_map_predicate_is_empty(&message->predicate) && message->action_filter_id == 0) {
+        rc = sky_minipack_fwrite_bstring(file, message->query);
+        check(rc == 0, "Unable to write query text");
+        return 0;
+    }
+
+    // Map
+    minipack_fwrite_map(file, SKY_PEACH_KEY_COUNT, &sz);
+    check(sz > 0, "Unable to write map");
+
+    // Query
+    check(sky_minipack_fwrite_bstring(file, &SKY_PEACH_KEY_QUERY) == 0, "Unable to pack query key");
     rc = sky_minipack_fwrite_bstring(file, message->query);
     check(rc == 0, "Unable to write query text");
 
+    // Action ID
+    check(sky_minipack_fwrite_bstring(file, &SKY_PEACH_KEY_ACTION_ID) == 0, "Unable to pack action id key");
+    minipack_fwrite_uint(file, message->predicate.action_id, &sz);
+    check(sz != 0, "Unable to pack action id");
+
+    // Property ID
+    check(sky_minipack_fwrite_bstring(file, &SKY_PEACH_KEY_PROPERTY_ID) == 0, "Unable to pack property id key");
+    minipack_fwrite_int(file, message->predicate.property_id, &sz);
+    check(sz != 0, "Unable to pack property id");
+
+    // Property range
+    check(sky_minipack_fwrite_bstring(file, &SKY_PEACH_KEY_MIN) == 0, "Unable to pack min key");
+    minipack_fwrite_double(file, message->predicate.min_value, &sz);
+    check(sz != 0, "Unable to pack min value");
+    check(sky_minipack_fwrite_bstring(file, &SKY_PEACH_KEY_MAX) == 0, "Unable to pack max key");
+    minipack_fwrite_double(file, message->predicate.max_value, &sz);
+    check(sz != 0, "Unable to pack max value");
+
+    // Time window
+    check(sky_minipack_fwrite_bstring(file, &SKY_PEACH_KEY_START) == 0, "Unable to pack start key");
+    minipack_fwrite_int(file, message->predicate.start_timestamp, &sz);
+    check(sz != 0, "Unable to pack start timestamp");
+    check(sky_minipack_fwrite_bstring(file, &SKY_PEACH_KEY_END) == 0, "Unable to pack end key");
+    minipack_fwrite_int(file, message->predicate.end_timestamp, &sz);
+    check(sz != 0, "Unable to pack end timestamp");
+
+    // Action filter
+    check(sky_minipack_fwrite_bstring(file, &SKY_PEACH_KEY_ACTION_FILTER_ID) == 0, "Unable to pack action filter key");
+    minipack_fwrite_uint(file, message->action_filter_id, &sz);
+    check(sz != 0, "Unable to pack action filter");
+
     return 0;
 
 error:
@@ -104,16 +186,77 @@ error:
 int sky_peach_message_unpack(sky_peach_message *message, FILE *file)
 {
     int rc;
+    size_t sz;
+    bstring key = NULL;
     check(message != NULL, "Message required");
     check(file != NULL, "File stream required");
 
-    // Query
-    rc = sky_minipack_fread_bstring(file, &message->query);
-    check(rc == 0, "Unable to read query text");
+    // Read the first byte of the message to determine the format.
+    uint8_t buffer[1];
+    check(fread(buffer, sizeof(*buffer), 1, file) == 1, "Unable to read message format");
+    ungetc(buffer[0], file);
+
+    // Messages without a predicate are just the query text.
+    if(!minipack_is_map((void*)buffer)) {
+        rc = sky_minipack_fread_bstring(file, &message->query);
+        check(rc == 0, "Unable to read query text");
+        return 0;
+    }
+
+    // Map
+    uint32_t map_length = minipack_fread_map(file, &sz);
+    check(sz > 0, "Unable to read map");
+
+    // Map items
+    uint32_t i;
+    for(i=0; i<map_length; i++) {
+        rc = sky_minipack_fread_bstring(file, &key);
+        check(rc == 0, "Unable to read map key");
+
+        if(biseq(key, &SKY_PEACH_KEY_QUERY) == 1) {
+            rc = sky_minipack_fread_bstring(file, &message->query);
+            check(rc == 0, "Unable to read query text");
+        }
+        else if(biseq(key, &SKY_PEACH_KEY_ACTION_ID) == 1) {
+            message->predicate.action_id = (sky_action_id_t)minipack_fread_uint(file, &sz);
+            check(sz != 0, "Unable to unpack action id");
+        }
+        else if(biseq(key, &SKY_PEACH_KEY_PROPERTY_ID) == 1) {
+            message->predicate.property_id = (sky_property_id_t)minipack_fread_int(file, &sz);
+            check(sz != 0, "Unable to unpack property id");
+        }
+        else if(biseq(key, &SKY_PEACH_KEY_MIN) == 1) {
+            message->predicate.min_value = minipack_fread_double(file, &sz);
+            check(sz != 0, "Unable to unpack min value");
+        }
+        else if(biseq(key, &SKY_PEACH_KEY_MAX) == 1) {
+            message->predicate.max_value = minipack_fread_double(file, &sz);
+            check(sz != 0, "Unable to unpack max value");
+        }
+        else if(biseq(key, &SKY_PEACH_KEY_START) == 1) {
+            message->predicate.start_timestamp = (sky_timestamp_t)minipack_fread_int(file, &sz);
+            check(sz != 0, "Unable to unpack start timestamp");
+        }
+        else if(biseq(key, &SKY_PEACH_KEY_END) == 1) {
+            message->predicate.end_timestamp = (sky_timestamp_t)minipack_fread_int(file, &sz);
+            check(sz != 0, "Unable to unpack end timestamp");
+        }
+        else if(biseq(key, &SKY_PEACH_KEY_ACTION_FILTER_ID) == 1) {
+            message->action_filter_id = (sky_action_id_t)minipack_fread_uint(file, &sz);
+            check(sz != 0, "Unable to unpack action filter");
+        }
+        else {
+            sentinel("Unknown PEACH message key: %s", bdata(key));
+        }
+
+        bdestroy(key);
+        key = NULL;
+    }
 
     return 0;
 
 error:
+    bdestroy(key);
     return -1;
 }
 
@@ -122,6 +265,46 @@ error:
 // Processing
 //--------------------------------------
 
+// Initializes a path iterator over the paths of a table that the query of a
+// message reads. Blocks that cannot match the message's predicate are
+// skipped and the paths are limited to the objects in the action filter.
+//
+// message   - The message.
+// table     - The table to iterate over.
+// snapshots - The snapshots of the table's shards to read from or null to
+//             read from the shards' data files.
+// iterator  - The iterator to initialize.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_peach_message_set_iterator(sky_peach_message *message,
+                                   sky_table *table,
+                                   sky_snapshot **snapshots,
+                                   sky_path_iterator *iterator)
+{
+    int rc;
+    check(message != NULL, "Message required");
+    check(table != NULL, "Table required");
+    check(iterator != NULL, "Iterator required");
+
+    sky_path_iterator_init(iterator);
+    iterator->predicate = &message->predicate;
+    iterator->action_index = table->action_index;
+    iterator->filter_action_id = message->action_filter_id;
+    if(snapshots != NULL) {
+        rc = sky_path_iterator_set_snapshots(iterator, snapshots, table->shard_count);
+        check(rc == 0, "Unable to set iterator snapshots");
+    }
+    else {
+        rc = sky_path_iterator_set_data_files(iterator, table->data_files, table->shard_count);
+        check(rc == 0, "Unable to set iterator data files");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
 // Runs a PEACH query against a table.
 //
 // message - The message.
@@ -133,33 +316,65 @@ int sky_peach_message_process(sky_peach_message *message, sky_table *table,
                               FILE *output)
 {
     int rc;
+    uint32_t i;
+    bool sequential = false;
+    sky_qip_module *module = NULL;
+    sky_qip_path *path = NULL;
+    qip_map *map = NULL;
+    qip_serializer *serializer = NULL;
+    sky_snapshot **snapshots = NULL;
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
     check(message != NULL, "Message required");
     check(table != NULL, "Table required");
     check(output != NULL, "Output stream required");
 
     // Compile.
-    sky_qip_module *module = sky_qip_module_create(); check_mem(module);
+    module = sky_qip_module_create(); check_mem(module);
     module->table = table;
     rc = sky_qip_module_compile(module, message->query);
     check(rc == 0, "Unable to compile query");
     sky_qip_path_map_func main_function = (sky_qip_path_map_func)module->main_function;
 
+    // A query without a predicate reads every block so the kernel can read
+    // ahead aggressively for the duration of the scan.
+    if(sky_zone_map_predicate_is_empty(&message->predicate)) {
+        sequential = true;
+        for(i=0; i<table->shard_count; i++) {
+            rc = sky_data_file_advise(table->data_files[i], MADV_SEQUENTIAL);
+            check(rc == 0, "Unable to advise sequential access");
+        }
+    }
+
+    // Read from a snapshot of each shard so that events added during the
+    // query don't change the blocks that it reads.
+    snapshots = calloc(table->shard_count, sizeof(*snapshots)); check_mem(snapshots);
+    for(i=0; i<table->shard_count; i++) {
+        rc = sky_data_file_pin_snapshot(table->data_files[i], &snapshots[i]);
+        check(rc == 0, "Unable to pin snapshot");
+    }
+
     // Initialize the path iterator.
-    sky_path_iterator iterator;
-    sky_path_iterator_init(&iterator);
-    rc = sky_path_iterator_set_data_file(&iterator, table->data_file);
+    rc = sky_peach_message_set_iterator(message, table, snapshots, &iterator);
     check(rc == 0, "Unable to initialze path iterator");
 
-    // Initialize QIP args.
-    sky_qip_path *path = sky_qip_path_create();
-    qip_map *map = qip_map_create();
+    // Initialize QIP args. Cursors on the path are limited to the window.
+    path = sky_qip_path_create(); check_mem(path);
+    path->iterator = &iterator;
+    path->wide = sky_data_file_is_wide(table->data_file);
+    if(sky_zone_map_predicate_has_window(&message->predicate)) {
+        path->start_timestamp = message->predicate.start_timestamp;
+        path->end_timestamp = message->predicate.end_timestamp;
+    }
+    map = qip_map_create(); check_mem(map);
     
     // Iterate over each path.
     uint32_t path_count = 0;
     while(!iterator.eof) {
-        // Retrieve the path pointer.
-        rc = sky_path_iterator_get_ptr(&iterator, &path->path_ptr);
-        check(rc == 0, "Unable to retrieve the path iterator pointer");
+        // Retrieve the path segments.
+        rc = sky_path_iterator_get_ptrs(&iterator, &path->path_ptrs, &path->path_count);
+        check(rc == 0, "Unable to retrieve the path iterator pointers");
+        path->path_ptr = path->path_ptrs[0];
     
         // Execute query.
         main_function(path, map);
@@ -172,6 +387,15 @@ int sky_peach_message_process(sky_peach_message *message, sky_table *table,
     }
     //debug("Paths processed: %d", path_count);
 
+    // Restore the default access pattern once the scan is complete.
+    if(sequential) {
+        sequential = false;
+        for(i=0; i<table->shard_count; i++) {
+            rc = sky_data_file_advise(table->data_files[i], MADV_NORMAL);
+            check(rc == 0, "Unable to advise normal access");
+        }
+    }
+
     // Retrieve Result serialization function.
     struct tagbstring result_str = bsStatic("Result");
     struct tagbstring serialize_str = bsStatic("serialize");
@@ -180,22 +404,55 @@ int sky_peach_message_process(sky_peach_message *message, sky_table *table,
     check(rc == 0 && result_serialize != NULL, "Unable to find serialize() method on class 'Result'");
 
     // Serialize.
-    qip_serializer *serializer = qip_serializer_create();
+    serializer = qip_serializer_create(); check_mem(serializer);
     qip_serializer_pack_map(module->_qip_module, serializer, map->count);
-    int64_t i;
-    for(i=0; i<map->count; i++) {
-        result_serialize(map->elements[i], serializer);
+    int64_t j;
+    for(j=0; j<map->count; j++) {
+        result_serialize(map->elements[j], serializer);
     }
 
-    // Send response to output stream.
-    rc = fwrite(serializer->data, serializer->length, 1, output);
-    check(rc == 1, "Unable to write serialized data to stream");
+    // Send response to output stream with factor ids decoded.
+    rc = sky_qip_module_write_results(module, serializer->data, serializer->length, output);
+    check(rc == 0, "Unable to write serialized data to stream");
     
+    qip_serializer_free(serializer);
+    serializer = NULL;
     qip_map_free(map);
+    map = NULL;
+    sky_qip_path_free(path);
+    path = NULL;
+    sky_path_iterator_uninit(&iterator);
+
+    // Release the snapshots once nothing reads from them.
+    for(i=0; i<table->shard_count; i++) {
+        rc = sky_data_file_release_snapshot(table->data_files[i], snapshots[i]);
+        snapshots[i] = NULL;
+        check(rc == 0, "Unable to release snapshot");
+    }
+    free(snapshots);
+    snapshots = NULL;
+
     sky_qip_module_free(module);
     return 0;
 
 error:
+    if(sequential) {
+        for(i=0; i<table->shard_count; i++) {
+            sky_data_file_advise(table->data_files[i], MADV_NORMAL);
+        }
+    }
+    qip_serializer_free(serializer);
+    qip_map_free(map);
+    sky_qip_path_free(path);
+    sky_path_iterator_uninit(&iterator);
+    if(snapshots) {
+        for(i=0; i<table->shard_count; i++) {
+            if(snapshots[i]) {
+                sky_data_file_release_snapshot(table->data_files[i], snapshots[i]);
+            }
+        }
+        free(snapshots);
+    }
     sky_qip_module_free(module);
     return -1;
 }
\ No newline at end of file
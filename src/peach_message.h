@@ -7,6 +7,8 @@
 #include "bstring.h"
 #include "types.h"
 #include "table.h"
+#include "zone_map.h"
+#include "path_iterator.h"
 
 
 //==============================================================================
@@ -15,9 +17,29 @@
 //
 //==============================================================================
 
-// A message for querying each path in the database.
+// A message for querying each path in the database. The message can declare
+// a predicate that every event of interest to the query meets. Blocks that
+// cannot contain a matching event are skipped without running the query on
+// their paths.
+//
+// The predicate can also limit the query to a time window. Blocks outside of
+// the window are skipped and the cursors of each path only return the events
+// inside the window.
+//
+// The message can also set an action filter. Only the paths of objects that
+// have performed the filter's action, according to the table's action index,
+// are read. This finds every object that performed an action without
+// scanning the paths of the objects that didn't. The predicate's action id
+// is only a hint for the zone maps and never filters paths by itself.
+//
+// A message without a predicate or action filter is serialized as the query
+// text alone. Otherwise it is serialized as a map of the query, the
+// predicate's action id, property id, inclusive property range and time
+// window and the action filter.
 typedef struct {
     bstring query;
+    sky_zone_map_predicate predicate;
+    sky_action_id_t action_filter_id;
 } sky_peach_message;
 
 
@@ -47,6 +69,9 @@ int sky_peach_message_unpack(sky_peach_message *message, FILE *file);
 // Processing
 //--------------------------------------
 
+int sky_peach_message_set_iterator(sky_peach_message *message,
+    sky_table *table, sky_snapshot **snapshots, sky_path_iterator *iterator);
+
 int sky_peach_message_process(sky_peach_message *message, sky_table *table,
     FILE *output);
 
@@ -30,6 +30,8 @@ struct tagbstring SKY_DATA_TYPE_BOOLEAN = bsStatic("Boolean");
 
 struct tagbstring SKY_DATA_TYPE_STRING = bsStatic("String");
 
+struct tagbstring SKY_DATA_TYPE_FACTOR = bsStatic("Factor");
+
 
 //==============================================================================
 //
@@ -263,6 +265,9 @@ int sky_property_get_standard_data_type_name(bstring type_name, bstring *ret)
     else if(biseq(&SKY_DATA_TYPE_STRING, type_name)) {
         *ret = &SKY_DATA_TYPE_STRING;
     }
+    else if(biseq(&SKY_DATA_TYPE_FACTOR, type_name)) {
+        *ret = &SKY_DATA_TYPE_FACTOR;
+    }
     // If this is not a standard type then return the name that came in.
     else {
         sentinel("Type is not a standard type: %s", bdata(type_name));
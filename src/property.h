@@ -25,6 +25,8 @@ extern struct tagbstring SKY_DATA_TYPE_BOOLEAN;
 
 extern struct tagbstring SKY_DATA_TYPE_STRING;
 
+extern struct tagbstring SKY_DATA_TYPE_FACTOR;
+
 
 typedef enum {
     SKY_PROPERTY_TYPE_OBJECT = 1,
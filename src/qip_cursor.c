@@ -6,6 +6,16 @@
 #include "dbg.h"
 
 
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+int sky_qip_cursor_unpack_value(bstring property_type, void *ptr,
+    void *property_value_ptr, size_t *sz);
+
+
 //==============================================================================
 //
 // Functions
@@ -99,59 +109,80 @@ void sky_qip_cursor_next(qip_module *module, sky_qip_cursor *cursor,
             }
         }
         
-        // Loop over data section until we run out of data.
-        void *ptr = data_ptr;
-        while(ptr < data_ptr+data_length) {
-            // Read property id.
-            sky_property_id_t property_id = *((sky_property_id_t*)ptr);
-            ptr += sizeof(property_id);
-            
-            // Initialize size to zero so we know if it was processed.
-            sz = 0;
-
-            // Loop over properties on event to check if we need to update.
+        // Read the properties that are stored in the columns of a columnar
+        // path. The remaining properties are in the data section.
+        if(cursor->cursor->columnar) {
+            uint32_t row_index = cursor->cursor->row_index;
+            for(i=0; i<property_count; i++) {
+                sky_column *column = NULL;
+                rc = sky_cursor_get_column(cursor->cursor, property_ids[i], &column);
+                check(rc == 0, "Unable to retrieve property column");
+                if(column == NULL || !sky_column_is_present(column, row_index)) {
+                    continue;
+                }
+
+                property_value_ptr = ((void*)event) + property_offsets[i];
+                bstring property_type = property_types[i];
+                if(property_type == &SKY_DATA_TYPE_INT) {
+                    check(column->type == SKY_COLUMN_TYPE_INT, "Unable to unpack event int data");
+                    *((int64_t*)property_value_ptr) = sky_column_get_int(column, row_index);
+                }
+                else if(property_type == &SKY_DATA_TYPE_FLOAT) {
+                    check(column->type == SKY_COLUMN_TYPE_FLOAT, "Unable to unpack event float data");
+                    *((double*)property_value_ptr) = sky_column_get_float(column, row_index);
+                }
+                else if(property_type == &SKY_DATA_TYPE_BOOLEAN) {
+                    check(column->type == SKY_COLUMN_TYPE_BOOLEAN, "Unable to unpack event boolean data");
+                    *((bool*)property_value_ptr) = sky_column_get_boolean(column, row_index);
+                }
+            }
+        }
+
+        // Look up each property in the index of an indexed event.
+        void *index_ptr = NULL;
+        rc = sky_cursor_get_data_index(cursor->cursor, &index_ptr);
+        check(rc == 0, "Unable to retrieve cursor data index");
+        if(index_ptr != NULL) {
             for(i=0; i<property_count; i++) {
-                if(property_id == property_ids[i]) {
+                void *ptr = NULL;
+                rc = sky_event_find_indexed_data(index_ptr, property_ids[i], &ptr);
+                check(rc == 0, "Unable to find indexed event data");
+                if(ptr != NULL) {
                     property_value_ptr = ((void*)event) + property_offsets[i];
-                    
-                    // Parse the data by the data type set on the database property.
-                    bstring property_type = property_types[i];
-                    if(property_type == &SKY_DATA_TYPE_INT) {
-                        *((int64_t*)property_value_ptr) = minipack_unpack_int(ptr, &sz);
-                        check(sz != 0, "Unable to unpack event int data");
-                        ptr += sz;
-                        break;
-                    }
-                    else if(property_type == &SKY_DATA_TYPE_FLOAT) {
-                        *((double*)property_value_ptr) = minipack_unpack_double(ptr, &sz);
-                        check(sz != 0, "Unable to unpack event float data");
-                        ptr += sz;
-                        break;
-                    }
-                    else if(property_type == &SKY_DATA_TYPE_BOOLEAN) {
-                        *((bool*)property_value_ptr) = minipack_unpack_bool(ptr, &sz);
-                        check(sz != 0, "Unable to unpack event boolean data");
-                        ptr += sz;
-                        break;
-                    }
-                    else if(property_type == &SKY_DATA_TYPE_STRING) {
-                        qip_string *string_value = (qip_string*)property_value_ptr;
-                        string_value->length = minipack_unpack_raw(ptr, &sz);
-                        check(sz != 0, "Unable to unpack event string data");
+                    rc = sky_qip_cursor_unpack_value(property_types[i], ptr, property_value_ptr, &sz);
+                    check(rc == 0, "Unable to unpack event data");
+                }
+            }
+        }
+        // Otherwise loop over data section until we run out of data.
+        else {
+            void *ptr = data_ptr;
+            while(ptr < data_ptr+data_length) {
+                // Read property id.
+                sky_property_id_t property_id = *((sky_property_id_t*)ptr);
+                ptr += sizeof(property_id);
+                
+                // Initialize size to zero so we know if it was processed.
+                sz = 0;
+
+                // Loop over properties on event to check if we need to update.
+                for(i=0; i<property_count; i++) {
+                    if(property_id == property_ids[i]) {
+                        property_value_ptr = ((void*)event) + property_offsets[i];
+                        rc = sky_qip_cursor_unpack_value(property_types[i], ptr, property_value_ptr, &sz);
+                        check(rc == 0, "Unable to unpack event data");
                         ptr += sz;
-                        string_value->data = ptr;
-                        ptr += string_value->length;
                         break;
                     }
                 }
-            }
-            
-            // If the property was not processed then jump ahead to the next
-            // property value in the event.
-            if(sz == 0) {
-                sz = minipack_sizeof_elem_and_data(ptr);
-                check(sz > 0, "Invalid data found in event");
-                ptr += sz;
+                
+                // If the property was not processed then jump ahead to the next
+                // property value in the event.
+                if(sz == 0) {
+                    sz = minipack_sizeof_elem_and_data(ptr);
+                    check(sz > 0, "Invalid data found in event");
+                    ptr += sz;
+                }
             }
         }
     }
@@ -166,6 +197,48 @@ error:
     return;
 }
 
+// Unpacks a property value from an event's data section into the property
+// field of a qip event.
+//
+// property_type      - The data type of the property.
+// ptr                - A pointer to the packed value.
+// property_value_ptr - A pointer to the property field on the event.
+// sz                 - A pointer to where the number of bytes read is
+//                      returned. This is zero if the type is not supported.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_qip_cursor_unpack_value(bstring property_type, void *ptr,
+                                void *property_value_ptr, size_t *sz)
+{
+    *sz = 0;
+    if(property_type == &SKY_DATA_TYPE_INT) {
+        *((int64_t*)property_value_ptr) = minipack_unpack_int(ptr, sz);
+        check(*sz != 0, "Unable to unpack event int data");
+    }
+    else if(property_type == &SKY_DATA_TYPE_FLOAT) {
+        *((double*)property_value_ptr) = minipack_unpack_double(ptr, sz);
+        check(*sz != 0, "Unable to unpack event float data");
+    }
+    else if(property_type == &SKY_DATA_TYPE_BOOLEAN) {
+        *((bool*)property_value_ptr) = minipack_unpack_bool(ptr, sz);
+        check(*sz != 0, "Unable to unpack event boolean data");
+    }
+    else if(property_type == &SKY_DATA_TYPE_STRING) {
+        qip_string *string_value = (qip_string*)property_value_ptr;
+        size_t _sz;
+        string_value->length = minipack_unpack_raw(ptr, &_sz);
+        check(_sz != 0, "Unable to unpack event string data");
+        string_value->data = ptr + _sz;
+        *sz = _sz + string_value->length;
+    }
+
+    return 0;
+
+error:
+    *sz = 0;
+    return -1;
+}
+
 // Checks whether the cursor is at the end.
 //
 // module - The module.
@@ -18,7 +18,13 @@
 sky_qip_path *sky_qip_path_create()
 {
     sky_qip_path *path = malloc(sizeof(sky_qip_path));
+    path->iterator = NULL;
     path->path_ptr = NULL;
+    path->path_ptrs = NULL;
+    path->path_count = 0;
+    path->wide = false;
+    path->start_timestamp = 0;
+    path->end_timestamp = 0;
     return path;
 }
 
@@ -28,7 +34,11 @@ sky_qip_path *sky_qip_path_create()
 void sky_qip_path_free(sky_qip_path *path)
 {
     if(path) {
+        path->iterator = NULL;
         path->path_ptr = NULL;
+        path->path_ptrs = NULL;
+        path->path_count = 0;
+        path->wide = false;
         free(path);
     }
 }
@@ -38,7 +48,9 @@ void sky_qip_path_free(sky_qip_path *path)
 // Cursor Management
 //--------------------------------------
 
-// Retrieves a cursor for the current path.
+// Retrieves a cursor for the current path. The cursor reads the segments of
+// a spanned path in place and merges the path with its runs if the path has
+// an iterator.
 //
 // module - The module.
 // path   - The path.
@@ -46,14 +58,36 @@ void sky_qip_path_free(sky_qip_path *path)
 // Returns a new cursor.
 sky_qip_cursor *sky_qip_path_events(qip_module *module, sky_qip_path *path)
 {
+    sky_qip_cursor *cursor = NULL;
     check(module != NULL, "Module required");
     
     // Initialize cursor with path.
-    sky_qip_cursor *cursor = sky_qip_cursor_create();
-    sky_cursor_set_path(cursor->cursor, path->path_ptr);
+    cursor = sky_qip_cursor_create();
+    cursor->cursor->wide = path->wide;
+    if(path->iterator != NULL) {
+        int rc = sky_path_iterator_set_cursor(path->iterator, cursor->cursor);
+        check(rc == 0, "Unable to set cursor paths");
+    }
+    else if(path->path_count > 1) {
+        // The cursor owns its list of segments.
+        void **ptrs = malloc(sizeof(*ptrs) * path->path_count); check_mem(ptrs);
+        memcpy(ptrs, path->path_ptrs, sizeof(*ptrs) * path->path_count);
+        int rc = sky_cursor_set_paths(cursor->cursor, ptrs, path->path_count);
+        check(rc == 0, "Unable to set cursor paths");
+    }
+    else {
+        sky_cursor_set_path(cursor->cursor, path->path_ptr);
+    }
+
+    // Limit the cursor to the path's time window.
+    if(path->end_timestamp > path->start_timestamp) {
+        int rc = sky_cursor_set_window(cursor->cursor, path->start_timestamp, path->end_timestamp);
+        check(rc == 0, "Unable to set cursor window");
+    }
     
     return cursor;
 
 error:
+    sky_qip_cursor_free(cursor);
     return NULL;
 }
@@ -2,6 +2,7 @@
 #define _sky_qip_path_h
 
 #include <inttypes.h>
+#include <stdbool.h>
 
 #include "path_iterator.h"
 #include "qip_cursor.h"
@@ -14,9 +15,25 @@
 //
 //==============================================================================
 
-// The path stores a reference to the current path.
+// The path stores a reference to the current path. A path that spans several
+// blocks also references the list of its segments, which is owned by the
+// path iterator, and cursors returned for the path read every segment. If the
+// end timestamp is greater than the start timestamp then the cursors returned
+// for the path only include the events from the start timestamp up to but not
+// including the end timestamp. The wide flag states if the path header stores
+// its object id as a varint.
+//
+// If the path references the iterator that it was retrieved from then its
+// cursors are positioned by the iterator instead, which merges the events of
+// the path in the data file with the events of the same object in its runs.
 typedef struct {
+    sky_path_iterator *iterator;
     void *path_ptr;
+    void **path_ptrs;
+    uint32_t path_count;
+    bool wide;
+    sky_timestamp_t start_timestamp;
+    sky_timestamp_t end_timestamp;
 } sky_qip_path;
 
 
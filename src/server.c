@@ -2,6 +2,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <poll.h>
 
 #include "bstring.h"
 #include "server.h"
@@ -28,6 +29,8 @@ int sky_server_open_table(sky_server *server, bstring database_name,
 
 int sky_server_close_table(sky_server *server, sky_table *table);
 
+int sky_server_wait(sky_server *server, bool *ready);
+
 
 //==============================================================================
 //
@@ -51,6 +54,7 @@ sky_server *sky_server_create(bstring path)
     server->path = bstrcpy(path);
     if(path) check_mem(server->path);
     server->port = SKY_DEFAULT_PORT;
+    server->data_file_version = SKY_DATA_FILE_VERSION;
     
     return server;
 
@@ -150,7 +154,9 @@ int sky_server_stop(sky_server *server)
 //--------------------------------------
 
 // Accepts a connection on a running server. Once a connection is accepted then
-// the message is parsed and processed.
+// the message is parsed and processed. If the open table has log records that
+// are due to be committed before a connection arrives then they are synced
+// and no connection is accepted.
 //
 // server - The server to start.
 //
@@ -158,7 +164,17 @@ int sky_server_stop(sky_server *server)
 int sky_server_accept(sky_server *server)
 {
     int rc;
+    FILE *input = NULL;
+    FILE *output = NULL;
     sky_message_header *header = NULL;
+
+    // Wait for the next connection.
+    bool ready;
+    rc = sky_server_wait(server, &ready);
+    check(rc == 0, "Unable to wait for connection");
+    if(!ready) {
+        return 0;
+    }
     
     // Accept the next connection.
     int sockaddr_size = sizeof(struct sockaddr_in);
@@ -166,8 +182,8 @@ int sky_server_accept(sky_server *server)
     check(socket != -1, "Unable to accept connection");
 
     // Wrap socket in a buffered file reference.
-    FILE *input = fdopen(socket, "r");
-    FILE *output = fdopen(dup(socket), "w");
+    input = fdopen(socket, "r");
+    output = fdopen(dup(socket), "w");
     check(input != NULL, "Unable to open buffered socket input");
     check(output != NULL, "Unable to open buffered socket output");
     
@@ -219,8 +235,55 @@ int sky_server_accept(sky_server *server)
 
 error:
     sky_message_header_free(header);
-    fclose(input);
-    fclose(output);
+    if(input) fclose(input);
+    if(output) fclose(output);
+    return -1;
+}
+
+// Waits for a connection on the server socket. While the open table has log
+// records that haven't been synced, the wait ends once they are due and they
+// are committed so that an acknowledged event is never left unsynced for
+// much longer than the log's group timeout.
+//
+// server - The server.
+// ready  - A pointer to where a flag is returned that is true if a connection
+//          is waiting to be accepted.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_server_wait(sky_server *server, bool *ready)
+{
+    int rc;
+    check(server != NULL, "Server required");
+    check(ready != NULL, "Ready flag return address required");
+
+    // Only wait as long as the pending log records can stay unsynced.
+    int timeout = -1;
+    sky_table *table = server->last_table;
+    if(table != NULL && table->wal != NULL && table->wal->pending_count > 0) {
+        sky_timestamp_t delay;
+        rc = sky_wal_get_sync_delay(table->wal, &delay);
+        check(rc == 0, "Unable to determine write-ahead log sync delay");
+        timeout = (int)((delay + 999) / 1000);
+    }
+
+    struct pollfd pfd;
+    pfd.fd = server->socket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    rc = poll(&pfd, 1, timeout);
+    check(rc != -1, "Unable to poll server socket");
+    *ready = (rc > 0);
+
+    // Commit the log group if it is due.
+    if(table != NULL && table->wal != NULL) {
+        rc = sky_table_sync(table);
+        check(rc == 0, "Unable to sync table");
+    }
+
+    return 0;
+
+error:
+    if(ready != NULL) *ready = false;
     return -1;
 }
 
@@ -270,6 +333,13 @@ int sky_server_open_table(sky_server *server, bstring database_name,
         *table = sky_table_create(); check_mem(*table);
         rc = sky_table_set_path(*table, path);
         check(rc == 0, "Unable to set table path");
+        (*table)->warm_up = server->warm_up;
+        (*table)->shadow_blocks = server->shadow_blocks;
+        (*table)->log_structured = server->log_structured;
+        (*table)->default_version = server->data_file_version;
+        (*table)->shard_count = server->shard_count;
+        (*table)->archive_age = server->archive_age;
+        (*table)->retention_age = server->retention_age;
     
         // Open the table.
         rc = sky_table_open(*table);
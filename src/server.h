@@ -21,6 +21,9 @@
 // The server acts as the interface to external applications. It communicates
 // over TCP sockets using a specific Sky protocol. See the message.h file for
 // more detail on the protocol.
+//
+// Tables created by the server use the current data file version unless a
+// different version is configured so that they can store wide object ids.
 
 
 //==============================================================================
@@ -55,6 +58,13 @@ typedef struct {
     int socket;
     sky_database *last_database;
     sky_table *last_table;
+    bool warm_up;
+    bool shadow_blocks;
+    bool log_structured;
+    uint32_t data_file_version;
+    uint32_t shard_count;
+    sky_timestamp_t archive_age;
+    sky_timestamp_t retention_age;
 } sky_server;
 
 
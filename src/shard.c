@@ -0,0 +1,27 @@
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "shard.h"
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+// Determines the shard that stores an object. Object ids are mixed with a
+// multiplicative hash before they are partitioned so that ids that are
+// assigned in strides are still spread evenly across the shards.
+//
+// object_id   - The object id.
+// shard_count - The number of shards.
+//
+// Returns the index of the object's shard.
+uint32_t sky_shard_get_index(sky_object_id_t object_id, uint32_t shard_count)
+{
+    if(shard_count <= 1) {
+        return 0;
+    }
+    uint64_t hash = ((uint64_t)object_id) * 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)((hash >> 32) % shard_count);
+}
@@ -0,0 +1,45 @@
+#ifndef _shard_h
+#define _shard_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include "types.h"
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A table can be split into shards. Each shard is a tablespace directory
+// (0, 1, 2, etc) with its own data file, header file and lock file, so the
+// blocks of one shard can be changed without touching the blocks of another.
+//
+// Objects are partitioned across the shards by a hash of their object id.
+// All the events of an object are stored in the same shard so a path is
+// never split across shards.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// The number of shards a table has when none is specified.
+#define SKY_DEFAULT_SHARD_COUNT 1
+
+// The largest number of shards a table can be split into.
+#define SKY_MAX_SHARD_COUNT 256
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+uint32_t sky_shard_get_index(sky_object_id_t object_id, uint32_t shard_count);
+
+#endif
@@ -162,7 +162,8 @@ void usage()
 //==============================================================================
 
 // Executes the benchmark over the database to compute step counts in order to
-// generate a directed acyclic graph (DAG).
+// generate a directed acyclic graph (DAG). Columnar paths are read from their
+// action id column so that the rest of the event data is never touched.
 //
 // options - A list of options to use.
 void benchmark_dag(Options *options)
@@ -171,6 +172,8 @@ void benchmark_dag(Options *options)
     sky_event *event = NULL;
     uint32_t event_count = 0;
     int32_t action_count = 100;     // TODO: Retrieve action count from actions file.
+    sky_action_id_t *action_ids = NULL;
+    uint32_t action_id_capacity = 0;
     
     // Initialize table.
     sky_table *table = sky_table_create(); check_mem(table);
@@ -187,8 +190,8 @@ void benchmark_dag(Options *options)
         sky_path_iterator iterator;
         sky_path_iterator_init(&iterator);
         
-        // Attach data file.
-        rc = sky_path_iterator_set_data_file(&iterator, table->data_file);
+        // Attach the data files of each shard.
+        rc = sky_path_iterator_set_data_files(&iterator, table->data_files, table->shard_count);
         check(rc == 0, "Unable to initialze path iterator");
         
         // Create a square matrix of structs.
@@ -206,9 +209,33 @@ void benchmark_dag(Options *options)
             // Initialize the cursor.
             sky_cursor cursor;
             sky_cursor_init(&cursor);
+            cursor.wide = sky_data_file_is_wide(table->data_file);
             rc = sky_cursor_set_path(&cursor, path_ptr);
             check(rc == 0, "Unable to set cursor path");
 
+            // Aggregate columnar paths over a copy of their action ids.
+            if(cursor.columnar) {
+                sky_columnar_path *columnar_path = &cursor.columnar_path;
+                if(columnar_path->event_count > action_id_capacity) {
+                    action_id_capacity = columnar_path->event_count;
+                    action_ids = realloc(action_ids, sizeof(*action_ids) * action_id_capacity);
+                    check_mem(action_ids);
+                }
+                rc = sky_columnar_path_read_action_ids(columnar_path, action_ids);
+                check(rc == 0, "Unable to read action ids");
+
+                uint32_t j;
+                for(j=1; j<columnar_path->event_count; j++) {
+                    int32_t index = ((action_ids[j-1]-1)*action_count) + (action_ids[j]-1);
+                    steps[index].count++;
+                }
+                event_count += columnar_path->event_count;
+
+                rc = sky_path_iterator_next(&iterator);
+                check(rc == 0, "Unable to find next path");
+                continue;
+            }
+
             // Increment total event count.
             event_count++;
             
@@ -263,9 +290,11 @@ void benchmark_dag(Options *options)
     // Show stats.
     printf("Total events processed: %d\n", event_count);
     
+    free(action_ids);
     return;
     
 error:
+    free(action_ids);
     sky_event_free(event);
     sky_table_free(table);
 }
@@ -346,12 +375,13 @@ void benchmark_count_with_qip(Options *options)
         sky_path_iterator iterator;
         sky_path_iterator_init(&iterator);
 
-        // Attach data file.
-        rc = sky_path_iterator_set_data_file(&iterator, table->data_file);
+        // Attach the data files of each shard.
+        rc = sky_path_iterator_set_data_files(&iterator, table->data_files, table->shard_count);
         check(rc == 0, "Unable to initialze path iterator");
 
         // Initialize QIP args.
         sky_qip_path *path = sky_qip_path_create();
+        path->wide = sky_data_file_is_wide(table->data_file);
         qip_map *map = qip_map_create();
         
         // Iterate over each path.
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+#include <stdbool.h>
+
+#include "bstring.h"
+#include "dbg.h"
+#include "mem.h"
+#include "table.h"
+#include "timestamp.h"
+#include "version.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The sky-compact application merges underfilled blocks in a table's data
+// file. Neighboring multi-object blocks are merged up to a fill factor and
+// the file is shrunk when blocks at the end of the file are freed. The number
+// of merges can be limited so that a large table is compacted in steps.
+// Blocks can optionally be compressed once they have been merged and blocks
+// whose events are all older than a given age can be moved to the archive.
+// Events older than a given age can be removed, which frees the blocks that
+// only hold expired events. The table's action index can also be rebuilt from
+// its data files. Any runs left by a log-structured table are merged into the
+// data files when the table is opened, before the blocks are compacted.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+typedef struct Options {
+    bstring path;
+    double fill_factor;
+    uint32_t max_merge_count;
+    bool compress;
+    long archive_age;
+    long retention_age;
+    bool reindex;
+} Options;
+
+
+//==============================================================================
+//
+// Command Line Arguments
+//
+//==============================================================================
+
+Options *parseopts(int argc, char **argv)
+{
+    Options *options = (Options*)calloc(1, sizeof(Options));
+    check_mem(options);
+
+    // Command line options.
+    struct option long_options[] = {
+        {"fill-factor", required_argument, 0, 'f'},
+        {"max-merges", required_argument, 0, 'm'},
+        {"compress", no_argument, 0, 'c'},
+        {"archive-age", required_argument, 0, 'a'},
+        {"retention-age", required_argument, 0, 'e'},
+        {"reindex", no_argument, 0, 'r'},
+        {0, 0, 0, 0}
+    };
+
+    // Parse command line options.
+    while(1) {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "f:m:ca:e:r", long_options, &option_index);
+
+        // Check for end of options.
+        if(c == -1) {
+            break;
+        }
+
+        // Parse each option.
+        switch(c) {
+            case 'f': {
+                options->fill_factor = atof(optarg);
+                break;
+            }
+
+            case 'm': {
+                options->max_merge_count = (uint32_t)atoi(optarg);
+                break;
+            }
+
+            case 'c': {
+                options->compress = true;
+                break;
+            }
+
+            case 'a': {
+                options->archive_age = atol(optarg);
+                break;
+            }
+
+            case 'e': {
+                options->retention_age = atol(optarg);
+                break;
+            }
+
+            case 'r': {
+                options->reindex = true;
+                break;
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    // Retrieve path as first non-getopts option.
+    if(argc < 1) {
+        fprintf(stderr, "Error: Table path required.\n\n");
+        exit(1);
+    }
+    options->path = bfromcstr(argv[0]);
+
+    // Default input.
+    if(options->fill_factor == 0) {
+        options->fill_factor = SKY_DEFAULT_FILL_FACTOR;
+    }
+
+    // Validate input.
+    if(options->fill_factor < 0 || options->fill_factor > 1) {
+        fprintf(stderr, "Error: Fill factor must be greater than 0 and at most 1.\n\n");
+        exit(1);
+    }
+    if(options->archive_age < 0) {
+        fprintf(stderr, "Error: Archive age must be a number of seconds.\n\n");
+        exit(1);
+    }
+    if(options->retention_age < 0) {
+        fprintf(stderr, "Error: Retention age must be a number of seconds.\n\n");
+        exit(1);
+    }
+
+    return options;
+
+error:
+    exit(1);
+}
+
+void Options_free(Options *options)
+{
+    if(options) {
+        bdestroy(options->path);
+        options->path = NULL;
+        free(options);
+    }
+}
+
+
+//==============================================================================
+//
+// Usage & Version
+//
+//==============================================================================
+
+void print_version()
+{
+    printf("sky-compact " SKY_VERSION "\n");
+    exit(0);
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: sky-compact [OPTIONS] [PATH]\n\n");
+    exit(0);
+}
+
+
+//==============================================================================
+//
+// Compaction
+//
+//==============================================================================
+
+// Compacts the data file of the table at a given path.
+//
+// options - A list of options to use while compacting the table.
+//
+// Returns 0 if successful, otherwise returns -1.
+int compact(Options *options)
+{
+    int rc;
+
+    // Open table.
+    sky_table *table = sky_table_create(); check_mem(table);
+    rc = sky_table_set_path(table, options->path);
+    check(rc == 0, "Unable to set table path");
+    rc = sky_table_open(table);
+    check(rc == 0, "Unable to open table");
+
+    // Compact the data file of each shard.
+    uint32_t i;
+    for(i=0; i<table->shard_count; i++) {
+        sky_data_file *data_file = table->data_files[i];
+        if(table->shard_count > 1) {
+            printf("Shard: %d\n", i);
+        }
+
+        // Remove the events that are older than the retention age.
+        if(options->retention_age > 0) {
+            sky_timestamp_t now;
+            rc = sky_timestamp_now(&now);
+            check(rc == 0, "Unable to determine current time");
+            uint32_t dropped_count, trimmed_count;
+            rc = sky_data_file_expire(data_file, now - (((sky_timestamp_t)options->retention_age) * 1000000), &dropped_count, &trimmed_count);
+            check(rc == 0, "Unable to expire data file");
+            printf("Expired Block Count: %d blocks\n", dropped_count);
+            printf("Trimmed Block Count: %d blocks\n", trimmed_count);
+        }
+
+        uint32_t block_count = data_file->block_count;
+        uint32_t merge_count;
+        rc = sky_data_file_compact(data_file, options->fill_factor, options->max_merge_count, &merge_count);
+        check(rc == 0, "Unable to compact data file");
+
+        printf("Merge Count: %d merges\n", merge_count);
+        printf("Block Count: %d blocks (was %d)\n", data_file->block_count, block_count);
+        printf("Free Block Count: %d blocks\n", data_file->free_block_count);
+
+        // Compress the blocks.
+        if(options->compress) {
+            uint32_t compressed_count;
+            rc = sky_data_file_compress(data_file, &compressed_count);
+            check(rc == 0, "Unable to compress data file");
+            printf("Compressed Block Count: %d blocks\n", compressed_count);
+        }
+
+        // Archive the blocks that are older than the archive age.
+        if(options->archive_age > 0) {
+            sky_timestamp_t now;
+            rc = sky_timestamp_now(&now);
+            check(rc == 0, "Unable to determine current time");
+            uint32_t archived_count;
+            rc = sky_data_file_archive(data_file, now - (((sky_timestamp_t)options->archive_age) * 1000000), &archived_count);
+            check(rc == 0, "Unable to archive data file");
+            printf("Archived Block Count: %d blocks\n", archived_count);
+        }
+    }
+
+    // Rebuild the action index from the compacted data files.
+    if(options->reindex) {
+        rc = sky_table_rebuild_action_index(table);
+        check(rc == 0, "Unable to rebuild action index");
+        printf("Indexed Action Count: %d actions\n", table->action_index->set_count);
+    }
+
+    // Clean up.
+    rc = sky_table_close(table);
+    check(rc == 0, "Unable to close table");
+    sky_table_free(table);
+
+    return 0;
+
+error:
+    sky_table_free(table);
+    return -1;
+}
+
+
+//==============================================================================
+//
+// Main
+//
+//==============================================================================
+
+int main(int argc, char **argv)
+{
+    int rc;
+
+    // Parse command line options.
+    Options *options = parseopts(argc, argv);
+
+    // Start time.
+    time_t t0 = time(NULL);
+
+    // Compact table.
+    rc = compact(options);
+    if(rc != 0) {
+        Options_free(options);
+        exit(1);
+    }
+
+    // Show wall clock time.
+    printf("Elapsed Time: %ld seconds\n", (time(NULL)-t0));
+
+    // Clean up.
+    Options_free(options);
+
+    return 0;
+}
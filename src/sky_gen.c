@@ -210,7 +210,7 @@ void generate(Options *options, uint32_t *total)
             sky_action_id_t action_id = (random() % options->action_count) + 1;
             event = sky_event_create(object_id, timestamp, action_id);
             rc = sky_table_add_event(table, event);
-            check(rc == 0, "Unable to add event: ts:%lld, oid:%d, action:%d", event->timestamp, event->object_id, event->action_id);
+            check(rc == 0, "Unable to add event: ts:%lld, oid:%llu, action:%d", (long long)event->timestamp, (unsigned long long)event->object_id, event->action_id);
             sky_event_free(event);
             
             // Increment event count.
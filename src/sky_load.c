@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "bstring.h"
+#include "dbg.h"
+#include "mem.h"
+#include "file.h"
+#include "table.h"
+#include "bulk_loader.h"
+#include "version.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The sky-load application builds a new table from sorted events using the
+// bulk loader. Events are either read from standard input as lines of
+// "OBJECT_ID TIMESTAMP ACTION_ID" sorted by object id and then timestamp or
+// they are read from the data file of an existing table in order to rebuild
+// it with densely packed blocks.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+typedef struct Options {
+    bstring path;
+    bstring source_path;
+    double fill_factor;
+    uint32_t block_size;
+} Options;
+
+
+//==============================================================================
+//
+// Command Line Arguments
+//
+//==============================================================================
+
+Options *parseopts(int argc, char **argv)
+{
+    Options *options = (Options*)calloc(1, sizeof(Options));
+    check_mem(options);
+
+    // Command line options.
+    struct option long_options[] = {
+        {"source", required_argument, 0, 's'},
+        {"fill-factor", required_argument, 0, 'f'},
+        {"block-size", required_argument, 0, 'b'},
+        {0, 0, 0, 0}
+    };
+
+    // Parse command line options.
+    while(1) {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "s:f:b:", long_options, &option_index);
+
+        // Check for end of options.
+        if(c == -1) {
+            break;
+        }
+
+        // Parse each option.
+        switch(c) {
+            case 's': {
+                options->source_path = bfromcstr(optarg);
+                check_mem(options->source_path);
+                break;
+            }
+
+            case 'f': {
+                options->fill_factor = atof(optarg);
+                break;
+            }
+
+            case 'b': {
+                options->block_size = (uint32_t)atoi(optarg);
+                break;
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    // Retrieve path as first non-getopts option.
+    if(argc < 1) {
+        fprintf(stderr, "Error: Table path required.\n\n");
+        exit(1);
+    }
+    options->path = bfromcstr(argv[0]);
+
+    // Default input.
+    if(options->fill_factor == 0) {
+        options->fill_factor = SKY_BULK_LOADER_DEFAULT_FILL_FACTOR;
+    }
+    if(options->block_size == 0) {
+        options->block_size = SKY_DEFAULT_BLOCK_SIZE;
+    }
+
+    // Validate input.
+    if(options->fill_factor < 0 || options->fill_factor > 1) {
+        fprintf(stderr, "Error: Fill factor must be greater than 0 and at most 1.\n\n");
+        exit(1);
+    }
+
+    return options;
+
+error:
+    exit(1);
+}
+
+void Options_free(Options *options)
+{
+    if(options) {
+        bdestroy(options->path);
+        options->path = NULL;
+        bdestroy(options->source_path);
+        options->source_path = NULL;
+        free(options);
+    }
+}
+
+
+//==============================================================================
+//
+// Usage & Version
+//
+//==============================================================================
+
+void print_version()
+{
+    printf("sky-load " SKY_VERSION "\n");
+    exit(0);
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: sky-load [OPTIONS] [PATH]\n\n");
+    exit(0);
+}
+
+
+//==============================================================================
+//
+// Loading
+//
+//==============================================================================
+
+// Adds events read from standard input to the bulk loader.
+//
+// loader - The bulk loader.
+// total  - The number of events loaded.
+//
+// Returns 0 if successful, otherwise returns -1.
+int load_stdin(sky_bulk_loader *loader, uint64_t *total)
+{
+    int rc;
+    sky_event *event = sky_event_create(0, 0, 0);
+    check_mem(event);
+
+    long long object_id, timestamp, action_id;
+    while((rc = fscanf(stdin, "%lld %lld %lld", &object_id, &timestamp, &action_id)) == 3) {
+        event->object_id = (sky_object_id_t)object_id;
+        event->timestamp = (sky_timestamp_t)timestamp;
+        event->action_id = (sky_action_id_t)action_id;
+        rc = sky_bulk_loader_add_event(loader, event);
+        check(rc == 0, "Unable to add event: oid:%lld, ts:%lld, action:%lld", object_id, timestamp, action_id);
+        (*total)++;
+    }
+    check(rc == EOF, "Invalid input after %lld events", (long long)*total);
+
+    sky_event_free(event);
+    return 0;
+
+error:
+    sky_event_free(event);
+    return -1;
+}
+
+// Adds the events of an existing table to the bulk loader and copies the
+// table's action and property definitions and its dictionary to the new
+// table.
+//
+// options - The command line options.
+// loader  - The bulk loader.
+// total   - The number of events loaded.
+//
+// Returns 0 if successful, otherwise returns -1.
+int load_table(Options *options, sky_bulk_loader *loader, uint64_t *total)
+{
+    int rc;
+    bstring src = NULL;
+    bstring dest = NULL;
+
+    // Open the source table. This applies any logged events to its data file.
+    sky_table *table = sky_table_create(); check_mem(table);
+    rc = sky_table_set_path(table, options->source_path);
+    check(rc == 0, "Unable to set source table path");
+    rc = sky_table_open(table);
+    check(rc == 0, "Unable to open source table");
+
+    check(table->shard_count == 1, "Loading from sharded tables is not supported: %s", bdata(options->source_path));
+    rc = sky_bulk_loader_add_data_file(loader, table->data_file);
+    check(rc == 0, "Unable to load source data file");
+    *total = loader->event_count;
+
+    // Copy actions, properties and the dictionary of factor values.
+    char *names[] = {"actions", "properties", "dictionary"};
+    int i;
+    for(i=0; i<3; i++) {
+        src = bformat("%s/%s", bdata(options->source_path), names[i]); check_mem(src);
+        dest = bformat("%s/%s", bdata(options->path), names[i]); check_mem(dest);
+        if(sky_file_exists(src)) {
+            rc = sky_file_cp(src, dest);
+            check(rc == 0, "Unable to copy %s", bdata(src));
+        }
+        bdestroy(src); src = NULL;
+        bdestroy(dest); dest = NULL;
+    }
+
+    sky_table_close(table);
+    sky_table_free(table);
+    return 0;
+
+error:
+    bdestroy(src);
+    bdestroy(dest);
+    sky_table_free(table);
+    return -1;
+}
+
+// Builds a new table at a given path.
+//
+// options - A list of options to use while loading the table.
+// total   - The number of events loaded.
+//
+// Returns 0 if successful, otherwise returns -1.
+int load(Options *options, uint64_t *total)
+{
+    int rc;
+    sky_bulk_loader *loader = NULL;
+    bstring tablespace_path = NULL;
+
+    *total = 0;
+
+    // Create the table directories. The data file must not already exist.
+    tablespace_path = bformat("%s/0", bdata(options->path)); check_mem(tablespace_path);
+    if(!sky_file_exists(options->path)) {
+        rc = mkdir(bdata(options->path), S_IRWXU);
+        check(rc == 0, "Unable to create table directory: %s", bdata(options->path));
+    }
+    if(!sky_file_exists(tablespace_path)) {
+        rc = mkdir(bdata(tablespace_path), S_IRWXU);
+        check(rc == 0, "Unable to create tablespace directory: %s", bdata(tablespace_path));
+    }
+
+    // Initialize the bulk loader.
+    loader = sky_bulk_loader_create(); check_mem(loader);
+    loader->path = bformat("%s/data", bdata(tablespace_path)); check_mem(loader->path);
+    loader->header_path = bformat("%s/header", bdata(tablespace_path)); check_mem(loader->header_path);
+    loader->block_size = options->block_size;
+    loader->fill_factor = options->fill_factor;
+    check(!sky_file_exists(loader->path), "Data file already exists: %s", bdata(loader->path));
+
+    rc = sky_bulk_loader_open(loader);
+    check(rc == 0, "Unable to open bulk loader");
+
+    // Load events.
+    if(options->source_path != NULL) {
+        rc = load_table(options, loader, total);
+        check(rc == 0, "Unable to load table: %s", bdata(options->source_path));
+    }
+    else {
+        rc = load_stdin(loader, total);
+        check(rc == 0, "Unable to load events from standard input");
+    }
+
+    rc = sky_bulk_loader_close(loader);
+    check(rc == 0, "Unable to close bulk loader");
+    printf("Block Count: %d blocks\n", loader->block_count);
+
+    sky_bulk_loader_free(loader);
+    bdestroy(tablespace_path);
+    return 0;
+
+error:
+    sky_bulk_loader_free(loader);
+    bdestroy(tablespace_path);
+    return -1;
+}
+
+
+//==============================================================================
+//
+// Main
+//
+//==============================================================================
+
+int main(int argc, char **argv)
+{
+    int rc;
+
+    // Parse command line options.
+    Options *options = parseopts(argc, argv);
+
+    // Start time.
+    time_t t0 = time(NULL);
+
+    // Load table.
+    uint64_t total;
+    rc = load(options, &total);
+    if(rc != 0) {
+        Options_free(options);
+        exit(1);
+    }
+
+    // Show wall clock time.
+    printf("Event Count: %lld events\n", (long long)total);
+    printf("Elapsed Time: %ld seconds\n", (time(NULL)-t0));
+
+    // Clean up.
+    Options_free(options);
+
+    return 0;
+}
@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "bstring.h"
+#include "dbg.h"
+#include "mem.h"
+#include "file.h"
+#include "table.h"
+#include "bulk_loader.h"
+#include "version.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The sky-migrate application rewrites the data files of a table with the
+// delta event encoding. The events of each shard are bulk loaded into a new
+// data file next to the existing one and the new files replace the old ones
+// once every event has been written. The block size of the table is
+// preserved.
+//
+// The --columnar option writes a version 4 data file that stores paths in
+// columns so that queries which only read action ids or a few properties
+// read less data.
+//
+// The --wide option writes a version 5 data file that stores paths in columns
+// and allows object ids larger than 32 bits. Path headers store the object id
+// as a varint so small ids take no more space than before.
+//
+// The --indexed option writes a version 6 data file, which is the same as
+// version 5 but indexes the data section of events with many properties.
+//
+// The --logged option writes a version 7 data file, which is the same as
+// version 6 but records the LSN of the last write-ahead log record applied to
+// it so that the log can be replayed again after a crash.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+typedef struct Options {
+    bstring path;
+    double fill_factor;
+    bool columnar;
+    bool wide;
+    bool indexed;
+    bool logged;
+} Options;
+
+
+//==============================================================================
+//
+// Command Line Arguments
+//
+//==============================================================================
+
+Options *parseopts(int argc, char **argv)
+{
+    Options *options = (Options*)calloc(1, sizeof(Options));
+    check_mem(options);
+
+    // Command line options.
+    struct option long_options[] = {
+        {"fill-factor", required_argument, 0, 'f'},
+        {"columnar", no_argument, 0, 'c'},
+        {"wide", no_argument, 0, 'w'},
+        {"indexed", no_argument, 0, 'i'},
+        {"logged", no_argument, 0, 'l'},
+        {0, 0, 0, 0}
+    };
+
+    // Parse command line options.
+    while(1) {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "f:cwil", long_options, &option_index);
+
+        // Check for end of options.
+        if(c == -1) {
+            break;
+        }
+
+        // Parse each option.
+        switch(c) {
+            case 'f': {
+                options->fill_factor = atof(optarg);
+                break;
+            }
+            case 'c': {
+                options->columnar = true;
+                break;
+            }
+            case 'w': {
+                options->wide = true;
+                break;
+            }
+            case 'i': {
+                options->indexed = true;
+                break;
+            }
+            case 'l': {
+                options->logged = true;
+                break;
+            }
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    // Retrieve path as first non-getopts option.
+    if(argc < 1) {
+        fprintf(stderr, "Error: Table path required.\n\n");
+        exit(1);
+    }
+    options->path = bfromcstr(argv[0]);
+
+    // Default input.
+    if(options->fill_factor == 0) {
+        options->fill_factor = SKY_BULK_LOADER_DEFAULT_FILL_FACTOR;
+    }
+
+    // Validate input.
+    if(options->fill_factor < 0 || options->fill_factor > 1) {
+        fprintf(stderr, "Error: Fill factor must be greater than 0 and at most 1.\n\n");
+        exit(1);
+    }
+
+    return options;
+
+error:
+    exit(1);
+}
+
+void Options_free(Options *options)
+{
+    if(options) {
+        bdestroy(options->path);
+        options->path = NULL;
+        free(options);
+    }
+}
+
+
+//==============================================================================
+//
+// Usage & Version
+//
+//==============================================================================
+
+void print_version()
+{
+    printf("sky-migrate " SKY_VERSION "\n");
+    exit(0);
+}
+
+void usage()
+{
+    fprintf(stderr, "usage: sky-migrate [OPTIONS] [PATH]\n\n");
+    exit(0);
+}
+
+
+//==============================================================================
+//
+// Migration
+//
+//==============================================================================
+
+// Rewrites the data files of every shard of the table at a given path with
+// the delta event encoding and optionally stores their paths in columns with
+// wide object ids, indexed events and a log position.
+//
+// options - A list of options to use while migrating the table.
+// total   - The number of events migrated.
+//
+// Returns 0 if successful, otherwise returns -1.
+int migrate(Options *options, uint64_t *total)
+{
+    int rc;
+    uint32_t i;
+    uint32_t shard_count = 0;
+    sky_bulk_loader **loaders = NULL;
+    bstring *paths = NULL;
+    bstring *header_paths = NULL;
+    bstring *zone_map_paths = NULL;
+
+    *total = 0;
+
+    // Open table. This applies any logged events to its data files.
+    sky_table *table = sky_table_create(); check_mem(table);
+    rc = sky_table_set_path(table, options->path);
+    check(rc == 0, "Unable to set table path");
+    rc = sky_table_open(table);
+    check(rc == 0, "Unable to open table");
+
+    shard_count = table->shard_count;
+    loaders = calloc(shard_count, sizeof(*loaders)); check_mem(loaders);
+    paths = calloc(shard_count, sizeof(*paths)); check_mem(paths);
+    header_paths = calloc(shard_count, sizeof(*header_paths)); check_mem(header_paths);
+    zone_map_paths = calloc(shard_count, sizeof(*zone_map_paths)); check_mem(zone_map_paths);
+    uint32_t version = table->data_file->version;
+    uint32_t block_count = 0;
+
+    // Write the events of each shard into a new data file next to the
+    // existing one.
+    for(i=0; i<shard_count; i++) {
+        sky_data_file *data_file = table->data_files[i];
+        block_count += data_file->block_count;
+        paths[i] = bstrcpy(data_file->path); check_mem(paths[i]);
+        header_paths[i] = bstrcpy(data_file->header_path); check_mem(header_paths[i]);
+        zone_map_paths[i] = bstrcpy(data_file->zone_map_path); check_mem(zone_map_paths[i]);
+
+        sky_bulk_loader *loader = sky_bulk_loader_create(); check_mem(loader);
+        loaders[i] = loader;
+        loader->path = bformat("%s.migrate", bdata(paths[i])); check_mem(loader->path);
+        loader->header_path = bformat("%s.migrate", bdata(header_paths[i])); check_mem(loader->header_path);
+        if(options->logged) {
+            loader->version = SKY_DATA_FILE_LSN_VERSION;
+        }
+        else if(options->indexed) {
+            loader->version = SKY_DATA_FILE_INDEXED_VERSION;
+        }
+        else if(options->wide) {
+            loader->version = SKY_DATA_FILE_WIDE_VERSION;
+        }
+        else {
+            loader->version = (options->columnar ? SKY_DATA_FILE_COLUMNAR_VERSION : SKY_DATA_FILE_DELTA_VERSION);
+        }
+        loader->block_size = data_file->block_size;
+        loader->lsn = sky_data_file_get_applied_lsn(data_file);
+        loader->fill_factor = options->fill_factor;
+        rc = sky_bulk_loader_open(loader);
+        check(rc == 0, "Unable to open bulk loader");
+        rc = sky_bulk_loader_add_data_file(loader, data_file);
+        check(rc == 0, "Unable to load data file");
+        rc = sky_bulk_loader_close(loader);
+        check(rc == 0, "Unable to close bulk loader");
+        *total += loader->event_count;
+    }
+
+    // Close the table before its files are replaced.
+    rc = sky_table_close(table);
+    check(rc == 0, "Unable to close table");
+    sky_table_free(table);
+    table = NULL;
+
+    uint32_t new_block_count = 0;
+    for(i=0; i<shard_count; i++) {
+        // Replace the header file last so that the shard is never left with a
+        // header that describes a different data file.
+        rc = rename(bdata(loaders[i]->path), bdata(paths[i]));
+        check(rc == 0, "Unable to replace data file: %s", bdata(paths[i]));
+        rc = rename(bdata(loaders[i]->header_path), bdata(header_paths[i]));
+        check(rc == 0, "Unable to replace header file: %s", bdata(header_paths[i]));
+
+        // The zone maps describe the old blocks so they are rebuilt on demand.
+        rc = sky_file_rm(zone_map_paths[i]);
+        check(rc == 0, "Unable to remove zone map file: %s", bdata(zone_map_paths[i]));
+        new_block_count += loaders[i]->block_count;
+    }
+
+    printf("Version: %d (was %d)\n", loaders[0]->version, version);
+    printf("Shard Count: %d shards\n", shard_count);
+    printf("Block Count: %d blocks (was %d)\n", new_block_count, block_count);
+
+    for(i=0; i<shard_count; i++) {
+        sky_bulk_loader_free(loaders[i]);
+        bdestroy(paths[i]);
+        bdestroy(header_paths[i]);
+        bdestroy(zone_map_paths[i]);
+    }
+    free(loaders);
+    free(paths);
+    free(header_paths);
+    free(zone_map_paths);
+    return 0;
+
+error:
+    for(i=0; i<shard_count; i++) {
+        if(loaders) sky_bulk_loader_free(loaders[i]);
+        if(paths) bdestroy(paths[i]);
+        if(header_paths) bdestroy(header_paths[i]);
+        if(zone_map_paths) bdestroy(zone_map_paths[i]);
+    }
+    free(loaders);
+    free(paths);
+    free(header_paths);
+    free(zone_map_paths);
+    sky_table_free(table);
+    return -1;
+}
+
+
+//==============================================================================
+//
+// Main
+//
+//==============================================================================
+
+int main(int argc, char **argv)
+{
+    int rc;
+
+    // Parse command line options.
+    Options *options = parseopts(argc, argv);
+
+    // Start time.
+    time_t t0 = time(NULL);
+
+    // Migrate table.
+    uint64_t total;
+    rc = migrate(options, &total);
+    if(rc != 0) {
+        Options_free(options);
+        exit(1);
+    }
+
+    // Show wall clock time.
+    printf("Event Count: %lld events\n", (long long)total);
+    printf("Elapsed Time: %ld seconds\n", (time(NULL)-t0));
+
+    // Clean up.
+    Options_free(options);
+
+    return 0;
+}
@@ -1,9 +1,9 @@
 #include <stdlib.h>
 
+#include "minipack.h"
 #include "sky_qip_module.h"
 #include "property.h"
 #include "constants.h"
-#include "minipack.h"
 #include "mem.h"
 #include "dbg.h"
 
@@ -35,6 +35,9 @@ int sky_qip_module_process_dynamic_class_callback(qip_module *module,
 int sky_qip_module_process_event_class(sky_qip_module *module,
     qip_ast_node *class);
 
+int sky_qip_module_process_factor_var_ref(sky_qip_module *module,
+    qip_ast_node *var_ref);
+
 
 //==============================================================================
 //
@@ -82,6 +85,15 @@ void sky_qip_module_free(sky_qip_module *module)
 {
     if(module) {
         sky_qip_module_free_event_info(module);
+
+        uint32_t i;
+        for(i=0; i<module->factor_field_count; i++) {
+            bdestroy(module->factor_fields[i]);
+        }
+        free(module->factor_fields);
+        module->factor_fields = NULL;
+        module->factor_field_count = 0;
+
         qip_compiler_free(module->compiler);
         qip_module_free(module->_qip_module);
         free(module);
@@ -190,16 +202,24 @@ int sky_qip_module_process_event_class(sky_qip_module *module,
             rc = qip_ast_class_get_property(class, property_name, &property);
             check(rc == 0, "Unable to retrieve property from Event class");
             
+            // Lookup property in the database. Built-in Event properties
+            // are not stored in the table.
+            sky_property *db_property = NULL;
+            rc = sky_property_file_find_by_name(module->table->property_file, property_name, &db_property);
+            check(rc == 0, "Unable to search for property '%s' in table: %s", bdata(property_name), bdata(module->table->path));
+
             // Only add one if it doesn't exist.
             if(property == NULL) {
-                // Lookup property in the database.
-                sky_property *db_property = NULL;
-                rc = sky_property_file_find_by_name(module->table->property_file, property_name, &db_property);
-                check(rc == 0 && db_property != NULL, "Unable to find property '%s' in table: %s", bdata(property_name), bdata(module->table->path));
+                check(db_property != NULL, "Unable to find property '%s' in table: %s", bdata(property_name), bdata(module->table->path));
                 
-                // Generate and add property to class.
+                // Generate and add property to class. Factors are stored as
+                // dictionary ids so they are exposed to the query as integers.
+                bstring data_type = db_property->data_type;
+                if(biseq(data_type, &SKY_DATA_TYPE_FACTOR) == 1) {
+                    data_type = &SKY_DATA_TYPE_INT;
+                }
                 property = qip_ast_property_create(QIP_ACCESS_PUBLIC, 
-                    qip_ast_var_decl_create(qip_ast_type_ref_create(db_property->data_type), property_name, NULL)
+                    qip_ast_var_decl_create(qip_ast_type_ref_create(data_type), property_name, NULL)
                 );
                 rc = qip_ast_class_add_property(class, property);
                 check(rc == 0, "Unable to add property to class");
@@ -228,6 +248,12 @@ int sky_qip_module_process_event_class(sky_qip_module *module,
                 rc = sky_property_get_standard_data_type_name(type_name, &module->event_property_types[module->event_property_count-1]);
                 check(rc == 0, "Unable to retrieve standard type name: '%s'", bdata(type_name));
             }
+
+            // Translate literals and mark result fields for factors.
+            if(db_property != NULL && biseq(db_property->data_type, &SKY_DATA_TYPE_FACTOR) == 1) {
+                rc = sky_qip_module_process_factor_var_ref(module, var_ref);
+                check(rc == 0, "Unable to process factor reference: %s", bdata(property_name));
+            }
         }
     }
     
@@ -243,6 +269,84 @@ error:
     return -1;
 }
 
+// Processes a reference to a Factor property on an Event. String literals
+// that the factor is compared against are replaced with their dictionary ids
+// and Result fields that receive the factor are recorded so their ids can be
+// decoded when the results are written.
+//
+// module  - The wrapped module.
+// var_ref - The Event variable reference whose member is a factor.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_qip_module_process_factor_var_ref(sky_qip_module *module,
+                                          qip_ast_node *var_ref)
+{
+    int rc;
+    check(module != NULL, "Module required");
+    check(var_ref != NULL, "Variable reference required");
+
+    qip_ast_node *parent = var_ref->parent;
+    if(parent == NULL) {
+        return 0;
+    }
+    
+    // Comparison against a string literal: `event.factor == "value"`.
+    if(parent->type == QIP_AST_TYPE_BINARY_EXPR) {
+        qip_ast_node **operand = (parent->binary_expr.lhs == var_ref ? &parent->binary_expr.rhs : &parent->binary_expr.lhs);
+        if(*operand != NULL && (*operand)->type == QIP_AST_TYPE_STRING_LITERAL) {
+            // Values that are not in the dictionary are never matched.
+            sky_dictionary_id_t id = 0;
+            rc = sky_dictionary_find_by_value(module->table->dictionary, (*operand)->string_literal.value, &id);
+            check(rc == 0, "Unable to find factor value");
+
+            qip_ast_node *literal = qip_ast_int_literal_create(id > 0 ? (int64_t)id : -1);
+            check_mem(literal);
+            literal->parent = parent;
+            qip_ast_node_free(*operand);
+            *operand = literal;
+        }
+    }
+    // Assignment to a result field: `item.field = event.factor`.
+    else if(parent->type == QIP_AST_TYPE_VAR_ASSIGN) {
+        qip_ast_node *target = parent->var_assign.var_ref;
+        if(parent->var_assign.expr == var_ref && target != NULL && target->var_ref.member != NULL) {
+            qip_ast_node *member = NULL;
+            rc = qip_ast_var_ref_get_last_member(target, &member);
+            check(rc == 0 && member != NULL, "Unable to retrieve assigned field");
+            rc = sky_qip_module_add_factor_field(module, member->var_ref.name);
+            check(rc == 0, "Unable to add factor field");
+        }
+    }
+    // Result lookup keyed by the factor: `data.get(event.factor)`.
+    else if(parent->type == QIP_AST_TYPE_VAR_REF && parent->var_ref.type == QIP_AST_VAR_REF_TYPE_INVOKE && biseqcstr(parent->var_ref.name, "get")) {
+        struct tagbstring result_str = bsStatic("Result");
+        struct tagbstring hashable_str = bsStatic("Hashable");
+        qip_ast_node *result_class = NULL;
+        rc = qip_module_get_ast_class(module->_qip_module, &result_str, &result_class);
+        check(rc == 0, "Unable to retrieve Result class");
+        
+        qip_ast_node *hashable_metadata = NULL;
+        if(result_class != NULL) {
+            rc = qip_ast_class_get_metadata_node(result_class, &hashable_str, &hashable_metadata);
+            check(rc == 0, "Unable to retrieve Hashable metadata for Result class");
+        }
+        if(hashable_metadata != NULL) {
+            bstring field_name = NULL;
+            rc = qip_ast_metadata_get_item_value(hashable_metadata, NULL, &field_name);
+            check(rc == 0, "Unable to retrieve Hashable field name");
+            if(field_name != NULL && blength(field_name) > 0) {
+                rc = sky_qip_module_add_factor_field(module, field_name);
+                check(rc == 0, "Unable to add factor field");
+            }
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
 // Compiles a Qip query against the module. This can only be performed once
 // on a module. Modules cannot be reused.
 //
@@ -313,3 +417,151 @@ error:
     return -1;
 }
  
+
+
+//--------------------------------------
+// Factors
+//--------------------------------------
+
+// Records a Result field whose value is a factor dictionary id.
+//
+// module - The wrapped module.
+// name   - The name of the Result field.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_qip_module_add_factor_field(sky_qip_module *module, bstring name)
+{
+    check(module != NULL, "Module required");
+    check(name != NULL, "Field name required");
+
+    if(!sky_qip_module_is_factor_field(module, name)) {
+        module->factor_fields = realloc(module->factor_fields, sizeof(*module->factor_fields) * (module->factor_field_count+1));
+        check_mem(module->factor_fields);
+        module->factor_fields[module->factor_field_count] = bstrcpy(name);
+        check_mem(module->factor_fields[module->factor_field_count]);
+        module->factor_field_count++;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Checks if a Result field holds factor dictionary ids.
+//
+// module - The wrapped module.
+// name   - The name of the Result field.
+//
+// Returns true if the field is a factor, otherwise returns false.
+bool sky_qip_module_is_factor_field(sky_qip_module *module, bstring name)
+{
+    uint32_t i;
+    for(i=0; i<module->factor_field_count; i++) {
+        if(biseq(module->factor_fields[i], name) == 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+//--------------------------------------
+// Results
+//--------------------------------------
+
+// Writes serialized query results to an output stream. The results are a map
+// header followed by one map per Result. Factor fields are written as their
+// dictionary values and everything else is copied as is.
+//
+// module - The wrapped module.
+// data   - The serialized results.
+// length - The length of the serialized results, in bytes.
+// output - The output stream to write to.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_qip_module_write_results(sky_qip_module *module, void *data,
+                                 size_t length, FILE *output)
+{
+    int rc;
+    size_t sz;
+    uint32_t i, j;
+    check(module != NULL, "Module required");
+    check(data != NULL || length == 0, "Data required");
+    check(output != NULL, "Output stream required");
+
+    // Results without factors are written directly.
+    if(module->factor_field_count == 0) {
+        if(length > 0) {
+            rc = fwrite(data, length, 1, output);
+            check(rc == 1, "Unable to write results");
+        }
+        return 0;
+    }
+    check(module->table != NULL && module->table->dictionary != NULL, "Table dictionary required");
+    
+    void *ptr = data;
+    void *end = data + length;
+
+    // Result count.
+    check(ptr < end && minipack_is_map(ptr), "Results map expected");
+    uint32_t count = minipack_unpack_map(ptr, &sz);
+    ptr += sz;
+    rc = minipack_fwrite_map(output, count, &sz);
+    check(rc == 0, "Unable to write results map");
+
+    for(i=0; i<count; i++) {
+        check(ptr < end && minipack_is_map(ptr), "Result map expected");
+        uint32_t field_count = minipack_unpack_map(ptr, &sz);
+        ptr += sz;
+        rc = minipack_fwrite_map(output, field_count, &sz);
+        check(rc == 0, "Unable to write result map");
+
+        for(j=0; j<field_count; j++) {
+            // Copy the field name.
+            check(ptr < end && minipack_is_raw(ptr), "Result field name expected");
+            uint32_t key_length = minipack_unpack_raw(ptr, &sz);
+            check(ptr + sz + key_length <= end, "Result field name out of bounds");
+            struct tagbstring key;
+            btfromblk(key, ptr + sz, key_length);
+            rc = fwrite(ptr, sz + key_length, 1, output);
+            check(rc == 1, "Unable to write result field name");
+            ptr += sz + key_length;
+            check(ptr < end, "Result field value expected");
+
+            // Decode factor ids. Zero ids mean there is no value.
+            if(sky_qip_module_is_factor_field(module, &key)) {
+                int64_t id = minipack_unpack_int(ptr, &sz);
+                check(sz > 0, "Factor field must be an integer: %s", bdata(&key));
+                ptr += sz;
+
+                bstring value = NULL;
+                if(id > 0 && id <= UINT32_MAX) {
+                    rc = sky_dictionary_find_by_id(module->table->dictionary, (sky_dictionary_id_t)id, &value);
+                    check(rc == 0, "Unable to find factor value: %" PRId64, id);
+                }
+                if(value != NULL) {
+                    rc = sky_minipack_fwrite_bstring(output, value);
+                    check(rc == 0, "Unable to write factor value");
+                }
+                else {
+                    rc = minipack_fwrite_nil(output, &sz);
+                    check(rc == 0, "Unable to write empty factor value");
+                }
+            }
+            // Copy all other values.
+            else {
+                sz = minipack_sizeof_elem_and_data(ptr);
+                check(sz > 0 && ptr + sz <= end, "Invalid result field value");
+                rc = fwrite(ptr, sz, 1, output);
+                check(rc == 1, "Unable to write result field value");
+                ptr += sz;
+            }
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
@@ -1,6 +1,8 @@
 #ifndef _sky_qip_module_h
 #define _sky_qip_module_h
 
+#include <stdio.h>
+#include <stdbool.h>
 #include <inttypes.h>
 
 #include "table.h"
@@ -15,6 +17,14 @@
 
 // This struct wraps the Qip module to provide some additional information
 // around dynamic Event properties.
+//
+// Factor properties are exposed to the query as their dictionary ids. String
+// literals compared against a factor (e.g. `event.country == "us"`) are
+// translated to ids when the query is compiled. Result fields that are
+// assigned a factor directly (`item.country = event.country`) or that are the
+// Hashable key of a `data.get(event.country)` lookup are recorded as factor
+// fields and their ids are decoded back to strings when the results are
+// written.
 typedef struct {
     qip_module *_qip_module;
     qip_compiler *compiler;
@@ -24,6 +34,8 @@ typedef struct {
     sky_property_id_t *event_property_ids;
     int64_t *event_property_offsets;
     bstring *event_property_types;
+    uint32_t factor_field_count;
+    bstring *factor_fields;
 } sky_qip_module;
 
 
@@ -49,4 +61,19 @@ void sky_qip_module_free_event_info(sky_qip_module *module);
 
 int sky_qip_module_compile(sky_qip_module *module, bstring query_text);
 
+//--------------------------------------
+// Factors
+//--------------------------------------
+
+int sky_qip_module_add_factor_field(sky_qip_module *module, bstring name);
+
+bool sky_qip_module_is_factor_field(sky_qip_module *module, bstring name);
+
+//--------------------------------------
+// Results
+//--------------------------------------
+
+int sky_qip_module_write_results(sky_qip_module *module, void *data,
+    size_t length, FILE *output);
+
 #endif
@@ -5,6 +5,7 @@
 #include "bstring.h"
 #include "dbg.h"
 #include "server.h"
+#include "shard.h"
 #include "version.h"
 
 
@@ -19,6 +20,13 @@
 typedef struct Options {
     bstring path;
     int port;
+    bool warm_up;
+    bool shadow_blocks;
+    bool log_structured;
+    int data_file_version;
+    int shard_count;
+    long archive_age;
+    long retention_age;
 } Options;
 
 
@@ -36,13 +44,20 @@ Options *parseopts(int argc, char **argv)
     // Command line options.
     struct option long_options[] = {
         {"port", optional_argument, 0, 'p'},
+        {"warm-up", no_argument, 0, 'w'},
+        {"shadow-blocks", no_argument, 0, 's'},
+        {"log-structured", no_argument, 0, 'l'},
+        {"data-file-version", required_argument, 0, 'f'},
+        {"shard-count", required_argument, 0, 'n'},
+        {"archive-age", required_argument, 0, 'a'},
+        {"retention-age", required_argument, 0, 'r'},
         {0, 0, 0, 0}
     };
 
     // Parse command line options.
     while(1) {
         int option_index = 0;
-        int c = getopt_long(argc, argv, "p:", long_options, &option_index);
+        int c = getopt_long(argc, argv, "p:wslf:n:a:r:", long_options, &option_index);
         
         // Check for end of options.
         if(c == -1) {
@@ -55,6 +70,34 @@ Options *parseopts(int argc, char **argv)
                 options->port = atoi(optarg);
                 break;
             }
+            case 'w': {
+                options->warm_up = true;
+                break;
+            }
+            case 's': {
+                options->shadow_blocks = true;
+                break;
+            }
+            case 'l': {
+                options->log_structured = true;
+                break;
+            }
+            case 'f': {
+                options->data_file_version = atoi(optarg);
+                break;
+            }
+            case 'n': {
+                options->shard_count = atoi(optarg);
+                break;
+            }
+            case 'a': {
+                options->archive_age = atol(optarg);
+                break;
+            }
+            case 'r': {
+                options->retention_age = atol(optarg);
+                break;
+            }
         }
     }
     
@@ -75,6 +118,30 @@ Options *parseopts(int argc, char **argv)
         exit(1);
     }
 
+    // Validate archive age.
+    if(options->archive_age < 0) {
+        fprintf(stderr, "Error: Invalid archive age.\n\n");
+        exit(1);
+    }
+
+    // Validate retention age.
+    if(options->retention_age < 0) {
+        fprintf(stderr, "Error: Invalid retention age.\n\n");
+        exit(1);
+    }
+
+    // Validate data file version.
+    if(options->data_file_version < 0 || options->data_file_version > SKY_DATA_FILE_VERSION) {
+        fprintf(stderr, "Error: Invalid data file version.\n\n");
+        exit(1);
+    }
+
+    // Validate shard count.
+    if(options->shard_count < 0 || options->shard_count > SKY_MAX_SHARD_COUNT) {
+        fprintf(stderr, "Error: Invalid shard count.\n\n");
+        exit(1);
+    }
+
     return options;
     
 error:
@@ -125,6 +192,15 @@ int main(int argc, char **argv)
     if(options->port > 0) {
         server->port = options->port;
     }
+    server->warm_up = options->warm_up;
+    server->shadow_blocks = options->shadow_blocks;
+    server->log_structured = options->log_structured;
+    if(options->data_file_version > 0) {
+        server->data_file_version = (uint32_t)options->data_file_version;
+    }
+    server->shard_count = options->shard_count;
+    server->archive_age = ((sky_timestamp_t)options->archive_age) * 1000000;
+    server->retention_age = ((sky_timestamp_t)options->retention_age) * 1000000;
     
     // Clean up options.
     Options_free(options);
@@ -0,0 +1,135 @@
+#include <stdlib.h>
+
+#include "snapshot.h"
+#include "dbg.h"
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates an empty snapshot. Snapshots are pinned on a data file with
+// `sky_data_file_pin_snapshot()`.
+//
+// Returns a reference to the new snapshot if successful. Otherwise returns
+// null.
+sky_snapshot *sky_snapshot_create()
+{
+    sky_snapshot *snapshot = calloc(1, sizeof(sky_snapshot)); check_mem(snapshot);
+    return snapshot;
+
+error:
+    sky_snapshot_free(snapshot);
+    return NULL;
+}
+
+// Removes a snapshot, its copy of the block directory and its copy of the
+// memtable from memory. The runs belong to the data file.
+//
+// snapshot - The snapshot to free.
+void sky_snapshot_free(sky_snapshot *snapshot)
+{
+    if(snapshot) {
+        uint32_t i;
+        for(i=0; i<snapshot->block_count; i++) {
+            sky_block_free(snapshot->blocks[i]);
+            snapshot->blocks[i] = NULL;
+        }
+        free(snapshot->blocks);
+        snapshot->blocks = NULL;
+        snapshot->block_count = 0;
+        free(snapshot->runs);
+        snapshot->runs = NULL;
+        snapshot->run_count = 0;
+        sky_memtable_free(snapshot->memtable);
+        snapshot->memtable = NULL;
+        snapshot->data = NULL;
+        snapshot->data_file = NULL;
+        free(snapshot);
+    }
+}
+
+
+//--------------------------------------
+// Blocks
+//--------------------------------------
+
+// Adds a copy of a block to the end of the snapshot's directory. The copy
+// keeps the block's slot, ranges and zone map and is read through the
+// snapshot's mapping.
+//
+// snapshot - The snapshot.
+// block    - The block to copy.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_snapshot_add_block(sky_snapshot *snapshot, sky_block *block)
+{
+    int rc;
+    sky_block *copy = NULL;
+    check(snapshot != NULL, "Snapshot required");
+    check(block != NULL, "Block required");
+
+    copy = sky_block_create(block->data_file); check_mem(copy);
+    copy->index = block->index;
+    copy->min_object_id = block->min_object_id;
+    copy->max_object_id = block->max_object_id;
+    copy->min_timestamp = block->min_timestamp;
+    copy->max_timestamp = block->max_timestamp;
+    copy->compressed_length = block->compressed_length;
+    copy->archived = block->archived;
+    copy->spanned = block->spanned;
+    copy->mapping = snapshot->data;
+
+    // Copy the zone map so that predicates don't rebuild it.
+    if(block->zone_map_loaded) {
+        rc = sky_zone_map_merge(&copy->zone_map, &block->zone_map);
+        check(rc == 0, "Unable to copy zone map");
+        copy->zone_map_loaded = true;
+    }
+
+    snapshot->blocks = realloc(snapshot->blocks, sizeof(*snapshot->blocks) * (snapshot->block_count+1));
+    check_mem(snapshot->blocks);
+    snapshot->blocks[snapshot->block_count++] = copy;
+
+    return 0;
+
+error:
+    sky_block_free(copy);
+    return -1;
+}
+
+// Determines the number of blocks in the snapshot that hold the path starting
+// at a given position in the snapshot's directory.
+//
+// snapshot - The snapshot.
+// position - The position of the first block of the path.
+// count    - A pointer to where the number of blocks is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_snapshot_get_span_count(sky_snapshot *snapshot, uint32_t position,
+                                uint32_t *count)
+{
+    check(snapshot != NULL, "Snapshot required");
+    check(position < snapshot->block_count, "Block position out of range");
+    check(count != NULL, "Span count address required");
+
+    sky_block *block = snapshot->blocks[position];
+    uint32_t i = position+1;
+    if(block->spanned) {
+        while(i < snapshot->block_count && snapshot->blocks[i]->spanned && snapshot->blocks[i]->min_object_id == block->min_object_id) {
+            i++;
+        }
+    }
+    *count = i - position;
+
+    return 0;
+
+error:
+    if(count) *count = 0;
+    return -1;
+}
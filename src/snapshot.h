@@ -0,0 +1,88 @@
+#ifndef _snapshot_h
+#define _snapshot_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_snapshot sky_snapshot;
+
+#include "data_file.h"
+#include "block.h"
+#include "memtable.h"
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A snapshot is a consistent view of a data file at the time it was pinned.
+// It holds its own copy of the block directory so that a query reading
+// through the snapshot isn't affected by blocks that are split, merged or
+// moved after it was pinned. It also holds the list of the data file's runs
+// and a copy of its memtable.
+//
+// Every block in a data file is marked as shared when a snapshot is pinned.
+// A shared block is never changed in place. The first change to it is made
+// to a copy in another slot and the original slot is retired. A retired slot
+// is only freed once every snapshot that could read it has been released.
+//
+// Each snapshot is given an epoch that increases with every snapshot pinned
+// on the data file. Retired slots record the epoch in which they were retired
+// so they can be freed when the oldest pinned snapshot is newer.
+//
+// The snapshot's blocks are read through the data file mapping as it was
+// when the snapshot was pinned. A data file that needs a larger mapping while
+// snapshots are pinned maps a new region instead of moving the old one, and
+// the old mapping is kept until the snapshots pinned before the remap are
+// released. Runs aren't merged and blocks aren't expired or archived while a
+// snapshot is pinned, so a reader never sees them freed or moved.
+//
+// A snapshot is pinned and released under the data file's lock. Writers hold
+// the same lock while they change the data file, so a snapshot can be read on
+// another thread while events are added.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+struct sky_snapshot {
+    sky_data_file *data_file;
+    uint32_t epoch;
+    void *data;
+    sky_block **blocks;
+    uint32_t block_count;
+    sky_data_file **runs;
+    uint32_t run_count;
+    sky_memtable *memtable;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_snapshot *sky_snapshot_create();
+
+void sky_snapshot_free(sky_snapshot *snapshot);
+
+
+//--------------------------------------
+// Blocks
+//--------------------------------------
+
+int sky_snapshot_add_block(sky_snapshot *snapshot, sky_block *block);
+
+int sky_snapshot_get_span_count(sky_snapshot *snapshot, uint32_t position,
+    uint32_t *count);
+
+#endif
@@ -11,8 +11,12 @@
 #include "endian.h"
 #include "bstring.h"
 #include "file.h"
+#include "timestamp.h"
 #include "database.h"
 #include "block.h"
+#include "path_iterator.h"
+#include "cursor.h"
+#include "bulk_loader.h"
 #include "table.h"
 
 //==============================================================================
@@ -29,6 +33,10 @@ int sky_table_lock(sky_table *table);
 
 int sky_table_unlock(sky_table *table);
 
+int sky_table_create_lock_file(bstring path);
+
+int sky_table_remove_lock_file(bstring path);
+
 
 //--------------------------------------
 // Data file
@@ -38,6 +46,10 @@ int sky_table_load_data_file(sky_table *table);
 
 int sky_table_unload_data_file(sky_table *table);
 
+int sky_table_get_tablespace_count(sky_table *table, uint32_t *count);
+
+int sky_table_load_shard(sky_table *table, uint32_t index);
+
 
 //--------------------------------------
 // Action file
@@ -55,6 +67,52 @@ int sky_table_load_property_file(sky_table *table);
 
 int sky_table_unload_property_file(sky_table *table);
 
+//--------------------------------------
+// Dictionary
+//--------------------------------------
+
+int sky_table_load_dictionary(sky_table *table);
+
+int sky_table_unload_dictionary(sky_table *table);
+
+int sky_table_encode_event(sky_table *table, sky_event *event);
+
+
+//--------------------------------------
+// Action index
+//--------------------------------------
+
+int sky_table_load_action_index(sky_table *table);
+
+int sky_table_unload_action_index(sky_table *table);
+
+int sky_table_index_event(sky_table *table, sky_event *event);
+
+
+//--------------------------------------
+// Write-ahead log
+//--------------------------------------
+
+int sky_table_load_wal(sky_table *table);
+
+int sky_table_unload_wal(sky_table *table);
+
+int sky_table_add_memtable_event(sky_table *table, sky_event *event);
+
+bool sky_table_has_memtable_events(sky_table *table);
+
+int sky_table_flush_memtable(sky_table *table, sky_timestamp_t min_timestamp);
+
+bool sky_table_has_expired_runs(sky_data_file *data_file,
+    sky_timestamp_t min_timestamp);
+
+
+//--------------------------------------
+// Event Management
+//--------------------------------------
+
+int sky_table_validate_event(sky_table *table, sky_event *event);
+
 
 //==============================================================================
 //
@@ -93,6 +151,9 @@ void sky_table_free(sky_table *table)
         table->path = NULL;
         sky_table_unload_action_file(table);
         sky_table_unload_property_file(table);
+        sky_table_unload_dictionary(table);
+        sky_table_unload_action_index(table);
+        sky_table_unload_wal(table);
         free(table);
     }
 }
@@ -131,7 +192,8 @@ error:
 // Data file management
 //--------------------------------------
 
-// Initializes and opens the data file on the table.
+// Initializes and opens the data files of each shard of the table. The
+// number of shards of an existing table is determined by its tablespaces.
 //
 // table - The table to initialize the data file for.
 //
@@ -145,54 +207,170 @@ int sky_table_load_data_file(sky_table *table)
     // Unload any existing data file.
     sky_table_unload_data_file(table);
     
-    // Initialize table space (0).
-    bstring tablespace_path = bformat("%s/0", bdata(table->path));
-    if(!sky_file_exists(tablespace_path)) {
-        rc = mkdir(bdata(tablespace_path), S_IRWXU);
-        check(rc == 0, "Unable to create tablespace directory: %s", bdata(tablespace_path));
+    // Determine the number of shards.
+    uint32_t tablespace_count;
+    rc = sky_table_get_tablespace_count(table, &tablespace_count);
+    check(rc == 0, "Unable to count tablespaces");
+    if(tablespace_count > 0) {
+        check(table->shard_count == 0 || table->shard_count == tablespace_count, "Table has %d shards: %s", tablespace_count, bdata(table->path));
+        table->shard_count = tablespace_count;
     }
-    bdestroy(tablespace_path);
-    
-    // Initialize data file.
-    table->data_file = sky_data_file_create();
-    check_mem(table->data_file);
-    table->data_file->path = bformat("%s/0/data", bdata(table->path));
-    check_mem(table->data_file->path);
-    table->data_file->header_path = bformat("%s/0/header", bdata(table->path));
-    check_mem(table->data_file->header_path);
-    
-    // Initialize settings on the block.
-    if(table->default_block_size > 0) {
-        table->data_file->block_size = table->default_block_size;
+    else if(table->shard_count == 0) {
+        table->shard_count = SKY_DEFAULT_SHARD_COUNT;
     }
-    
-    // Load data
-    rc = sky_data_file_load(table->data_file);
-    check(rc == 0, "Unable to load data file");
+    check(table->shard_count <= SKY_MAX_SHARD_COUNT, "Shard count cannot exceed %d", SKY_MAX_SHARD_COUNT);
+
+    // Load each shard.
+    uint32_t i;
+    table->data_files = calloc(table->shard_count, sizeof(*table->data_files));
+    check_mem(table->data_files);
+    for(i=0; i<table->shard_count; i++) {
+        rc = sky_table_load_shard(table, i);
+        check(rc == 0, "Unable to load shard: %d", i);
+    }
+    table->data_file = table->data_files[0];
 
     return 0;
 error:
-    bdestroy(tablespace_path);
     sky_table_unload_data_file(table);
     return -1;
 }
 
-// Initializes and opens the data file on the table.
+// Closes the data files of the table and releases the locks on its shards.
 //
-// table - The table to initialize the data file for.
+// table - The table to unload the data files for.
 //
 // Returns 0 if successful, otherwise returns -1.
 int sky_table_unload_data_file(sky_table *table)
 {
+    int rc;
+    check(table != NULL, "Table required");
+
+    if(table->data_files) {
+        uint32_t i;
+        for(i=0; i<table->shard_count; i++) {
+            if(table->data_files[i] == NULL) {
+                continue;
+            }
+            sky_data_file_free(table->data_files[i]);
+            table->data_files[i] = NULL;
+
+            bstring lock_path = bformat("%s/%d/%s", bdata(table->path), i, SKY_LOCK_NAME); check_mem(lock_path);
+            rc = sky_table_remove_lock_file(lock_path);
+            bdestroy(lock_path);
+            check(rc == 0, "Unable to remove shard lock: %d", i);
+        }
+        free(table->data_files);
+        table->data_files = NULL;
+    }
+    table->data_file = NULL;
+
+    return 0;
+error:
+    return -1;
+}
+
+// Counts the consecutively numbered tablespace directories of the table.
+//
+// table - The table.
+// count - A pointer to where the number of tablespaces is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_get_tablespace_count(sky_table *table, uint32_t *count)
+{
+    check(table != NULL, "Table required");
+    check(count != NULL, "Tablespace count return address required");
+
+    *count = 0;
+    while(*count < SKY_MAX_SHARD_COUNT) {
+        bstring path = bformat("%s/%d", bdata(table->path), *count); check_mem(path);
+        bool exists = sky_file_exists(path);
+        bdestroy(path);
+        if(!exists) {
+            break;
+        }
+        (*count)++;
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+// Creates the tablespace of a shard if it doesn't exist, locks it and loads
+// its data file.
+//
+// table - The table.
+// index - The index of the shard.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_load_shard(sky_table *table, uint32_t index)
+{
+    int rc;
+    bool locked = false;
+    bstring lock_path = NULL;
+    sky_data_file *data_file = NULL;
     check(table != NULL, "Table required");
+    check(index < table->shard_count, "Shard index out of range: %d", index);
 
-    if(table->data_file) {
-        sky_data_file_free(table->data_file);
-        table->data_file = NULL;
+    // Initialize table space.
+    bstring tablespace_path = bformat("%s/%d", bdata(table->path), index);
+    check_mem(tablespace_path);
+    if(!sky_file_exists(tablespace_path)) {
+        rc = mkdir(bdata(tablespace_path), S_IRWXU);
+        check(rc == 0, "Unable to create tablespace directory: %s", bdata(tablespace_path));
     }
 
+    // Lock the shard.
+    lock_path = bformat("%s/%s", bdata(tablespace_path), SKY_LOCK_NAME); check_mem(lock_path);
+    rc = sky_table_create_lock_file(lock_path);
+    check(rc == 0, "Unable to obtain shard lock");
+    locked = true;
+    
+    // Initialize data file.
+    data_file = sky_data_file_create();
+    check_mem(data_file);
+    data_file->path = bformat("%s/data", bdata(tablespace_path));
+    check_mem(data_file->path);
+    data_file->header_path = bformat("%s/header", bdata(tablespace_path));
+    check_mem(data_file->header_path);
+    data_file->zone_map_path = bformat("%s/zones", bdata(tablespace_path));
+    check_mem(data_file->zone_map_path);
+    data_file->archive_path = bformat("%s/archive", bdata(tablespace_path));
+    check_mem(data_file->archive_path);
+    data_file->run_path = bformat("%s/%s", bdata(tablespace_path), SKY_RUN_NAME);
+    check_mem(data_file->run_path);
+    data_file->memtable = sky_memtable_create();
+    check_mem(data_file->memtable);
+    table->data_files[index] = data_file;
+    
+    // Initialize settings on the block.
+    if(table->default_block_size > 0) {
+        data_file->block_size = table->default_block_size;
+    }
+    if(table->default_version > 0) {
+        data_file->version = table->default_version;
+    }
+    data_file->huge_pages = table->huge_pages;
+    data_file->shadow_blocks = table->shadow_blocks;
+    
+    // Load data
+    rc = sky_data_file_load(data_file);
+    check(rc == 0, "Unable to load data file");
+
+    bdestroy(tablespace_path);
+    bdestroy(lock_path);
     return 0;
+
 error:
+    // Once the data file is on the table it is freed and unlocked when the
+    // table is unloaded.
+    if(locked && table->data_files[index] == NULL) {
+        sky_data_file_free(data_file);
+        sky_table_remove_lock_file(lock_path);
+    }
+    bdestroy(tablespace_path);
+    bdestroy(lock_path);
     return -1;
 }
 
@@ -305,6 +483,252 @@ error:
 }
 
 
+//--------------------------------------
+// Dictionary management
+//--------------------------------------
+
+// Initializes and loads the dictionary of the table.
+//
+// table - The table to initialize the dictionary for.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_load_dictionary(sky_table *table)
+{
+    int rc;
+    check(table != NULL, "Table required");
+    check(table->path != NULL, "Table path required");
+    
+    // Unload any existing dictionary.
+    sky_table_unload_dictionary(table);
+    
+    // Initialize dictionary.
+    table->dictionary = sky_dictionary_create();
+    check_mem(table->dictionary);
+    table->dictionary->path = bformat("%s/dictionary", bdata(table->path));
+    check_mem(table->dictionary->path);
+    
+    // Load data
+    rc = sky_dictionary_load(table->dictionary);
+    check(rc == 0, "Unable to load dictionary");
+
+    return 0;
+error:
+    sky_table_unload_dictionary(table);
+    return -1;
+}
+
+// Unloads the dictionary of the table.
+//
+// table - The table.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_unload_dictionary(sky_table *table)
+{
+    check(table != NULL, "Table required");
+
+    if(table->dictionary) {
+        sky_dictionary_free(table->dictionary);
+        table->dictionary = NULL;
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+// Replaces the string values of Factor properties on an event with their
+// dictionary ids. Values that are not in the dictionary yet are added to it.
+//
+// table - The table.
+// event - The event to encode.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_encode_event(sky_table *table, sky_event *event)
+{
+    int rc;
+    check(table != NULL, "Table required");
+    check(event != NULL, "Event required");
+
+    uint32_t i;
+    for(i=0; i<event->data_count; i++) {
+        sky_event_data *data = event->data[i];
+        if(data->data_type != &SKY_DATA_TYPE_STRING) {
+            continue;
+        }
+
+        // Only Factor properties are encoded.
+        sky_property *property = NULL;
+        rc = sky_property_file_find_by_id(table->property_file, data->key, &property);
+        check(rc == 0, "Unable to find property: %d", data->key);
+        if(property == NULL || biseq(property->data_type, &SKY_DATA_TYPE_FACTOR) != 1) {
+            continue;
+        }
+
+        sky_dictionary_id_t id = 0;
+        rc = sky_dictionary_add_value(table->dictionary, data->string_value, &id);
+        check(rc == 0, "Unable to add dictionary value");
+
+        bdestroy(data->string_value);
+        data->data_type = &SKY_DATA_TYPE_INT;
+        data->int_value = (int64_t)id;
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Action index management
+//--------------------------------------
+
+// Initializes and loads the action index of the table. The index file is
+// removed once it is read so that the index is rebuilt from the data files
+// if the table is not closed cleanly. A table without an index file has its
+// index rebuilt.
+//
+// table - The table to initialize the action index for.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_load_action_index(sky_table *table)
+{
+    int rc;
+    check(table != NULL, "Table required");
+    check(table->path != NULL, "Table path required");
+
+    // Unload any existing action index.
+    sky_table_unload_action_index(table);
+
+    // Initialize action index.
+    table->action_index = sky_action_index_create();
+    check_mem(table->action_index);
+    table->action_index->path = bformat("%s/action_index", bdata(table->path));
+    check_mem(table->action_index->path);
+
+    // Load the saved index or rebuild it if there isn't one.
+    if(sky_file_exists(table->action_index->path)) {
+        rc = sky_action_index_load(table->action_index);
+        check(rc == 0, "Unable to load action index");
+        rc = sky_file_rm(table->action_index->path);
+        check(rc == 0, "Unable to remove action index file: %s", bdata(table->action_index->path));
+    }
+    else {
+        rc = sky_table_rebuild_action_index(table);
+        check(rc == 0, "Unable to rebuild action index");
+    }
+
+    return 0;
+error:
+    sky_table_unload_action_index(table);
+    return -1;
+}
+
+// Unloads the action index of the table.
+//
+// table - The table.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_unload_action_index(sky_table *table)
+{
+    check(table != NULL, "Table required");
+
+    if(table->action_index) {
+        sky_action_index_free(table->action_index);
+        table->action_index = NULL;
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+// Adds the object of an event to the action index under the event's action.
+// Events without an action are not indexed.
+//
+// table - The table.
+// event - The event to index.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_index_event(sky_table *table, sky_event *event)
+{
+    int rc;
+
+    if(table->action_index != NULL && event->action_id != 0) {
+        rc = sky_action_index_add(table->action_index, event->action_id, event->object_id);
+        check(rc == 0, "Unable to add event to action index");
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Write-ahead log management
+//--------------------------------------
+
+// Initializes and opens the write-ahead log on the table.
+//
+// table - The table to initialize the log for.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_load_wal(sky_table *table)
+{
+    int rc;
+    check(table != NULL, "Table required");
+    check(table->path != NULL, "Table path required");
+    
+    // Unload any existing log.
+    sky_table_unload_wal(table);
+    
+    // Initialize log.
+    table->wal = sky_wal_create();
+    check_mem(table->wal);
+    table->wal->path = bformat("%s/%s", bdata(table->path), SKY_WAL_NAME);
+    check_mem(table->wal->path);
+    
+    // Open log.
+    rc = sky_wal_open(table->wal);
+    check(rc == 0, "Unable to open WAL");
+
+    // Number new records after every record that the shards have applied.
+    uint32_t i;
+    for(i=0; i<table->shard_count; i++) {
+        uint64_t lsn = sky_data_file_get_applied_lsn(table->data_files[i]);
+        if(lsn > table->wal->lsn) {
+            table->wal->lsn = lsn;
+        }
+    }
+
+    return 0;
+error:
+    sky_table_unload_wal(table);
+    return -1;
+}
+
+// Closes and frees the write-ahead log on the table.
+//
+// table - The table to unload the log for.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_unload_wal(sky_table *table)
+{
+    check(table != NULL, "Table required");
+
+    if(table->wal) {
+        sky_wal_free(table->wal);
+        table->wal = NULL;
+    }
+
+    return 0;
+error:
+    return -1;
+}
+
+
 //--------------------------------------
 // State
 //--------------------------------------
@@ -343,6 +767,31 @@ int sky_table_open(sky_table *table)
     rc = sky_table_load_property_file(table);
     check(rc == 0, "Unable to load property file");
     
+    // Load dictionary.
+    rc = sky_table_load_dictionary(table);
+    check(rc == 0, "Unable to load dictionary");
+    
+    // Load write-ahead log.
+    rc = sky_table_load_wal(table);
+    check(rc == 0, "Unable to load write-ahead log");
+    
+    // Replay any events that were logged but not applied.
+    rc = sky_table_checkpoint(table);
+    check(rc == 0, "Unable to replay write-ahead log");
+
+    // Load the action index once every logged event is in the data files.
+    rc = sky_table_load_action_index(table);
+    check(rc == 0, "Unable to load action index");
+
+    // Start reading the data file into memory in the background.
+    if(table->warm_up) {
+        uint32_t i;
+        for(i=0; i<table->shard_count; i++) {
+            rc = sky_data_file_warm(table->data_files[i]);
+            check(rc == 0, "Unable to warm data file for shard: %d", i);
+        }
+    }
+
     // Flag the table as open.
     table->opened = true;
 
@@ -363,6 +812,24 @@ int sky_table_close(sky_table *table)
     int rc;
     check(table != NULL, "Table required to close");
 
+    // Apply logged events before closing.
+    if(table->opened) {
+        rc = sky_table_checkpoint(table);
+        check(rc == 0, "Unable to checkpoint write-ahead log");
+    }
+
+    // Save and unload the action index.
+    if(table->action_index) {
+        rc = sky_action_index_save(table->action_index);
+        check(rc == 0, "Unable to save action index");
+    }
+    rc = sky_table_unload_action_index(table);
+    check(rc == 0, "Unable to unload action index");
+
+    // Unload write-ahead log.
+    rc = sky_table_unload_wal(table);
+    check(rc == 0, "Unable to unload write-ahead log");
+
     // Unload data file.
     rc = sky_table_unload_data_file(table);
     check(rc == 0, "Unable to unload data file");
@@ -375,6 +842,10 @@ int sky_table_close(sky_table *table)
     rc = sky_table_unload_property_file(table);
     check(rc == 0, "Unable to unload property file");
 
+    // Unload dictionary.
+    rc = sky_table_unload_dictionary(table);
+    check(rc == 0, "Unable to unload dictionary");
+
     // Update state to closed.
     table->opened = false;
 
@@ -400,20 +871,13 @@ error:
 // Returns 0 if successful, otherwise returns -1.
 int sky_table_lock(sky_table *table)
 {
-    FILE *file;
+    int rc;
     check(table != NULL, "Table required to lock");
 
     // Construct path to lock.
     bstring path = bformat("%s/%s", bdata(table->path), SKY_LOCK_NAME); check_mem(path);
-
-    // Raise error if table is already locked.
-    check(!sky_file_exists(path), "Cannot obtain lock: %s", bdata(path));
-
-    // Write pid to lock file.
-    file = fopen(bdata(path), "w");
-    check(file, "Failed to open lock file: %s",  bdata(path));
-    check(fprintf(file, "%d", getpid()) > 0, "Error writing lock file: %s",  bdata(path));
-    fclose(file);
+    rc = sky_table_create_lock_file(path);
+    check(rc == 0, "Unable to create lock file");
 
     // Clean up.
     bdestroy(path);
@@ -421,7 +885,6 @@ int sky_table_lock(sky_table *table)
     return 0;
 
 error:
-    if(file) fclose(file);
     bdestroy(path);
     return -1;
 }
@@ -433,13 +896,62 @@ error:
 // Returns 0 if successful, otherwise returns -1.
 int sky_table_unlock(sky_table *table)
 {
-    FILE *file;
+    int rc;
 
     // Validate arguments.
     check(table != NULL, "Table required to unlock");
 
     // Construct path to lock.
     bstring path = bformat("%s/%s", bdata(table->path), SKY_LOCK_NAME); check_mem(path);
+    rc = sky_table_remove_lock_file(path);
+    check(rc == 0, "Unable to remove lock file");
+
+    // Clean up.
+    bdestroy(path);
+
+    return 0;
+
+error:
+    bdestroy(path);
+    return -1;
+}
+
+// Creates a lock file that holds the current process id. Tables and the
+// shards of a table are each locked with their own lock file.
+// 
+// path - The path of the lock file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_create_lock_file(bstring path)
+{
+    FILE *file = NULL;
+    check(path != NULL, "Lock path required");
+
+    // Raise error if already locked.
+    check(!sky_file_exists(path), "Cannot obtain lock: %s", bdata(path));
+
+    // Write pid to lock file.
+    file = fopen(bdata(path), "w");
+    check(file, "Failed to open lock file: %s",  bdata(path));
+    check(fprintf(file, "%d", getpid()) > 0, "Error writing lock file: %s",  bdata(path));
+    fclose(file);
+
+    return 0;
+
+error:
+    if(file) fclose(file);
+    return -1;
+}
+
+// Removes a lock file if it was created by the current process.
+// 
+// path - The path of the lock file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_remove_lock_file(bstring path)
+{
+    FILE *file = NULL;
+    check(path != NULL, "Lock path required");
 
     // If file exists, check its PID and then attempt to remove it.
     if(sky_file_exists(path)) {
@@ -449,6 +961,7 @@ int sky_table_unlock(sky_table *table)
         check(file, "Failed to open lock file: %s",  bdata(path));
         check(fscanf(file, "%d", &pid) > 0, "Error reading lock file: %s", bdata(path));
         fclose(file);
+        file = NULL;
 
         // Make sure we are removing a lock we created.
         check(pid == getpid(), "Cannot remove lock from another process (PID #%d): %s", pid, bdata(path));
@@ -457,14 +970,10 @@ int sky_table_unlock(sky_table *table)
         check(unlink(bdata(path)) == 0, "Unable to remove lock: %s", bdata(path));
     }
 
-    // Clean up.
-    bdestroy(path);
-
     return 0;
 
 error:
     if(file) fclose(file);
-    bdestroy(path);
     return -1;
 }
 
@@ -486,9 +995,29 @@ int sky_table_add_event(sky_table *table, sky_event *event)
     check(event != NULL, "Event required");
     check(table->opened, "Table must be open to add an event");
 
-    // Delegate to the data file.
-    rc = sky_data_file_add_event(table->data_file, event);
-    check(rc == 0, "Unable to add event to data file");
+    // Reject the event before it is logged so that it is never replayed.
+    rc = sky_table_validate_event(table, event);
+    check(rc == 0, "Invalid event");
+
+    // Replace factor values with their dictionary ids.
+    rc = sky_table_encode_event(table, event);
+    check(rc == 0, "Unable to encode event");
+
+    // Log the event. It is applied to the data file of the object's shard at
+    // the next checkpoint and is read from the shard's memtable until then.
+    rc = sky_wal_append(table->wal, event);
+    check(rc == 0, "Unable to log event");
+    rc = sky_table_add_memtable_event(table, event);
+    check(rc == 0, "Unable to add event to memtable");
+
+    rc = sky_table_index_event(table, event);
+    check(rc == 0, "Unable to index event");
+
+    // Apply logged events once enough have accumulated.
+    if(table->wal->record_count >= table->wal->apply_threshold) {
+        rc = sky_table_checkpoint(table);
+        check(rc == 0, "Unable to checkpoint write-ahead log");
+    }
     
     return 0;
 
@@ -496,3 +1025,488 @@ error:
     return -1;
 }
 
+
+// Adds a batch of events to the table. The events are logged together and are
+// sorted and applied to the data file a block at a time at the next
+// checkpoint.
+//
+// table       - The table to add the events to.
+// events      - The events to add.
+// event_count - The number of events.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_add_events(sky_table *table, sky_event **events,
+                         uint32_t event_count)
+{
+    int rc;
+    check(table != NULL, "Table required");
+    check(events != NULL || event_count == 0, "Events required");
+    check(table->opened, "Table must be open to add events");
+
+    // Reject the batch before any of it is logged so that an invalid event is
+    // never replayed.
+    uint32_t i;
+    for(i=0; i<event_count; i++) {
+        rc = sky_table_validate_event(table, events[i]);
+        check(rc == 0, "Invalid event");
+    }
+
+    // Log the events and commit them as a group.
+    for(i=0; i<event_count; i++) {
+        rc = sky_table_encode_event(table, events[i]);
+        check(rc == 0, "Unable to encode event");
+
+        rc = sky_wal_append(table->wal, events[i]);
+        check(rc == 0, "Unable to log event");
+        rc = sky_table_add_memtable_event(table, events[i]);
+        check(rc == 0, "Unable to add event to memtable");
+
+        rc = sky_table_index_event(table, events[i]);
+        check(rc == 0, "Unable to index event");
+    }
+    rc = sky_wal_sync(table->wal);
+    check(rc == 0, "Unable to sync write-ahead log");
+
+    // Apply logged events once enough have accumulated.
+    if(table->wal->record_count >= table->wal->apply_threshold) {
+        rc = sky_table_checkpoint(table);
+        check(rc == 0, "Unable to checkpoint write-ahead log");
+    }
+    
+    return 0;
+
+error:
+    return -1;
+}
+
+
+// Checks that an event can be stored in the data file of its shard. Object
+// ids that are wider than 32 bits require a data file with wide object ids.
+//
+// table - The table.
+// event - The event to check.
+//
+// Returns 0 if the event can be stored, otherwise returns -1.
+int sky_table_validate_event(sky_table *table, sky_event *event)
+{
+    int rc;
+    check(table != NULL, "Table required");
+    check(event != NULL, "Event required");
+
+    sky_data_file *data_file = NULL;
+    rc = sky_table_get_shard(table, event->object_id, &data_file);
+    check(rc == 0, "Unable to retrieve shard");
+    check(sky_data_file_is_wide(data_file) || event->object_id <= SKY_NARROW_OBJECT_ID_MAX, "Object id requires a data file with wide object ids: %llu", (unsigned long long)event->object_id);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Shards
+//--------------------------------------
+
+// Retrieves the data file of the shard that stores an object.
+//
+// table     - The table.
+// object_id - The object id.
+// ret       - A pointer to where the data file is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_get_shard(sky_table *table, sky_object_id_t object_id,
+                        sky_data_file **ret)
+{
+    check(table != NULL, "Table required");
+    check(table->data_files != NULL, "Data files required");
+    check(ret != NULL, "Data file return address required");
+
+    *ret = table->data_files[sky_shard_get_index(object_id, table->shard_count)];
+    return 0;
+
+error:
+    if(ret != NULL) *ret = NULL;
+    return -1;
+}
+
+
+//--------------------------------------
+// Action Index
+//--------------------------------------
+
+// Rebuilds the action index of the table from the events in its data files.
+//
+// table - The table.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_rebuild_action_index(sky_table *table)
+{
+    int rc;
+    check(table != NULL, "Table required");
+    check(table->data_files != NULL, "Data files required");
+    check(table->action_index != NULL, "Action index required");
+
+    rc = sky_action_index_unload(table->action_index);
+    check(rc == 0, "Unable to unload action index");
+
+    // Add the object of every path to the sets of the actions in its path.
+    sky_cursor cursor;
+    sky_cursor_init(&cursor);
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    rc = sky_path_iterator_set_data_files(&iterator, table->data_files, table->shard_count);
+    check(rc == 0, "Unable to initialize path iterator");
+    while(!iterator.eof) {
+        rc = sky_path_iterator_set_cursor(&iterator, &cursor);
+        check(rc == 0, "Unable to set cursor paths");
+        while(!cursor.eof) {
+            sky_action_id_t action_id;
+            rc = sky_cursor_get_action_id(&cursor, &action_id);
+            check(rc == 0, "Unable to retrieve action id");
+            if(action_id != 0) {
+                rc = sky_action_index_add(table->action_index, action_id, iterator.current_object_id);
+                check(rc == 0, "Unable to add object to action index");
+            }
+
+            rc = sky_cursor_next(&cursor);
+            check(rc == 0, "Unable to move to next event");
+        }
+
+        rc = sky_path_iterator_next(&iterator);
+        check(rc == 0, "Unable to move to next path");
+    }
+
+    sky_path_iterator_uninit(&iterator);
+    sky_cursor_uninit(&cursor);
+    return 0;
+
+error:
+    sky_path_iterator_uninit(&iterator);
+    sky_cursor_uninit(&cursor);
+    return -1;
+}
+
+
+//--------------------------------------
+// Write-Ahead Log
+//--------------------------------------
+
+// Applies all events in the write-ahead log to the data files of the table's
+// shards, removes the events that have expired under the table's retention
+// policy and archives the blocks that are older than the table's archive age.
+// Once the data files have been flushed to disk, the log is truncated.
+//
+// The events of a log-structured table are written from its memtable to a
+// new run of each shard instead. The runs of a shard are merged into its data
+// file once it has the maximum number of runs or once one of them holds
+// expired events. The runs of a table that isn't log-structured are always
+// merged. Expired events are dropped as the memtable is written and as runs
+// are merged so they never reach the data file after it has been expired.
+// A shard with pinned snapshots isn't merged, expired or archived until a
+// checkpoint after its snapshots are released.
+//
+// table - The table to checkpoint.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_checkpoint(sky_table *table)
+{
+    int rc;
+    uint32_t locked_count = 0;
+    check(table != NULL, "Table required");
+    check(table->data_files != NULL, "Data files required");
+    check(table->wal != NULL, "Write-ahead log required");
+
+    // Hold every shard's lock so that snapshots are pinned before or after
+    // the checkpoint but never during it.
+    uint32_t i;
+    for(i=0; i<table->shard_count; i++) {
+        rc = sky_data_file_lock(table->data_files[i]);
+        check(rc == 0, "Unable to lock shard: %d", i);
+        locked_count++;
+    }
+
+    // Commit the current group before applying it.
+    rc = sky_wal_sync(table->wal);
+    check(rc == 0, "Unable to sync write-ahead log");
+
+    // Events older than the retention policy allows are removed.
+    sky_timestamp_t retention_timestamp;
+    rc = sky_table_get_retention_timestamp(table, &retention_timestamp);
+    check(rc == 0, "Unable to determine retention timestamp");
+
+    // Apply logged events to the shards of their objects. The memtables hold
+    // the same events as the log so a log-structured table writes them from
+    // there as runs. A log that was left by a crash is replayed before the
+    // memtables have events. Once the events are in the data files they are
+    // no longer read from the memtables.
+    uint32_t count = 0;
+    if(table->log_structured && sky_table_has_memtable_events(table)) {
+        rc = sky_table_flush_memtable(table, retention_timestamp);
+        check(rc == 0, "Unable to flush memtable");
+    }
+    else {
+        rc = sky_wal_replay_shards(table->wal, table->data_files, table->shard_count, &count);
+        check(rc == 0, "Unable to replay write-ahead log");
+        for(i=0; i<table->shard_count; i++) {
+            rc = sky_memtable_clear(table->data_files[i]->memtable);
+            check(rc == 0, "Unable to clear memtable for shard: %d", i);
+        }
+    }
+
+    // Merge runs into the data files once too many have accumulated or once
+    // they hold expired events. Shards with pinned snapshots are merged,
+    // expired and archived at a later checkpoint since their readers still
+    // use the runs and blocks that these would free.
+    uint32_t max_run_count = (table->max_run_count > 0 ? table->max_run_count : SKY_DEFAULT_MAX_RUN_COUNT);
+    for(i=0; i<table->shard_count; i++) {
+        sky_data_file *data_file = table->data_files[i];
+        if(data_file->snapshot_count > 0) {
+            continue;
+        }
+        if(data_file->run_count > 0 && (!table->log_structured || data_file->run_count >= max_run_count || sky_table_has_expired_runs(data_file, retention_timestamp))) {
+            uint32_t merged_count;
+            rc = sky_data_file_merge_runs(data_file, retention_timestamp, &merged_count);
+            check(rc == 0, "Unable to merge runs for shard: %d", i);
+            count += merged_count;
+        }
+    }
+
+    // Expire the data files after the runs have been merged into them.
+    uint32_t expired_count = 0;
+    if(retention_timestamp != 0) {
+        for(i=0; i<table->shard_count; i++) {
+            if(table->data_files[i]->snapshot_count > 0) {
+                continue;
+            }
+            uint32_t dropped_count, trimmed_count;
+            rc = sky_data_file_expire(table->data_files[i], retention_timestamp, &dropped_count, &trimmed_count);
+            check(rc == 0, "Unable to expire events for shard: %d", i);
+            expired_count += dropped_count + trimmed_count;
+        }
+    }
+
+    // Move blocks that are older than the archive age to the archive.
+    uint32_t archived_count = 0;
+    if(table->archive_age > 0) {
+        sky_timestamp_t now;
+        rc = sky_timestamp_now(&now);
+        check(rc == 0, "Unable to determine current time");
+        for(i=0; i<table->shard_count; i++) {
+            if(table->data_files[i]->snapshot_count > 0) {
+                continue;
+            }
+            uint32_t shard_archived_count;
+            rc = sky_data_file_archive(table->data_files[i], now - table->archive_age, &shard_archived_count);
+            check(rc == 0, "Unable to archive blocks for shard: %d", i);
+            archived_count += shard_archived_count;
+        }
+    }
+
+    // Persist the data files and then remove the applied events from the log.
+    if(count > 0 || expired_count > 0 || archived_count > 0) {
+        for(i=0; i<table->shard_count; i++) {
+            rc = sky_data_file_flush(table->data_files[i]);
+            check(rc == 0, "Unable to flush data file for shard: %d", i);
+        }
+    }
+    rc = sky_wal_truncate(table->wal);
+    check(rc == 0, "Unable to truncate write-ahead log");
+
+    for(i=0; i<table->shard_count; i++) {
+        sky_data_file_unlock(table->data_files[i]);
+    }
+
+    return 0;
+
+error:
+    for(i=0; i<locked_count; i++) {
+        sky_data_file_unlock(table->data_files[i]);
+    }
+    return -1;
+}
+
+// Commits the current group of the table's write-ahead log if it has been
+// open for longer than the group timeout. Events are acknowledged once they
+// are logged so this bounds how long an acknowledged event can be lost for.
+//
+// table - The table.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_sync(sky_table *table)
+{
+    int rc;
+    check(table != NULL, "Table required");
+    check(table->wal != NULL, "Write-ahead log required");
+
+    rc = sky_wal_sync_if_due(table->wal);
+    check(rc == 0, "Unable to sync write-ahead log");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Writes the memtable of each shard of a log-structured table that has events
+// in it to a new run of the shard and then clears the memtable. The runs are
+// synced to disk before they are added to their data files. Events older than
+// the minimum timestamp have expired and are not written. Every logged event
+// is in a memtable so each run records the last LSN of the log.
+//
+// table         - The table.
+// min_timestamp - The timestamp of the oldest event to keep or zero to keep
+//                 every event.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_flush_memtable(sky_table *table, sky_timestamp_t min_timestamp)
+{
+    int rc;
+    sky_bulk_loader *loader = NULL;
+    check(table != NULL, "Table required");
+    check(table->data_files != NULL, "Data files required");
+
+    uint32_t i, j;
+    for(i=0; i<table->shard_count; i++) {
+        sky_data_file *data_file = table->data_files[i];
+        sky_memtable *memtable = data_file->memtable;
+        rc = sky_memtable_sort(memtable);
+        check(rc == 0, "Unable to sort memtable for shard: %d", i);
+
+        for(j=0; j<memtable->event_count; j++) {
+            sky_event *event = memtable->entries[j].event;
+            if(min_timestamp != 0 && event->timestamp < min_timestamp) {
+                continue;
+            }
+            if(loader == NULL) {
+                rc = sky_data_file_open_run(data_file, table->wal->lsn, &loader);
+                check(rc == 0, "Unable to open run for shard: %d", i);
+            }
+            rc = sky_bulk_loader_add_event(loader, event);
+            check(rc == 0, "Unable to add event to run");
+        }
+        if(loader != NULL) {
+            rc = sky_data_file_close_run(data_file, loader);
+            loader = NULL;
+            check(rc == 0, "Unable to close run for shard: %d", i);
+        }
+
+        rc = sky_memtable_clear(memtable);
+        check(rc == 0, "Unable to clear memtable for shard: %d", i);
+    }
+
+    return 0;
+
+error:
+    sky_bulk_loader_free(loader);
+    return -1;
+}
+
+// Adds a copy of a logged event to the memtable of its object's shard.
+//
+// table - The table.
+// event - The event.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_add_memtable_event(sky_table *table, sky_event *event)
+{
+    int rc;
+    check(table != NULL, "Table required");
+    check(event != NULL, "Event required");
+
+    sky_data_file *data_file = NULL;
+    rc = sky_table_get_shard(table, event->object_id, &data_file);
+    check(rc == 0, "Unable to retrieve shard");
+
+    // Snapshots copy the memtable so it is changed under the shard's lock.
+    rc = sky_data_file_lock(data_file);
+    check(rc == 0, "Unable to lock shard");
+    rc = sky_memtable_add_event(data_file->memtable, event);
+    sky_data_file_unlock(data_file);
+    check(rc == 0, "Unable to add event to memtable");
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Checks if the memtable of any shard has events in it.
+//
+// table - The table.
+//
+// Returns true if a memtable has events, otherwise returns false.
+bool sky_table_has_memtable_events(sky_table *table)
+{
+    uint32_t i;
+    for(i=0; i<table->shard_count; i++) {
+        if(table->data_files[i]->memtable->event_count > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Checks if any run of a data file holds events that are older than the
+// minimum timestamp.
+//
+// data_file     - The data file.
+// min_timestamp - The timestamp of the oldest event to keep or zero to keep
+//                 every event.
+//
+// Returns true if a run holds expired events, otherwise returns false.
+bool sky_table_has_expired_runs(sky_data_file *data_file,
+                                sky_timestamp_t min_timestamp)
+{
+    uint32_t i, j;
+    if(min_timestamp == 0) {
+        return false;
+    }
+    for(i=0; i<data_file->run_count; i++) {
+        sky_data_file *run = data_file->runs[i];
+        for(j=0; j<run->block_count; j++) {
+            if(run->blocks[j]->min_timestamp < min_timestamp) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+//--------------------------------------
+// Retention
+//--------------------------------------
+
+// Calculates the timestamp of the oldest event that the table's retention
+// policy keeps. This is the later of the retention timestamp and the current
+// time less the retention age.
+//
+// table - The table.
+// ret   - A pointer to where the timestamp is returned. This is zero if the
+//         table keeps every event.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_table_get_retention_timestamp(sky_table *table, sky_timestamp_t *ret)
+{
+    int rc;
+    check(table != NULL, "Table required");
+    check(ret != NULL, "Return address required");
+
+    *ret = table->retention_timestamp;
+    if(table->retention_age > 0) {
+        sky_timestamp_t now;
+        rc = sky_timestamp_now(&now);
+        check(rc == 0, "Unable to determine current time");
+        if(*ret == 0 || now - table->retention_age > *ret) {
+            *ret = now - table->retention_age;
+        }
+    }
+
+    return 0;
+
+error:
+    if(ret) *ret = 0;
+    return -1;
+}
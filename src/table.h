@@ -14,8 +14,13 @@ typedef struct sky_table sky_table;
 #include "event.h"
 #include "types.h"
 #include "data_file.h"
+#include "shard.h"
 #include "action_file.h"
 #include "property_file.h"
+#include "dictionary.h"
+#include "action_index.h"
+#include "memtable.h"
+#include "wal.h"
 
 //==============================================================================
 //
@@ -41,6 +46,72 @@ typedef struct sky_table sky_table;
 // Because of the redundancy of action names and data keys, those strings are
 // cached and converted into integer identifiers. The action cache is located
 // in the 'actions' file and the data keys cache is located in the 'keys' file.
+//
+// Events added to an open table are first appended to the write-ahead log in
+// the 'wal' file. Logged events are applied to the data file in batches by a
+// checkpoint, which runs once enough events have accumulated and when the
+// table is closed. Queries don't wait for a checkpoint since they read the
+// events that haven't been applied yet from the memtables. Opening a table
+// replays any events that were logged but not applied before a crash.
+//
+// A table can be opened with warm-up enabled, which starts reading the data
+// file into the page cache in the background once the table is open so that
+// the first query after a restart doesn't wait on the disk. The data file
+// mapping can also be backed by huge pages.
+//
+// Tables opened with shadow blocks never overwrite published blocks in place.
+// A crash during a checkpoint leaves the data file as it was at the previous
+// checkpoint and the events are replayed from the write-ahead log.
+//
+// The data files of a new table are created with the table's default
+// version. Tables are created with uncompressed data files if no version is
+// set, which cannot store object ids that are wider than 32 bits.
+//
+// A table can be split into several shards when it is first created. Each
+// shard is stored in its own tablespace directory with its own data file and
+// lock file and objects are assigned to shards by a hash of their id. The
+// number of shards of an existing table is determined by its tablespace
+// directories. The data file of the first shard is also available as the
+// table's data file. A checkpoint applies the logged events of each shard on
+// its own thread.
+//
+// A table can be given an archive age, in which case each checkpoint moves
+// the blocks whose events are all older than that age into the archive file
+// of their shard. Archived blocks are compressed and packed together so
+// recent blocks keep the page cache to themselves. Archived blocks are still
+// read by queries.
+//
+// A table can also be given a retention policy as a maximum event age, a
+// minimum event timestamp or both. Each checkpoint removes the events that
+// are older than the policy allows. Blocks that only hold expired events are
+// freed without being read and the expired events at the start of a path are
+// trimmed by rewriting its block in place.
+//
+// String values of Factor properties are replaced by ids from the table's
+// dictionary as events are added so they are stored and queried as integers.
+//
+// The table keeps an action index of the objects that have performed each
+// action so queries can be limited to the paths of those objects. The index
+// is updated as events are added and is saved to the 'action_index' file
+// when the table is closed. The file is removed when the table is opened so
+// the index is rebuilt from the data files if the table isn't closed
+// cleanly.
+//
+// The events added since the last checkpoint are kept in the memtable of
+// their shard's data file as well as in the write-ahead log. Queries merge
+// the memtable with the data file and its runs so they see those events
+// without a checkpoint. A checkpoint of a log-structured table sorts each
+// memtable and writes it to its shard as a new run instead of inserting the
+// events into the blocks of the data file. Once a shard has accumulated the
+// maximum number of runs they are merged into its data file by the
+// checkpoint. Opening a table that isn't log-structured merges any runs that
+// were left by a log-structured one.
+//
+// Queries read from snapshots of the shards so that events added while a
+// query runs don't change what it reads. The table changes a shard's
+// memtable and checkpoints its data file under the shard's lock so that a
+// snapshot is pinned in between. A shard isn't merged, expired or archived
+// while it has pinned snapshots.
 
 
 //==============================================================================
@@ -51,18 +122,38 @@ typedef struct sky_table sky_table;
 
 #define SKY_LOCK_NAME ".skylock"
 
+#define SKY_WAL_NAME "wal"
+
+#define SKY_RUN_NAME "run"
+
+#define SKY_DEFAULT_MAX_RUN_COUNT 8
+
 // The table is a reference to the disk location where data is stored. The
 // table also maintains a cache of block info and predefined actions and
 // properties.
 struct sky_table {
     sky_database *database;
     sky_data_file *data_file;
+    sky_data_file **data_files;
+    uint32_t shard_count;
     sky_action_file *action_file;
     sky_property_file *property_file;
+    sky_dictionary *dictionary;
+    sky_action_index *action_index;
+    sky_wal *wal;
     bstring name;
     bstring path;
     bool opened;
     uint32_t default_block_size;
+    uint32_t default_version;
+    bool warm_up;
+    bool huge_pages;
+    bool shadow_blocks;
+    sky_timestamp_t archive_age;
+    sky_timestamp_t retention_age;
+    sky_timestamp_t retention_timestamp;
+    bool log_structured;
+    uint32_t max_run_count;
 };
 
 
@@ -103,4 +194,38 @@ int sky_table_close(sky_table *table);
 
 int sky_table_add_event(sky_table *table, sky_event *event);
 
+int sky_table_add_events(sky_table *table, sky_event **events,
+    uint32_t event_count);
+
+
+//--------------------------------------
+// Shards
+//--------------------------------------
+
+int sky_table_get_shard(sky_table *table, sky_object_id_t object_id,
+    sky_data_file **ret);
+
+
+//--------------------------------------
+// Action Index
+//--------------------------------------
+
+int sky_table_rebuild_action_index(sky_table *table);
+
+
+//--------------------------------------
+// Write-Ahead Log
+//--------------------------------------
+
+int sky_table_checkpoint(sky_table *table);
+
+int sky_table_sync(sky_table *table);
+
+
+//--------------------------------------
+// Retention
+//--------------------------------------
+
+int sky_table_get_retention_timestamp(sky_table *table, sky_timestamp_t *ret);
+
 #endif
@@ -38,11 +38,15 @@
 //--------------------------------------
 
 // Stores an object identifier.
-#define sky_object_id_t uint32_t
+#define sky_object_id_t uint64_t
 
 #define SKY_OBJECT_ID_MIN 1
 
-#define SKY_OBJECT_ID_MAX UINT32_MAX
+#define SKY_OBJECT_ID_MAX UINT64_MAX
+
+// The largest object id that can be stored in a data file without wide
+// object ids.
+#define SKY_NARROW_OBJECT_ID_MAX UINT32_MAX
 
 
 //--------------------------------------
@@ -0,0 +1,134 @@
+#include <stdlib.h>
+
+#include "varint.h"
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Unsigned Int
+//--------------------------------------
+
+// Calculates the number of bytes needed to store an unsigned integer.
+//
+// value - The value.
+//
+// Returns the number of bytes.
+size_t sky_varint_sizeof(uint64_t value)
+{
+    size_t sz = 1;
+    while(value >= 0x80) {
+        value >>= 7;
+        sz++;
+    }
+    return sz;
+}
+
+// Calculates the number of bytes used by an integer stored at a given
+// memory address.
+//
+// ptr - A pointer to the raw integer.
+//
+// Returns the number of bytes.
+size_t sky_varint_sizeof_raw(void *ptr)
+{
+    uint8_t *p = (uint8_t*)ptr;
+    size_t sz = 1;
+    while((*p & 0x80) && sz < SKY_VARINT_MAX_LENGTH) {
+        p++;
+        sz++;
+    }
+    return sz;
+}
+
+// Reads an unsigned integer from a given memory address.
+//
+// ptr - A pointer to where the integer should be read from.
+// sz  - A pointer to where the number of bytes read should be stored.
+//
+// Returns the value of the integer.
+uint64_t sky_varint_unpack(void *ptr, size_t *sz)
+{
+    uint8_t *p = (uint8_t*)ptr;
+    uint64_t value = 0;
+    uint32_t shift = 0;
+    size_t _sz = 0;
+    while(_sz < SKY_VARINT_MAX_LENGTH) {
+        uint8_t byte = p[_sz++];
+        value |= ((uint64_t)(byte & 0x7F)) << shift;
+        if(!(byte & 0x80)) {
+            break;
+        }
+        shift += 7;
+    }
+
+    if(sz != NULL) {
+        *sz = _sz;
+    }
+    return value;
+}
+
+// Writes an unsigned integer to a given memory address.
+//
+// ptr   - A pointer to where the integer should be written to.
+// value - The value to write.
+// sz    - A pointer to where the number of bytes written should be stored.
+//
+// Returns nothing.
+void sky_varint_pack(void *ptr, uint64_t value, size_t *sz)
+{
+    uint8_t *p = (uint8_t*)ptr;
+    size_t _sz = 0;
+    while(value >= 0x80) {
+        p[_sz++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    p[_sz++] = (uint8_t)value;
+
+    if(sz != NULL) {
+        *sz = _sz;
+    }
+}
+
+
+//--------------------------------------
+// Signed Int
+//--------------------------------------
+
+// Calculates the number of bytes needed to store a signed integer.
+//
+// value - The value.
+//
+// Returns the number of bytes.
+size_t sky_varint_sizeof_signed(int64_t value)
+{
+    return sky_varint_sizeof(((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+// Reads a signed integer from a given memory address.
+//
+// ptr - A pointer to where the integer should be read from.
+// sz  - A pointer to where the number of bytes read should be stored.
+//
+// Returns the value of the integer.
+int64_t sky_varint_unpack_signed(void *ptr, size_t *sz)
+{
+    uint64_t value = sky_varint_unpack(ptr, sz);
+    return (int64_t)(value >> 1) ^ -((int64_t)(value & 1));
+}
+
+// Writes a signed integer to a given memory address.
+//
+// ptr   - A pointer to where the integer should be written to.
+// value - The value to write.
+// sz    - A pointer to where the number of bytes written should be stored.
+//
+// Returns nothing.
+void sky_varint_pack_signed(void *ptr, int64_t value, size_t *sz)
+{
+    sky_varint_pack(ptr, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63), sz);
+}
@@ -0,0 +1,61 @@
+#ifndef _varint_h
+#define _varint_h
+
+#include <inttypes.h>
+#include <stddef.h>
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// Variable-length integers store seven bits of a value in each byte, starting
+// with the least significant bits. The high bit of each byte is set when more
+// bytes follow. Small values take a single byte and a 64-bit value takes at
+// most ten bytes.
+//
+// Signed integers are zigzag encoded before they are written so that values
+// close to zero are small regardless of their sign.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+#define SKY_VARINT_MAX_LENGTH 10
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Unsigned Int
+//--------------------------------------
+
+size_t sky_varint_sizeof(uint64_t value);
+
+size_t sky_varint_sizeof_raw(void *ptr);
+
+uint64_t sky_varint_unpack(void *ptr, size_t *sz);
+
+void sky_varint_pack(void *ptr, uint64_t value, size_t *sz);
+
+
+//--------------------------------------
+// Signed Int
+//--------------------------------------
+
+size_t sky_varint_sizeof_signed(int64_t value);
+
+int64_t sky_varint_unpack_signed(void *ptr, size_t *sz);
+
+void sky_varint_pack_signed(void *ptr, int64_t value, size_t *sz);
+
+#endif
@@ -0,0 +1,629 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "dbg.h"
+#include "mem.h"
+#include "bstring.h"
+#include "file.h"
+#include "timestamp.h"
+#include "shard.h"
+#include "wal.h"
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+// This structure holds the records of a single shard while the log is
+// replayed. The records point into the log that was read into memory.
+typedef struct sky_wal_shard_replay {
+    sky_data_file *data_file;
+    void **records;
+    uint32_t record_count;
+    uint32_t record_capacity;
+    uint64_t lsn;
+    uint32_t count;
+    int rc;
+} sky_wal_shard_replay;
+
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+int sky_wal_replay_shard(sky_wal_shard_replay *shard);
+
+void *sky_wal_replay_shard_thread(void *arg);
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Creates a reference to a write-ahead log.
+//
+// Returns a reference to the new log if successful. Otherwise returns null.
+sky_wal *sky_wal_create()
+{
+    sky_wal *wal = calloc(sizeof(sky_wal), 1); check_mem(wal);
+    wal->group_size = SKY_WAL_DEFAULT_GROUP_SIZE;
+    wal->group_timeout = SKY_WAL_DEFAULT_GROUP_TIMEOUT;
+    wal->apply_threshold = SKY_WAL_DEFAULT_APPLY_THRESHOLD;
+    return wal;
+
+error:
+    sky_wal_free(wal);
+    return NULL;
+}
+
+// Removes a write-ahead log reference from memory. The log is synced and
+// closed if it is open.
+//
+// wal - The log to free.
+void sky_wal_free(sky_wal *wal)
+{
+    if(wal) {
+        sky_wal_close(wal);
+        if(wal->path) bdestroy(wal->path);
+        wal->path = NULL;
+        free(wal);
+    }
+}
+
+
+//--------------------------------------
+// Path
+//--------------------------------------
+
+// Sets the file path of a write-ahead log.
+//
+// wal  - The log.
+// path - The file path to set.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_set_path(sky_wal *wal, bstring path)
+{
+    check(wal != NULL, "WAL required");
+
+    if(wal->path) {
+        bdestroy(wal->path);
+    }
+
+    wal->path = bstrcpy(path);
+    if(path) check_mem(wal->path);
+
+    return 0;
+
+error:
+    wal->path = NULL;
+    return -1;
+}
+
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+// Opens the log file for appending. The file is created if it does not exist.
+//
+// wal - The log to open.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_open(sky_wal *wal)
+{
+    check(wal != NULL, "WAL required");
+    check(wal->path != NULL, "WAL path required");
+    check(wal->fd == 0, "WAL is already open");
+
+    wal->fd = open(bdata(wal->path), O_RDWR | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+    check(wal->fd != -1, "Failed to open WAL: %s", bdata(wal->path));
+
+    wal->pending_count = 0;
+    wal->record_count = 0;
+    sky_timestamp_now(&wal->last_sync);
+
+    return 0;
+
+error:
+    wal->fd = 0;
+    return -1;
+}
+
+// Syncs any pending records and closes the log file.
+//
+// wal - The log to close.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_close(sky_wal *wal)
+{
+    int rc;
+    check(wal != NULL, "WAL required");
+
+    if(wal->fd > 0) {
+        rc = sky_wal_sync(wal);
+        check(rc == 0, "Unable to sync WAL");
+        close(wal->fd);
+    }
+    wal->fd = 0;
+
+    return 0;
+
+error:
+    if(wal->fd > 0) close(wal->fd);
+    wal->fd = 0;
+    return -1;
+}
+
+
+//--------------------------------------
+// Logging
+//--------------------------------------
+
+// Appends an event to the log. The record is written to the file immediately
+// but is only synced to disk once the current group is committed.
+//
+// wal   - The log.
+// event - The event to append.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_append(sky_wal *wal, sky_event *event)
+{
+    int rc;
+    size_t sz;
+    off_t offset = -1;
+    void *buffer = NULL;
+    check(wal != NULL, "WAL required");
+    check(wal->fd > 0, "WAL must be open to append");
+    check(event != NULL, "Event required");
+    check(event->object_id != 0, "Event object id required");
+
+    // Allocate space for the record.
+    uint32_t length = sizeof(uint64_t) + sizeof(sky_object_id_t) + sky_event_sizeof(event);
+    size_t record_length = SKY_WAL_RECORD_HEADER_LENGTH + length;
+    buffer = malloc(record_length); check_mem(buffer);
+
+    // Pack the LSN, the object id and the event after the record header.
+    uint64_t lsn = wal->lsn + 1;
+    void *ptr = buffer + SKY_WAL_RECORD_HEADER_LENGTH;
+    memwrite(ptr, &lsn, sizeof(lsn), "LSN");
+    memwrite(ptr, &event->object_id, sizeof(event->object_id), "object id");
+    rc = sky_event_pack(event, ptr, &sz);
+    check(rc == 0, "Unable to pack event");
+    check(sizeof(uint64_t) + sizeof(sky_object_id_t) + sz == length, "Unexpected event size: %ld", sz);
+
+    // Write the record header.
+    *((uint32_t*)buffer) = length;
+    *((uint32_t*)(buffer + sizeof(uint32_t))) = sky_wal_checksum(buffer + SKY_WAL_RECORD_HEADER_LENGTH, length);
+
+    // Write the record to the log. A record that can't be written completely
+    // is cut off again so that the next record doesn't follow torn bytes.
+    offset = lseek(wal->fd, 0, SEEK_END);
+    check(offset != -1, "Unable to determine WAL length");
+    size_t written = 0;
+    while(written < record_length) {
+        ssize_t bytes = write(wal->fd, buffer + written, record_length - written);
+        if(bytes == -1 && errno == EINTR) {
+            continue;
+        }
+        check(bytes > 0, "Unable to write WAL record: %s", bdata(wal->path));
+        written += bytes;
+    }
+    offset = -1;
+    free(buffer);
+    buffer = NULL;
+
+    wal->lsn = lsn;
+    wal->pending_count++;
+    wal->record_count++;
+
+    // Commit the group if it is full or if it has been open too long.
+    sky_timestamp_t now;
+    sky_timestamp_now(&now);
+    if(wal->pending_count >= wal->group_size || now - wal->last_sync >= wal->group_timeout) {
+        rc = sky_wal_sync(wal);
+        check(rc == 0, "Unable to sync WAL");
+    }
+
+    return 0;
+
+error:
+    if(offset != -1) {
+        if(ftruncate(wal->fd, offset) != 0) {
+            log_err("Unable to remove partial WAL record: %s", bdata(wal->path));
+        }
+    }
+    if(buffer) free(buffer);
+    return -1;
+}
+
+// Commits the current group by syncing all written records to disk.
+//
+// wal - The log.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_sync(sky_wal *wal)
+{
+    int rc;
+    check(wal != NULL, "WAL required");
+    check(wal->fd > 0, "WAL must be open to sync");
+
+    if(wal->pending_count > 0) {
+        rc = fsync(wal->fd);
+        check(rc == 0, "Unable to sync WAL: %s", bdata(wal->path));
+    }
+
+    wal->pending_count = 0;
+    sky_timestamp_now(&wal->last_sync);
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+// Commits the current group if it has been open for at least the group
+// timeout. This bounds how long a record stays unsynced when too few records
+// are appended to fill a group.
+//
+// wal - The log.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_sync_if_due(sky_wal *wal)
+{
+    int rc;
+    check(wal != NULL, "WAL required");
+
+    sky_timestamp_t delay;
+    rc = sky_wal_get_sync_delay(wal, &delay);
+    check(rc == 0, "Unable to determine WAL sync delay");
+    if(wal->pending_count > 0 && delay == 0) {
+        rc = sky_wal_sync(wal);
+        check(rc == 0, "Unable to sync WAL");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Calculates the time left before the current group must be committed.
+//
+// wal - The log.
+// ret - A pointer to where the delay is returned in microseconds. This is
+//       zero once the group is due.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_get_sync_delay(sky_wal *wal, sky_timestamp_t *ret)
+{
+    int rc;
+    check(wal != NULL, "WAL required");
+    check(ret != NULL, "Return address required");
+
+    sky_timestamp_t now;
+    rc = sky_timestamp_now(&now);
+    check(rc == 0, "Unable to determine current time");
+    sky_timestamp_t elapsed = now - wal->last_sync;
+    *ret = (elapsed < wal->group_timeout ? wal->group_timeout - elapsed : 0);
+
+    return 0;
+
+error:
+    if(ret != NULL) *ret = 0;
+    return -1;
+}
+
+
+//--------------------------------------
+// Replay
+//--------------------------------------
+
+// Applies every complete record in the log to a data file. Replay stops at the
+// first incomplete or corrupt record. Events are added to the data file in
+// batches so that each block is rewritten once per batch.
+//
+// wal       - The log.
+// data_file - The data file to add the events to.
+// count     - A pointer to where the number of applied events is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_replay(sky_wal *wal, sky_data_file *data_file, uint32_t *count)
+{
+    check(data_file != NULL, "Data file required");
+    return sky_wal_replay_shards(wal, &data_file, 1, count);
+
+error:
+    if(count != NULL) *count = 0;
+    return -1;
+}
+
+// Applies every complete record in the log to the data files of a sharded
+// table. Each event is added to the data file of its object's shard. Replay
+// stops at the first incomplete or corrupt record.
+//
+// The log is read and split into a list of records per shard first. The
+// shards are then applied at the same time with one worker thread per shard
+// that has records. A shard's events are added in batches so that each block
+// is rewritten once per batch. Shards share no data so the workers don't
+// need to lock anything.
+//
+// Records at or below the applied LSN of a shard's data file are skipped
+// since the data file or one of its runs already holds them. The LSN of the
+// last record applied to a data file is set on it so that it is saved with
+// the blocks on the next flush. The log continues numbering records after
+// the last LSN that it reads.
+//
+// wal         - The log.
+// data_files  - The data files of the shards.
+// shard_count - The number of shards.
+// count       - A pointer to where the number of applied events is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_replay_shards(sky_wal *wal, sky_data_file **data_files,
+                          uint32_t shard_count, uint32_t *count)
+{
+    int rc;
+    uint32_t i;
+    void *buffer = NULL;
+    sky_wal_shard_replay *shards = NULL;
+    pthread_t *threads = NULL;
+    bool *started = NULL;
+    check(wal != NULL, "WAL required");
+    check(wal->fd > 0, "WAL must be open to replay");
+    check(data_files != NULL && shard_count > 0, "Data files required");
+    for(i=0; i<shard_count; i++) {
+        check(data_files[i] != NULL, "Data file required for shard: %d", i);
+    }
+
+    uint32_t _count = 0;
+
+    // Read the entire log into memory.
+    off_t file_length = lseek(wal->fd, 0, SEEK_END);
+    check(file_length != -1, "Unable to determine WAL length");
+    if(file_length == 0) {
+        if(count != NULL) *count = 0;
+        return 0;
+    }
+    buffer = malloc(file_length); check_mem(buffer);
+    ssize_t bytes = pread(wal->fd, buffer, file_length, 0);
+    check(bytes == file_length, "Unable to read WAL: %s", bdata(wal->path));
+
+    shards = calloc(shard_count, sizeof(*shards)); check_mem(shards);
+    threads = calloc(shard_count, sizeof(*threads)); check_mem(threads);
+    started = calloc(shard_count, sizeof(*started)); check_mem(started);
+    for(i=0; i<shard_count; i++) {
+        shards[i].data_file = data_files[i];
+        shards[i].lsn = sky_data_file_get_applied_lsn(data_files[i]);
+        if(shards[i].lsn > wal->lsn) {
+            wal->lsn = shards[i].lsn;
+        }
+    }
+
+    // Split the records that the shards don't hold yet by shard.
+    void *ptr = buffer;
+    void *endptr = buffer + file_length;
+    while(ptr + SKY_WAL_RECORD_HEADER_LENGTH + sizeof(uint64_t) + sizeof(sky_object_id_t) <= endptr) {
+        uint32_t length = *((uint32_t*)ptr);
+        uint32_t checksum = *((uint32_t*)(ptr + sizeof(uint32_t)));
+        void *record_ptr = ptr + SKY_WAL_RECORD_HEADER_LENGTH;
+
+        // Stop at the first partially written record.
+        if(length < sizeof(uint64_t) + sizeof(sky_object_id_t) || record_ptr + length > endptr || sky_wal_checksum(record_ptr, length) != checksum) {
+            log_warn("Ignoring incomplete WAL record at byte %ld: %s", (long)(ptr - buffer), bdata(wal->path));
+            break;
+        }
+
+        uint64_t lsn;
+        sky_object_id_t object_id;
+        memcpy(&lsn, record_ptr, sizeof(lsn));
+        memcpy(&object_id, record_ptr + sizeof(lsn), sizeof(object_id));
+        if(lsn > wal->lsn) {
+            wal->lsn = lsn;
+        }
+
+        // Skip records that the shard already holds.
+        sky_wal_shard_replay *shard = &shards[sky_shard_get_index(object_id, shard_count)];
+        if(lsn > shard->lsn) {
+            if(shard->record_count == shard->record_capacity) {
+                shard->record_capacity = (shard->record_capacity > 0 ? shard->record_capacity * 2 : SKY_WAL_REPLAY_BATCH_SIZE);
+                shard->records = realloc(shard->records, shard->record_capacity * sizeof(*shard->records));
+                check_mem(shard->records);
+            }
+            shard->records[shard->record_count++] = record_ptr;
+            shard->lsn = lsn;
+        }
+        ptr = record_ptr + length;
+    }
+
+    // Apply each shard on its own thread. A table with a single shard is
+    // applied on the calling thread.
+    for(i=0; i<shard_count; i++) {
+        if(shards[i].record_count > 0) {
+            if(shard_count > 1) {
+                rc = pthread_create(&threads[i], NULL, sky_wal_replay_shard_thread, &shards[i]);
+                check(rc == 0, "Unable to start replay thread for shard: %d", i);
+                started[i] = true;
+            }
+            else {
+                shards[i].rc = sky_wal_replay_shard(&shards[i]);
+            }
+        }
+    }
+    for(i=0; i<shard_count; i++) {
+        if(started[i]) {
+            pthread_join(threads[i], NULL);
+            started[i] = false;
+        }
+    }
+    for(i=0; i<shard_count; i++) {
+        check(shards[i].rc == 0, "Unable to apply WAL events for shard: %d", i);
+        _count += shards[i].count;
+    }
+
+    for(i=0; i<shard_count; i++) {
+        free(shards[i].records);
+    }
+    free(shards);
+    free(threads);
+    free(started);
+    free(buffer);
+    if(count != NULL) *count = _count;
+    return 0;
+
+error:
+    if(started) {
+        for(i=0; i<shard_count; i++) {
+            if(started[i]) pthread_join(threads[i], NULL);
+        }
+        free(started);
+    }
+    if(shards) {
+        for(i=0; i<shard_count; i++) {
+            free(shards[i].records);
+        }
+        free(shards);
+    }
+    if(threads) free(threads);
+    if(buffer) free(buffer);
+    if(count != NULL) *count = 0;
+    return -1;
+}
+
+// Adds the records of a shard to its data file in batches. The applied LSN
+// of the data file is set after each batch.
+//
+// shard - The shard's records and data file.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_replay_shard(sky_wal_shard_replay *shard)
+{
+    int rc;
+    size_t sz;
+    uint32_t i, j;
+    uint32_t event_count = 0;
+    sky_event **events = NULL;
+    check(shard != NULL, "Shard required");
+
+    events = calloc(SKY_WAL_REPLAY_BATCH_SIZE, sizeof(*events)); check_mem(events);
+
+    for(i=0; i<shard->record_count; i++) {
+        uint64_t lsn;
+        void *record_ptr = shard->records[i];
+        sky_event *event = sky_event_create(0, 0, 0); check_mem(event);
+        events[event_count++] = event;
+        memread(record_ptr, &lsn, sizeof(lsn), "LSN");
+        memread(record_ptr, &event->object_id, sizeof(event->object_id), "object id");
+        rc = sky_event_unpack(event, record_ptr, &sz);
+        check(rc == 0, "Unable to unpack WAL event");
+
+        // Apply the batch once it is full or the shard's records are read.
+        if(event_count == SKY_WAL_REPLAY_BATCH_SIZE || i == shard->record_count - 1) {
+            rc = sky_data_file_add_events(shard->data_file, events, event_count);
+            check(rc == 0, "Unable to apply WAL events");
+            rc = sky_data_file_set_lsn(shard->data_file, lsn);
+            check(rc == 0, "Unable to set applied LSN");
+
+            for(j=0; j<event_count; j++) {
+                sky_event_free(events[j]);
+                events[j] = NULL;
+            }
+            shard->count += event_count;
+            event_count = 0;
+        }
+    }
+
+    free(events);
+    return 0;
+
+error:
+    if(events) {
+        for(j=0; j<event_count; j++) {
+            sky_event_free(events[j]);
+        }
+        free(events);
+    }
+    return -1;
+}
+
+// Applies the records of a shard on a replay worker thread. The result is
+// stored on the shard.
+//
+// arg - The shard's records and data file.
+//
+// Returns null.
+void *sky_wal_replay_shard_thread(void *arg)
+{
+    sky_wal_shard_replay *shard = arg;
+    shard->rc = sky_wal_replay_shard(shard);
+    return NULL;
+}
+
+// Removes all records from the log. This should only be done after the
+// logged events have been applied and flushed to the data file.
+//
+// wal - The log.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_wal_truncate(sky_wal *wal)
+{
+    int rc;
+    check(wal != NULL, "WAL required");
+    check(wal->fd > 0, "WAL must be open to truncate");
+
+    // Only truncate if there is something in the log.
+    off_t file_length = lseek(wal->fd, 0, SEEK_END);
+    check(file_length != -1, "Unable to determine WAL length");
+    if(file_length > 0) {
+        rc = ftruncate(wal->fd, 0);
+        check(rc == 0, "Unable to truncate WAL: %s", bdata(wal->path));
+        rc = fsync(wal->fd);
+        check(rc == 0, "Unable to sync WAL: %s", bdata(wal->path));
+    }
+
+    wal->pending_count = 0;
+    wal->record_count = 0;
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Checksum
+//--------------------------------------
+
+// Calculates a 32-bit FNV-1a hash over a range of bytes.
+//
+// ptr - A pointer to the bytes.
+// sz  - The number of bytes.
+//
+// Returns the hash.
+uint32_t sky_wal_checksum(void *ptr, size_t sz)
+{
+    uint32_t hash = 2166136261U;
+    uint8_t *bytes = (uint8_t*)ptr;
+    size_t i;
+    for(i=0; i<sz; i++) {
+        hash ^= bytes[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
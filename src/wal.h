@@ -0,0 +1,143 @@
+#ifndef _wal_h
+#define _wal_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+typedef struct sky_wal sky_wal;
+
+#include "bstring.h"
+#include "types.h"
+#include "event.h"
+#include "data_file.h"
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// The write-ahead log (WAL) is an append-only file of events that have been
+// accepted by a table but not yet applied to its data file. Each record is
+// stored as:
+//
+//     LENGTH (4-bytes) CHECKSUM (4-bytes) LSN (8-bytes) OBJECT_ID (8-bytes)
+//     EVENT
+//
+// The length covers the LSN, the object id and the packed event and the
+// checksum is an FNV-1a hash of the same bytes. A record with an invalid
+// length or checksum marks the end of the log since it was only partially
+// written.
+//
+// Each record is given a log sequence number (LSN) that is one more than the
+// LSN of the previous record. LSNs keep increasing after the log is
+// truncated. Replay records the LSN of the last record applied to each data
+// file and skips the records at or below the LSN that a data file already
+// holds, so a log that was applied and flushed but not truncated before a
+// crash can be replayed again without duplicating its events.
+//
+// Records are synced to disk in groups. A group is committed once it reaches
+// a set number of records or once a set amount of time has passed since the
+// previous commit, whichever comes first. A group that doesn't fill up is
+// committed by sky_wal_sync_if_due() which the server calls while it waits
+// for connections so records are never left unsynced for much longer than
+// the group timeout. Logged events are applied to the data file in batches
+// and the log is truncated once the data file has been flushed.
+//
+// A sharded table keeps a single log. Events are routed to the data file of
+// their object's shard when the log is replayed. The shards are applied in
+// parallel, each on its own worker thread, since they don't share any data.
+
+
+//==============================================================================
+//
+// Typedefs
+//
+//==============================================================================
+
+#define SKY_WAL_RECORD_HEADER_LENGTH (sizeof(uint32_t) + sizeof(uint32_t))
+
+#define SKY_WAL_DEFAULT_GROUP_SIZE 64
+
+#define SKY_WAL_DEFAULT_GROUP_TIMEOUT 10000
+
+#define SKY_WAL_DEFAULT_APPLY_THRESHOLD 10000
+
+#define SKY_WAL_REPLAY_BATCH_SIZE 1000
+
+struct sky_wal {
+    bstring path;
+    int fd;
+    uint32_t group_size;
+    sky_timestamp_t group_timeout;
+    uint32_t apply_threshold;
+    uint32_t pending_count;
+    uint32_t record_count;
+    uint64_t lsn;
+    sky_timestamp_t last_sync;
+};
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+sky_wal *sky_wal_create();
+
+void sky_wal_free(sky_wal *wal);
+
+
+//--------------------------------------
+// Path
+//--------------------------------------
+
+int sky_wal_set_path(sky_wal *wal, bstring path);
+
+
+//--------------------------------------
+// State
+//--------------------------------------
+
+int sky_wal_open(sky_wal *wal);
+
+int sky_wal_close(sky_wal *wal);
+
+
+//--------------------------------------
+// Logging
+//--------------------------------------
+
+int sky_wal_append(sky_wal *wal, sky_event *event);
+
+int sky_wal_sync(sky_wal *wal);
+
+int sky_wal_sync_if_due(sky_wal *wal);
+
+int sky_wal_get_sync_delay(sky_wal *wal, sky_timestamp_t *ret);
+
+
+//--------------------------------------
+// Replay
+//--------------------------------------
+
+int sky_wal_replay(sky_wal *wal, sky_data_file *data_file, uint32_t *count);
+
+int sky_wal_replay_shards(sky_wal *wal, sky_data_file **data_files,
+    uint32_t shard_count, uint32_t *count);
+
+int sky_wal_truncate(sky_wal *wal);
+
+
+//--------------------------------------
+// Checksum
+//--------------------------------------
+
+uint32_t sky_wal_checksum(void *ptr, size_t sz);
+
+#endif
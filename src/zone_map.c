@@ -0,0 +1,361 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dbg.h"
+#include "mem.h"
+#include "property.h"
+#include "zone_map.h"
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+#define SKY_ZONE_MAP_PROPERTY_SIZE sizeof(sky_property_id_t) + sizeof(uint8_t) + (sizeof(double) * 2)
+
+
+//==============================================================================
+//
+// Forward Declarations
+//
+//==============================================================================
+
+sky_zone_map_property *sky_zone_map_find_property(sky_zone_map *zone_map,
+    sky_property_id_t property_id);
+
+int sky_zone_map_add_value(sky_zone_map *zone_map,
+    sky_property_id_t property_id, bool bounded, double min_value,
+    double max_value);
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+// Initializes an empty zone map.
+//
+// zone_map - The zone map.
+void sky_zone_map_init(sky_zone_map *zone_map)
+{
+    memset(zone_map, 0, sizeof(*zone_map));
+}
+
+// Removes every action and property from a zone map and frees its property
+// ranges.
+//
+// zone_map - The zone map.
+void sky_zone_map_clear(sky_zone_map *zone_map)
+{
+    if(zone_map) {
+        free(zone_map->properties);
+        sky_zone_map_init(zone_map);
+    }
+}
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+// Calculates the number of bytes needed to store a zone map.
+//
+// zone_map - The zone map.
+//
+// Returns the number of bytes required to store the zone map.
+size_t sky_zone_map_sizeof(sky_zone_map *zone_map)
+{
+    return SKY_ZONE_MAP_ACTION_BITMAP_SIZE + sizeof(uint32_t) + (zone_map->property_count * (SKY_ZONE_MAP_PROPERTY_SIZE));
+}
+
+// Packs a zone map into memory. The action bitmap is written first and is
+// followed by the property count and the range of each property.
+//
+// zone_map - The zone map.
+// ptr      - The pointer to write to.
+// sz       - A pointer to where the number of bytes written is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_zone_map_pack(sky_zone_map *zone_map, void *ptr, size_t *sz)
+{
+    check(zone_map != NULL, "Zone map required");
+    check(ptr != NULL, "Pointer required");
+    void *start = ptr;
+
+    memcpy(ptr, zone_map->actions, SKY_ZONE_MAP_ACTION_BITMAP_SIZE);
+    ptr += SKY_ZONE_MAP_ACTION_BITMAP_SIZE;
+    *((uint32_t*)ptr) = zone_map->property_count;
+    ptr += sizeof(uint32_t);
+
+    uint32_t i;
+    for(i=0; i<zone_map->property_count; i++) {
+        sky_zone_map_property *property = &zone_map->properties[i];
+        *((sky_property_id_t*)ptr) = property->property_id;
+        ptr += sizeof(sky_property_id_t);
+        *((uint8_t*)ptr) = (property->bounded ? 1 : 0);
+        ptr += sizeof(uint8_t);
+        memcpy(ptr, &property->min_value, sizeof(double));
+        ptr += sizeof(double);
+        memcpy(ptr, &property->max_value, sizeof(double));
+        ptr += sizeof(double);
+    }
+
+    if(sz != NULL) {
+        *sz = ptr - start;
+    }
+    return 0;
+
+error:
+    if(sz != NULL) *sz = 0;
+    return -1;
+}
+
+// Unpacks a zone map from memory. Any existing ranges in the zone map are
+// replaced.
+//
+// zone_map - The zone map.
+// ptr      - The pointer to read from.
+// length   - The number of bytes available to read.
+// sz       - A pointer to where the number of bytes read is returned.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_zone_map_unpack(sky_zone_map *zone_map, void *ptr, size_t length,
+                        size_t *sz)
+{
+    check(zone_map != NULL, "Zone map required");
+    check(ptr != NULL, "Pointer required");
+    void *start = ptr;
+
+    sky_zone_map_clear(zone_map);
+    check(length >= SKY_ZONE_MAP_ACTION_BITMAP_SIZE + sizeof(uint32_t), "Zone map is truncated");
+    memcpy(zone_map->actions, ptr, SKY_ZONE_MAP_ACTION_BITMAP_SIZE);
+    ptr += SKY_ZONE_MAP_ACTION_BITMAP_SIZE;
+    uint32_t property_count = *((uint32_t*)ptr);
+    ptr += sizeof(uint32_t);
+    check(property_count <= (length - (ptr - start)) / (SKY_ZONE_MAP_PROPERTY_SIZE), "Zone map properties are truncated");
+
+    if(property_count > 0) {
+        zone_map->properties = calloc(property_count, sizeof(*zone_map->properties));
+        check_mem(zone_map->properties);
+    }
+    zone_map->property_count = property_count;
+
+    uint32_t i;
+    for(i=0; i<property_count; i++) {
+        sky_zone_map_property *property = &zone_map->properties[i];
+        property->property_id = *((sky_property_id_t*)ptr);
+        ptr += sizeof(sky_property_id_t);
+        property->bounded = (*((uint8_t*)ptr) != 0);
+        ptr += sizeof(uint8_t);
+        memcpy(&property->min_value, ptr, sizeof(double));
+        ptr += sizeof(double);
+        memcpy(&property->max_value, ptr, sizeof(double));
+        ptr += sizeof(double);
+    }
+
+    if(sz != NULL) {
+        *sz = ptr - start;
+    }
+    return 0;
+
+error:
+    sky_zone_map_clear(zone_map);
+    if(sz != NULL) *sz = 0;
+    return -1;
+}
+
+
+//--------------------------------------
+// Updates
+//--------------------------------------
+
+// Adds the action and property values of an event to a zone map.
+//
+// zone_map - The zone map.
+// event    - The event to add.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_zone_map_add_event(sky_zone_map *zone_map, sky_event *event)
+{
+    int rc;
+    check(zone_map != NULL, "Zone map required");
+    check(event != NULL, "Event required");
+
+    if(event->action_id != 0) {
+        uint32_t bit = event->action_id % SKY_ZONE_MAP_ACTION_BIT_COUNT;
+        zone_map->actions[bit / 8] |= (1 << (bit % 8));
+    }
+
+    uint32_t i;
+    for(i=0; i<event->data_count; i++) {
+        sky_event_data *data = event->data[i];
+        if(data->data_type == &SKY_DATA_TYPE_INT) {
+            rc = sky_zone_map_add_value(zone_map, data->key, true, (double)data->int_value, (double)data->int_value);
+        }
+        else if(data->data_type == &SKY_DATA_TYPE_FLOAT) {
+            rc = sky_zone_map_add_value(zone_map, data->key, true, data->float_value, data->float_value);
+        }
+        else {
+            rc = sky_zone_map_add_value(zone_map, data->key, false, 0, 0);
+        }
+        check(rc == 0, "Unable to add property value to zone map");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Adds the actions and property ranges of one zone map to another.
+//
+// zone_map - The zone map to update.
+// source   - The zone map to add.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_zone_map_merge(sky_zone_map *zone_map, sky_zone_map *source)
+{
+    int rc;
+    check(zone_map != NULL, "Zone map required");
+    check(source != NULL, "Source zone map required");
+
+    uint32_t i;
+    for(i=0; i<SKY_ZONE_MAP_ACTION_BITMAP_SIZE; i++) {
+        zone_map->actions[i] |= source->actions[i];
+    }
+    for(i=0; i<source->property_count; i++) {
+        sky_zone_map_property *property = &source->properties[i];
+        rc = sky_zone_map_add_value(zone_map, property->property_id, property->bounded, property->min_value, property->max_value);
+        check(rc == 0, "Unable to merge property range");
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+// Finds the range of a property in a zone map.
+//
+// zone_map    - The zone map.
+// property_id - The property id to find.
+//
+// Returns the property range or NULL if the property is not in the zone map.
+sky_zone_map_property *sky_zone_map_find_property(sky_zone_map *zone_map,
+                                                  sky_property_id_t property_id)
+{
+    uint32_t i;
+    for(i=0; i<zone_map->property_count; i++) {
+        if(zone_map->properties[i].property_id == property_id) {
+            return &zone_map->properties[i];
+        }
+    }
+    return NULL;
+}
+
+// Widens the range of a property to include a range of values. The property
+// is added if it is not already in the zone map.
+//
+// zone_map    - The zone map.
+// property_id - The property id.
+// bounded     - A flag stating if the values are numeric.
+// min_value   - The smallest value.
+// max_value   - The largest value.
+//
+// Returns 0 if successful, otherwise returns -1.
+int sky_zone_map_add_value(sky_zone_map *zone_map,
+                           sky_property_id_t property_id, bool bounded,
+                           double min_value, double max_value)
+{
+    sky_zone_map_property *property = sky_zone_map_find_property(zone_map, property_id);
+    if(property == NULL) {
+        zone_map->properties = realloc(zone_map->properties, sizeof(*zone_map->properties) * (zone_map->property_count+1));
+        check_mem(zone_map->properties);
+        property = &zone_map->properties[zone_map->property_count++];
+        property->property_id = property_id;
+        property->bounded = bounded;
+        property->min_value = min_value;
+        property->max_value = max_value;
+    }
+    else if(!bounded) {
+        property->bounded = false;
+    }
+    else {
+        if(min_value < property->min_value) {
+            property->min_value = min_value;
+        }
+        if(max_value > property->max_value) {
+            property->max_value = max_value;
+        }
+    }
+
+    return 0;
+
+error:
+    return -1;
+}
+
+
+//--------------------------------------
+// Predicates
+//--------------------------------------
+
+// Checks if a predicate has no conditions.
+//
+// predicate - The predicate.
+//
+// Returns true if the predicate matches every event.
+bool sky_zone_map_predicate_is_empty(sky_zone_map_predicate *predicate)
+{
+    return (predicate == NULL || (predicate->action_id == 0 && predicate->property_id == 0 && !sky_zone_map_predicate_has_window(predicate)));
+}
+
+// Checks if a predicate limits events to a time window.
+//
+// predicate - The predicate.
+//
+// Returns true if the predicate has a time window.
+bool sky_zone_map_predicate_has_window(sky_zone_map_predicate *predicate)
+{
+    return (predicate != NULL && predicate->end_timestamp > predicate->start_timestamp);
+}
+
+// Checks if a zone map could contain an event that matches a predicate.
+//
+// zone_map  - The zone map.
+// predicate - The predicate.
+//
+// Returns false if no event in the zone map can match the predicate.
+bool sky_zone_map_matches(sky_zone_map *zone_map,
+                          sky_zone_map_predicate *predicate)
+{
+    if(predicate == NULL) {
+        return true;
+    }
+
+    if(predicate->action_id != 0) {
+        uint32_t bit = predicate->action_id % SKY_ZONE_MAP_ACTION_BIT_COUNT;
+        if((zone_map->actions[bit / 8] & (1 << (bit % 8))) == 0) {
+            return false;
+        }
+    }
+
+    if(predicate->property_id != 0) {
+        sky_zone_map_property *property = sky_zone_map_find_property(zone_map, predicate->property_id);
+        if(property == NULL) {
+            return false;
+        }
+        if(property->bounded && (property->max_value < predicate->min_value || property->min_value > predicate->max_value)) {
+            return false;
+        }
+    }
+
+    return true;
+}
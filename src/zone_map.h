@@ -0,0 +1,121 @@
+#ifndef _zone_map_h
+#define _zone_map_h
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "types.h"
+#include "event.h"
+
+
+//==============================================================================
+//
+// Overview
+//
+//==============================================================================
+
+// A zone map is a synopsis of the events stored in a block. It records which
+// action ids occur in the block and the range of values of each numeric
+// property so that a query can skip a block that cannot contain a matching
+// event without reading its paths.
+//
+// Action ids are stored in a fixed-size bitmap indexed by the action id modulo
+// the number of bits in the bitmap. Two actions can share a bit so the bitmap
+// can report an action that is not in the block but never misses one that is.
+//
+// Int and float values are tracked as a single numeric range per property.
+// A property that also has string or boolean values is marked as unbounded
+// and never causes a block to be skipped.
+
+
+//==============================================================================
+//
+// Definitions
+//
+//==============================================================================
+
+#define SKY_ZONE_MAP_ACTION_BITMAP_SIZE 32
+
+#define SKY_ZONE_MAP_ACTION_BIT_COUNT (SKY_ZONE_MAP_ACTION_BITMAP_SIZE * 8)
+
+// The range of values of a single property within a block.
+typedef struct sky_zone_map_property {
+    sky_property_id_t property_id;
+    bool bounded;
+    double min_value;
+    double max_value;
+} sky_zone_map_property;
+
+typedef struct sky_zone_map {
+    uint8_t actions[SKY_ZONE_MAP_ACTION_BITMAP_SIZE];
+    sky_zone_map_property *properties;
+    uint32_t property_count;
+} sky_zone_map;
+
+// A declared condition that every event of interest to a query meets. An
+// action id of zero matches any action and a property id of zero matches any
+// property values. The property range is inclusive.
+//
+// The time window covers timestamps from the start timestamp up to but not
+// including the end timestamp. It is only applied if the end timestamp is
+// greater than the start timestamp. The window is checked against the
+// timestamp range of a block rather than its zone map.
+typedef struct sky_zone_map_predicate {
+    sky_action_id_t action_id;
+    sky_property_id_t property_id;
+    double min_value;
+    double max_value;
+    sky_timestamp_t start_timestamp;
+    sky_timestamp_t end_timestamp;
+} sky_zone_map_predicate;
+
+
+//==============================================================================
+//
+// Functions
+//
+//==============================================================================
+
+//--------------------------------------
+// Lifecycle
+//--------------------------------------
+
+void sky_zone_map_init(sky_zone_map *zone_map);
+
+void sky_zone_map_clear(sky_zone_map *zone_map);
+
+
+//--------------------------------------
+// Serialization
+//--------------------------------------
+
+size_t sky_zone_map_sizeof(sky_zone_map *zone_map);
+
+int sky_zone_map_pack(sky_zone_map *zone_map, void *ptr, size_t *sz);
+
+int sky_zone_map_unpack(sky_zone_map *zone_map, void *ptr, size_t length,
+    size_t *sz);
+
+
+//--------------------------------------
+// Updates
+//--------------------------------------
+
+int sky_zone_map_add_event(sky_zone_map *zone_map, sky_event *event);
+
+int sky_zone_map_merge(sky_zone_map *zone_map, sky_zone_map *source);
+
+
+//--------------------------------------
+// Predicates
+//--------------------------------------
+
+bool sky_zone_map_predicate_is_empty(sky_zone_map_predicate *predicate);
+
+bool sky_zone_map_predicate_has_window(sky_zone_map_predicate *predicate);
+
+bool sky_zone_map_matches(sky_zone_map *zone_map,
+    sky_zone_map_predicate *predicate);
+
+#endif
@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <action_index.h>
+#include <mem.h>
+#include <bstring.h>
+
+#include "minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Object Management
+//--------------------------------------
+
+int test_sky_action_index_add() {
+    sky_object_id_t object_id;
+    bool found;
+
+    sky_action_index *index = sky_action_index_create();
+
+    // Objects are kept in order and duplicates are ignored.
+    mu_assert_int_equals(sky_action_index_add(index, 2, 30), 0);
+    mu_assert_int_equals(sky_action_index_add(index, 2, 10), 0);
+    mu_assert_int_equals(sky_action_index_add(index, 2, 20), 0);
+    mu_assert_int_equals(sky_action_index_add(index, 2, 10), 0);
+    mu_assert_int_equals(sky_action_index_add(index, 1, 20), 0);
+    mu_assert_int_equals(index->set_count, 2);
+    mu_assert_int_equals(index->sets[0].action_id, 1);
+    mu_assert_int_equals(index->sets[1].action_id, 2);
+    mu_assert_int_equals(index->sets[1].count, 3);
+    mu_assert_int64_equals(index->sets[1].object_ids[0], 10LL);
+    mu_assert_int64_equals(index->sets[1].object_ids[1], 20LL);
+    mu_assert_int64_equals(index->sets[1].object_ids[2], 30LL);
+
+    // Lookups.
+    mu_assert_int_equals(sky_action_index_contains(index, 2, 20, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int_equals(sky_action_index_contains(index, 1, 10, &found), 0);
+    mu_assert_bool(!found);
+    mu_assert_int_equals(sky_action_index_contains(index, 3, 10, &found), 0);
+    mu_assert_bool(!found);
+    mu_assert_int_equals(sky_action_index_find_next(index, 2, 11, &object_id), 0);
+    mu_assert_int64_equals(object_id, 20LL);
+    mu_assert_int_equals(sky_action_index_find_next(index, 2, 31, &object_id), 0);
+    mu_assert_int64_equals(object_id, 0LL);
+
+    sky_action_index_free(index);
+    return 0;
+}
+
+
+//--------------------------------------
+// Persistence
+//--------------------------------------
+
+int test_sky_action_index_load() {
+    cleantmp();
+    bool found;
+
+    sky_action_index *index = sky_action_index_create();
+    index->path = bfromcstr("tmp/action_index");
+    mu_assert_int_equals(sky_action_index_load(index), 0);
+    mu_assert_int_equals(index->set_count, 0);
+    sky_object_id_t i;
+    for(i=1; i<=1000; i++) {
+        mu_assert_int_equals(sky_action_index_add(index, (i % 3) + 1, i * 7), 0);
+    }
+    mu_assert_int_equals(sky_action_index_add(index, 5, 0x10000000000LL), 0);
+    mu_assert_int_equals(sky_action_index_save(index), 0);
+    sky_action_index_free(index);
+
+    // Reload the sets from disk.
+    index = sky_action_index_create();
+    index->path = bfromcstr("tmp/action_index");
+    mu_assert_int_equals(sky_action_index_load(index), 0);
+    mu_assert_int_equals(index->set_count, 4);
+    mu_assert_int_equals(index->sets[0].count, 333);
+    mu_assert_int_equals(index->sets[1].count, 334);
+    mu_assert_int_equals(index->sets[2].count, 333);
+    for(i=1; i<=1000; i++) {
+        mu_assert_int_equals(sky_action_index_contains(index, (i % 3) + 1, i * 7, &found), 0);
+        mu_assert_bool(found);
+        mu_assert_int_equals(sky_action_index_contains(index, (i % 3) + 1, (i * 7) + 1, &found), 0);
+        mu_assert_bool(!found);
+    }
+    mu_assert_int_equals(sky_action_index_contains(index, 5, 0x10000000000LL, &found), 0);
+    mu_assert_bool(found);
+
+    sky_action_index_free(index);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_action_index_add);
+    mu_run_test(test_sky_action_index_load);
+    return 0;
+}
+
+RUN_TESTS()
@@ -41,6 +41,11 @@ char DATA[] =
     mu_assert_long_equals(PATH_STAT.sz, SZ); \
 } while(0)
 
+#define ASSERT_PATH_REF(BLOCK, INDEX, OBJECT_ID, OFFSET) do { \
+    mu_assert_int_equals(BLOCK->path_refs[INDEX].object_id, OBJECT_ID); \
+    mu_assert_int_equals(BLOCK->path_refs[INDEX].offset, OFFSET); \
+} while(0)
+
 
 sky_block *create_block(sky_data_file *data_file, uint32_t index,
                         sky_object_id_t min_object_id,
@@ -170,6 +175,75 @@ int test_sky_block_get_span_count() {
 }
 
 
+//--------------------------------------
+// Path Directory
+//--------------------------------------
+
+int test_sky_block_load_path_refs() {
+    sky_data_file *data_file;
+    INIT_DATA_FILE("tests/fixtures/blocks/path_stats/a");
+    sky_block *block = data_file->blocks[0];
+    mu_assert_int_equals(sky_block_load_path_refs(block), 0);
+    mu_assert_bool(block->path_refs_loaded);
+    mu_assert_int_equals(block->path_ref_count, 2);
+    mu_assert_int_equals(block->data_length, 60);
+    ASSERT_PATH_REF(block, 0, 3, 0);
+    ASSERT_PATH_REF(block, 1, 10, 41);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_block_get_path_ptr() {
+    void *block_ptr, *path_ptr;
+    sky_data_file *data_file;
+    INIT_DATA_FILE("tests/fixtures/blocks/path_stats/a");
+    sky_block *block = data_file->blocks[0];
+    sky_block_get_ptr(block, &block_ptr);
+    mu_assert_int_equals(sky_block_get_path_ptr(block, 10, &path_ptr), 0);
+    mu_assert_long_equals(path_ptr - block_ptr, 41L);
+    mu_assert_int_equals(sky_block_get_path_ptr(block, 3, &path_ptr), 0);
+    mu_assert_long_equals(path_ptr - block_ptr, 0L);
+    mu_assert_int_equals(sky_block_get_path_ptr(block, 4, &path_ptr), 0);
+    mu_assert(path_ptr == NULL, "");
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_block_add_event_updates_path_refs() {
+    sky_data_file *data_file;
+    INIT_DATA_FILE("");
+    sky_block *block = NULL;
+    sky_data_file_create_block(data_file, &block);
+    mu_assert_int_equals(sky_block_load_path_refs(block), 0);
+
+    sky_object_id_t object_ids[] = {10, 3, 7, 3, 12, 10, 1};
+    sky_timestamp_t timestamps[] = {5, 4, 2, 1, 9, 6, 3};
+    int i;
+    for(i=0; i<7; i++) {
+        sky_event *event = sky_event_create(object_ids[i], timestamps[i], 20);
+        mu_assert_int_equals(sky_block_add_event(block, event), 0);
+        sky_event_free(event);
+    }
+
+    // Compare the maintained directory against a rebuilt one.
+    mu_assert_bool(block->path_refs_loaded);
+    mu_assert_int_equals(block->path_ref_count, 5);
+    sky_block_path_ref refs[5];
+    memcpy(refs, block->path_refs, sizeof(refs));
+    uint32_t data_length = block->data_length;
+    sky_block_unload_path_refs(block);
+    mu_assert_int_equals(sky_block_load_path_refs(block), 0);
+    mu_assert_int_equals(block->data_length, data_length);
+    for(i=0; i<5; i++) {
+        ASSERT_PATH_REF(block, i, refs[i].object_id, refs[i].offset);
+    }
+    ASSERT_PATH_REF(block, 0, 1, 0);
+    ASSERT_PATH_REF(block, 1, 3, 19);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
 //--------------------------------------
 // Path Stats
 //--------------------------------------
@@ -270,6 +344,10 @@ int all_tests() {
     mu_run_test(test_sky_block_get_ptr);
     mu_run_test(test_sky_block_get_span_count);
 
+    mu_run_test(test_sky_block_load_path_refs);
+    mu_run_test(test_sky_block_get_path_ptr);
+    mu_run_test(test_sky_block_add_event_updates_path_refs);
+
     mu_run_test(test_sky_block_get_path_stats_with_no_event);
     mu_run_test(test_sky_block_get_path_stats_with_event_in_existing_path);
     mu_run_test(test_sky_block_get_path_stats_with_event_in_new_starting_path);
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <bulk_loader.h>
+#include <data_file.h>
+#include <path_iterator.h>
+#include <cursor.h>
+#include <bstring.h>
+
+#include "minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+#define INIT_BULK_LOADER(FILL_FACTOR) \
+    cleantmp(); \
+    loader = sky_bulk_loader_create(); \
+    loader->block_size = 64; \
+    loader->fill_factor = FILL_FACTOR; \
+    loader->path = bfromcstr("tmp/data"); \
+    loader->header_path = bfromcstr("tmp/header"); \
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0);
+
+#define LOAD_DATA_FILE() \
+    data_file = sky_data_file_create(); \
+    data_file->path = bfromcstr("tmp/data"); \
+    data_file->header_path = bfromcstr("tmp/header"); \
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+
+#define ADD_EVENT(OBJECT_ID, TIMESTAMP, ACTION_ID) do { \
+    sky_event *event = sky_event_create(OBJECT_ID, TIMESTAMP, ACTION_ID); \
+    mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0); \
+    sky_event_free(event); \
+} while (0)
+
+#define ASSERT_BLOCK(NUM, MIN_OBJECT_ID, MAX_OBJECT_ID, MIN_TIMESTAMP, MAX_TIMESTAMP, SPANNED) do {\
+    sky_block *_block = data_file->blocks[NUM]; \
+    mu_assert_int_equals(_block->min_object_id, MIN_OBJECT_ID); \
+    mu_assert_int_equals(_block->max_object_id, MAX_OBJECT_ID); \
+    mu_assert_long_equals(_block->min_timestamp, MIN_TIMESTAMP); \
+    mu_assert_long_equals(_block->max_timestamp, MAX_TIMESTAMP); \
+    mu_assert(_block->spanned == SPANNED, ""); \
+} while(0)
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Loading
+//--------------------------------------
+
+int test_sky_bulk_loader_add_event() {
+    sky_bulk_loader *loader;
+    INIT_BULK_LOADER(1.0);
+    ADD_EVENT(3, 10LL, 20);
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    mu_assert_int_equals(loader->block_count, 1);
+    mu_assert_file("tmp/data", "tests/fixtures/data_files/1/a/data");
+    mu_assert_file("tmp/header", "tests/fixtures/data_files/1/a/header");
+    sky_bulk_loader_free(loader);
+    return 0;
+}
+
+int test_sky_bulk_loader_fill_factor() {
+    sky_bulk_loader *loader;
+    sky_data_file *data_file;
+
+    // Three 19-byte paths fit in a single full block.
+    INIT_BULK_LOADER(1.0);
+    ADD_EVENT(1, 10LL, 1);
+    ADD_EVENT(2, 20LL, 1);
+    ADD_EVENT(3, 30LL, 1);
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    sky_bulk_loader_free(loader);
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->block_count, 1);
+    ASSERT_BLOCK(0, 1, 3, 10LL, 30LL, false);
+    sky_data_file_free(data_file);
+
+    // Only one path fits in each half-filled block.
+    INIT_BULK_LOADER(0.5);
+    ADD_EVENT(1, 10LL, 1);
+    ADD_EVENT(2, 20LL, 1);
+    ADD_EVENT(3, 30LL, 1);
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    sky_bulk_loader_free(loader);
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->block_count, 3);
+    ASSERT_BLOCK(0, 1, 1, 10LL, 10LL, false);
+    ASSERT_BLOCK(1, 2, 2, 20LL, 20LL, false);
+    ASSERT_BLOCK(2, 3, 3, 30LL, 30LL, false);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_bulk_loader_spanned_path() {
+    sky_bulk_loader *loader;
+    sky_data_file *data_file;
+    INIT_BULK_LOADER(1.0);
+    ADD_EVENT(1, 1LL, 1);
+    int64_t i;
+    for(i=0; i<12; i++) {
+        ADD_EVENT(2, 10LL + i, 1);
+    }
+    ADD_EVENT(3, 100LL, 1);
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    mu_assert_long_equals(loader->event_count, 14LL);
+    sky_bulk_loader_free(loader);
+
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->block_count, 5);
+    ASSERT_BLOCK(0, 1, 1, 1LL, 1LL, false);
+    ASSERT_BLOCK(1, 2, 2, 10LL, 14LL, true);
+    ASSERT_BLOCK(2, 2, 2, 15LL, 19LL, true);
+    ASSERT_BLOCK(3, 2, 2, 20LL, 21LL, true);
+    ASSERT_BLOCK(4, 3, 3, 100LL, 100LL, false);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_bulk_loader_requires_sorted_events() {
+    sky_bulk_loader *loader;
+    INIT_BULK_LOADER(1.0);
+    ADD_EVENT(2, 10LL, 1);
+    sky_event *event = sky_event_create(2, 9LL, 1);
+    mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), -1);
+    event->object_id = 1;
+    event->timestamp = 20LL;
+    mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), -1);
+    sky_event_free(event);
+    sky_bulk_loader_free(loader);
+    return 0;
+}
+
+int test_sky_bulk_loader_add_data_file() {
+    sky_bulk_loader *loader;
+    sky_data_file *data_file;
+
+    // Build a source data file with a spanned path.
+    INIT_BULK_LOADER(0.5);
+    ADD_EVENT(1, 1LL, 1);
+    int64_t i;
+    for(i=0; i<6; i++) {
+        ADD_EVENT(2, 10LL + i, 2);
+    }
+    ADD_EVENT(3, 100LL, 3);
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    sky_bulk_loader_free(loader);
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->block_count, 5);
+
+    // Rebuild it with full blocks.
+    loader = sky_bulk_loader_create();
+    loader->block_size = 64;
+    loader->fill_factor = 1.0;
+    loader->path = bfromcstr("tmp/data2");
+    loader->header_path = bfromcstr("tmp/header2");
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0);
+    mu_assert_int_equals(sky_bulk_loader_add_data_file(loader, data_file), 0);
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    mu_assert_long_equals(loader->event_count, 8LL);
+    sky_bulk_loader_free(loader);
+    sky_data_file_free(data_file);
+
+    data_file = sky_data_file_create();
+    data_file->path = bfromcstr("tmp/data2");
+    data_file->header_path = bfromcstr("tmp/header2");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    mu_assert_int_equals(data_file->block_count, 4);
+    ASSERT_BLOCK(0, 1, 1, 1LL, 1LL, false);
+    ASSERT_BLOCK(1, 2, 2, 10LL, 14LL, true);
+    ASSERT_BLOCK(2, 2, 2, 15LL, 15LL, true);
+    ASSERT_BLOCK(3, 3, 3, 100LL, 100LL, false);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_bulk_loader_add_data_file_with_zero_low_byte() {
+    sky_bulk_loader *loader;
+    sky_data_file *data_file;
+
+    // Object 256 has a zero first byte and must not end the block.
+    INIT_BULK_LOADER(1.0);
+    ADD_EVENT(255, 10LL, 1);
+    ADD_EVENT(256, 20LL, 1);
+    ADD_EVENT(257, 30LL, 1);
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    sky_bulk_loader_free(loader);
+    LOAD_DATA_FILE();
+
+    loader = sky_bulk_loader_create();
+    loader->path = bfromcstr("tmp/data2");
+    loader->header_path = bfromcstr("tmp/header2");
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0);
+    mu_assert_int_equals(sky_bulk_loader_add_data_file(loader, data_file), 0);
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    mu_assert_long_equals(loader->event_count, 3LL);
+    sky_bulk_loader_free(loader);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_bulk_loader_delta_encoding() {
+    sky_bulk_loader *loader;
+    sky_data_file *data_file;
+
+    // Delta encoded action events take three bytes so the spanned path from
+    // the fixed encoding fits in a single block.
+    cleantmp();
+    loader = sky_bulk_loader_create();
+    loader->version = SKY_DATA_FILE_DELTA_VERSION;
+    loader->block_size = 64;
+    loader->fill_factor = 1.0;
+    loader->path = bfromcstr("tmp/data");
+    loader->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0);
+    ADD_EVENT(1, 1LL, 1);
+    int64_t i;
+    for(i=0; i<40; i++) {
+        ADD_EVENT(2, 1000LL + i, 1);
+    }
+    ADD_EVENT(3, 100LL, 1);
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    sky_bulk_loader_free(loader);
+
+    // Larger paths are spanned and each span starts from a zero base.
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->version, SKY_DATA_FILE_DELTA_VERSION);
+    mu_assert_int_equals(data_file->block_count, 5);
+    ASSERT_BLOCK(0, 1, 1, 1LL, 1LL, false);
+    ASSERT_BLOCK(1, 2, 2, 1000LL, 1017LL, true);
+    ASSERT_BLOCK(2, 2, 2, 1018LL, 1035LL, true);
+    ASSERT_BLOCK(3, 2, 2, 1036LL, 1039LL, true);
+    ASSERT_BLOCK(4, 3, 3, 100LL, 100LL, false);
+
+    // Every timestamp is read back in order.
+    int64_t timestamp = 1000LL;
+    for(i=1; i<4; i++) {
+        sky_path_iterator iterator;
+        sky_path_iterator_init(&iterator);
+        mu_assert_int_equals(sky_path_iterator_set_block(&iterator, data_file->blocks[i]), 0);
+        void *path_ptr;
+        mu_assert_int_equals(sky_path_iterator_get_ptr(&iterator, &path_ptr), 0);
+        sky_cursor cursor;
+        sky_cursor_init(&cursor);
+        sky_cursor_set_path(&cursor, path_ptr);
+        while(!cursor.eof) {
+            mu_assert_int64_equals(cursor.timestamp, timestamp);
+            timestamp++;
+            mu_assert_int_equals(sky_cursor_next(&cursor), 0);
+        }
+    }
+    mu_assert_int64_equals(timestamp, 1040LL);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_bulk_loader_columnar() {
+    sky_bulk_loader *loader;
+    sky_data_file *data_file;
+
+    // Paths with an int property are smaller in columns.
+    cleantmp();
+    loader = sky_bulk_loader_create();
+    loader->version = SKY_DATA_FILE_COLUMNAR_VERSION;
+    loader->block_size = 64;
+    loader->fill_factor = 1.0;
+    loader->path = bfromcstr("tmp/data");
+    loader->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0);
+    int64_t i;
+    for(i=0; i<6; i++) {
+        sky_event *event = sky_event_create(2, 1000LL + i, 1);
+        event->data_count = 1;
+        event->data = malloc(sizeof(*event->data));
+        event->data[0] = sky_event_data_create_int(1, 1000 + i);
+        mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0);
+        sky_event_free(event);
+    }
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    sky_bulk_loader_free(loader);
+
+    // The path is read back through its columns.
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->version, SKY_DATA_FILE_COLUMNAR_VERSION);
+    mu_assert_int_equals(data_file->block_count, 1);
+    ASSERT_BLOCK(0, 2, 2, 1000LL, 1005LL, false);
+    void *path_ptr;
+    mu_assert_int_equals(sky_block_get_path_ptr(data_file->blocks[0], 2, &path_ptr), 0);
+    sky_cursor cursor;
+    sky_cursor_init(&cursor);
+    mu_assert_int_equals(sky_cursor_set_path(&cursor, path_ptr), 0);
+    mu_assert_bool(cursor.columnar);
+    sky_column *column;
+    for(i=0; i<6; i++) {
+        mu_assert_int64_equals(cursor.timestamp, 1000LL + i);
+        mu_assert_int_equals(sky_cursor_get_column(&cursor, 1, &column), 0);
+        mu_assert_int64_equals(sky_column_get_int(column, cursor.row_index), 1000LL + i);
+        mu_assert_int_equals(sky_cursor_next(&cursor), 0);
+    }
+    mu_assert_bool(cursor.eof);
+    free(cursor.paths);
+    size_t row_length;
+    mu_assert_int_equals(sky_block_get_row_length(data_file->blocks[0], &row_length), 0);
+    mu_assert(row_length > data_file->blocks[0]->data_length, "");
+
+    // Adding an event expands the block back into rows.
+    sky_event *event = sky_event_create(2, 999LL, 2);
+    mu_assert_int_equals(sky_data_file_add_event(data_file, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(sky_block_get_path_ptr(data_file->blocks[0], 2, &path_ptr), 0);
+    sky_cursor_init(&cursor);
+    mu_assert_int_equals(sky_cursor_set_path(&cursor, path_ptr), 0);
+    mu_assert_bool(!cursor.columnar);
+    mu_assert_int64_equals(cursor.timestamp, 999LL);
+    for(i=0; i<6; i++) {
+        mu_assert_int_equals(sky_cursor_next(&cursor), 0);
+        mu_assert_int64_equals(cursor.timestamp, 1000LL + i);
+    }
+    mu_assert_int_equals(sky_cursor_next(&cursor), 0);
+    mu_assert_bool(cursor.eof);
+    free(cursor.paths);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+int test_sky_bulk_loader_wide_object_ids() {
+    sky_bulk_loader *loader;
+    sky_data_file *data_file;
+
+    // Narrow data files can't store object ids larger than 32 bits.
+    INIT_BULK_LOADER(1.0);
+    sky_event *event = sky_event_create(1ULL << 40, 10LL, 1);
+    mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), -1);
+    sky_event_free(event);
+    sky_bulk_loader_free(loader);
+
+    // Wide object ids are stored in varint path headers.
+    cleantmp();
+    sky_object_id_t object_ids[] = {1, 300, 1ULL << 40, UINT64_MAX - 1};
+    loader = sky_bulk_loader_create();
+    loader->version = SKY_DATA_FILE_WIDE_VERSION;
+    loader->block_size = 64;
+    loader->fill_factor = 1.0;
+    loader->path = bfromcstr("tmp/data");
+    loader->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0);
+    uint32_t i, j;
+    for(i=0; i<4; i++) {
+        for(j=0; j<3; j++) {
+            ADD_EVENT(object_ids[i], 10LL + j, j + 1);
+        }
+    }
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    sky_bulk_loader_free(loader);
+
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->version, SKY_DATA_FILE_WIDE_VERSION);
+    mu_assert_bool(sky_data_file_is_wide(data_file));
+    mu_assert_bool(data_file->blocks[data_file->block_count-1]->max_object_id == UINT64_MAX - 1);
+
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_data_file(&iterator, data_file), 0);
+    for(i=0; i<4; i++) {
+        mu_assert_bool(!iterator.eof);
+        mu_assert_bool(iterator.current_object_id == object_ids[i]);
+        void *path_ptr;
+        mu_assert_int_equals(sky_path_iterator_get_ptr(&iterator, &path_ptr), 0);
+        sky_cursor cursor;
+        sky_cursor_init(&cursor);
+        cursor.wide = true;
+        mu_assert_int_equals(sky_cursor_set_path(&cursor, path_ptr), 0);
+        for(j=0; j<3; j++) {
+            mu_assert_int64_equals(cursor.timestamp, 10LL + j);
+            mu_assert_int_equals(sky_cursor_next(&cursor), 0);
+        }
+        mu_assert_bool(cursor.eof);
+        free(cursor.paths);
+        mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    }
+    mu_assert_bool(iterator.eof);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_bulk_loader_add_event);
+    mu_run_test(test_sky_bulk_loader_fill_factor);
+    mu_run_test(test_sky_bulk_loader_spanned_path);
+    mu_run_test(test_sky_bulk_loader_requires_sorted_events);
+    mu_run_test(test_sky_bulk_loader_add_data_file);
+    mu_run_test(test_sky_bulk_loader_add_data_file_with_zero_low_byte);
+    mu_run_test(test_sky_bulk_loader_delta_encoding);
+    mu_run_test(test_sky_bulk_loader_columnar);
+    mu_run_test(test_sky_bulk_loader_wide_object_ids);
+    return 0;
+}
+
+RUN_TESTS()
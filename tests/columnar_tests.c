@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <columnar.h>
+#include <event.h>
+#include <event_data.h>
+
+#include "minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+struct tagbstring foo = bsStatic("foo");
+
+// Packs a path of delta encoded events. Each event has an int, float, boolean
+// and string property. The int property is a string on the event at
+// MIXED_INDEX.
+size_t pack_rows(void *ptr, uint32_t event_count, int32_t mixed_index)
+{
+    size_t sz, length = 0;
+    sky_timestamp_t base = 0;
+    uint32_t i;
+    for(i=0; i<event_count; i++) {
+        sky_event *event = sky_event_create(1, 1000 + (i * 10), (i % 3) + 1);
+        event->data_count = 4;
+        event->data = malloc(sizeof(*event->data) * event->data_count);
+        if((int32_t)i == mixed_index) {
+            event->data[0] = sky_event_data_create_string(1, &foo);
+        }
+        else {
+            event->data[0] = sky_event_data_create_int(1, (int64_t)i * 100);
+        }
+        event->data[1] = sky_event_data_create_float(2, i + 0.5);
+        event->data[2] = sky_event_data_create_boolean(3, (i % 2) == 0);
+        event->data[3] = sky_event_data_create_string(4, &foo);
+        sky_event_pack_delta(event, base, ptr + length, &sz);
+        base = event->timestamp;
+        length += sz;
+        sky_event_free(event);
+    }
+    return length;
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+int test_sky_columnar_pack() {
+    size_t sz;
+    uint8_t rows[2048], columns[2048], expanded[2048];
+    size_t rows_length = pack_rows(rows, 16, -1);
+
+    // The typed properties are stored in columns and the string is left in
+    // the remaining data.
+    mu_assert_int_equals(sky_columnar_pack(rows, rows_length, NULL, &sz), 0);
+    size_t columns_length = sz;
+    mu_assert(columns_length < rows_length, "");
+    mu_assert_int_equals(sky_columnar_pack(rows, rows_length, columns, &sz), 0);
+    mu_assert_long_equals((long)sz, (long)columns_length);
+    mu_assert_bool(sky_columnar_is_columnar(columns, columns_length));
+    mu_assert_bool(!sky_columnar_is_columnar(rows, rows_length));
+
+    sky_columnar_path path;
+    mu_assert_int_equals(sky_columnar_path_init(&path, columns, columns_length), 0);
+    mu_assert_int_equals(path.event_count, 16);
+    mu_assert_int_equals(path.column_count, 3);
+    mu_assert(sky_columnar_path_get_column(&path, 4) == NULL, "");
+
+    // Read each column into an array.
+    sky_timestamp_t timestamps[16];
+    sky_action_id_t action_ids[16];
+    int64_t ints[16];
+    double floats[16];
+    bool booleans[16];
+    sky_column *int_column = sky_columnar_path_get_column(&path, 1);
+    sky_column *float_column = sky_columnar_path_get_column(&path, 2);
+    sky_column *boolean_column = sky_columnar_path_get_column(&path, 3);
+    mu_assert_int_equals(int_column->type, SKY_COLUMN_TYPE_INT);
+    mu_assert_int_equals(int_column->width, 2);
+    mu_assert_int_equals(sky_columnar_path_read_timestamps(&path, timestamps), 0);
+    mu_assert_int_equals(sky_columnar_path_read_action_ids(&path, action_ids), 0);
+    mu_assert_int_equals(sky_column_read_ints(int_column, ints), 0);
+    mu_assert_int_equals(sky_column_read_floats(float_column, floats), 0);
+    mu_assert_int_equals(sky_column_read_booleans(boolean_column, booleans), 0);
+    mu_assert_int_equals(sky_column_read_ints(float_column, ints), -1);
+    uint32_t i;
+    for(i=0; i<16; i++) {
+        mu_assert_int64_equals(timestamps[i], 1000LL + (i * 10));
+        mu_assert_int_equals(action_ids[i], (i % 3) + 1);
+        mu_assert_bool(sky_column_is_present(int_column, i));
+        mu_assert_int64_equals(ints[i], (long long)i * 100);
+        mu_assert(floats[i] == i + 0.5, "");
+        mu_assert(booleans[i] == ((i % 2) == 0), "");
+    }
+
+    // Expanding the columns restores the original rows.
+    mu_assert_int_equals(sky_columnar_unpack(&path, true, NULL, &sz), 0);
+    mu_assert_long_equals((long)sz, (long)rows_length);
+    mu_assert_int_equals(sky_columnar_unpack(&path, true, expanded, &sz), 0);
+    mu_assert_mem(expanded, rows, rows_length);
+    return 0;
+}
+
+int test_sky_columnar_pack_mixed_types() {
+    size_t sz;
+    uint8_t rows[2048], columns[2048], expanded[2048];
+    size_t rows_length = pack_rows(rows, 16, 5);
+
+    // A property with more than one type stays in the remaining data.
+    mu_assert_int_equals(sky_columnar_pack(rows, rows_length, columns, &sz), 0);
+    sky_columnar_path path;
+    mu_assert_int_equals(sky_columnar_path_init(&path, columns, sz), 0);
+    mu_assert_int_equals(path.column_count, 2);
+    mu_assert(sky_columnar_path_get_column(&path, 1) == NULL, "");
+
+    mu_assert_int_equals(sky_columnar_unpack(&path, true, expanded, &sz), 0);
+    mu_assert_long_equals((long)sz, (long)rows_length);
+    mu_assert_int_equals(sky_columnar_unpack(&path, false, NULL, &sz), 0);
+    mu_assert(sz > rows_length, "");
+    return 0;
+}
+
+int test_sky_columnar_pack_short_path() {
+    size_t sz;
+    uint8_t rows[256], columns[256];
+    size_t rows_length = pack_rows(rows, 2, -1);
+
+    // Int and boolean columns for short paths are larger than their rows.
+    mu_assert_int_equals(sky_columnar_pack(rows, rows_length, columns, &sz), 0);
+    sky_columnar_path path;
+    mu_assert_int_equals(sky_columnar_path_init(&path, columns, sz), 0);
+    mu_assert_int_equals(path.event_count, 2);
+    mu_assert_int_equals(path.column_count, 1);
+    mu_assert_int_equals(path.columns[0].type, SKY_COLUMN_TYPE_FLOAT);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_columnar_pack);
+    mu_run_test(test_sky_columnar_pack_mixed_types);
+    mu_run_test(test_sky_columnar_pack_short_path);
+    return 0;
+}
+
+RUN_TESTS()
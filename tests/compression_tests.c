@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <compression.h>
+
+#include "minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+int test_sky_compress_roundtrip() {
+    size_t sz;
+    uint8_t src[1024], compressed[1024], decompressed[1024];
+    int i;
+    for(i=0; i<1024; i++) {
+        src[i] = (i % 11 == 0 ? i / 11 : 0);
+    }
+
+    mu_assert_int_equals(sky_compress(src, sizeof(src), compressed, sizeof(compressed), &sz), 0);
+    mu_assert(sz > 0 && sz < sizeof(src), "");
+    size_t compressed_length = sz;
+    mu_assert_int_equals(sky_decompress(compressed, compressed_length, decompressed, sizeof(decompressed), &sz), 0);
+    mu_assert_long_equals((long)sz, 1024L);
+    mu_assert(memcmp(src, decompressed, sizeof(src)) == 0, "");
+    return 0;
+}
+
+int test_sky_compress_incompressible() {
+    size_t sz;
+    uint8_t src[256], compressed[255];
+    int i;
+    for(i=0; i<256; i++) {
+        src[i] = i;
+    }
+    mu_assert_int_equals(sky_compress(src, sizeof(src), compressed, sizeof(compressed), &sz), 0);
+    mu_assert_long_equals((long)sz, 0L);
+    return 0;
+}
+
+int test_sky_decompress_corrupt() {
+    size_t sz;
+    uint8_t decompressed[64];
+
+    // Literal run is longer than the input.
+    uint8_t truncated[] = {0x05, 'a', 'b'};
+    mu_assert_int_equals(sky_decompress(truncated, sizeof(truncated), decompressed, sizeof(decompressed), &sz), -1);
+
+    // Back reference before the start of the output.
+    uint8_t out_of_range[] = {0x00, 'a', 0x20, 0x05};
+    mu_assert_int_equals(sky_decompress(out_of_range, sizeof(out_of_range), decompressed, sizeof(decompressed), &sz), -1);
+
+    // Output is larger than the destination.
+    uint8_t too_large[] = {0x00, 'a', 0xE0, 0xFF, 0x00};
+    mu_assert_int_equals(sky_decompress(too_large, sizeof(too_large), decompressed, sizeof(decompressed), &sz), -1);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_compress_roundtrip);
+    mu_run_test(test_sky_compress_incompressible);
+    mu_run_test(test_sky_decompress_corrupt);
+    return 0;
+}
+
+RUN_TESTS()
@@ -22,6 +22,19 @@ char DATA[] =
     "\x05\x00\x00\x00\x01\xa3\x62\x61\x72"
 ;
 
+size_t DELTA_DATA_LENGTH = 18;
+char DELTA_DATA[] = 
+    "\x0a\x00\x00\x00\x0a\x00\x00\x00\x05\xc0\x02\x0b\x05\x02\x0c\x05"
+    "\x4e\x0d"
+;
+
+size_t COLUMNAR_DATA_LENGTH = 38;
+char COLUMNAR_DATA[] = 
+    "\x0a\x00\x00\x00\x1e\x00\x00\x00\x80\x03\x01\x04\x08\xc0\x02\x02"
+    "\x4e\x0b\x00\x0c\x00\x0d\x00\x01\x01\x01\x05\x07\x00\x09\x00\x05"
+    "\x02\xa3\x66\x6f\x6f\x00"
+;
+
 
 //==============================================================================
 //
@@ -71,6 +84,129 @@ int test_sky_cursor_next() {
     return 0;
 }
 
+int test_sky_cursor_next_delta() {
+    sky_action_id_t action_id;
+    sky_cursor *cursor = sky_cursor_create();
+    
+    // Event 1
+    mu_assert_int_equals(sky_cursor_set_path(cursor, &DELTA_DATA), 0);
+    mu_assert_long_equals(cursor->ptr-((void*)&DELTA_DATA), 8L);
+    mu_assert_int64_equals(cursor->timestamp, 160LL);
+    mu_assert_int_equals(sky_cursor_get_action_id(cursor, &action_id), 0);
+    mu_assert_int_equals(action_id, 11);
+    
+    // Event 2
+    mu_assert_int_equals(sky_cursor_next(cursor), 0);
+    mu_assert_long_equals(cursor->ptr-((void*)&DELTA_DATA), 12L);
+    mu_assert_int64_equals(cursor->timestamp, 161LL);
+    mu_assert_int_equals(sky_cursor_get_action_id(cursor, &action_id), 0);
+    mu_assert_int_equals(action_id, 12);
+
+    // Event 3
+    mu_assert_int_equals(sky_cursor_next(cursor), 0);
+    mu_assert_long_equals(cursor->ptr-((void*)&DELTA_DATA), 15L);
+    mu_assert_int64_equals(cursor->timestamp, 200LL);
+    mu_assert_int_equals(sky_cursor_get_action_id(cursor, &action_id), 0);
+    mu_assert_int_equals(action_id, 13);
+    
+    // EOF
+    mu_assert_int_equals(sky_cursor_next(cursor), 0);
+    mu_assert_bool(cursor->eof);
+
+    sky_cursor_free(cursor);
+    return 0;
+}
+
+int test_sky_cursor_next_columnar() {
+    void *data_ptr;
+    uint32_t data_length;
+    sky_action_id_t action_id;
+    sky_column *column;
+    sky_event *event = sky_event_create(0, 0, 0);
+    sky_cursor *cursor = sky_cursor_create();
+    
+    // Event 1
+    mu_assert_int_equals(sky_cursor_set_path(cursor, &COLUMNAR_DATA), 0);
+    mu_assert_bool(cursor->columnar);
+    mu_assert_int64_equals(cursor->timestamp, 160LL);
+    mu_assert_int_equals(sky_cursor_get_action_id(cursor, &action_id), 0);
+    mu_assert_int_equals(action_id, 11);
+    mu_assert_int_equals(sky_cursor_get_column(cursor, 1, &column), 0);
+    mu_assert_bool(sky_column_is_present(column, cursor->row_index));
+    mu_assert_int64_equals(sky_column_get_int(column, cursor->row_index), 7LL);
+    mu_assert_int_equals(sky_cursor_get_data_ptr(cursor, &data_ptr, &data_length), 0);
+    mu_assert_int_equals(data_length, 0);
+    mu_assert(data_ptr == NULL, "");
+    mu_assert_int_equals(sky_cursor_get_event(cursor, event), 0);
+    mu_assert_int64_equals(event->timestamp, 160LL);
+    mu_assert_int_equals(event->action_id, 11);
+    mu_assert_int_equals(event->data_count, 1);
+    mu_assert_int64_equals(event->data[0]->int_value, 7LL);
+    
+    // Event 2
+    mu_assert_int_equals(sky_cursor_next(cursor), 0);
+    mu_assert_int64_equals(cursor->timestamp, 161LL);
+    mu_assert_int_equals(sky_cursor_get_action_id(cursor, &action_id), 0);
+    mu_assert_int_equals(action_id, 12);
+    mu_assert_int_equals(sky_cursor_get_column(cursor, 1, &column), 0);
+    mu_assert_bool(!sky_column_is_present(column, cursor->row_index));
+    mu_assert_int_equals(sky_cursor_get_column(cursor, 2, &column), 0);
+    mu_assert(column == NULL, "");
+    mu_assert_int_equals(sky_cursor_get_data_ptr(cursor, &data_ptr, &data_length), 0);
+    mu_assert_int_equals(data_length, 5);
+    mu_assert_mem(data_ptr, "\x02\xa3" "foo", 5);
+    mu_assert_int_equals(sky_cursor_get_event(cursor, event), 0);
+    mu_assert_int_equals(event->data_count, 1);
+    mu_assert_bstring(event->data[0]->string_value, "foo");
+
+    // Event 3
+    mu_assert_int_equals(sky_cursor_next(cursor), 0);
+    mu_assert_int64_equals(cursor->timestamp, 200LL);
+    mu_assert_int_equals(sky_cursor_get_action_id(cursor, &action_id), 0);
+    mu_assert_int_equals(action_id, 13);
+    mu_assert_int_equals(sky_cursor_get_column(cursor, 1, &column), 0);
+    mu_assert_int64_equals(sky_column_get_int(column, cursor->row_index), 9LL);
+    
+    // EOF
+    mu_assert_int_equals(sky_cursor_next(cursor), 0);
+    mu_assert_bool(cursor->eof);
+
+    sky_event_free(event);
+    sky_cursor_free(cursor);
+    return 0;
+}
+
+int test_sky_cursor_set_window() {
+    sky_action_id_t action_id;
+    sky_cursor *cursor = sky_cursor_create();
+
+    // Only the second event is inside the window.
+    mu_assert_int_equals(sky_cursor_set_path(cursor, &DELTA_DATA), 0);
+    mu_assert_int_equals(sky_cursor_set_window(cursor, 161LL, 200LL), 0);
+    mu_assert_bool(!cursor->eof);
+    mu_assert_int64_equals(cursor->timestamp, 161LL);
+    mu_assert_int_equals(sky_cursor_get_action_id(cursor, &action_id), 0);
+    mu_assert_int_equals(action_id, 12);
+    mu_assert_int_equals(sky_cursor_next(cursor), 0);
+    mu_assert_bool(cursor->eof);
+
+    // Windows before and after the path have no events.
+    mu_assert_int_equals(sky_cursor_set_path(cursor, &DELTA_DATA), 0);
+    mu_assert_int_equals(sky_cursor_set_window(cursor, 0LL, 160LL), 0);
+    mu_assert_bool(cursor->eof);
+    mu_assert_int_equals(sky_cursor_set_path(cursor, &DELTA_DATA), 0);
+    mu_assert_int_equals(sky_cursor_set_window(cursor, 201LL, 300LL), 0);
+    mu_assert_bool(cursor->eof);
+
+    // Assigning a path removes the window.
+    mu_assert_int_equals(sky_cursor_set_path(cursor, &DELTA_DATA), 0);
+    mu_assert_bool(!cursor->windowed);
+    mu_assert_int64_equals(cursor->timestamp, 160LL);
+
+    sky_cursor_free(cursor);
+    return 0;
+}
+
 
 //==============================================================================
 //
@@ -80,6 +216,9 @@ int test_sky_cursor_next() {
 
 int all_tests() {
     mu_run_test(test_sky_cursor_next);
+    mu_run_test(test_sky_cursor_next_delta);
+    mu_run_test(test_sky_cursor_next_columnar);
+    mu_run_test(test_sky_cursor_set_window);
     return 0;
 }
 
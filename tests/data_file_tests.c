@@ -1,9 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
 
 #include <dbg.h>
 #include <mem.h>
 #include <data_file.h>
+#include <path_iterator.h>
+#include <cursor.h>
+#include <bulk_loader.h>
+#include <minipack.h>
 
 #include "minunit.h"
 
@@ -48,6 +54,97 @@
     mu_assert_file("tmp/data", FIXTURE "/data"); \
     mu_assert_file("tmp/header", FIXTURE "/header");
 
+// Bulk loads one event per object into tmp with a low fill factor so that
+// each path is written to its own block.
+#define BULK_LOAD_UNDERFILLED(OBJECT_COUNT) do { \
+    sky_bulk_loader *loader = sky_bulk_loader_create(); \
+    loader->block_size = 64; \
+    loader->fill_factor = 0.3; \
+    loader->path = bfromcstr("tmp/data"); \
+    loader->header_path = bfromcstr("tmp/header"); \
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0); \
+    sky_object_id_t _i; \
+    for(_i=1; _i<=OBJECT_COUNT; _i++) { \
+        sky_event *event = sky_event_create(_i, _i * 10, 1); \
+        mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0); \
+        sky_event_free(event); \
+    } \
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0); \
+    sky_bulk_loader_free(loader); \
+} while(0)
+
+#define LOAD_DATA_FILE() \
+    data_file = sky_data_file_create(); \
+    data_file->path = bfromcstr("tmp/data"); \
+    data_file->header_path = bfromcstr("tmp/header"); \
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+
+// Counts the events in a data file and verifies that the blocks in the
+// directory do not overlap.
+uint32_t count_events(sky_data_file *data_file)
+{
+    uint32_t i, count = 0;
+    sky_object_id_t last_max_object_id = 0;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        if(block->min_object_id == 0) continue;
+        if(!block->spanned && block->min_object_id <= last_max_object_id) return 0;
+        last_max_object_id = block->max_object_id;
+
+        sky_path_iterator iterator;
+        sky_path_iterator_init(&iterator);
+        sky_path_iterator_set_block(&iterator, block);
+        while(!iterator.eof) {
+            void *ptr;
+            sky_path_iterator_get_ptr(&iterator, &ptr);
+            sky_cursor cursor;
+            sky_cursor_init(&cursor);
+            cursor.wide = sky_data_file_is_wide(data_file);
+            sky_cursor_set_path(&cursor, ptr);
+            while(!cursor.eof) {
+                count++;
+                sky_cursor_next(&cursor);
+            }
+            sky_path_iterator_next(&iterator);
+        }
+    }
+    return count;
+}
+
+// Reads the object id, timestamp and action id of every event in a data file
+// in block order.
+uint32_t read_events(sky_data_file *data_file, sky_object_id_t *object_ids,
+                     sky_timestamp_t *timestamps, sky_action_id_t *action_ids)
+{
+    uint32_t i, count = 0;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_path_iterator iterator;
+        sky_path_iterator_init(&iterator);
+        sky_path_iterator_set_block(&iterator, data_file->blocks[i]);
+        while(!iterator.eof) {
+            void *ptr;
+            sky_path_iterator_get_ptr(&iterator, &ptr);
+            sky_cursor cursor;
+            sky_cursor_init(&cursor);
+            cursor.wide = sky_data_file_is_wide(data_file);
+            sky_cursor_set_path(&cursor, ptr);
+            while(!cursor.eof) {
+                object_ids[count] = iterator.current_object_id;
+                timestamps[count] = cursor.timestamp;
+                sky_cursor_get_action_id(&cursor, &action_ids[count]);
+                count++;
+                sky_cursor_next(&cursor);
+            }
+            sky_path_iterator_next(&iterator);
+        }
+    }
+    return count;
+}
+
+#define BATCH_EVENT_COUNT 15
+sky_object_id_t BATCH_OBJECT_IDS[] = {5, 3, 9, 3, 5, 1, 12, 3, 9, 5, 7, 3, 3, 20, 1};
+sky_timestamp_t BATCH_TIMESTAMPS[] = {4, 10, 2, 7, 4, 3, 1, 10, 8, 2, 5, 1, 12, 3, 3};
+
 
 //==============================================================================
 //
@@ -134,6 +231,49 @@ int test_sky_data_file_add_event_to_new_block() {
 }
 
 
+//--------------------------------------
+// Flush
+//--------------------------------------
+
+int test_sky_data_file_flush() {
+    sky_data_file *data_file;
+    INIT_DATA_FILE("", 64);
+    ADD_EVENT(3LL, 10LL, 20);
+    mu_assert_bool(data_file->header_dirty_end > data_file->header_dirty_start);
+    mu_assert_int_equals(sky_data_file_flush(data_file), 0);
+    mu_assert_int_equals(data_file->header_dirty_start, 0);
+    mu_assert_int_equals(data_file->header_dirty_end, 0);
+    ASSERT_DATA_FILE("tests/fixtures/data_files/1/a");
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+int test_sky_data_file_flush_lsn() {
+    sky_data_file *data_file;
+    cleantmp();
+    data_file = sky_data_file_create();
+    data_file->version = SKY_DATA_FILE_LSN_VERSION;
+    data_file->block_size = 64;
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+
+    // The LSN only reaches the header once the blocks are flushed.
+    ADD_EVENT(3LL, 10LL, 20);
+    mu_assert_int_equals(sky_data_file_set_lsn(data_file, 5), 0);
+    mu_assert_int64_equals(*((uint64_t*)(data_file->header + 8)), 0LL);
+    mu_assert_int_equals(sky_data_file_flush(data_file), 0);
+    mu_assert_int64_equals(*((uint64_t*)(data_file->header + 8)), 5LL);
+
+    mu_assert_int_equals(sky_data_file_unload(data_file), 0);
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    mu_assert_int64_equals(data_file->lsn, 5LL);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
 //--------------------------------------
 // Add Event (Existing Path)
 //--------------------------------------
@@ -389,6 +529,990 @@ int test_sky_data_file_add_event_to_end_of_ending_path_causing_block_span() {
 }
 
 
+//--------------------------------------
+// Add Events (Batch)
+//--------------------------------------
+
+// Adds the same events to one data file individually and to another as
+// batches and checks that the files are identical.
+int test_sky_data_file_add_events_matches_individual_inserts() {
+    uint32_t i;
+    cleantmp();
+    sky_data_file *a = sky_data_file_create();
+    a->block_size = 256;
+    a->path = bfromcstr("tmp/a_data");
+    a->header_path = bfromcstr("tmp/a_header");
+    mu_assert_int_equals(sky_data_file_load(a), 0);
+
+    sky_data_file *b = sky_data_file_create();
+    b->block_size = 256;
+    b->path = bfromcstr("tmp/b_data");
+    b->header_path = bfromcstr("tmp/b_header");
+    mu_assert_int_equals(sky_data_file_load(b), 0);
+
+    // Add events in two batches so the second batch merges with the existing
+    // paths.
+    sky_event *events[BATCH_EVENT_COUNT];
+    for(i=0; i<BATCH_EVENT_COUNT; i++) {
+        events[i] = sky_event_create(BATCH_OBJECT_IDS[i], BATCH_TIMESTAMPS[i], (sky_action_id_t)(i+1));
+        mu_assert_int_equals(sky_data_file_add_event(a, events[i]), 0);
+    }
+    mu_assert_int_equals(sky_data_file_add_events(b, events, 7), 0);
+    mu_assert_int_equals(sky_data_file_add_events(b, &events[7], BATCH_EVENT_COUNT-7), 0);
+    for(i=0; i<BATCH_EVENT_COUNT; i++) {
+        sky_event_free(events[i]);
+    }
+
+    mu_assert_int_equals(a->block_count, 1);
+    mu_assert_int_equals(b->block_count, 1);
+    sky_data_file_free(a);
+    sky_data_file_free(b);
+    mu_assert_file("tmp/b_data", "tmp/a_data");
+    mu_assert_file("tmp/b_header", "tmp/a_header");
+    return 0;
+}
+
+int test_sky_data_file_add_events_causing_block_splits() {
+    uint32_t i;
+    sky_data_file *data_file;
+    INIT_DATA_FILE("", 64);
+
+    sky_event *events[BATCH_EVENT_COUNT];
+    for(i=0; i<BATCH_EVENT_COUNT; i++) {
+        events[i] = sky_event_create(BATCH_OBJECT_IDS[i], BATCH_TIMESTAMPS[i], (sky_action_id_t)(i+1));
+    }
+    mu_assert_int_equals(sky_data_file_add_events(data_file, events, BATCH_EVENT_COUNT), 0);
+    for(i=0; i<BATCH_EVENT_COUNT; i++) {
+        sky_event_free(events[i]);
+    }
+    mu_assert_bool(data_file->block_count > 1);
+
+    // Every event should be stored in order with no overlapping blocks.
+    uint32_t event_count = 0;
+    sky_object_id_t last_max_object_id = 0;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_block *block = data_file->blocks[i];
+        mu_assert_bool(block->min_object_id > last_max_object_id);
+        last_max_object_id = block->max_object_id;
+
+        sky_path_iterator iterator;
+        sky_path_iterator_init(&iterator);
+        mu_assert_int_equals(sky_path_iterator_set_block(&iterator, block), 0);
+        while(!iterator.eof) {
+            void *ptr;
+            mu_assert_int_equals(sky_path_iterator_get_ptr(&iterator, &ptr), 0);
+            sky_cursor cursor;
+            sky_cursor_init(&cursor);
+            sky_cursor_set_path(&cursor, ptr);
+            sky_timestamp_t last_timestamp = 0;
+            while(!cursor.eof) {
+                sky_timestamp_t timestamp = *((sky_timestamp_t*)(cursor.ptr+1));
+                mu_assert_bool(timestamp >= last_timestamp);
+                last_timestamp = timestamp;
+                event_count++;
+                mu_assert_int_equals(sky_cursor_next(&cursor), 0);
+            }
+            mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+        }
+    }
+    mu_assert_int_equals(event_count, BATCH_EVENT_COUNT);
+
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+//--------------------------------------
+// Block Directory
+//--------------------------------------
+
+int test_sky_data_file_get_object_blocks() {
+    sky_data_file *data_file;
+    sky_block *block;
+    uint32_t span_count;
+    INIT_DATA_FILE("tests/fixtures/data_files/spanning/b", 0);
+
+    // Spanned object.
+    mu_assert_int_equals(sky_data_file_get_object_blocks(data_file, 3, &block, &span_count), 0);
+    mu_assert_int_equals(block->index, 0);
+    mu_assert_int_equals(span_count, 2);
+
+    // Multi-object block.
+    mu_assert_int_equals(sky_data_file_get_object_blocks(data_file, 10, &block, &span_count), 0);
+    mu_assert_int_equals(block->index, 2);
+    mu_assert_int_equals(span_count, 1);
+
+    // Missing objects.
+    mu_assert_int_equals(sky_data_file_get_object_blocks(data_file, 5, &block, &span_count), 0);
+    mu_assert(block == NULL, "");
+    mu_assert_int_equals(span_count, 0);
+    mu_assert_int_equals(sky_data_file_get_object_blocks(data_file, 11, &block, &span_count), 0);
+    mu_assert(block == NULL, "");
+
+    // Span count from the middle of a span.
+    mu_assert_int_equals(sky_block_get_span_count(data_file->blocks[1], &span_count), 0);
+    mu_assert_int_equals(span_count, 1);
+
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_data_file_add_event_after_span_uses_last_span_block() {
+    sky_data_file *data_file;
+    INIT_DATA_FILE("tests/fixtures/data_files/spanning/b", 0);
+    ADD_EVENT(3, 9LL, 20);
+    mu_assert_int_equals(data_file->block_count, 3);
+    mu_assert_int_equals(data_file->blocks[1]->index, 1);
+    mu_assert_long_equals(data_file->blocks[1]->min_timestamp, 8LL);
+    mu_assert_long_equals(data_file->blocks[1]->max_timestamp, 11LL);
+    mu_assert_long_equals(data_file->blocks[0]->max_timestamp, 7LL);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+//--------------------------------------
+// Compaction
+//--------------------------------------
+
+int test_sky_data_file_compact() {
+    uint32_t merge_count;
+    sky_data_file *data_file;
+    cleantmp();
+    BULK_LOAD_UNDERFILLED(3);
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->block_count, 3);
+
+    mu_assert_int_equals(sky_data_file_compact(data_file, 1.0, 0, &merge_count), 0);
+    mu_assert_int_equals(merge_count, 2);
+    mu_assert_int_equals(data_file->block_count, 1);
+    mu_assert_int_equals(data_file->free_block_count, 0);
+    mu_assert_int_equals(data_file->blocks[0]->min_object_id, 1);
+    mu_assert_int_equals(data_file->blocks[0]->max_object_id, 3);
+    mu_assert_long_equals(data_file->blocks[0]->min_timestamp, 10LL);
+    mu_assert_long_equals(data_file->blocks[0]->max_timestamp, 30LL);
+    mu_assert_int_equals(count_events(data_file), 3);
+    sky_data_file_free(data_file);
+
+    // The files should be truncated to a single block.
+    struct tagbstring data_path = bsStatic("tmp/data");
+    struct tagbstring header_path = bsStatic("tmp/header");
+    mu_assert_long_equals(sky_file_get_size(&data_path), 64L);
+    mu_assert_long_equals(sky_file_get_size(&header_path), 32L);
+    return 0;
+}
+
+int test_sky_data_file_compact_incrementally() {
+    uint32_t merge_count;
+    sky_data_file *data_file;
+    cleantmp();
+    BULK_LOAD_UNDERFILLED(4);
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->block_count, 4);
+
+    mu_assert_int_equals(sky_data_file_compact(data_file, 1.0, 1, &merge_count), 0);
+    mu_assert_int_equals(merge_count, 1);
+    mu_assert_int_equals(data_file->block_count, 3);
+    mu_assert_int_equals(count_events(data_file), 4);
+
+    mu_assert_int_equals(sky_data_file_compact(data_file, 1.0, 1, &merge_count), 0);
+    mu_assert_int_equals(merge_count, 1);
+    mu_assert_int_equals(data_file->block_count, 2);
+    mu_assert_int_equals(count_events(data_file), 4);
+
+    // Nothing more fits.
+    mu_assert_int_equals(sky_data_file_compact(data_file, 1.0, 0, &merge_count), 0);
+    mu_assert_int_equals(merge_count, 0);
+    mu_assert_int_equals(data_file->block_count, 2);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_data_file_split_reuses_free_block() {
+    uint32_t merge_count;
+    sky_data_file *data_file;
+    cleantmp();
+
+    // Write three small paths followed by a spanned path.
+    sky_bulk_loader *loader = sky_bulk_loader_create();
+    loader->block_size = 64;
+    loader->fill_factor = 0.3;
+    loader->path = bfromcstr("tmp/data");
+    loader->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0);
+    int64_t i;
+    for(i=0; i<11; i++) {
+        sky_event *event = sky_event_create((i < 3 ? i+1 : 4), (i+1) * 10, 1);
+        mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0);
+        sky_event_free(event);
+    }
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    sky_bulk_loader_free(loader);
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->block_count, 11);
+
+    // The spanned blocks at the end of the file keep it from shrinking.
+    mu_assert_int_equals(sky_data_file_compact(data_file, 1.0, 0, &merge_count), 0);
+    mu_assert_int_equals(merge_count, 2);
+    mu_assert_int_equals(data_file->block_count, 11);
+    mu_assert_int_equals(data_file->free_block_count, 2);
+
+    // Splitting the merged block should reuse a free block.
+    ADD_EVENT(3, 35LL, 1);
+    mu_assert_int_equals(data_file->block_count, 11);
+    mu_assert_int_equals(data_file->free_block_count, 1);
+    mu_assert_int_equals(count_events(data_file), 12);
+    sky_data_file_free(data_file);
+
+    // Free blocks are found again when the data file is reloaded.
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->free_block_count, 1);
+    mu_assert_int_equals(count_events(data_file), 12);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+
+//--------------------------------------
+// Compression
+//--------------------------------------
+
+int test_sky_data_file_compress() {
+    uint32_t count;
+    sky_data_file *data_file;
+    cleantmp();
+
+    // Write three objects with four events each into their own blocks.
+    sky_bulk_loader *loader = sky_bulk_loader_create();
+    loader->block_size = 64;
+    loader->fill_factor = 1.0;
+    loader->path = bfromcstr("tmp/data");
+    loader->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0);
+    int64_t i;
+    for(i=0; i<12; i++) {
+        sky_event *event = sky_event_create((i/4)+1, i * 10, 1);
+        mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0);
+        sky_event_free(event);
+    }
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    sky_bulk_loader_free(loader);
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->version, SKY_DATA_FILE_RAW_VERSION);
+    mu_assert_int_equals(data_file->block_count, 3);
+
+    // Compressing upgrades the data file and shrinks every block.
+    mu_assert_int_equals(sky_data_file_compress(data_file, &count), 0);
+    mu_assert_int_equals(count, 3);
+    mu_assert_int_equals(data_file->version, SKY_DATA_FILE_COMPRESSED_VERSION);
+    for(i=0; i<3; i++) {
+        mu_assert(data_file->blocks[i]->compressed_length > 0, "");
+        mu_assert(data_file->blocks[i]->compressed_length < 52, "");
+    }
+    mu_assert_int_equals(count_events(data_file), 12);
+    sky_data_file_free(data_file);
+
+    // The compressed lengths are stored in the header.
+    struct tagbstring header_path = bsStatic("tmp/header");
+    mu_assert_long_equals(sky_file_get_size(&header_path), 92L);
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->version, SKY_DATA_FILE_COMPRESSED_VERSION);
+    mu_assert(data_file->blocks[1]->compressed_length > 0, "");
+    mu_assert_int_equals(count_events(data_file), 12);
+
+    // Adding an event decompresses the block.
+    ADD_EVENT(2, 45LL, 1);
+    mu_assert_int_equals(data_file->blocks[1]->compressed_length, 0);
+    mu_assert(data_file->blocks[0]->compressed_length > 0, "");
+    mu_assert_int_equals(count_events(data_file), 13);
+    sky_data_file_free(data_file);
+
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->blocks[1]->compressed_length, 0);
+    mu_assert_int_equals(count_events(data_file), 13);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+//--------------------------------------
+// Delta Encoding
+//--------------------------------------
+
+#define DELTA_EVENT_COUNT 120
+
+int test_sky_data_file_delta_encoding() {
+    uint32_t i;
+    sky_data_file *data_file;
+    cleantmp();
+    sky_data_file *a = sky_data_file_create();
+    a->block_size = 64;
+    a->path = bfromcstr("tmp/a_data");
+    a->header_path = bfromcstr("tmp/a_header");
+    mu_assert_int_equals(sky_data_file_load(a), 0);
+
+    data_file = sky_data_file_create();
+    data_file->version = SKY_DATA_FILE_DELTA_VERSION;
+    data_file->block_size = 64;
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+
+    // Insert out of order so events are added to the start, middle and end
+    // of paths and blocks are split and spanned.
+    for(i=0; i<DELTA_EVENT_COUNT-BATCH_EVENT_COUNT; i++) {
+        sky_event *event = sky_event_create((i % 3) + 1, ((i * 37) % 101) * 1000 + i, (i % 4) + 1);
+        mu_assert_int_equals(sky_data_file_add_event(a, event), 0);
+        mu_assert_int_equals(sky_data_file_add_event(data_file, event), 0);
+        sky_event_free(event);
+    }
+
+    // Merge a batch of events into the existing paths.
+    sky_event *events[BATCH_EVENT_COUNT];
+    for(i=0; i<BATCH_EVENT_COUNT; i++) {
+        events[i] = sky_event_create(BATCH_OBJECT_IDS[i] + 100, BATCH_TIMESTAMPS[i], (sky_action_id_t)(i+1));
+    }
+    mu_assert_int_equals(sky_data_file_add_events(a, events, BATCH_EVENT_COUNT), 0);
+    mu_assert_int_equals(sky_data_file_add_events(data_file, events, BATCH_EVENT_COUNT), 0);
+    for(i=0; i<BATCH_EVENT_COUNT; i++) {
+        sky_event_free(events[i]);
+    }
+    mu_assert_bool(data_file->block_count < a->block_count);
+    sky_data_file_free(data_file);
+
+    // Both encodings store the same events.
+    sky_object_id_t a_object_ids[DELTA_EVENT_COUNT], object_ids[DELTA_EVENT_COUNT];
+    sky_timestamp_t a_timestamps[DELTA_EVENT_COUNT], timestamps[DELTA_EVENT_COUNT];
+    sky_action_id_t a_action_ids[DELTA_EVENT_COUNT], action_ids[DELTA_EVENT_COUNT];
+    mu_assert_int_equals(read_events(a, a_object_ids, a_timestamps, a_action_ids), DELTA_EVENT_COUNT);
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->version, SKY_DATA_FILE_DELTA_VERSION);
+    mu_assert_int_equals(count_events(data_file), DELTA_EVENT_COUNT);
+    mu_assert_int_equals(read_events(data_file, object_ids, timestamps, action_ids), DELTA_EVENT_COUNT);
+    for(i=0; i<DELTA_EVENT_COUNT; i++) {
+        mu_assert_int_equals(object_ids[i], a_object_ids[i]);
+        mu_assert_int64_equals(timestamps[i], a_timestamps[i]);
+        mu_assert_int_equals(action_ids[i], a_action_ids[i]);
+    }
+    sky_data_file_free(data_file);
+    sky_data_file_free(a);
+    return 0;
+}
+
+
+// Creates an event with eight int properties that are derived from its
+// timestamp.
+sky_event *create_wide_event(sky_object_id_t object_id, sky_timestamp_t timestamp)
+{
+    sky_event *event = sky_event_create(object_id, timestamp, 1);
+    event->data_count = 8;
+    event->data = calloc(event->data_count, sizeof(*event->data));
+    sky_property_id_t key;
+    for(key=1; key<=8; key++) {
+        event->data[8-key] = sky_event_data_create_int(key, timestamp + key);
+    }
+    return event;
+}
+
+int test_sky_data_file_indexed_events() {
+    uint32_t i;
+    size_t sz;
+    sky_data_file *data_file = sky_data_file_create();
+    cleantmp();
+    data_file->version = SKY_DATA_FILE_INDEXED_VERSION;
+    data_file->block_size = 256;
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+
+    // Insert out of order so events are rebased and blocks are split.
+    for(i=0; i<30; i++) {
+        sky_event *event = create_wide_event((i % 3) + 1, ((i * 37) % 101) * 1000 + i);
+        mu_assert_int_equals(sky_data_file_add_event(data_file, event), 0);
+        sky_event_free(event);
+    }
+    sky_event *events[5];
+    for(i=0; i<5; i++) {
+        events[i] = create_wide_event(BATCH_OBJECT_IDS[i], BATCH_TIMESTAMPS[i]);
+    }
+    mu_assert_int_equals(sky_data_file_add_events(data_file, events, 5), 0);
+    for(i=0; i<5; i++) {
+        sky_event_free(events[i]);
+    }
+    sky_data_file_free(data_file);
+
+    // Every event is indexed and its properties can be found.
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->version, SKY_DATA_FILE_INDEXED_VERSION);
+    mu_assert_int_equals(count_events(data_file), 35);
+    uint32_t count = 0;
+    for(i=0; i<data_file->block_count; i++) {
+        sky_path_iterator iterator;
+        sky_path_iterator_init(&iterator);
+        sky_path_iterator_set_block(&iterator, data_file->blocks[i]);
+        while(!iterator.eof) {
+            void *ptr;
+            sky_path_iterator_get_ptr(&iterator, &ptr);
+            sky_cursor cursor;
+            sky_cursor_init(&cursor);
+            cursor.wide = sky_data_file_is_wide(data_file);
+            sky_cursor_set_path(&cursor, ptr);
+            while(!cursor.eof) {
+                void *index_ptr, *value_ptr, *data_ptr;
+                uint32_t data_length;
+                mu_assert_int_equals(sky_cursor_get_data_index(&cursor, &index_ptr), 0);
+                mu_assert_bool(index_ptr != NULL);
+                mu_assert_int_equals(sky_event_find_indexed_data(index_ptr, 5, &value_ptr), 0);
+                mu_assert_bool(value_ptr != NULL);
+                mu_assert_int64_equals(minipack_unpack_int(value_ptr, &sz), cursor.timestamp + 5);
+
+                // The data section still starts with the first property.
+                mu_assert_int_equals(sky_cursor_get_data_ptr(&cursor, &data_ptr, &data_length), 0);
+                mu_assert_int_equals(*((sky_property_id_t*)data_ptr), 1);
+                mu_assert_int64_equals(minipack_unpack_int(data_ptr + sizeof(sky_property_id_t), &sz), cursor.timestamp + 1);
+
+                count++;
+                sky_cursor_next(&cursor);
+            }
+            sky_path_iterator_next(&iterator);
+        }
+    }
+    mu_assert_int_equals(count, 35);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+//--------------------------------------
+// Zone Maps
+//--------------------------------------
+
+#define LOAD_DATA_FILE_WITH_ZONE_MAPS() \
+    data_file = sky_data_file_create(); \
+    data_file->path = bfromcstr("tmp/data"); \
+    data_file->header_path = bfromcstr("tmp/header"); \
+    data_file->zone_map_path = bfromcstr("tmp/zones"); \
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+
+int test_sky_data_file_zone_maps() {
+    bool match;
+    sky_data_file *data_file;
+    struct tagbstring zone_map_path = bsStatic("tmp/zones");
+    cleantmp();
+    BULK_LOAD_UNDERFILLED(3);
+
+    // Zone maps are built when they are first needed.
+    LOAD_DATA_FILE_WITH_ZONE_MAPS();
+    sky_zone_map_predicate predicate;
+    memset(&predicate, 0, sizeof(predicate));
+    predicate.action_id = 2;
+    mu_assert_bool(!data_file->blocks[0]->zone_map_loaded);
+    mu_assert_int_equals(sky_block_matches(data_file->blocks[0], &predicate, &match), 0);
+    mu_assert_bool(!match);
+    mu_assert_bool(data_file->blocks[0]->zone_map_loaded);
+    sky_data_file_free(data_file);
+
+    // Loaded zone maps are saved on unload and the file is removed once it
+    // is read.
+    mu_assert_bool(sky_file_exists(&zone_map_path));
+    LOAD_DATA_FILE_WITH_ZONE_MAPS();
+    mu_assert_bool(!sky_file_exists(&zone_map_path));
+    mu_assert_bool(data_file->blocks[0]->zone_map_loaded);
+    mu_assert_bool(!data_file->blocks[1]->zone_map_loaded);
+    predicate.action_id = 1;
+    mu_assert_int_equals(sky_block_matches(data_file->blocks[0], &predicate, &match), 0);
+    mu_assert_bool(match);
+    sky_data_file_free(data_file);
+
+    // Zone maps are ignored if the header changes without them.
+    mu_assert_bool(sky_file_exists(&zone_map_path));
+    LOAD_DATA_FILE();
+    ADD_EVENT(1, 100LL, 2);
+    sky_data_file_free(data_file);
+    LOAD_DATA_FILE_WITH_ZONE_MAPS();
+    mu_assert_bool(!sky_file_exists(&zone_map_path));
+    mu_assert_bool(!data_file->blocks[0]->zone_map_loaded);
+    predicate.action_id = 2;
+    mu_assert_int_equals(sky_block_matches(data_file->blocks[0], &predicate, &match), 0);
+    mu_assert_bool(match);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+int test_sky_data_file_access_hints() {
+    sky_data_file *data_file;
+    cleantmp();
+    BULK_LOAD_UNDERFILLED(3);
+
+    // Huge pages are optional and don't stop the data file from loading.
+    data_file = sky_data_file_create();
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    data_file->huge_pages = true;
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    mu_assert_int_equals(data_file->block_count, 3);
+
+    mu_assert_int_equals(sky_data_file_advise(data_file, MADV_SEQUENTIAL), 0);
+    mu_assert_int_equals(sky_data_file_prefetch_block(data_file, data_file->blocks[2]), 0);
+    mu_assert_int_equals(sky_data_file_advise(data_file, MADV_NORMAL), 0);
+    mu_assert_int_equals(sky_data_file_warm(data_file), 0);
+    mu_assert_int_equals(*((uint32_t*)(data_file->data + 128)), 3);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+//--------------------------------------
+// Extents
+//--------------------------------------
+
+int test_sky_data_file_extents() {
+    sky_data_file *data_file;
+    struct tagbstring path = bsStatic("tmp/data");
+    cleantmp();
+    data_file = sky_data_file_create();
+    data_file->block_size = 64;
+    data_file->extent_size = 4;
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    mu_assert_int_equals(data_file->block_count, 1);
+    mu_assert_int_equals(data_file->allocated_block_count, 4);
+
+    // Blocks within the extent are created without remapping and the file
+    // is only as long as its blocks.
+    void *data = data_file->data;
+    sky_object_id_t object_id = 1;
+    while(data_file->block_count < 4) {
+        ADD_EVENT_WITH_DATA(object_id++, 10LL, 1, 1, "0123456789abcdef");
+        mu_assert_bool(data_file->data == data);
+        mu_assert_int_equals(data_file->allocated_block_count, 4);
+        mu_assert_long_equals(sky_file_get_size(&path), (long)(data_file->block_count * 64));
+    }
+
+    // The next block grows the allocation by another extent.
+    while(data_file->block_count < 5) {
+        ADD_EVENT_WITH_DATA(object_id++, 10LL, 1, 1, "0123456789abcdef");
+    }
+    mu_assert_int_equals(data_file->allocated_block_count, 8);
+    mu_assert_long_equals(sky_file_get_size(&path), 5 * 64L);
+    mu_assert_int_equals(count_events(data_file), (uint32_t)(object_id - 1));
+    sky_data_file_free(data_file);
+
+    // Reloading starts a new extent from the blocks in the file.
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->block_count, 5);
+    mu_assert_int_equals(data_file->allocated_block_count, SKY_DEFAULT_EXTENT_SIZE);
+    mu_assert_long_equals(sky_file_get_size(&path), 5 * 64L);
+    mu_assert_int_equals(count_events(data_file), (uint32_t)(object_id - 1));
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+//--------------------------------------
+// Wide Object Ids
+//--------------------------------------
+
+int test_sky_data_file_wide_object_ids() {
+    uint32_t i;
+    sky_data_file *data_file;
+    cleantmp();
+
+    // Narrow data files reject object ids larger than 32 bits.
+    data_file = sky_data_file_create();
+    data_file->block_size = 64;
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    sky_event *event = sky_event_create(1ULL << 40, 10LL, 1);
+    mu_assert_int_equals(sky_data_file_add_event(data_file, event), -1);
+    sky_event_free(event);
+    sky_data_file_free(data_file);
+
+    // Insert out of order into a wide data file so that blocks are split.
+    cleantmp();
+    data_file = sky_data_file_create();
+    data_file->version = SKY_DATA_FILE_WIDE_VERSION;
+    data_file->block_size = 64;
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    sky_object_id_t wide_object_ids[] = {1ULL << 40, 5, UINT64_MAX - 1, 300, (1ULL << 32) + 1};
+    for(i=0; i<30; i++) {
+        ADD_EVENT(wide_object_ids[i % 5], ((i * 37) % 101) + 1, (i % 4) + 1);
+    }
+    sky_event *events[3];
+    for(i=0; i<3; i++) {
+        events[i] = sky_event_create(wide_object_ids[i], 1000LL + i, 1);
+    }
+    mu_assert_int_equals(sky_data_file_add_events(data_file, events, 3), 0);
+    for(i=0; i<3; i++) {
+        sky_event_free(events[i]);
+    }
+    mu_assert_bool(data_file->block_count > 1);
+    sky_data_file_free(data_file);
+
+    // Object ids and block ranges are read back in full.
+    sky_object_id_t object_ids[33];
+    sky_timestamp_t timestamps[33];
+    sky_action_id_t action_ids[33];
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(data_file->version, SKY_DATA_FILE_WIDE_VERSION);
+    mu_assert_int_equals(count_events(data_file), 33);
+    mu_assert_int_equals(read_events(data_file, object_ids, timestamps, action_ids), 33);
+    mu_assert_bool(object_ids[0] == 5);
+    mu_assert_bool(object_ids[32] == UINT64_MAX - 1);
+    for(i=1; i<33; i++) {
+        mu_assert_bool(object_ids[i] >= object_ids[i-1]);
+    }
+    mu_assert_bool(data_file->blocks[data_file->block_count-1]->max_object_id == UINT64_MAX - 1);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+//--------------------------------------
+// Shadow Blocks
+//--------------------------------------
+
+#define LOAD_SHADOWED_DATA_FILE() \
+    data_file = sky_data_file_create(); \
+    data_file->shadow_blocks = true; \
+    data_file->path = bfromcstr("tmp/data"); \
+    data_file->header_path = bfromcstr("tmp/header"); \
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+
+int test_sky_data_file_shadow_blocks() {
+    uint32_t merge_count;
+    sky_data_file *data_file;
+    struct tagbstring header_path = bsStatic("tmp/header");
+    struct tagbstring published_header_path = bsStatic("tmp/header.published");
+    cleantmp();
+    BULK_LOAD_UNDERFILLED(3);
+    LOAD_SHADOWED_DATA_FILE();
+    mu_assert_int_equals(data_file->block_count, 3);
+    mu_assert_int_equals(sky_file_cp(&header_path, &published_header_path), 0);
+
+    // Changing a block copies it to a new slot and leaves the original.
+    sky_block *block = data_file->blocks[1];
+    mu_assert_int_equals(block->index, 1);
+    uint8_t original[64];
+    memcpy(original, data_file->data + 64, 64);
+    ADD_EVENT(2, 25LL, 1);
+    mu_assert_int_equals(block->index, 3);
+    mu_assert_int_equals(data_file->block_count, 4);
+    mu_assert_int_equals(data_file->retired_block_count, 1);
+    mu_assert_int_equals(data_file->retired_blocks[0]->index, 1);
+    mu_assert_bool(memcmp(data_file->data + 64, original, 64) == 0);
+    mu_assert_int_equals(count_events(data_file), 4);
+
+    // The header on disk is unchanged until the data file is flushed.
+    mu_assert_file("tmp/header", "tmp/header.published");
+    mu_assert_int_equals(sky_data_file_flush(data_file), 0);
+    mu_assert_long_equals(sky_file_get_size(&header_path), 8L + (4 * 24L));
+    mu_assert_int_equals(data_file->retired_block_count, 0);
+    mu_assert_int_equals(data_file->free_block_count, 1);
+    mu_assert_bool(data_file->free_blocks[0]->index == 1);
+    mu_assert_bool(block->published);
+
+    // Changing the block again reuses the freed slot.
+    ADD_EVENT(2, 26LL, 1);
+    mu_assert_int_equals(block->index, 1);
+    mu_assert_int_equals(data_file->block_count, 4);
+    mu_assert_int_equals(data_file->retired_blocks[0]->index, 3);
+    sky_data_file_free(data_file);
+
+    // Blocks are read back from the published header.
+    LOAD_SHADOWED_DATA_FILE();
+    mu_assert_int_equals(data_file->block_count, 4);
+    mu_assert_int_equals(data_file->free_block_count, 1);
+    mu_assert_int_equals(count_events(data_file), 5);
+
+    // Merged blocks are shadowed as well and free blocks are only removed
+    // from the end of the file.
+    mu_assert_int_equals(sky_data_file_compact(data_file, 1.0, 0, &merge_count), 0);
+    mu_assert_int_equals(merge_count, 1);
+    mu_assert_int_equals(count_events(data_file), 5);
+    sky_data_file_free(data_file);
+
+    LOAD_SHADOWED_DATA_FILE();
+    mu_assert_int_equals(count_events(data_file), 5);
+    mu_assert_int_equals(data_file->free_block_count, data_file->block_count - 2);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+//--------------------------------------
+// Archive
+//--------------------------------------
+
+#define LOAD_ARCHIVED_DATA_FILE() \
+    data_file = sky_data_file_create(); \
+    data_file->path = bfromcstr("tmp/data"); \
+    data_file->header_path = bfromcstr("tmp/header"); \
+    data_file->archive_path = bfromcstr("tmp/archive"); \
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+
+int test_sky_data_file_archive() {
+    uint32_t count;
+    sky_data_file *data_file;
+    struct tagbstring archive_path = bsStatic("tmp/archive");
+    cleantmp();
+    BULK_LOAD_UNDERFILLED(3);
+    LOAD_ARCHIVED_DATA_FILE();
+    mu_assert(sky_file_exists(&archive_path), "");
+
+    // Only blocks that are older than the timestamp are archived.
+    mu_assert_int_equals(sky_data_file_archive(data_file, 25LL, &count), 0);
+    mu_assert_int_equals(count, 2);
+    mu_assert_int_equals(data_file->version, SKY_DATA_FILE_COMPRESSED_VERSION);
+    mu_assert_bool(data_file->blocks[0]->archived);
+    mu_assert_bool(data_file->blocks[1]->archived);
+    mu_assert_bool(!data_file->blocks[2]->archived);
+    mu_assert(data_file->blocks[0]->compressed_length > 0, "");
+    mu_assert(sky_file_get_size(&archive_path) > 0, "");
+    mu_assert_int_equals(count_events(data_file), 3);
+
+    // Archived blocks are not archived again.
+    mu_assert_int_equals(sky_data_file_archive(data_file, 25LL, &count), 0);
+    mu_assert_int_equals(count, 0);
+    sky_data_file_free(data_file);
+
+    // The archived flag is stored in the header.
+    LOAD_ARCHIVED_DATA_FILE();
+    mu_assert_bool(data_file->blocks[0]->archived);
+    mu_assert_bool(data_file->blocks[1]->archived);
+    mu_assert_int_equals(count_events(data_file), 3);
+
+    // Archived blocks are read through the path iterator.
+    uint32_t path_count = 0;
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_data_file(&iterator, data_file), 0);
+    while(!iterator.eof) {
+        path_count++;
+        mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    }
+    mu_assert_int_equals(path_count, 3);
+
+    // Adding an event moves the block back into the data file.
+    ADD_EVENT(2, 25LL, 1);
+    mu_assert_bool(!data_file->blocks[1]->archived);
+    mu_assert_int_equals(data_file->blocks[1]->compressed_length, 0);
+    mu_assert_bool(data_file->blocks[0]->archived);
+    mu_assert_int_equals(count_events(data_file), 4);
+    sky_data_file_free(data_file);
+
+    LOAD_ARCHIVED_DATA_FILE();
+    mu_assert_bool(!data_file->blocks[1]->archived);
+    mu_assert_int_equals(count_events(data_file), 4);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+int test_sky_data_file_expire() {
+    uint32_t dropped_count, trimmed_count;
+    sky_data_file *data_file;
+    sky_object_id_t object_ids[10];
+    sky_timestamp_t timestamps[10];
+    sky_action_id_t action_ids[10];
+    cleantmp();
+    BULK_LOAD_UNDERFILLED(3);
+    LOAD_DATA_FILE();
+    ADD_EVENT(3, 35LL, 2);
+    ADD_EVENT(3, 40LL, 3);
+    mu_assert_int_equals(count_events(data_file), 5);
+
+    // Blocks that only have expired events are freed.
+    mu_assert_int_equals(sky_data_file_expire(data_file, 15LL, &dropped_count, &trimmed_count), 0);
+    mu_assert_int_equals(dropped_count, 1);
+    mu_assert_int_equals(trimmed_count, 0);
+    mu_assert_int_equals(data_file->block_count, 2);
+    mu_assert_int64_equals(data_file->blocks[0]->min_object_id, 2LL);
+    mu_assert_int64_equals(data_file->blocks[1]->min_object_id, 3LL);
+    mu_assert_int_equals(count_events(data_file), 4);
+
+    // Blocks with a mix of events have their expired events removed.
+    mu_assert_int_equals(sky_data_file_expire(data_file, 32LL, &dropped_count, &trimmed_count), 0);
+    mu_assert_int_equals(dropped_count, 1);
+    mu_assert_int_equals(trimmed_count, 1);
+    mu_assert_int_equals(data_file->block_count, 1);
+    mu_assert_int_equals(count_events(data_file), 2);
+    mu_assert_int64_equals(data_file->blocks[0]->min_timestamp, 35LL);
+
+    // Nothing changes once every remaining event is current.
+    mu_assert_int_equals(sky_data_file_expire(data_file, 32LL, &dropped_count, &trimmed_count), 0);
+    mu_assert_int_equals(dropped_count, 0);
+    mu_assert_int_equals(trimmed_count, 0);
+    sky_data_file_free(data_file);
+
+    // The remaining events are rebased and persisted.
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(read_events(data_file, object_ids, timestamps, action_ids), 2);
+    mu_assert_int64_equals(object_ids[0], 3LL);
+    mu_assert_int64_equals(timestamps[0], 35LL);
+    mu_assert_int_equals(action_ids[0], 2);
+    mu_assert_int64_equals(timestamps[1], 40LL);
+    mu_assert_int_equals(action_ids[1], 3);
+
+    // Freed blocks are reused for new paths.
+    ADD_EVENT(1, 50LL, 1);
+    mu_assert_int_equals(count_events(data_file), 3);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+int test_sky_data_file_runs() {
+    uint32_t count;
+    sky_bulk_loader *loader;
+    sky_data_file *data_file;
+    sky_object_id_t object_ids[10];
+    sky_timestamp_t timestamps[10];
+    sky_action_id_t action_ids[10];
+    struct tagbstring run_header_path = bsStatic("tmp/run.0.header");
+    cleantmp();
+    BULK_LOAD_UNDERFILLED(3);
+    LOAD_DATA_FILE();
+    data_file->run_path = bfromcstr("tmp/run");
+
+    // Runs are published when they are closed.
+    mu_assert_int_equals(sky_data_file_open_run(data_file, 0, &loader), 0);
+    sky_event *event = sky_event_create(2, 20LL, 2);
+    mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0);
+    sky_event_free(event);
+    event = sky_event_create(4, 5LL, 3);
+    mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0);
+    sky_event_free(event);
+    mu_assert_bool(!sky_file_exists(&run_header_path));
+    mu_assert_int_equals(sky_data_file_close_run(data_file, loader), 0);
+    mu_assert_bool(sky_file_exists(&run_header_path));
+    mu_assert_int_equals(sky_data_file_open_run(data_file, 0, &loader), 0);
+    event = sky_event_create(2, 25LL, 4);
+    mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(sky_data_file_close_run(data_file, loader), 0);
+    mu_assert_int_equals(data_file->run_count, 2);
+    sky_data_file_free(data_file);
+
+    // Runs are loaded with the data file and merged with its paths. Run
+    // events come before data file events with the same timestamp.
+    data_file = sky_data_file_create();
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    data_file->run_path = bfromcstr("tmp/run");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    mu_assert_int_equals(data_file->run_count, 2);
+
+    count = 0;
+    sky_cursor cursor;
+    sky_cursor_init(&cursor);
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_data_file(&iterator, data_file), 0);
+    while(!iterator.eof) {
+        mu_assert_int_equals(sky_path_iterator_set_cursor(&iterator, &cursor), 0);
+        while(!cursor.eof) {
+            object_ids[count] = iterator.current_object_id;
+            timestamps[count] = cursor.timestamp;
+            mu_assert_int_equals(sky_cursor_get_action_id(&cursor, &action_ids[count]), 0);
+            count++;
+            mu_assert_int_equals(sky_cursor_next(&cursor), 0);
+        }
+        mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    }
+    sky_cursor_uninit(&cursor);
+    mu_assert_int_equals(count, 6);
+    mu_assert_int64_equals(object_ids[0], 1LL);
+    mu_assert_int64_equals(object_ids[1], 2LL);
+    mu_assert_int_equals(action_ids[1], 2);
+    mu_assert_int64_equals(object_ids[2], 2LL);
+    mu_assert_int_equals(action_ids[2], 1);
+    mu_assert_int64_equals(timestamps[3], 25LL);
+    mu_assert_int_equals(action_ids[3], 4);
+    mu_assert_int64_equals(object_ids[4], 3LL);
+    mu_assert_int64_equals(object_ids[5], 4LL);
+    mu_assert_int64_equals(timestamps[5], 5LL);
+
+    // Merging adds the run events to the blocks and removes the runs.
+    mu_assert_int_equals(sky_data_file_merge_runs(data_file, 0, &count), 0);
+    mu_assert_int_equals(count, 3);
+    mu_assert_int_equals(data_file->run_count, 0);
+    mu_assert_bool(!sky_file_exists(&run_header_path));
+    sky_data_file_free(data_file);
+
+    LOAD_DATA_FILE();
+    mu_assert_int_equals(count_events(data_file), 6);
+    mu_assert_int_equals(read_events(data_file, object_ids, timestamps, action_ids), 6);
+    mu_assert_int64_equals(object_ids[1], 2LL);
+    mu_assert_int_equals(action_ids[1], 2);
+    mu_assert_int_equals(action_ids[2], 1);
+    mu_assert_int_equals(action_ids[3], 4);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+int test_sky_data_file_recover_merge() {
+    sky_bulk_loader *loader;
+    sky_data_file *data_file;
+    struct tagbstring data_path = bsStatic("tmp/data");
+    struct tagbstring header_path = bsStatic("tmp/header");
+    struct tagbstring merge_path = bsStatic("tmp/data.merge");
+    struct tagbstring merge_header_path = bsStatic("tmp/header.merge");
+    struct tagbstring manifest_path = bsStatic("tmp/run.merged");
+    struct tagbstring run_header_path = bsStatic("tmp/run.0.header");
+    cleantmp();
+    BULK_LOAD_UNDERFILLED(3);
+    LOAD_DATA_FILE();
+    data_file->run_path = bfromcstr("tmp/run");
+    mu_assert_int_equals(sky_data_file_open_run(data_file, 0, &loader), 0);
+    sky_event *event = sky_event_create(2, 20LL, 2);
+    mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(sky_data_file_close_run(data_file, loader), 0);
+    sky_data_file_free(data_file);
+
+    // Merged files without a manifest were never committed and are removed.
+    FILE *file = fopen("tmp/data.merge", "w");
+    fclose(file);
+    file = fopen("tmp/header.merge", "w");
+    fclose(file);
+    data_file = sky_data_file_create();
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    data_file->run_path = bfromcstr("tmp/run");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    mu_assert_bool(!sky_file_exists(&merge_path));
+    mu_assert_bool(!sky_file_exists(&merge_header_path));
+    mu_assert_int_equals(data_file->run_count, 1);
+    sky_data_file_free(data_file);
+
+    // A committed merge is finished when the data file is loaded.
+    mu_assert_int_equals(sky_file_cp(&data_path, &merge_path), 0);
+    mu_assert_int_equals(sky_file_cp(&header_path, &merge_header_path), 0);
+    uint32_t run_count = 1;
+    file = fopen("tmp/run.merged", "w");
+    mu_assert_int_equals(fwrite(&run_count, sizeof(run_count), 1, file), 1);
+    fclose(file);
+    data_file = sky_data_file_create();
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    data_file->run_path = bfromcstr("tmp/run");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    mu_assert_bool(!sky_file_exists(&merge_path));
+    mu_assert_bool(!sky_file_exists(&merge_header_path));
+    mu_assert_bool(!sky_file_exists(&manifest_path));
+    mu_assert_bool(!sky_file_exists(&run_header_path));
+    mu_assert_int_equals(data_file->run_count, 0);
+    mu_assert_int_equals(count_events(data_file), 3);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
 //==============================================================================
 //
 // Setup
@@ -401,6 +1525,8 @@ int all_tests() {
     mu_run_test(test_sky_data_file_load_empty);
 
     mu_run_test(test_sky_data_file_add_event_to_new_block);
+    mu_run_test(test_sky_data_file_flush);
+    mu_run_test(test_sky_data_file_flush_lsn);
     mu_run_test(test_sky_data_file_prepend_event_to_existing_path);
     mu_run_test(test_sky_data_file_append_event_to_existing_path);
 
@@ -427,6 +1553,29 @@ int all_tests() {
     mu_run_test(test_sky_data_file_add_event_to_start_of_ending_path_causing_block_span);
     mu_run_test(test_sky_data_file_add_event_to_end_of_ending_path_causing_block_span);
 
+    mu_run_test(test_sky_data_file_add_events_matches_individual_inserts);
+    mu_run_test(test_sky_data_file_add_events_causing_block_splits);
+
+    mu_run_test(test_sky_data_file_get_object_blocks);
+    mu_run_test(test_sky_data_file_add_event_after_span_uses_last_span_block);
+
+    mu_run_test(test_sky_data_file_compact);
+    mu_run_test(test_sky_data_file_compact_incrementally);
+    mu_run_test(test_sky_data_file_split_reuses_free_block);
+
+    mu_run_test(test_sky_data_file_compress);
+    mu_run_test(test_sky_data_file_delta_encoding);
+    mu_run_test(test_sky_data_file_indexed_events);
+    mu_run_test(test_sky_data_file_zone_maps);
+    mu_run_test(test_sky_data_file_access_hints);
+    mu_run_test(test_sky_data_file_extents);
+    mu_run_test(test_sky_data_file_wide_object_ids);
+    mu_run_test(test_sky_data_file_shadow_blocks);
+    mu_run_test(test_sky_data_file_archive);
+    mu_run_test(test_sky_data_file_expire);
+    mu_run_test(test_sky_data_file_runs);
+    mu_run_test(test_sky_data_file_recover_merge);
+
     return 0;
 }
 
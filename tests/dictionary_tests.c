@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <dictionary.h>
+#include <mem.h>
+#include <bstring.h>
+
+#include "minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Value Management
+//--------------------------------------
+
+int test_sky_dictionary_add_value() {
+    cleantmp();
+    struct tagbstring us = bsStatic("us");
+    struct tagbstring fr = bsStatic("fr");
+    struct tagbstring de = bsStatic("de");
+    sky_dictionary_id_t id;
+    bstring value;
+
+    sky_dictionary *dictionary = sky_dictionary_create();
+    dictionary->path = bfromcstr("tmp/dictionary");
+    mu_assert_int_equals(sky_dictionary_load(dictionary), 0);
+    mu_assert_int_equals(dictionary->count, 0);
+
+    // Ids are assigned in the order values are added.
+    mu_assert_int_equals(sky_dictionary_add_value(dictionary, &us, &id), 0);
+    mu_assert_int_equals(id, 1);
+    mu_assert_int_equals(sky_dictionary_add_value(dictionary, &fr, &id), 0);
+    mu_assert_int_equals(id, 2);
+    mu_assert_int_equals(sky_dictionary_add_value(dictionary, &us, &id), 0);
+    mu_assert_int_equals(id, 1);
+    mu_assert_int_equals(dictionary->count, 2);
+
+    // Lookups.
+    mu_assert_int_equals(sky_dictionary_find_by_value(dictionary, &fr, &id), 0);
+    mu_assert_int_equals(id, 2);
+    mu_assert_int_equals(sky_dictionary_find_by_value(dictionary, &de, &id), 0);
+    mu_assert_int_equals(id, 0);
+    mu_assert_int_equals(sky_dictionary_find_by_id(dictionary, 1, &value), 0);
+    mu_assert_bstring(value, "us");
+    mu_assert_int_equals(sky_dictionary_find_by_id(dictionary, 3, &value), 0);
+    mu_assert_bool(value == NULL);
+
+    sky_dictionary_free(dictionary);
+    return 0;
+}
+
+
+//--------------------------------------
+// Persistence
+//--------------------------------------
+
+int test_sky_dictionary_load() {
+    cleantmp();
+    char *values[] = {"safari", "chrome", "firefox", "chrome mobile"};
+    sky_dictionary_id_t id;
+    bstring value;
+
+    sky_dictionary *dictionary = sky_dictionary_create();
+    dictionary->path = bfromcstr("tmp/dictionary");
+    mu_assert_int_equals(sky_dictionary_load(dictionary), 0);
+    uint32_t i;
+    for(i=0; i<4; i++) {
+        bstring str = bfromcstr(values[i]);
+        mu_assert_int_equals(sky_dictionary_add_value(dictionary, str, &id), 0);
+        mu_assert_int_equals(id, i+1);
+        bdestroy(str);
+    }
+    sky_dictionary_free(dictionary);
+
+    // Reload the values from disk.
+    dictionary = sky_dictionary_create();
+    dictionary->path = bfromcstr("tmp/dictionary");
+    mu_assert_int_equals(sky_dictionary_load(dictionary), 0);
+    mu_assert_int_equals(dictionary->count, 4);
+    for(i=0; i<4; i++) {
+        bstring str = bfromcstr(values[i]);
+        mu_assert_int_equals(sky_dictionary_find_by_value(dictionary, str, &id), 0);
+        mu_assert_int_equals(id, i+1);
+        mu_assert_int_equals(sky_dictionary_find_by_id(dictionary, i+1, &value), 0);
+        mu_assert_bool(biseq(value, str) == 1);
+        bdestroy(str);
+    }
+
+    sky_dictionary_free(dictionary);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_dictionary_add_value);
+    mu_run_test(test_sky_dictionary_load);
+    return 0;
+}
+
+RUN_TESTS()
@@ -103,6 +103,7 @@ int test_sky_eadd_message_process() {
     FILE *output = fopen("tmp/output", "w");
     mu_assert(sky_eadd_message_process(message, table, output) == 0, "");
     fclose(output);
+    mu_assert_int_equals(sky_table_checkpoint(table), 0);
     mu_assert_file("tmp/0/header", "tests/fixtures/eadd_message/1/table/post/0/header");
     mu_assert_file("tmp/0/data", "tests/fixtures/eadd_message/1/table/post/0/data");
     mu_assert_file("tmp/output", "tests/fixtures/eadd_message/1/output");
@@ -4,6 +4,7 @@
 #include <errno.h>
 
 #include <event.h>
+#include <minipack.h>
 #include <mem.h>
 
 #include "minunit.h"
@@ -35,6 +36,12 @@ char ACTION_DATA_EVENT_DATA[] =
     "\xa3\x66\x6f\x6f\x02\xa3\x62\x61\x72"
 ;
 
+// Timestamp 30 relative to a base of 10.
+size_t DELTA_ACTION_DATA_EVENT_DATA_LENGTH = 14;
+char DELTA_ACTION_DATA_EVENT_DATA[] = 
+    "\x07\x28\x14\x0a\x01\xa3\x66\x6f\x6f\x02\xa3\x62\x61\x72"
+;
+
 
 //==============================================================================
 //
@@ -259,6 +266,159 @@ int test_sky_event_action_data_event_unpack() {
     return 0;
 }
 
+//--------------------------------------
+// Delta Encoding
+//--------------------------------------
+
+int test_sky_event_delta_event_pack() {
+    size_t sz;
+    void *addr = calloc(DELTA_ACTION_DATA_EVENT_DATA_LENGTH, 1);
+    sky_event *event = sky_event_create(0, 30LL, 20);
+    sky_event_set_data(event, 1, &foo);
+    sky_event_set_data(event, 2, &bar);
+    mu_assert_long_equals(sky_event_sizeof_delta(event, 10LL), DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    sky_event_pack_delta(event, 10LL, addr, &sz);
+    sky_event_free(event);
+    mu_assert_long_equals(sz, DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    mu_assert_mem(addr, &DELTA_ACTION_DATA_EVENT_DATA, DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    mu_assert_long_equals(sky_event_sizeof_raw(addr), DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    free(addr);
+    return 0;
+}
+
+int test_sky_event_delta_event_unpack() {
+    size_t sz;
+    sky_event *event = sky_event_create(0, 0, 0);
+    sky_event_unpack_delta(event, 10LL, &DELTA_ACTION_DATA_EVENT_DATA, &sz);
+
+    mu_assert_long_equals(sz, DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    mu_assert_int64_equals(event->timestamp, 30LL);
+    mu_assert(event->action_id == 20, "Expected action id to equal 20");
+    mu_assert(event->data_count == 2, "Expected data count to be 2");
+
+    sky_event_data *data = NULL;
+    sky_event_get_data(event, 2, &data);
+    mu_assert(biseqcstr(data->string_value, "bar"), "Expected data 2 to equal 'bar'");
+
+    sky_event_free(event);
+    return 0;
+}
+
+int test_sky_event_delta_event_rebase() {
+    size_t sz;
+    char buffer[32];
+
+    // Rebasing onto a distant timestamp widens the timestamp offset.
+    mu_assert_long_equals(sky_event_sizeof_raw_rebased(&DELTA_ACTION_DATA_EVENT_DATA, 30LL, -1000LL), 15L);
+    mu_assert_int_equals(sky_event_rebase_raw(&DELTA_ACTION_DATA_EVENT_DATA, 30LL, -1000LL, buffer, &sz), 0);
+    mu_assert_long_equals(sz, 15L);
+
+    sky_event *event = sky_event_create(0, 0, 0);
+    sky_event_unpack_delta(event, -1000LL, buffer, &sz);
+    mu_assert_long_equals(sz, 15L);
+    mu_assert_int64_equals(event->timestamp, 30LL);
+    mu_assert(event->action_id == 20, "Expected action id to equal 20");
+    mu_assert(event->data_count == 2, "Expected data count to be 2");
+    sky_event_free(event);
+    return 0;
+}
+
+
+//--------------------------------------
+// Indexed Encoding
+//--------------------------------------
+
+// Creates an event with ten int properties that are added out of order.
+sky_event *create_indexed_event() {
+    sky_event *event = sky_event_create(0, 30LL, 20);
+    event->data_count = 10;
+    event->data = calloc(event->data_count, sizeof(*event->data));
+    uint32_t i;
+    for(i=0; i<event->data_count; i++) {
+        sky_property_id_t key = (i % 2 == 0 ? 10 - i : -(sky_property_id_t)i);
+        event->data[i] = sky_event_data_create_int(key, (int64_t)key * 1000);
+    }
+    return event;
+}
+
+int test_sky_event_indexed_event_pack() {
+    size_t sz;
+    char buffer[128];
+    void *ptr;
+    size_t _sz;
+
+    // Events with only a few properties are not indexed.
+    sky_event *event = sky_event_create(0, 30LL, 20);
+    sky_event_set_data(event, 1, &foo);
+    sky_event_set_data(event, 2, &bar);
+    mu_assert_long_equals(sky_event_sizeof_indexed(event, 10LL), DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    mu_assert_int_equals(sky_event_pack_indexed(event, 10LL, buffer, &sz), 0);
+    mu_assert_long_equals(sz, DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    mu_assert_mem(buffer, &DELTA_ACTION_DATA_EVENT_DATA, DELTA_ACTION_DATA_EVENT_DATA_LENGTH);
+    sky_event_free(event);
+
+    // Wide events are indexed.
+    event = create_indexed_event();
+    size_t expected_sz = sky_event_sizeof_delta(event, 10LL) + sky_event_sizeof_index(event);
+    mu_assert_long_equals(sky_event_sizeof_index(event), 21L);
+    mu_assert_long_equals(sky_event_sizeof_indexed(event, 10LL), expected_sz);
+    mu_assert_int_equals(sky_event_pack_indexed(event, 10LL, buffer, &sz), 0);
+    mu_assert_long_equals(sz, expected_sz);
+    mu_assert_long_equals(sky_event_sizeof_raw(buffer), expected_sz);
+    mu_assert_bool(*((sky_event_flag_t*)buffer) & SKY_EVENT_FLAG_INDEXED);
+    sky_event_free(event);
+
+    // Every property can be found through the index.
+    void *index_ptr = buffer + 4;
+    sky_property_id_t key;
+    for(key=-9; key<=10; key++) {
+        mu_assert_int_equals(sky_event_find_indexed_data(index_ptr, key, &ptr), 0);
+        if(key == 0 || (key > 0 && key % 2 != 0) || (key < 0 && -key % 2 != 1)) {
+            mu_assert_bool(ptr == NULL);
+        }
+        else {
+            mu_assert_bool(ptr != NULL);
+            mu_assert_int64_equals(minipack_unpack_int(ptr, &_sz), (int64_t)key * 1000);
+        }
+    }
+    return 0;
+}
+
+int test_sky_event_indexed_event_unpack() {
+    size_t sz, rebased_sz;
+    char buffer[128];
+    char rebased[128];
+
+    sky_event *event = create_indexed_event();
+    sky_event_pack_indexed(event, 10LL, buffer, &sz);
+    sky_event_free(event);
+
+    // Unpacking skips over the index.
+    event = sky_event_create(0, 0, 0);
+    mu_assert_int_equals(sky_event_unpack_delta(event, 10LL, buffer, &rebased_sz), 0);
+    mu_assert_long_equals(rebased_sz, sz);
+    mu_assert_int64_equals(event->timestamp, 30LL);
+    mu_assert(event->action_id == 20, "Expected action id to equal 20");
+    mu_assert_int_equals(event->data_count, 10);
+    mu_assert_int_equals(event->data[0]->key, -9);
+    mu_assert_int_equals(event->data[9]->key, 10);
+    mu_assert_int64_equals(event->data[9]->int_value, 10000LL);
+    sky_event_free(event);
+
+    // Rebasing keeps the index.
+    mu_assert_long_equals(sky_event_sizeof_raw_rebased(buffer, 30LL, -1000LL), sz + 1);
+    mu_assert_int_equals(sky_event_rebase_raw(buffer, 30LL, -1000LL, rebased, &rebased_sz), 0);
+    mu_assert_long_equals(rebased_sz, sz + 1);
+    mu_assert_bool(*((sky_event_flag_t*)rebased) & SKY_EVENT_FLAG_INDEXED);
+    event = sky_event_create(0, 0, 0);
+    mu_assert_int_equals(sky_event_unpack_delta(event, -1000LL, rebased, &rebased_sz), 0);
+    mu_assert_long_equals(rebased_sz, sz + 1);
+    mu_assert_int64_equals(event->timestamp, 30LL);
+    mu_assert_int_equals(event->data_count, 10);
+    sky_event_free(event);
+    return 0;
+}
+
 
 
 //==============================================================================
@@ -287,6 +447,13 @@ int all_tests() {
     mu_run_test(test_sky_event_data_event_unpack);
     mu_run_test(test_sky_event_action_data_event_unpack);
 
+    mu_run_test(test_sky_event_delta_event_pack);
+    mu_run_test(test_sky_event_delta_event_unpack);
+    mu_run_test(test_sky_event_delta_event_rebase);
+
+    mu_run_test(test_sky_event_indexed_event_pack);
+    mu_run_test(test_sky_event_indexed_event_unpack);
+
     return 0;
 }
 
@@ -37,6 +37,34 @@ int test_sky_importer_import() {
     return 0;
 }
 
+int test_sky_importer_import_rejects_wide_object_id_in_narrow_file() {
+    cleantmp();
+    sky_importer *importer = sky_importer_create();
+    importer->path = bfromcstr("tmp");
+    
+    FILE *file = fopen("tests/fixtures/importer/1/data.json", "r");
+    int rc = sky_importer_import(importer, file);
+    mu_assert_int_equals(rc, -1);
+    fclose(file);
+
+    sky_importer_free(importer);
+    return 0;
+}
+
+int test_sky_importer_import_rejects_negative_object_id() {
+    cleantmp();
+    sky_importer *importer = sky_importer_create();
+    importer->path = bfromcstr("tmp");
+    
+    FILE *file = fopen("tests/fixtures/importer/2/data.json", "r");
+    int rc = sky_importer_import(importer, file);
+    mu_assert_int_equals(rc, -1);
+    fclose(file);
+
+    sky_importer_free(importer);
+    return 0;
+}
+
 
 //==============================================================================
 //
@@ -46,6 +74,8 @@ int test_sky_importer_import() {
 
 int all_tests() {
     mu_run_test(test_sky_importer_import);
+    mu_run_test(test_sky_importer_import_rejects_wide_object_id_in_narrow_file);
+    mu_run_test(test_sky_importer_import_rejects_negative_object_id);
     return 0;
 }
 
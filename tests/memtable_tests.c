@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memtable.h>
+#include <mem.h>
+
+#include "minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Event Management
+//--------------------------------------
+
+int test_sky_memtable_add_event() {
+    sky_memtable *memtable = sky_memtable_create();
+
+    // Events are copied into the memtable.
+    sky_event *event = sky_event_create(2, 10LL, 1);
+    mu_assert_int_equals(sky_memtable_add_event(memtable, event), 0);
+    sky_event_free(event);
+    sky_object_id_t i;
+    for(i=1; i<=100; i++) {
+        event = sky_event_create(i, 20LL, 2);
+        mu_assert_int_equals(sky_memtable_add_event(memtable, event), 0);
+        sky_event_free(event);
+    }
+    mu_assert_int_equals(memtable->event_count, 101);
+    mu_assert_bool(!memtable->sorted);
+    mu_assert_int64_equals(memtable->entries[0].event->object_id, 2LL);
+
+    // Clearing keeps the entry list.
+    mu_assert_int_equals(sky_memtable_clear(memtable), 0);
+    mu_assert_int_equals(memtable->event_count, 0);
+    mu_assert_bool(memtable->capacity >= 101);
+
+    sky_memtable_free(memtable);
+    return 0;
+}
+
+int test_sky_memtable_sort() {
+    sky_memtable *memtable = sky_memtable_create();
+
+    // Events with the same object and timestamp are sorted last-to-first.
+    sky_object_id_t object_ids[] = {3, 1, 3, 2, 1, 3};
+    sky_timestamp_t timestamps[] = {20, 10, 10, 5, 10, 20};
+    uint32_t i;
+    for(i=0; i<6; i++) {
+        sky_event *event = sky_event_create(object_ids[i], timestamps[i], i+1);
+        mu_assert_int_equals(sky_memtable_add_event(memtable, event), 0);
+        sky_event_free(event);
+    }
+    mu_assert_int_equals(sky_memtable_sort(memtable), 0);
+    mu_assert_bool(memtable->sorted);
+
+    sky_action_id_t action_ids[] = {5, 2, 4, 3, 6, 1};
+    for(i=0; i<6; i++) {
+        mu_assert_int_equals(memtable->entries[i].event->action_id, action_ids[i]);
+    }
+
+    sky_memtable_free(memtable);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_memtable_add_event);
+    mu_run_test(test_sky_memtable_sort);
+    return 0;
+}
+
+RUN_TESTS()
@@ -1,9 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <dbg.h>
 #include <mem.h>
 #include <path_iterator.h>
+#include <bulk_loader.h>
 
 #include "minunit.h"
 
@@ -89,6 +91,7 @@ int test_sky_path_iterator_data_file_next() {
     mu_assert(iterator->block == NULL, "");
     mu_assert(iterator->data_file == data_file, "");
     mu_assert_int_equals(iterator->block_index, 0);
+    mu_assert_int_equals(iterator->prefetch_index, data_file->block_count);
 
     // Path 1
     rc = sky_path_iterator_get_ptr(iterator, &ptr);
@@ -138,6 +141,210 @@ int test_sky_path_iterator_data_file_next() {
     return 0;
 }
 
+int test_sky_path_iterator_data_file_spanned_ptrs() {
+    loadtmp("tests/fixtures/path_iterator/1");
+    void **ptrs;
+    uint32_t count;
+    sky_data_file *data_file = sky_data_file_create();
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    sky_data_file_load(data_file);
+
+    sky_path_iterator *iterator = sky_path_iterator_create();
+    sky_path_iterator_set_data_file(iterator, data_file);
+
+    // Paths that aren't spanned have one segment.
+    mu_assert_int_equals(sky_path_iterator_get_ptrs(iterator, &ptrs, &count), 0);
+    mu_assert_int_equals(count, 1);
+    mu_assert_long_equals(ptrs[0]-data_file->data, 0L);
+
+    // Spanned paths return the segment in each block.
+    sky_path_iterator_next(iterator);
+    sky_path_iterator_next(iterator);
+    mu_assert_int_equals(iterator->current_object_id, 4);
+    mu_assert_int_equals(sky_path_iterator_get_ptrs(iterator, &ptrs, &count), 0);
+    mu_assert_int_equals(count, 2);
+    mu_assert_long_equals(ptrs[0]-data_file->data, 64L);
+    mu_assert_long_equals(ptrs[1]-data_file->data, 192L);
+
+    // A cursor reads the events of every segment.
+    sky_cursor *cursor = sky_cursor_create();
+    void **cursor_ptrs = malloc(sizeof(*cursor_ptrs) * count);
+    memcpy(cursor_ptrs, ptrs, sizeof(*cursor_ptrs) * count);
+    mu_assert_int_equals(sky_cursor_set_paths(cursor, cursor_ptrs, count), 0);
+    mu_assert_long_equals(cursor->timestamp, 26LL);
+    mu_assert_int_equals(sky_cursor_next(cursor), 0);
+    mu_assert_bool(!cursor->eof);
+    mu_assert_long_equals(cursor->timestamp, 27LL);
+    mu_assert_int_equals(sky_cursor_next(cursor), 0);
+    mu_assert_bool(cursor->eof);
+    sky_cursor_free(cursor);
+
+    // The span is only returned once.
+    sky_path_iterator_next(iterator);
+    mu_assert_int_equals(iterator->current_object_id, 5);
+    mu_assert_int_equals(sky_path_iterator_get_ptrs(iterator, &ptrs, &count), 0);
+    mu_assert_int_equals(count, 1);
+
+    sky_path_iterator_free(iterator);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+//--------------------------------------
+// Predicate
+//--------------------------------------
+
+// Counts the paths returned by an iterator with a predicate.
+int count_matching_paths(sky_data_file *data_file,
+                         sky_zone_map_predicate *predicate)
+{
+    int count = 0;
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    iterator.predicate = predicate;
+    if(sky_path_iterator_set_data_file(&iterator, data_file) != 0) {
+        return -1;
+    }
+    while(!iterator.eof) {
+        count++;
+        if(sky_path_iterator_next(&iterator) != 0) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+int test_sky_path_iterator_data_file_predicate() {
+    cleantmp();
+
+    // Write three objects into their own blocks. Each object only performs
+    // the action with its own id.
+    sky_bulk_loader *loader = sky_bulk_loader_create();
+    loader->block_size = 64;
+    loader->fill_factor = 0.3;
+    loader->path = bfromcstr("tmp/data");
+    loader->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0);
+    sky_object_id_t i;
+    for(i=1; i<=3; i++) {
+        sky_event *event = sky_event_create(i, i * 10, i);
+        mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0);
+        sky_event_free(event);
+    }
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+    sky_bulk_loader_free(loader);
+
+    sky_data_file *data_file = sky_data_file_create();
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    mu_assert_int_equals(data_file->block_count, 3);
+
+    // Only the block with the action is visited.
+    sky_zone_map_predicate predicate;
+    memset(&predicate, 0, sizeof(predicate));
+    mu_assert_int_equals(count_matching_paths(data_file, &predicate), 3);
+    predicate.action_id = 2;
+    mu_assert_int_equals(count_matching_paths(data_file, &predicate), 1);
+    predicate.action_id = 4;
+    mu_assert_int_equals(count_matching_paths(data_file, &predicate), 0);
+
+    // Added events widen the zone map of their block.
+    sky_event *event = sky_event_create(3, 40, 2);
+    mu_assert_int_equals(sky_data_file_add_event(data_file, event), 0);
+    sky_event_free(event);
+    predicate.action_id = 2;
+    mu_assert_int_equals(count_matching_paths(data_file, &predicate), 2);
+
+    // Blocks outside of the time window are skipped.
+    memset(&predicate, 0, sizeof(predicate));
+    predicate.start_timestamp = 15;
+    predicate.end_timestamp = 30;
+    mu_assert_int_equals(count_matching_paths(data_file, &predicate), 1);
+    predicate.end_timestamp = 31;
+    mu_assert_int_equals(count_matching_paths(data_file, &predicate), 2);
+    predicate.start_timestamp = 35;
+    predicate.end_timestamp = 50;
+    mu_assert_int_equals(count_matching_paths(data_file, &predicate), 1);
+
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+//--------------------------------------
+// Action Filter
+//--------------------------------------
+
+// Counts the paths returned by an iterator with an action filter.
+int count_filtered_paths(sky_data_file *data_file,
+                         sky_action_index *action_index,
+                         sky_action_id_t action_id)
+{
+    int count = 0;
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    iterator.action_index = action_index;
+    iterator.filter_action_id = action_id;
+    if(sky_path_iterator_set_data_file(&iterator, data_file) != 0) {
+        return -1;
+    }
+    while(!iterator.eof) {
+        count++;
+        if(sky_path_iterator_next(&iterator) != 0) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+int test_sky_path_iterator_data_file_action_filter() {
+    // Objects with even ids perform action 1 and odd ids perform action 2.
+    // The objects are written into their own blocks and then together into
+    // a single block.
+    uint32_t block_sizes[] = {64, 0x10000};
+    int j;
+    for(j=0; j<2; j++) {
+        cleantmp();
+        sky_action_index *action_index = sky_action_index_create();
+        sky_bulk_loader *loader = sky_bulk_loader_create();
+        loader->block_size = block_sizes[j];
+        loader->fill_factor = 0.3;
+        loader->path = bfromcstr("tmp/data");
+        loader->header_path = bfromcstr("tmp/header");
+        mu_assert_int_equals(sky_bulk_loader_open(loader), 0);
+        sky_object_id_t i;
+        for(i=1; i<=6; i++) {
+            sky_action_id_t action_id = (i % 2 == 0 ? 1 : 2);
+            sky_event *event = sky_event_create(i, i * 10, action_id);
+            mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0);
+            mu_assert_int_equals(sky_action_index_add(action_index, action_id, i), 0);
+            sky_event_free(event);
+        }
+        mu_assert_int_equals(sky_bulk_loader_close(loader), 0);
+        sky_bulk_loader_free(loader);
+
+        sky_data_file *data_file = sky_data_file_create();
+        data_file->path = bfromcstr("tmp/data");
+        data_file->header_path = bfromcstr("tmp/header");
+        mu_assert_int_equals(sky_data_file_load(data_file), 0);
+        mu_assert_int_equals(data_file->block_count, (j == 0 ? 6 : 1));
+
+        // Only the paths of objects in the action's set are returned.
+        mu_assert_int_equals(count_filtered_paths(data_file, action_index, 0), 6);
+        mu_assert_int_equals(count_filtered_paths(data_file, action_index, 1), 3);
+        mu_assert_int_equals(count_filtered_paths(data_file, action_index, 2), 3);
+        mu_assert_int_equals(count_filtered_paths(data_file, action_index, 3), 0);
+        mu_assert_int_equals(sky_action_index_add(action_index, 3, 5), 0);
+        mu_assert_int_equals(count_filtered_paths(data_file, action_index, 3), 1);
+
+        sky_data_file_free(data_file);
+        sky_action_index_free(action_index);
+    }
+    return 0;
+}
+
 
 //==============================================================================
 //
@@ -148,6 +355,9 @@ int test_sky_path_iterator_data_file_next() {
 int all_tests() {
     mu_run_test(test_sky_path_iterator_single_block_next);
     mu_run_test(test_sky_path_iterator_data_file_next);
+    mu_run_test(test_sky_path_iterator_data_file_spanned_ptrs);
+    mu_run_test(test_sky_path_iterator_data_file_predicate);
+    mu_run_test(test_sky_path_iterator_data_file_action_filter);
     return 0;
 }
 
@@ -146,6 +146,31 @@ int test_sky_path_pack() {
     return 0;
 }
 
+int test_sky_path_pack_hdr_wide() {
+    size_t sz;
+    uint8_t buffer[16];
+    sky_object_id_t object_id;
+    uint32_t event_data_length;
+
+    // Small object ids take no more space than a narrow header.
+    mu_assert_long_equals(sky_path_sizeof_hdr(2, true), 5);
+    mu_assert_int_equals(sky_path_pack_hdr(2, 20, true, buffer, &sz), 0);
+    mu_assert_long_equals(sz, 5);
+    mu_assert_long_equals(sky_path_sizeof_raw(buffer, true), 25);
+
+    // Object ids larger than 32 bits require a wide header.
+    object_id = (1ULL << 40) + 3;
+    mu_assert_int_equals(sky_path_pack_hdr(object_id, 20, false, buffer, &sz), -1);
+    mu_assert_int_equals(sky_path_pack_hdr(object_id, 20, true, buffer, &sz), 0);
+    mu_assert_long_equals(sz, sky_path_sizeof_hdr(object_id, true));
+    mu_assert_long_equals(sky_path_sizeof_raw_hdr(buffer, true), sz);
+    object_id = 0;
+    mu_assert_int_equals(sky_path_unpack_hdr(&object_id, &event_data_length, true, buffer, &sz), 0);
+    mu_assert_bool(object_id == (1ULL << 40) + 3);
+    mu_assert_int_equals(event_data_length, 20);
+    return 0;
+}
+
 
 //--------------------------------------
 // Deserialization
@@ -197,7 +222,7 @@ int test_sky_path_unpack() {
 int test_sky_path_get_event_stats_with_no_event() {
     uint32_t event_count = 0;
     sky_path_event_stat *events = NULL;
-    int rc = sky_path_get_event_stats(&DATA, NULL, &events, &event_count);
+    int rc = sky_path_get_event_stats(&DATA, false, NULL, &events, &event_count);
     mu_assert_int_equals(rc, 0);
     mu_assert_int_equals(event_count, 3);
     ASSERT_EVENT_STAT(events[0], 26LL, 8L, 19L, 11L);
@@ -211,7 +236,7 @@ int test_sky_path_get_event_stats_with_starting_event() {
     uint32_t event_count = 0;
     sky_path_event_stat *events = NULL;
     sky_event *event = sky_event_create(2, 25LL, 20);
-    int rc = sky_path_get_event_stats(&DATA, event, &events, &event_count);
+    int rc = sky_path_get_event_stats(&DATA, false, event, &events, &event_count);
     mu_assert_int_equals(rc, 0);
     mu_assert_int_equals(event_count, 4);
     ASSERT_EVENT_STAT(events[0], 25LL, 8L, 8L, 11L);
@@ -227,7 +252,7 @@ int test_sky_path_get_event_stats_with_middle_event() {
     uint32_t event_count = 0;
     sky_path_event_stat *events = NULL;
     sky_event *event = sky_event_create(2, 27LL, 20);
-    int rc = sky_path_get_event_stats(&DATA, event, &events, &event_count);
+    int rc = sky_path_get_event_stats(&DATA, false, event, &events, &event_count);
     mu_assert_int_equals(rc, 0);
     mu_assert_int_equals(event_count, 4);
     ASSERT_EVENT_STAT(events[0], 26LL, 8L, 19L, 11L);
@@ -243,7 +268,7 @@ int test_sky_path_get_event_stats_with_ending_event() {
     uint32_t event_count = 0;
     sky_path_event_stat *events = NULL;
     sky_event *event = sky_event_create(2, 30LL, 20);
-    int rc = sky_path_get_event_stats(&DATA, event, &events, &event_count);
+    int rc = sky_path_get_event_stats(&DATA, false, event, &events, &event_count);
     mu_assert_int_equals(rc, 0);
     mu_assert_int_equals(event_count, 4);
     ASSERT_EVENT_STAT(events[0], 26LL, 8L, 19L, 11L);
@@ -267,6 +292,7 @@ int all_tests() {
     mu_run_test(test_sky_path_add_remove_event);
     mu_run_test(test_sky_path_sizeof);
     mu_run_test(test_sky_path_pack);
+    mu_run_test(test_sky_path_pack_hdr_wide);
     mu_run_test(test_sky_path_unpack);
 
     mu_run_test(test_sky_path_get_event_stats_with_no_event);
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 
 #include <peach_message.h>
+#include <sky_qip_module.h>
 #include <mem.h>
 #include <dbg.h>
 
@@ -43,10 +44,153 @@ int test_sky_peach_message_unpack() {
 }
 
 
+int test_sky_peach_message_pack_predicate() {
+    cleantmp();
+    sky_peach_message *message = sky_peach_message_create();
+    message->query = bfromcstr("class Foo{ public Int x; }");
+    message->predicate.action_id = 3;
+    message->predicate.property_id = -2;
+    message->predicate.min_value = 10;
+    message->predicate.max_value = 20.5;
+    message->predicate.start_timestamp = -100;
+    message->predicate.end_timestamp = 1000000;
+    message->action_filter_id = 4;
+
+    FILE *file = fopen("tmp/message", "w");
+    mu_assert_bool(sky_peach_message_pack(message, file) == 0);
+    fclose(file);
+    sky_peach_message_free(message);
+
+    file = fopen("tmp/message", "r");
+    message = sky_peach_message_create();
+    mu_assert_bool(sky_peach_message_unpack(message, file) == 0);
+    fclose(file);
+    mu_assert_bstring(message->query, "class Foo{ public Int x; }");
+    mu_assert_int_equals(message->predicate.action_id, 3);
+    mu_assert_int_equals(message->predicate.property_id, -2);
+    mu_assert(message->predicate.min_value == 10, "");
+    mu_assert(message->predicate.max_value == 20.5, "");
+    mu_assert_int64_equals(message->predicate.start_timestamp, -100LL);
+    mu_assert_int64_equals(message->predicate.end_timestamp, 1000000LL);
+    mu_assert_int_equals(message->action_filter_id, 4);
+    sky_peach_message_free(message);
+    return 0;
+}
+
+
 //--------------------------------------
 // Processing
 //--------------------------------------
 
+// Counts the events returned by iterating over the paths of a message.
+int count_message_events(sky_peach_message *message, sky_table *table)
+{
+    int count = 0;
+    sky_cursor cursor;
+    sky_cursor_init(&cursor);
+    sky_path_iterator iterator;
+    if(sky_peach_message_set_iterator(message, table, NULL, &iterator) != 0) {
+        return -1;
+    }
+    while(!iterator.eof) {
+        if(sky_path_iterator_set_cursor(&iterator, &cursor) != 0) {
+            return -1;
+        }
+        while(!cursor.eof) {
+            count++;
+            if(sky_cursor_next(&cursor) != 0) {
+                return -1;
+            }
+        }
+        if(sky_path_iterator_next(&iterator) != 0) {
+            return -1;
+        }
+    }
+    sky_cursor_uninit(&cursor);
+    sky_path_iterator_uninit(&iterator);
+    return count;
+}
+
+int test_sky_peach_message_action_filter() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    mu_assert_int_equals(sky_table_open(table), 0);
+
+    // Objects 1 and 3 perform action 1 and object 2 performs action 2.
+    sky_object_id_t object_id;
+    for(object_id=1; object_id<=3; object_id++) {
+        sky_event *event = sky_event_create(object_id, 10LL, (object_id == 2 ? 2 : 1));
+        mu_assert_int_equals(sky_table_add_event(table, event), 0);
+        sky_event_free(event);
+    }
+    mu_assert_int_equals(sky_table_checkpoint(table), 0);
+
+    // A predicate action is only a hint so every event is returned.
+    sky_peach_message *message = sky_peach_message_create();
+    message->predicate.action_id = 1;
+    mu_assert_int_equals(count_message_events(message, table), 3);
+
+    // The action filter limits the paths to objects that performed it.
+    message->predicate.action_id = 0;
+    message->action_filter_id = 1;
+    mu_assert_int_equals(count_message_events(message, table), 2);
+    message->action_filter_id = 2;
+    mu_assert_int_equals(count_message_events(message, table), 1);
+    sky_peach_message_free(message);
+
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+//--------------------------------------
+// Results
+//--------------------------------------
+
+int test_sky_peach_message_factor_results() {
+    cleantmp();
+    struct tagbstring us = bsStatic("us");
+    struct tagbstring country = bsStatic("country");
+    sky_dictionary_id_t id;
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_int_equals(sky_dictionary_add_value(table->dictionary, &us, &id), 0);
+    mu_assert_int_equals(id, 1);
+
+    sky_qip_module *module = sky_qip_module_create();
+    module->table = table;
+    mu_assert_int_equals(sky_qip_module_add_factor_field(module, &country), 0);
+    mu_assert_int_equals(sky_qip_module_add_factor_field(module, &country), 0);
+    mu_assert_int_equals(module->factor_field_count, 1);
+
+    // Factor ids are decoded and unset ids are written as nil.
+    char input[] =
+        "\x82"
+        "\x82\xA2" "id" "\x01" "\xA7" "country" "\x01"
+        "\x82\xA2" "id" "\x02" "\xA7" "country" "\x00";
+    char expected[] =
+        "\x82"
+        "\x82\xA2" "id" "\x01" "\xA7" "country" "\xA2" "us"
+        "\x82\xA2" "id" "\x02" "\xA7" "country" "\xC0";
+    FILE *output = fopen("tmp/output", "w");
+    mu_assert_int_equals(sky_qip_module_write_results(module, input, sizeof(input)-1, output), 0);
+    fclose(output);
+
+    char actual[64];
+    FILE *file = fopen("tmp/output", "r");
+    size_t length = fread(actual, 1, sizeof(actual), file);
+    fclose(file);
+    mu_assert_long_equals(length, sizeof(expected)-1);
+    mu_assert_mem(actual, expected, sizeof(expected)-1);
+
+    sky_qip_module_free(module);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
 int test_sky_peach_message_process() {
     importtmp("tests/fixtures/peach_message/1/import.json");
     sky_table *table = sky_table_create();
@@ -95,6 +239,9 @@ int test_sky_peach_message_process() {
 int all_tests() {
     mu_run_test(test_sky_peach_message_pack);
     mu_run_test(test_sky_peach_message_unpack);
+    mu_run_test(test_sky_peach_message_pack_predicate);
+    mu_run_test(test_sky_peach_message_action_filter);
+    mu_run_test(test_sky_peach_message_factor_results);
     mu_run_test(test_sky_peach_message_process);
     return 0;
 }
@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dbg.h>
+#include <mem.h>
+#include <snapshot.h>
+#include <data_file.h>
+#include <path_iterator.h>
+#include <bulk_loader.h>
+
+#include "minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+#define ADD_EVENT(OBJECT_ID, TIMESTAMP, ACTION_ID) do { \
+    sky_event *event = sky_event_create(OBJECT_ID, TIMESTAMP, ACTION_ID); \
+    mu_assert_int_equals(sky_data_file_add_event(data_file, event), 0); \
+    sky_event_free(event); \
+} while (0)
+
+// Bulk loads one event per object into tmp with a low fill factor so that
+// each path is written to its own block and loads the data file.
+#define LOAD_UNDERFILLED_DATA_FILE(OBJECT_COUNT) do { \
+    sky_bulk_loader *loader = sky_bulk_loader_create(); \
+    loader->block_size = 64; \
+    loader->fill_factor = 0.3; \
+    loader->path = bfromcstr("tmp/data"); \
+    loader->header_path = bfromcstr("tmp/header"); \
+    mu_assert_int_equals(sky_bulk_loader_open(loader), 0); \
+    sky_object_id_t _i; \
+    for(_i=1; _i<=OBJECT_COUNT; _i++) { \
+        sky_event *event = sky_event_create(_i, _i * 10, 1); \
+        mu_assert_int_equals(sky_bulk_loader_add_event(loader, event), 0); \
+        sky_event_free(event); \
+    } \
+    mu_assert_int_equals(sky_bulk_loader_close(loader), 0); \
+    sky_bulk_loader_free(loader); \
+    data_file = sky_data_file_create(); \
+    data_file->path = bfromcstr("tmp/data"); \
+    data_file->header_path = bfromcstr("tmp/header"); \
+    mu_assert_int_equals(sky_data_file_load(data_file), 0); \
+} while(0)
+
+// Counts the events that can be read through a path iterator.
+uint32_t count_iterator_events(sky_path_iterator *iterator)
+{
+    uint32_t count = 0;
+    while(!iterator->eof) {
+        void **ptrs;
+        uint32_t ptr_count;
+        sky_path_iterator_get_ptrs(iterator, &ptrs, &ptr_count);
+        void **cursor_ptrs = malloc(sizeof(*cursor_ptrs) * ptr_count);
+        memcpy(cursor_ptrs, ptrs, sizeof(*cursor_ptrs) * ptr_count);
+        sky_cursor cursor;
+        sky_cursor_init(&cursor);
+        sky_cursor_set_paths(&cursor, cursor_ptrs, ptr_count);
+        while(!cursor.eof) {
+            count++;
+            sky_cursor_next(&cursor);
+        }
+        free(cursor.paths);
+        sky_path_iterator_next(iterator);
+    }
+    return count;
+}
+
+// Counts the events in a snapshot.
+uint32_t count_snapshot_events(sky_snapshot *snapshot)
+{
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    sky_path_iterator_set_snapshot(&iterator, snapshot);
+    return count_iterator_events(&iterator);
+}
+
+// Counts the events in a data file.
+uint32_t count_data_file_events(sky_data_file *data_file)
+{
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    sky_path_iterator_set_data_file(&iterator, data_file);
+    return count_iterator_events(&iterator);
+}
+
+// Repeatedly counts the events in a snapshot until the count changes or the
+// writer is done. The done flag is guarded by the data file's lock.
+typedef struct {
+    sky_snapshot *snapshot;
+    bool done;
+    uint32_t expected_count;
+    uint32_t scan_count;
+    bool failed;
+} snapshot_reader;
+
+void *read_snapshot(void *arg)
+{
+    snapshot_reader *reader = arg;
+    sky_data_file *data_file = reader->snapshot->data_file;
+    bool done = false;
+    while(!done) {
+        if(count_snapshot_events(reader->snapshot) != reader->expected_count) {
+            reader->failed = true;
+            break;
+        }
+        reader->scan_count++;
+
+        sky_data_file_lock(data_file);
+        done = reader->done;
+        sky_data_file_unlock(data_file);
+    }
+    return NULL;
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Pinning
+//--------------------------------------
+
+int test_sky_snapshot_pin() {
+    sky_data_file *data_file;
+    sky_snapshot *snapshot;
+    cleantmp();
+    LOAD_UNDERFILLED_DATA_FILE(3);
+    mu_assert_int_equals(sky_data_file_pin_snapshot(data_file, &snapshot), 0);
+    mu_assert_int_equals(snapshot->epoch, 1);
+    mu_assert_int_equals(snapshot->block_count, 3);
+    mu_assert_int_equals(data_file->snapshot_count, 1);
+    mu_assert_bool(data_file->blocks[0]->shared);
+    mu_assert_int_equals(count_snapshot_events(snapshot), 3);
+
+    mu_assert_int_equals(sky_data_file_release_snapshot(data_file, snapshot), 0);
+    mu_assert_int_equals(data_file->snapshot_count, 0);
+    mu_assert_bool(!data_file->blocks[0]->shared);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+//--------------------------------------
+// Isolation
+//--------------------------------------
+
+int test_sky_snapshot_isolates_added_events() {
+    sky_data_file *data_file;
+    sky_snapshot *snapshot;
+    cleantmp();
+    LOAD_UNDERFILLED_DATA_FILE(3);
+    mu_assert_int_equals(sky_data_file_pin_snapshot(data_file, &snapshot), 0);
+
+    // The shared block is copied before the event is added.
+    sky_block *block = data_file->blocks[1];
+    ADD_EVENT(2, 25LL, 1);
+    ADD_EVENT(2, 26LL, 1);
+    mu_assert_int_equals(block->index, 3);
+    mu_assert_int_equals(data_file->retired_block_count, 1);
+    mu_assert_int_equals(snapshot->blocks[1]->index, 1);
+    mu_assert_int_equals(count_snapshot_events(snapshot), 3);
+    mu_assert_int_equals(count_data_file_events(data_file), 5);
+
+    // The original slot is freed once the snapshot is released.
+    mu_assert_int_equals(sky_data_file_release_snapshot(data_file, snapshot), 0);
+    mu_assert_int_equals(data_file->retired_block_count, 0);
+    mu_assert_int_equals(data_file->free_block_count, 1);
+    mu_assert_int_equals(data_file->free_blocks[0]->index, 1);
+    mu_assert_int_equals(count_data_file_events(data_file), 5);
+    sky_data_file_free(data_file);
+
+    // Only the new events are stored on disk.
+    data_file = sky_data_file_create();
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    mu_assert_int_equals(count_data_file_events(data_file), 5);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_snapshot_defers_compaction() {
+    uint32_t merge_count;
+    sky_data_file *data_file;
+    sky_snapshot *snapshot;
+    cleantmp();
+    LOAD_UNDERFILLED_DATA_FILE(3);
+    mu_assert_int_equals(sky_data_file_pin_snapshot(data_file, &snapshot), 0);
+
+    // Blocks can't be merged under a pinned snapshot.
+    mu_assert_int_equals(sky_data_file_compact(data_file, 1.0, 0, &merge_count), -1);
+    mu_assert_int_equals(count_snapshot_events(snapshot), 3);
+
+    mu_assert_int_equals(sky_data_file_release_snapshot(data_file, snapshot), 0);
+    mu_assert_int_equals(sky_data_file_compact(data_file, 1.0, 0, &merge_count), 0);
+    mu_assert_int_equals(merge_count, 2);
+    mu_assert_int_equals(count_data_file_events(data_file), 3);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_snapshot_keeps_slots_for_older_snapshots() {
+    sky_data_file *data_file;
+    sky_snapshot *snapshot1, *snapshot2;
+    cleantmp();
+    LOAD_UNDERFILLED_DATA_FILE(2);
+    mu_assert_int_equals(sky_data_file_pin_snapshot(data_file, &snapshot1), 0);
+    ADD_EVENT(1, 15LL, 1);
+    mu_assert_int_equals(sky_data_file_pin_snapshot(data_file, &snapshot2), 0);
+    mu_assert_int_equals(snapshot2->epoch, 2);
+    ADD_EVENT(1, 16LL, 1);
+    mu_assert_int_equals(data_file->retired_block_count, 2);
+    mu_assert_int_equals(count_snapshot_events(snapshot1), 2);
+    mu_assert_int_equals(count_snapshot_events(snapshot2), 3);
+    mu_assert_int_equals(count_data_file_events(data_file), 4);
+
+    // Releasing the newer snapshot only frees the slot that it shared.
+    mu_assert_int_equals(sky_data_file_release_snapshot(data_file, snapshot2), 0);
+    mu_assert_int_equals(data_file->retired_block_count, 2);
+    mu_assert_int_equals(count_snapshot_events(snapshot1), 2);
+    mu_assert_int_equals(sky_data_file_release_snapshot(data_file, snapshot1), 0);
+    mu_assert_int_equals(data_file->retired_block_count, 0);
+    mu_assert_int_equals(count_data_file_events(data_file), 4);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+int test_sky_snapshot_keeps_mapping_when_remapped() {
+    sky_data_file *data_file;
+    sky_snapshot *snapshot;
+    cleantmp();
+    LOAD_UNDERFILLED_DATA_FILE(3);
+    mu_assert_int_equals(sky_data_file_pin_snapshot(data_file, &snapshot), 0);
+
+    // New objects add blocks until the mapping has to grow.
+    sky_object_id_t object_id;
+    for(object_id=4; data_file->retired_mapping_count == 0; object_id++) {
+        ADD_EVENT(object_id, object_id * 10, 1);
+    }
+    mu_assert_bool(data_file->data != snapshot->data);
+    mu_assert_bool(data_file->retired_mappings[0].data == snapshot->data);
+    mu_assert_int_equals(count_snapshot_events(snapshot), 3);
+    mu_assert_int_equals(count_data_file_events(data_file), object_id - 1);
+
+    // The old mapping is unmapped once the snapshot is released.
+    mu_assert_int_equals(sky_data_file_release_snapshot(data_file, snapshot), 0);
+    mu_assert_int_equals(data_file->retired_mapping_count, 0);
+    mu_assert_int_equals(count_data_file_events(data_file), object_id - 1);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_snapshot_concurrent_read() {
+    pthread_t thread;
+    sky_data_file *data_file;
+    sky_snapshot *snapshot;
+    cleantmp();
+    LOAD_UNDERFILLED_DATA_FILE(3);
+    mu_assert_int_equals(sky_data_file_pin_snapshot(data_file, &snapshot), 0);
+
+    // Scan the snapshot while events are added to existing and new objects.
+    snapshot_reader reader;
+    memset(&reader, 0, sizeof(reader));
+    reader.snapshot = snapshot;
+    reader.expected_count = 3;
+    mu_assert_int_equals(pthread_create(&thread, NULL, read_snapshot, &reader), 0);
+
+    sky_object_id_t object_id;
+    for(object_id=1; object_id<=500; object_id++) {
+        mu_assert_int_equals(sky_data_file_lock(data_file), 0);
+        ADD_EVENT(object_id, (object_id * 10) + 1, 1);
+        mu_assert_int_equals(sky_data_file_unlock(data_file), 0);
+    }
+    mu_assert_int_equals(sky_data_file_lock(data_file), 0);
+    reader.done = true;
+    mu_assert_int_equals(sky_data_file_unlock(data_file), 0);
+    mu_assert_int_equals(pthread_join(thread, NULL), 0);
+    mu_assert_bool(!reader.failed);
+    mu_assert_bool(reader.scan_count > 0);
+    mu_assert_bool(data_file->retired_mapping_count > 0);
+
+    mu_assert_int_equals(sky_data_file_release_snapshot(data_file, snapshot), 0);
+    mu_assert_int_equals(data_file->retired_block_count, 0);
+    mu_assert_int_equals(data_file->retired_mapping_count, 0);
+    mu_assert_int_equals(count_data_file_events(data_file), 503);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_snapshot_pin);
+    mu_run_test(test_sky_snapshot_isolates_added_events);
+    mu_run_test(test_sky_snapshot_defers_compaction);
+    mu_run_test(test_sky_snapshot_keeps_slots_for_older_snapshots);
+    mu_run_test(test_sky_snapshot_keeps_mapping_when_remapped);
+    mu_run_test(test_sky_snapshot_concurrent_read);
+    return 0;
+}
+
+RUN_TESTS()
@@ -5,6 +5,8 @@
 
 #include <dbg.h>
 #include <table.h>
+#include <path_iterator.h>
+#include <cursor.h>
 #include <bstring.h>
 
 #include "minunit.h"
@@ -49,6 +51,538 @@ int test_sky_table_open() {
 }
 
 
+//--------------------------------------
+// Write-Ahead Log
+//--------------------------------------
+
+int test_sky_table_open_replays_wal() {
+    cleantmp();
+    mkdir("tmp/0", S_IRWXU);
+
+    // Log an event without applying it.
+    sky_wal *wal = sky_wal_create();
+    wal->path = bfromcstr("tmp/wal");
+    mu_assert_int_equals(sky_wal_open(wal), 0);
+    sky_event *event = sky_event_create(3, 10LL, 20);
+    mu_assert_int_equals(sky_wal_append(wal, event), 0);
+    sky_event_free(event);
+    sky_wal_free(wal);
+
+    // Opening the table should apply the logged event.
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_file("tmp/0/data", "tests/fixtures/data_files/1/a/data");
+    mu_assert_file("tmp/0/header", "tests/fixtures/data_files/1/a/header");
+    mu_assert_long_equals(sky_file_get_size(table->wal->path), 0L);
+
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_table_add_event_is_applied_at_checkpoint() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    mu_assert_int_equals(sky_table_open(table), 0);
+
+    sky_event *event = sky_event_create(3, 10LL, 20);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(table->wal->record_count, 1);
+    
+    mu_assert_int_equals(sky_table_checkpoint(table), 0);
+    mu_assert_int_equals(table->wal->record_count, 0);
+    mu_assert_file("tmp/0/data", "tests/fixtures/data_files/1/a/data");
+    mu_assert_file("tmp/0/header", "tests/fixtures/data_files/1/a/header");
+
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+
+int test_sky_table_add_event_is_read_before_checkpoint() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    mu_assert_int_equals(sky_table_open(table), 0);
+
+    // Events are read from the memtable until they are applied.
+    sky_event *event = sky_event_create(3, 10LL, 20);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    event = sky_event_create(3, 5LL, 21);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(table->data_file->memtable->event_count, 2);
+
+    uint32_t count = 0;
+    sky_action_id_t action_ids[2];
+    sky_cursor cursor;
+    sky_cursor_init(&cursor);
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_data_files(&iterator, table->data_files, table->shard_count), 0);
+    while(!iterator.eof) {
+        mu_assert_int64_equals(iterator.current_object_id, 3LL);
+        mu_assert_int_equals(sky_path_iterator_set_cursor(&iterator, &cursor), 0);
+        while(!cursor.eof) {
+            mu_assert_int_equals(sky_cursor_get_action_id(&cursor, &action_ids[count++]), 0);
+            mu_assert_int_equals(sky_cursor_next(&cursor), 0);
+        }
+        mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    }
+    sky_path_iterator_uninit(&iterator);
+    sky_cursor_uninit(&cursor);
+    mu_assert_int_equals(count, 2);
+    mu_assert_int_equals(action_ids[0], 21);
+    mu_assert_int_equals(action_ids[1], 20);
+
+    // The memtable is cleared once its events are in the data file.
+    mu_assert_int_equals(sky_table_checkpoint(table), 0);
+    mu_assert_int_equals(table->data_file->memtable->event_count, 0);
+    mu_assert_int_equals(table->wal->record_count, 0);
+
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Event Management
+//--------------------------------------
+
+int test_sky_table_add_events() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    mu_assert_int_equals(sky_table_open(table), 0);
+
+    sky_event *events[1];
+    events[0] = sky_event_create(3, 10LL, 20);
+    mu_assert_int_equals(sky_table_add_events(table, events, 1), 0);
+    sky_event_free(events[0]);
+    mu_assert_int_equals(table->wal->record_count, 1);
+    mu_assert_int_equals(table->wal->pending_count, 0);
+
+    mu_assert_int_equals(sky_table_close(table), 0);
+    mu_assert_file("tmp/0/data", "tests/fixtures/data_files/1/a/data");
+    mu_assert_file("tmp/0/header", "tests/fixtures/data_files/1/a/header");
+    sky_table_free(table);
+    return 0;
+}
+
+
+int test_sky_table_add_event_rejects_wide_object_id() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    mu_assert_int_equals(sky_table_open(table), 0);
+
+    // Wide object ids are rejected before they are logged.
+    sky_event *events[2];
+    events[0] = sky_event_create(3, 10LL, 20);
+    events[1] = sky_event_create(0x100000000LL, 10LL, 20);
+    mu_assert_int_equals(sky_table_add_event(table, events[1]), -1);
+    mu_assert_int_equals(sky_table_add_events(table, events, 2), -1);
+    sky_event_free(events[0]);
+    sky_event_free(events[1]);
+    mu_assert_int_equals(table->wal->record_count, 0);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+
+    // The table can still be reopened.
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_table_default_version() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    table->default_version = SKY_DATA_FILE_VERSION;
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_int_equals(table->data_file->version, SKY_DATA_FILE_VERSION);
+
+    // New tables with a wide version accept wide object ids.
+    sky_event *event = sky_event_create(0x100000000LL, 10LL, 20);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+
+    // The version is read from the data file when reopened.
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_int_equals(table->data_file->version, SKY_DATA_FILE_VERSION);
+    sky_block *block;
+    uint32_t span_count;
+    mu_assert_int_equals(sky_data_file_get_object_blocks(table->data_file, 0x100000000LL, &block, &span_count), 0);
+    mu_assert(block != NULL, "");
+    mu_assert_int_equals(span_count, 1);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Shards
+//--------------------------------------
+
+int test_sky_table_sharded() {
+    struct tagbstring shard_lock_file_path = bsStatic("tmp/3/.skylock");
+    struct tagbstring shard_header_file_path = bsStatic("tmp/3/header");
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    table->shard_count = 4;
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert(sky_file_exists(&shard_lock_file_path), "");
+    mu_assert(sky_file_exists(&shard_header_file_path), "");
+    mu_assert(table->data_file == table->data_files[0], "");
+
+    // Events are applied to the shard of their object.
+    sky_object_id_t object_id;
+    for(object_id=1; object_id<=8; object_id++) {
+        sky_event *event = sky_event_create(object_id, 10LL, 20);
+        mu_assert_int_equals(sky_table_add_event(table, event), 0);
+        sky_event_free(event);
+    }
+    mu_assert_int_equals(sky_table_checkpoint(table), 0);
+    for(object_id=1; object_id<=8; object_id++) {
+        sky_data_file *data_file;
+        sky_block *block;
+        uint32_t span_count;
+        mu_assert_int_equals(sky_table_get_shard(table, object_id, &data_file), 0);
+        mu_assert_int_equals(sky_data_file_get_object_blocks(data_file, object_id, &block, &span_count), 0);
+        mu_assert(block != NULL, "");
+        mu_assert_int_equals(span_count, 1);
+    }
+    mu_assert_int_equals(sky_table_close(table), 0);
+    mu_assert(!sky_file_exists(&shard_lock_file_path), "");
+    sky_table_free(table);
+
+    // The shard count is determined by the tablespaces when reopened.
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_int_equals(table->shard_count, 4);
+
+    // Every shard is iterated over.
+    uint32_t path_count = 0;
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_data_files(&iterator, table->data_files, table->shard_count), 0);
+    while(!iterator.eof) {
+        path_count++;
+        mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    }
+    mu_assert_int_equals(path_count, 8);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+
+    // A table cannot be reopened with a different number of shards.
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->shard_count = 2;
+    mu_assert_int_equals(sky_table_open(table), -1);
+    sky_table_free(table);
+    return 0;
+}
+
+
+//--------------------------------------
+// Dictionary
+//--------------------------------------
+
+int test_sky_table_factor_properties() {
+    struct tagbstring us = bsStatic("us");
+    struct tagbstring fr = bsStatic("fr");
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    mu_assert_int_equals(sky_table_open(table), 0);
+
+    sky_property *country = sky_property_create();
+    country->type = SKY_PROPERTY_TYPE_OBJECT;
+    country->data_type = bfromcstr("Factor");
+    country->name = bfromcstr("country");
+    mu_assert_int_equals(sky_property_file_add_property(table->property_file, country), 0);
+    sky_property *name = sky_property_create();
+    name->type = SKY_PROPERTY_TYPE_OBJECT;
+    name->data_type = bfromcstr("String");
+    name->name = bfromcstr("name");
+    mu_assert_int_equals(sky_property_file_add_property(table->property_file, name), 0);
+
+    // Factor values are replaced by their dictionary ids. Other strings are
+    // left inline.
+    sky_event *event = sky_event_create(3, 10LL, 20);
+    mu_assert_int_equals(sky_event_set_data(event, country->id, &fr), 0);
+    mu_assert_int_equals(sky_event_set_data(event, name->id, &us), 0);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    mu_assert_bool(event->data[0]->data_type == &SKY_DATA_TYPE_INT);
+    mu_assert_int_equals(event->data[0]->int_value, 1);
+    mu_assert_bool(event->data[1]->data_type == &SKY_DATA_TYPE_STRING);
+    sky_event_free(event);
+
+    event = sky_event_create(4, 10LL, 20);
+    mu_assert_int_equals(sky_event_set_data(event, country->id, &us), 0);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    mu_assert_int_equals(event->data[0]->int_value, 2);
+    sky_event_free(event);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+
+    // The dictionary is reloaded when the table is reopened.
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_int_equals(table->dictionary->count, 2);
+    sky_dictionary_id_t id;
+    mu_assert_int_equals(sky_dictionary_find_by_value(table->dictionary, &us, &id), 0);
+    mu_assert_int_equals(id, 2);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+int test_sky_table_action_index() {
+    bool found;
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    mu_assert_int_equals(sky_table_open(table), 0);
+
+    // Objects are added to the index as their events are added.
+    sky_object_id_t i;
+    for(i=1; i<=10; i++) {
+        sky_event *event = sky_event_create(i, 10LL, (i % 2 == 0 ? 1 : 2));
+        mu_assert_int_equals(sky_table_add_event(table, event), 0);
+        sky_event_free(event);
+    }
+    mu_assert_int_equals(sky_action_index_contains(table->action_index, 1, 4, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int_equals(sky_action_index_contains(table->action_index, 1, 5, &found), 0);
+    mu_assert_bool(!found);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+
+    // The index is saved when the table is closed and removed once it is
+    // loaded again.
+    struct tagbstring action_index_path = bsStatic("tmp/action_index");
+    mu_assert_bool(sky_file_exists(&action_index_path));
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_bool(!sky_file_exists(&action_index_path));
+    mu_assert_int_equals(table->action_index->set_count, 2);
+    mu_assert_int_equals(table->action_index->sets[0].count, 5);
+    mu_assert_int_equals(table->action_index->sets[1].count, 5);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+
+    // The index is rebuilt from the data file if there is no index file.
+    mu_assert_int_equals(sky_file_rm(&action_index_path), 0);
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_int_equals(table->action_index->set_count, 2);
+    mu_assert_int_equals(sky_action_index_contains(table->action_index, 2, 9, &found), 0);
+    mu_assert_bool(found);
+    mu_assert_int_equals(sky_action_index_contains(table->action_index, 2, 10, &found), 0);
+    mu_assert_bool(!found);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+
+int test_sky_table_retention() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    table->retention_timestamp = 20LL;
+    mu_assert_int_equals(sky_table_open(table), 0);
+
+    // Events older than the retention timestamp are removed at checkpoint.
+    sky_object_id_t i;
+    for(i=1; i<=4; i++) {
+        sky_event *event = sky_event_create(i, i * 10LL, 1);
+        mu_assert_int_equals(sky_table_add_event(table, event), 0);
+        sky_event_free(event);
+    }
+    mu_assert_int_equals(sky_table_checkpoint(table), 0);
+
+    uint32_t path_count = 0;
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_data_file(&iterator, table->data_files[0]), 0);
+    while(!iterator.eof) {
+        path_count++;
+        mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    }
+    mu_assert_int_equals(path_count, 3);
+    mu_assert_int64_equals(table->data_files[0]->blocks[0]->min_object_id, 2LL);
+
+    // The retention age is measured back from the current time.
+    sky_timestamp_t timestamp;
+    table->retention_age = 1000000LL;
+    mu_assert_int_equals(sky_table_get_retention_timestamp(table, &timestamp), 0);
+    mu_assert(timestamp > 20LL, "");
+
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+
+int test_sky_table_retention_log_structured() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    table->log_structured = true;
+    table->max_run_count = 10;
+    mu_assert_int_equals(sky_table_open(table), 0);
+
+    sky_event *event = sky_event_create(1, 10LL, 1);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    event = sky_event_create(2, 30LL, 1);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(sky_table_checkpoint(table), 0);
+    mu_assert_int_equals(table->data_file->run_count, 1);
+
+    // Expired memtable events are not written and runs that hold expired
+    // events are merged so the expired events are dropped.
+    table->retention_timestamp = 20LL;
+    event = sky_event_create(3, 5LL, 1);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    event = sky_event_create(4, 40LL, 1);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(sky_table_checkpoint(table), 0);
+    mu_assert_int_equals(table->data_file->run_count, 0);
+
+    uint32_t count = 0;
+    sky_object_id_t object_ids[4];
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_data_file(&iterator, table->data_files[0]), 0);
+    while(!iterator.eof) {
+        object_ids[count++] = iterator.current_object_id;
+        mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    }
+    mu_assert_int_equals(count, 2);
+    mu_assert_int64_equals(object_ids[0], 2LL);
+    mu_assert_int64_equals(object_ids[1], 4LL);
+
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+
+int test_sky_table_log_structured() {
+    cleantmp();
+    sky_table *table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    table->default_block_size = 64;
+    table->log_structured = true;
+    table->max_run_count = 2;
+    mu_assert_int_equals(sky_table_open(table), 0);
+
+    // Each checkpoint writes the memtable to a new run.
+    sky_event *event = sky_event_create(2, 20LL, 1);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    event = sky_event_create(1, 10LL, 1);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(table->data_file->memtable->event_count, 2);
+    mu_assert_int_equals(sky_table_checkpoint(table), 0);
+    mu_assert_int_equals(table->data_file->memtable->event_count, 0);
+    mu_assert_int_equals(table->data_file->run_count, 1);
+    mu_assert_int64_equals(table->data_file->blocks[0]->min_object_id, 0LL);
+
+    // Queries merge the runs with the data file.
+    uint32_t count = 0;
+    sky_cursor cursor;
+    sky_cursor_init(&cursor);
+    sky_path_iterator iterator;
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_data_files(&iterator, table->data_files, table->shard_count), 0);
+    while(!iterator.eof) {
+        mu_assert_int_equals(sky_path_iterator_set_cursor(&iterator, &cursor), 0);
+        while(!cursor.eof) {
+            count++;
+            mu_assert_int_equals(sky_cursor_next(&cursor), 0);
+        }
+        mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    }
+    sky_cursor_uninit(&cursor);
+    mu_assert_int_equals(count, 2);
+
+    // Runs are merged into the data file once there are too many.
+    event = sky_event_create(2, 30LL, 2);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(sky_table_checkpoint(table), 0);
+    mu_assert_int_equals(table->data_file->run_count, 0);
+    mu_assert_int64_equals(table->data_file->blocks[0]->min_object_id, 1LL);
+
+    // Runs are merged when the table is closed by a table that isn't
+    // log-structured.
+    event = sky_event_create(3, 40LL, 1);
+    mu_assert_int_equals(sky_table_add_event(table, event), 0);
+    sky_event_free(event);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+
+    table = sky_table_create();
+    table->path = bfromcstr("tmp");
+    mu_assert_int_equals(sky_table_open(table), 0);
+    mu_assert_int_equals(table->data_file->run_count, 0);
+    count = 0;
+    sky_path_iterator_init(&iterator);
+    mu_assert_int_equals(sky_path_iterator_set_data_files(&iterator, table->data_files, table->shard_count), 0);
+    while(!iterator.eof) {
+        mu_assert_int_equals(sky_path_iterator_set_cursor(&iterator, &cursor), 0);
+        while(!cursor.eof) {
+            count++;
+            mu_assert_int_equals(sky_cursor_next(&cursor), 0);
+        }
+        mu_assert_int_equals(sky_path_iterator_next(&iterator), 0);
+    }
+    sky_cursor_uninit(&cursor);
+    mu_assert_int_equals(count, 4);
+    mu_assert_int_equals(sky_table_close(table), 0);
+    sky_table_free(table);
+    return 0;
+}
+
+
 //==============================================================================
 //
 // Setup
@@ -57,6 +591,18 @@ int test_sky_table_open() {
 
 int all_tests() {
     mu_run_test(test_sky_table_open);
+    mu_run_test(test_sky_table_open_replays_wal);
+    mu_run_test(test_sky_table_add_event_is_applied_at_checkpoint);
+    mu_run_test(test_sky_table_add_event_is_read_before_checkpoint);
+    mu_run_test(test_sky_table_add_events);
+    mu_run_test(test_sky_table_add_event_rejects_wide_object_id);
+    mu_run_test(test_sky_table_default_version);
+    mu_run_test(test_sky_table_sharded);
+    mu_run_test(test_sky_table_factor_properties);
+    mu_run_test(test_sky_table_action_index);
+    mu_run_test(test_sky_table_retention);
+    mu_run_test(test_sky_table_retention_log_structured);
+    mu_run_test(test_sky_table_log_structured);
     return 0;
 }
 
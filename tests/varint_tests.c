@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <varint.h>
+
+#include "minunit.h"
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+int test_sky_varint_pack() {
+    size_t sz;
+    uint8_t buffer[SKY_VARINT_MAX_LENGTH];
+
+    sky_varint_pack(buffer, 20, &sz);
+    mu_assert_long_equals((long)sz, 1L);
+    mu_assert_mem(buffer, "\x14", 1);
+
+    sky_varint_pack(buffer, 300, &sz);
+    mu_assert_long_equals((long)sz, 2L);
+    mu_assert_mem(buffer, "\xac\x02", 2);
+
+    sky_varint_pack(buffer, UINT64_MAX, &sz);
+    mu_assert_long_equals((long)sz, 10L);
+    mu_assert_long_equals((long)sky_varint_sizeof_raw(buffer), 10L);
+    return 0;
+}
+
+int test_sky_varint_roundtrip() {
+    size_t sz;
+    uint8_t buffer[SKY_VARINT_MAX_LENGTH];
+    uint64_t values[] = {0, 1, 127, 128, 16383, 16384, 1ULL << 35, UINT64_MAX};
+    int i;
+    for(i=0; i<8; i++) {
+        sky_varint_pack(buffer, values[i], &sz);
+        mu_assert_long_equals((long)sz, (long)sky_varint_sizeof(values[i]));
+        mu_assert_long_equals((long)sky_varint_sizeof_raw(buffer), (long)sz);
+        mu_assert(sky_varint_unpack(buffer, &sz) == values[i], "");
+        mu_assert_long_equals((long)sz, (long)sky_varint_sizeof(values[i]));
+    }
+    return 0;
+}
+
+int test_sky_varint_signed_roundtrip() {
+    size_t sz;
+    uint8_t buffer[SKY_VARINT_MAX_LENGTH];
+
+    // Values close to zero use a single byte regardless of sign.
+    sky_varint_pack_signed(buffer, -1, &sz);
+    mu_assert_long_equals((long)sz, 1L);
+    mu_assert_mem(buffer, "\x01", 1);
+    sky_varint_pack_signed(buffer, 1, &sz);
+    mu_assert_long_equals((long)sz, 1L);
+    mu_assert_mem(buffer, "\x02", 1);
+
+    int64_t values[] = {0, -64, 63, -65, 1000000, INT64_MIN, INT64_MAX};
+    int i;
+    for(i=0; i<7; i++) {
+        sky_varint_pack_signed(buffer, values[i], &sz);
+        mu_assert_long_equals((long)sz, (long)sky_varint_sizeof_signed(values[i]));
+        mu_assert(sky_varint_unpack_signed(buffer, &sz) == values[i], "");
+    }
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_varint_pack);
+    mu_run_test(test_sky_varint_roundtrip);
+    mu_run_test(test_sky_varint_signed_roundtrip);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/resource.h>
+
+#include <wal.h>
+#include <data_file.h>
+#include <shard.h>
+#include <bstring.h>
+
+#include "minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+#define INIT_DATA_FILE(PATH) \
+    loadtmp(PATH); \
+    data_file = sky_data_file_create(); \
+    data_file->block_size = 64; \
+    data_file->path = bfromcstr("tmp/data"); \
+    data_file->header_path = bfromcstr("tmp/header"); \
+    sky_data_file_load(data_file);
+
+#define INIT_WAL() \
+    wal = sky_wal_create(); \
+    wal->path = bfromcstr("tmp/wal"); \
+    mu_assert_int_equals(sky_wal_open(wal), 0);
+
+#define APPEND_EVENT(OBJECT_ID, TIMESTAMP, ACTION_ID) do { \
+    sky_event *event = sky_event_create(OBJECT_ID, TIMESTAMP, ACTION_ID); \
+    mu_assert_int_equals(sky_wal_append(wal, event), 0); \
+    sky_event_free(event); \
+} while (0)
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+//--------------------------------------
+// Group Commit
+//--------------------------------------
+
+int test_sky_wal_append_commits_in_groups() {
+    sky_wal *wal;
+    cleantmp();
+    INIT_WAL();
+    wal->group_size = 2;
+    wal->group_timeout = 60000000LL;
+    APPEND_EVENT(3, 10LL, 20);
+    mu_assert_int_equals(wal->pending_count, 1);
+    APPEND_EVENT(3, 11LL, 20);
+    mu_assert_int_equals(wal->pending_count, 0);
+    mu_assert_int_equals(wal->record_count, 2);
+    sky_wal_free(wal);
+    return 0;
+}
+
+
+int test_sky_wal_sync_if_due() {
+    sky_wal *wal;
+    cleantmp();
+    INIT_WAL();
+    wal->group_size = 64;
+    wal->group_timeout = 60000000LL;
+    APPEND_EVENT(3, 10LL, 20);
+    mu_assert_int_equals(sky_wal_sync_if_due(wal), 0);
+    mu_assert_int_equals(wal->pending_count, 1);
+
+    // A group that doesn't fill up is committed after the group timeout.
+    wal->group_timeout = 1000LL;
+    usleep(2000);
+    mu_assert_int_equals(sky_wal_sync_if_due(wal), 0);
+    mu_assert_int_equals(wal->pending_count, 0);
+    mu_assert_int_equals(wal->record_count, 1);
+    sky_wal_free(wal);
+    return 0;
+}
+
+
+//--------------------------------------
+// Replay
+//--------------------------------------
+
+int test_sky_wal_replay() {
+    uint32_t count;
+    sky_wal *wal;
+    sky_data_file *data_file;
+    INIT_DATA_FILE("");
+    INIT_WAL();
+    APPEND_EVENT(3, 10LL, 20);
+    mu_assert_int_equals(sky_wal_replay(wal, data_file, &count), 0);
+    mu_assert_int_equals(count, 1);
+    mu_assert_file("tmp/data", "tests/fixtures/data_files/1/a/data");
+    mu_assert_file("tmp/header", "tests/fixtures/data_files/1/a/header");
+
+    mu_assert_int_equals(sky_wal_truncate(wal), 0);
+    mu_assert_int_equals(wal->record_count, 0);
+    mu_assert_long_equals(sky_file_get_size(wal->path), 0L);
+    sky_wal_free(wal);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+int test_sky_wal_replay_ignores_incomplete_record() {
+    uint32_t count;
+    sky_wal *wal;
+    sky_data_file *data_file;
+    INIT_DATA_FILE("");
+    INIT_WAL();
+    APPEND_EVENT(3, 10LL, 20);
+    APPEND_EVENT(3, 11LL, 20);
+
+    // Chop off the end of the last record.
+    off_t length = sky_file_get_size(wal->path);
+    mu_assert_int_equals(ftruncate(wal->fd, length - 2), 0);
+
+    mu_assert_int_equals(sky_wal_replay(wal, data_file, &count), 0);
+    mu_assert_int_equals(count, 1);
+    mu_assert_file("tmp/data", "tests/fixtures/data_files/1/a/data");
+    sky_wal_free(wal);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+int test_sky_wal_replay_skips_applied_records() {
+    uint32_t count;
+    sky_wal *wal;
+    sky_data_file *data_file;
+    cleantmp();
+    data_file = sky_data_file_create();
+    data_file->version = SKY_DATA_FILE_LSN_VERSION;
+    data_file->block_size = 64;
+    data_file->path = bfromcstr("tmp/data");
+    data_file->header_path = bfromcstr("tmp/header");
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    INIT_WAL();
+    APPEND_EVENT(3, 10LL, 20);
+    APPEND_EVENT(4, 10LL, 20);
+    mu_assert_int_equals(sky_wal_replay(wal, data_file, &count), 0);
+    mu_assert_int_equals(count, 2);
+    mu_assert_int64_equals(data_file->lsn, 2LL);
+
+    // The LSN is saved with the blocks so replaying a log that wasn't
+    // truncated only applies the records after it.
+    mu_assert_int_equals(sky_data_file_flush(data_file), 0);
+    mu_assert_int_equals(sky_data_file_unload(data_file), 0);
+    mu_assert_int_equals(sky_data_file_load(data_file), 0);
+    mu_assert_int64_equals(data_file->lsn, 2LL);
+    APPEND_EVENT(5, 10LL, 20);
+    mu_assert_int_equals(sky_wal_replay(wal, data_file, &count), 0);
+    mu_assert_int_equals(count, 1);
+    mu_assert_int64_equals(data_file->lsn, 3LL);
+    mu_assert_int_equals(sky_wal_replay(wal, data_file, &count), 0);
+    mu_assert_int_equals(count, 0);
+
+    sky_wal_free(wal);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+int test_sky_wal_replay_shards() {
+    uint32_t i, count;
+    sky_wal *wal;
+    sky_data_file *data_files[4];
+    uint64_t lsns[4] = {0, 0, 0, 0};
+    cleantmp();
+    for(i=0; i<4; i++) {
+        data_files[i] = sky_data_file_create();
+        data_files[i]->version = SKY_DATA_FILE_LSN_VERSION;
+        data_files[i]->path = bformat("tmp/data%d", i);
+        data_files[i]->header_path = bformat("tmp/header%d", i);
+        mu_assert_int_equals(sky_data_file_load(data_files[i]), 0);
+    }
+    INIT_WAL();
+
+    // Log enough events to fill several batches on each shard.
+    sky_object_id_t object_id;
+    uint64_t lsn = 0;
+    for(i=0; i<SKY_WAL_REPLAY_BATCH_SIZE * 3; i++) {
+        object_id = (i % 40) + 1;
+        APPEND_EVENT(object_id, (sky_timestamp_t)i, 20);
+        lsns[sky_shard_get_index(object_id, 4)] = ++lsn;
+    }
+
+    // Each shard holds its own objects and the LSN of its last record.
+    mu_assert_int_equals(sky_wal_replay_shards(wal, data_files, 4, &count), 0);
+    mu_assert_int_equals(count, SKY_WAL_REPLAY_BATCH_SIZE * 3);
+    for(i=0; i<4; i++) {
+        mu_assert_int64_equals(data_files[i]->lsn, lsns[i]);
+    }
+    for(object_id=1; object_id<=40; object_id++) {
+        sky_block *block;
+        uint32_t span_count;
+        sky_data_file *data_file = data_files[sky_shard_get_index(object_id, 4)];
+        mu_assert_int_equals(sky_data_file_get_object_blocks(data_file, object_id, &block, &span_count), 0);
+        mu_assert(block != NULL, "");
+    }
+
+    // Replaying again applies nothing.
+    mu_assert_int_equals(sky_wal_replay_shards(wal, data_files, 4, &count), 0);
+    mu_assert_int_equals(count, 0);
+
+    sky_wal_free(wal);
+    for(i=0; i<4; i++) {
+        sky_data_file_free(data_files[i]);
+    }
+    return 0;
+}
+
+int test_sky_wal_append_removes_partial_record() {
+    uint32_t count;
+    sky_wal *wal;
+    sky_data_file *data_file;
+    INIT_DATA_FILE("");
+    INIT_WAL();
+    APPEND_EVENT(3, 10LL, 20);
+
+    // Limit the file size so that the next record is only partially written.
+    struct rlimit limit, original_limit;
+    mu_assert_int_equals(getrlimit(RLIMIT_FSIZE, &original_limit), 0);
+    signal(SIGXFSZ, SIG_IGN);
+    off_t length = sky_file_get_size(wal->path);
+    limit.rlim_cur = length + 10;
+    limit.rlim_max = original_limit.rlim_max;
+    mu_assert_int_equals(setrlimit(RLIMIT_FSIZE, &limit), 0);
+    sky_event *event = sky_event_create(3, 11LL, 20);
+    mu_assert_int_equals(sky_wal_append(wal, event), -1);
+    sky_event_free(event);
+    mu_assert_int_equals(setrlimit(RLIMIT_FSIZE, &original_limit), 0);
+    signal(SIGXFSZ, SIG_DFL);
+    mu_assert_long_equals(sky_file_get_size(wal->path), length);
+    mu_assert_int_equals(wal->record_count, 1);
+
+    // Later records are still replayed.
+    APPEND_EVENT(3, 12LL, 20);
+    mu_assert_int_equals(sky_wal_replay(wal, data_file, &count), 0);
+    mu_assert_int_equals(count, 2);
+    sky_wal_free(wal);
+    sky_data_file_free(data_file);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_wal_append_commits_in_groups);
+    mu_run_test(test_sky_wal_sync_if_due);
+    mu_run_test(test_sky_wal_append_removes_partial_record);
+    mu_run_test(test_sky_wal_replay);
+    mu_run_test(test_sky_wal_replay_ignores_incomplete_record);
+    mu_run_test(test_sky_wal_replay_skips_applied_records);
+    mu_run_test(test_sky_wal_replay_shards);
+    return 0;
+}
+
+RUN_TESTS()
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zone_map.h>
+#include <event.h>
+#include <event_data.h>
+
+#include "minunit.h"
+
+
+//==============================================================================
+//
+// Helpers
+//
+//==============================================================================
+
+struct tagbstring foo = bsStatic("foo");
+
+// Adds an event with an int and a float property to a zone map.
+int add_event(sky_zone_map *zone_map, sky_action_id_t action_id,
+              int64_t int_value, double float_value)
+{
+    sky_event *event = sky_event_create(1, 0, action_id);
+    event->data_count = 2;
+    event->data = malloc(sizeof(*event->data) * event->data_count);
+    event->data[0] = sky_event_data_create_int(1, int_value);
+    event->data[1] = sky_event_data_create_float(2, float_value);
+    int rc = sky_zone_map_add_event(zone_map, event);
+    sky_event_free(event);
+    return rc;
+}
+
+
+//==============================================================================
+//
+// Test Cases
+//
+//==============================================================================
+
+int test_sky_zone_map_matches() {
+    sky_zone_map zone_map;
+    sky_zone_map_init(&zone_map);
+    mu_assert_int_equals(add_event(&zone_map, 3, 10, 1.5), 0);
+    mu_assert_int_equals(add_event(&zone_map, 300, -20, 2.5), 0);
+    mu_assert_int_equals(zone_map.property_count, 2);
+    mu_assert(zone_map.properties[0].min_value == -20, "");
+    mu_assert(zone_map.properties[0].max_value == 10, "");
+
+    // An empty predicate matches everything.
+    sky_zone_map_predicate predicate;
+    memset(&predicate, 0, sizeof(predicate));
+    mu_assert_bool(sky_zone_map_predicate_is_empty(&predicate));
+    mu_assert_bool(sky_zone_map_matches(&zone_map, &predicate));
+
+    // Actions.
+    predicate.action_id = 3;
+    mu_assert_bool(sky_zone_map_matches(&zone_map, &predicate));
+    predicate.action_id = 300;
+    mu_assert_bool(sky_zone_map_matches(&zone_map, &predicate));
+    predicate.action_id = 4;
+    mu_assert_bool(!sky_zone_map_matches(&zone_map, &predicate));
+
+    // Property ranges.
+    predicate.action_id = 0;
+    predicate.property_id = 1;
+    predicate.min_value = 10;
+    predicate.max_value = 100;
+    mu_assert_bool(sky_zone_map_matches(&zone_map, &predicate));
+    predicate.min_value = 11;
+    mu_assert_bool(!sky_zone_map_matches(&zone_map, &predicate));
+    predicate.property_id = 2;
+    predicate.min_value = 0;
+    predicate.max_value = 1;
+    mu_assert_bool(!sky_zone_map_matches(&zone_map, &predicate));
+    predicate.property_id = 5;
+    mu_assert_bool(!sky_zone_map_matches(&zone_map, &predicate));
+
+    // Properties with string values are never skipped.
+    sky_event *event = sky_event_create(1, 0, 3);
+    sky_event_set_data(event, 2, &foo);
+    mu_assert_int_equals(sky_zone_map_add_event(&zone_map, event), 0);
+    sky_event_free(event);
+    predicate.property_id = 2;
+    mu_assert_bool(sky_zone_map_matches(&zone_map, &predicate));
+
+    sky_zone_map_clear(&zone_map);
+    return 0;
+}
+
+int test_sky_zone_map_pack() {
+    size_t sz;
+    uint8_t buffer[256];
+    sky_zone_map zone_map, copy;
+    sky_zone_map_init(&zone_map);
+    sky_zone_map_init(&copy);
+    mu_assert_int_equals(add_event(&zone_map, 7, 100, 0.25), 0);
+
+    mu_assert_int_equals(sky_zone_map_pack(&zone_map, buffer, &sz), 0);
+    mu_assert_long_equals((long)sz, (long)sky_zone_map_sizeof(&zone_map));
+    mu_assert_int_equals(sky_zone_map_unpack(&copy, buffer, sz, &sz), 0);
+    mu_assert_long_equals((long)sz, (long)sky_zone_map_sizeof(&zone_map));
+    mu_assert_mem(copy.actions, zone_map.actions, SKY_ZONE_MAP_ACTION_BITMAP_SIZE);
+    mu_assert_int_equals(copy.property_count, 2);
+    mu_assert_int_equals(copy.properties[1].property_id, 2);
+    mu_assert(copy.properties[1].min_value == 0.25, "");
+
+    // Truncated zone maps are rejected.
+    mu_assert_int_equals(sky_zone_map_unpack(&copy, buffer, sz - 1, &sz), -1);
+    mu_assert_int_equals(copy.property_count, 0);
+
+    sky_zone_map_clear(&zone_map);
+    sky_zone_map_clear(&copy);
+    return 0;
+}
+
+int test_sky_zone_map_merge() {
+    sky_zone_map zone_map, other;
+    sky_zone_map_init(&zone_map);
+    sky_zone_map_init(&other);
+    mu_assert_int_equals(add_event(&zone_map, 1, 10, 1.0), 0);
+    mu_assert_int_equals(add_event(&other, 2, 50, 1.0), 0);
+    mu_assert_int_equals(sky_zone_map_merge(&zone_map, &other), 0);
+
+    sky_zone_map_predicate predicate;
+    memset(&predicate, 0, sizeof(predicate));
+    predicate.action_id = 2;
+    predicate.property_id = 1;
+    predicate.min_value = 30;
+    predicate.max_value = 40;
+    mu_assert_bool(sky_zone_map_matches(&zone_map, &predicate));
+    predicate.min_value = 60;
+    predicate.max_value = 70;
+    mu_assert_bool(!sky_zone_map_matches(&zone_map, &predicate));
+
+    sky_zone_map_clear(&zone_map);
+    sky_zone_map_clear(&other);
+    return 0;
+}
+
+
+//==============================================================================
+//
+// Setup
+//
+//==============================================================================
+
+int all_tests() {
+    mu_run_test(test_sky_zone_map_matches);
+    mu_run_test(test_sky_zone_map_pack);
+    mu_run_test(test_sky_zone_map_merge);
+    return 0;
+}
+
+RUN_TESTS()